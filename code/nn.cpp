@@ -1,547 +1,1847 @@
-
-#include <stdlib.h>
-#include "nn.h"
-
-#include "nn_io.cpp"
-
-internal neural_network
-CreateNetwork(memory_pool *Pool, u32 *Layers, u32 LayerCount, cost_function CostFn = CostFn_CrossEntropy)
-{
-	Assert(LayerCount >= 2);
-	
-	neural_network Result = {};
-	Result.CostFn = CostFn;
-
-	Result.LayerCount = LayerCount;
-	Result.Layers = PoolPushArray(Pool, u32, Result.LayerCount);
-
-	u32 *LayerDest = Result.Layers;
-	u32 *LayerSource = Layers;
-	for(u32 LayerIndex = 0;
-	    LayerIndex < Result.LayerCount;
-	    ++LayerIndex)
-	{
-		*LayerDest++ = *LayerSource++;
-	}
-
-	Result.WeightMatrices = PoolPushArray(Pool, matrix, Result.LayerCount);
-	Result.BiasVectors = PoolPushArray(Pool, vec, Result.LayerCount);
-
-	for(u32 LayerIndex = 1;
-	    LayerIndex < Result.LayerCount;
-	    ++LayerIndex)
-	{
-		u32 LayerSize = Result.Layers[LayerIndex];
-		u32 LastLayerSize = Result.Layers[LayerIndex - 1];
-
-		r32 WeightStandardDeviation = 1.0f / SquareRoot((r32)LastLayerSize);
-		Result.WeightMatrices[LayerIndex] = MatrixRand(Pool, LayerSize, LastLayerSize, 0.0f, WeightStandardDeviation);
-		Result.BiasVectors[LayerIndex] = VecRand(Pool, LayerSize, 0.0f, 1.0f);
-	}
-
-	return Result;
-}
-
-internal feed_forward_result
-FeedForward(memory_pool *Pool, neural_network Network, vec Input)
-{
-	Assert(Input.Dimension == Network.Layers[0]);
-
-	feed_forward_result Result = {};
-
-	Result.Activations = PoolPushArray(Pool, vec, Network.LayerCount);
-	Result.WeightedInputs = PoolPushArray(Pool, vec, Network.LayerCount);
-
-	vec *Activations = Result.Activations;
-	vec *WeightedInputs = Result.WeightedInputs;
-
-	vec *OldActivation = Activations;
-	*Activations++ = Input;
-	*WeightedInputs++ = Input;
-
-	for(u32 Index = 1;
-	    Index < Network.LayerCount;
-	    ++Index)
-	{
-		matrix *Weight = Network.WeightMatrices + Index;
-		vec *Bias = Network.BiasVectors + Index;
-
-		*WeightedInputs = Plus(Pool, Mult(Pool, *Weight, *OldActivation), *Bias);
-		*Activations = Sigmoid(Pool, *WeightedInputs);
-		OldActivation = Activations;
-
-		++WeightedInputs;
-		++Activations;
-	}
-
-	return Result;
-}
-
-internal feed_forward_batch_result
-FeedForwardBatch(memory_pool *Pool, neural_network Network, matrix Inputs)
-{
-	Assert(Inputs.RowCount == Network.Layers[0]);
-
-	feed_forward_batch_result Result = {};
-
-	Result.Activations = PoolPushArray(Pool, matrix, Network.LayerCount);
-	Result.WeightedInputs = PoolPushArray(Pool, matrix, Network.LayerCount);
-
-	matrix *Activations = Result.Activations;
-	matrix *WeightedInputs = Result.WeightedInputs;
-
-	matrix *OldActivation = Activations;
-	*Activations++ = Inputs;
-	*WeightedInputs++ = Inputs;
-
-	for(u32 Index = 1;
-	    Index < Network.LayerCount;
-	    ++Index)
-	{
-		matrix *Weight = Network.WeightMatrices + Index;
-		vec *Bias = Network.BiasVectors + Index;
-
-		*WeightedInputs = MVPlus(Pool, Mult(Pool, *Weight, *OldActivation), *Bias);
-		*Activations = Sigmoid(Pool, *WeightedInputs);
-		OldActivation = Activations;
-
-		++WeightedInputs;
-		++Activations;
-	}
-
-	return Result;
-}
-
-internal back_propagate_batch_result
-BackPropagateBatch(memory_pool *Pool, neural_network Network,
-                   matrix Inputs, matrix DesiredOutputs)
-{
-	back_propagate_batch_result Result = {};
-	feed_forward_batch_result FeedForwardResult = FeedForwardBatch(Pool, Network, Inputs);
-	Result.WeightedInputs = FeedForwardResult.WeightedInputs;
-	Result.Activations = FeedForwardResult.Activations;
-
-	Result.Errors = PoolPushArray(Pool, matrix, Network.LayerCount);
-	matrix *Error = Result.Errors + (Network.LayerCount - 1);
-
-	switch(Network.CostFn)
-	{
-		case CostFn_Quadratic:
-		{
-			*Error = Hadamard(Pool, Minus(Pool, FeedForwardResult.Activations[Network.LayerCount - 1], DesiredOutputs),
-			                  SigmoidPrime(Pool, FeedForwardResult.WeightedInputs[Network.LayerCount - 1]));
-		} break;
-
-		case CostFn_CrossEntropy:
-		{
-			*Error = Minus(Pool, FeedForwardResult.Activations[Network.LayerCount - 1], DesiredOutputs);
-		} break;
-
-		InvalidDefaultCase;
-	}
-
-	for(u32 LayerIndex = Network.LayerCount - 2;
-	    LayerIndex > 0;
-	    --LayerIndex)
-	{
-		matrix *OldError = Error;
-		--Error;
-
-		*Error = Hadamard(Pool, TransposeMult(Pool, Network.WeightMatrices[LayerIndex + 1], *OldError),
-		                  SigmoidPrime(Pool, FeedForwardResult.WeightedInputs[LayerIndex]));
-	}
-
-	return Result;
-}
-
-internal void
-GradientDescentBatch(memory_pool *Pool, neural_network Network,
-                     matrix Inputs, matrix Outputs,
-                     r32 LearningRate, r32 Regularization, u32 TotalTrials)
-{
-	temp_memory TempMem = PoolBeginTempMemory(Pool);
-
-	back_propagate_batch_result BackPropagateResult = BackPropagateBatch(Pool, Network, Inputs, Outputs);
-
-	u32 TrialCount = Inputs.ColumnCount;
-	for(u32 LayerIndex = 1;
-	    LayerIndex < Network.LayerCount;
-	    ++LayerIndex)
-	{
-		matrix *Weight = Network.WeightMatrices + LayerIndex;
-		vec *Bias = Network.BiasVectors + LayerIndex;
-
-		matrix WeightGradient = MultTranspose(Pool,
-            BackPropagateResult.Errors[LayerIndex],
-            BackPropagateResult.Activations[LayerIndex - 1]);
-		MatrixScaleEquals(-LearningRate/TrialCount, WeightGradient);
-		MatrixScaleEquals((1.0f - (LearningRate*Regularization)/TotalTrials), *Weight);
-		MatrixPlusEquals(*Weight, WeightGradient);
-
-		vec BiasGradient = MatrixSumColumns(Pool, BackPropagateResult.Errors[LayerIndex]);
-		VectorScaleEquals(-LearningRate/TrialCount, BiasGradient);
-		VectorPlusEquals(*Bias, BiasGradient);
-	}
-
-	PoolEndTempMemory(TempMem);
-}
-
-internal void
-PrintFeedForwardResult(neural_network Network, feed_forward_result FeedForwardResult)
-{
-	PrintVec(FeedForwardResult.Activations[Network.LayerCount - 1]);
-}
-
-internal void
-PrintBackPropagateBatchResult(neural_network Network, back_propagate_batch_result BackPropagateBatchResult)
-{
-	u32 LayerCount = Network.LayerCount;
-
-	printf("WeightedInputs:\n");
-	for(u32 LayerIndex = 0;
-	    LayerIndex < LayerCount;
-	    ++LayerIndex)
-	{
-		PrintMatrix(BackPropagateBatchResult.WeightedInputs[LayerIndex]);
-	}
-
-	printf("Activations:\n");
-	for(u32 LayerIndex = 0;
-	    LayerIndex < LayerCount;
-	    ++LayerIndex)
-	{
-		PrintMatrix(BackPropagateBatchResult.Activations[LayerIndex]);
-	}
-
-	printf("Errors:\n");
-	for(u32 LayerIndex = 1;
-	    LayerIndex < LayerCount;
-	    ++LayerIndex)
-	{
-		PrintMatrix(BackPropagateBatchResult.Errors[LayerIndex]);
-	}
-}
-
-internal batch
-CreateMiniBatch(memory_pool *Pool, data_set DataSet, u32 Size)
-{
-	Assert(Size <= DataSet.DataCount);
-
-	batch Result = {};
-	Result.Input = MatrixRaw_(Pool, DataSet.InputData[0].Dimension, Size);
-	Result.Output = MatrixRaw_(Pool, DataSet.OutputData[0].Dimension, Size);
-
-	temp_memory TempMem = PoolBeginTempMemory(Pool);
-	u32 *Indexes = PoolPushArray(Pool, u32, DataSet.DataCount);
-
-	u32 *IndexAt = Indexes;
-	for(u32 Index = 0;
-	    Index < DataSet.DataCount;
-	    ++Index)
-	{
-		*IndexAt++ = Index;
-	}
-
-	r32 *InputDest = Result.Input.Data;
-	r32 *OutputDest = Result.Output.Data;
-	for(u32 Index = 0;
-	    Index < Size;
-	    ++Index)
-	{
-		u32 NextElementIndex = RandomU32InRangeCloseOpen(Index, DataSet.DataCount);
-		u32 NextElement = Indexes[NextElementIndex];
-		Indexes[NextElementIndex] = Indexes[Index];
-
-		vec InputVec = DataSet.InputData[NextElement];
-		vec OutputVec = DataSet.OutputData[NextElement];
-
-		r32 *InputSource = InputVec.Data;
-		for(u32 DataIndex = 0;
-		    DataIndex < InputVec.Dimension;
-		    ++DataIndex)
-		{
-			*InputDest++ = *InputSource++;
-		}
-
-		r32 *OutputSource = OutputVec.Data;
-		for(u32 DataIndex = 0;
-		    DataIndex < OutputVec.Dimension;
-		    ++DataIndex)
-		{
-			*OutputDest++ = *OutputSource++;
-		}
-	}
-
-	PoolEndTempMemory(TempMem);
-	return Result;
-}
-
-internal batch *
-CreateBatches(memory_pool *Pool, data_set DataSet, u32 Size)
-{
-	Assert((DataSet.DataCount / Size)*Size == DataSet.DataCount);
-
-	u32 BatchCount = DataSet.DataCount / Size;
-	batch *Result = PoolPushArray(Pool, batch, BatchCount);
-
-	for(u32 BatchIndex = 0;
-	    BatchIndex < BatchCount;
-	    ++BatchIndex)
-	{
-		batch *Batch = Result + BatchIndex;
-		Batch->Input = MatrixRaw_(Pool, DataSet.InputData[0].Dimension, Size);
-		Batch->Output = MatrixRaw_(Pool, DataSet.OutputData[0].Dimension, Size);
-	}
-
-	temp_memory TempMem = PoolBeginTempMemory(Pool);
-	u32 *Indexes = PoolPushArray(Pool, u32, DataSet.DataCount);
-
-	u32 *IndexAt = Indexes;
-	for(u32 Index = 0;
-	    Index < DataSet.DataCount;
-	    ++Index)
-	{
-		*IndexAt++ = Index;
-	}
-
-	for(u32 Index = 0;
-	    Index < DataSet.DataCount;
-	    ++Index)
-	{
-		u32 NextElementIndex = RandomU32InRangeCloseOpen(Index, DataSet.DataCount);
-		u32 NextElement = Indexes[NextElementIndex];
-		Indexes[NextElementIndex] = Indexes[Index];
-		Indexes[Index] = NextElement;
-	}
-
-	r32 *InputDest = 0;
-	r32 *OutputDest = 0;
-	u32 BatchIndex = 0;
-	for(u32 Index = 0;
-	    Index < DataSet.DataCount;
-	    ++Index)
-	{
-		u32 NextElement = Indexes[Index];
-
-		if((Index % Size) == 0)
-		{
-			InputDest = Result[BatchIndex].Input.Data;
-			OutputDest = Result[BatchIndex].Output.Data;
-			++BatchIndex;
-		}
-	
-		vec InputVec = DataSet.InputData[NextElement];
-		vec OutputVec = DataSet.OutputData[NextElement];
-
-		r32 *InputSource = InputVec.Data;
-		for(u32 DataIndex = 0;
-		    DataIndex < InputVec.Dimension;
-		    ++DataIndex)
-		{
-			*InputDest++ = *InputSource++;
-		}
-
-		r32 *OutputSource = OutputVec.Data;
-		for(u32 DataIndex = 0;
-		    DataIndex < OutputVec.Dimension;
-		    ++DataIndex)
-		{
-			*OutputDest++ = *OutputSource++;
-		}
-	}
-
-	PoolEndTempMemory(TempMem);
-	return Result;
-}
-
-internal void
-TestNetwork(memory_pool *Pool, neural_network Network, data_set TestSet)
-{
-	temp_memory TempMem = PoolBeginTempMemory(Pool);
-
-	u32 TotalTrials = TestSet.DataCount;
-	u32 Errors = 0;
-
-	batch Batch = CreateMiniBatch(Pool, TestSet, TotalTrials);
-	feed_forward_batch_result FeedForward = FeedForwardBatch(Pool, Network, Batch.Input);
-	matrix Outputs = FeedForward.Activations[Network.LayerCount - 1];
-
-	for(u32 TrialIndex = 0;
-	    TrialIndex < TotalTrials;
-	    ++TrialIndex)
-	{
-		u32 Guess = 123;
-		r32 MaxValue = 0.0f;
-		r32 *OutputValue = Outputs.Data + TrialIndex*Outputs.RowCount;
-		for(u32 OutputIndex = 0;
-		    OutputIndex < Outputs.RowCount;
-		    ++OutputIndex)
-		{
-			r32 Value = *OutputValue++;
-			if(Value > MaxValue)
-			{
-				MaxValue = Value;
-				Guess = OutputIndex;
-			}
-		}
-
-		u32 Answer = 124;
-		MaxValue = 0.0f;
-		r32 *AnswerValue = Batch.Output.Data + TrialIndex*Batch.Output.RowCount;
-		for(u32 OutputIndex = 0;
-		    OutputIndex < Batch.Output.RowCount;
-		    ++OutputIndex)
-		{
-			r32 Value = *AnswerValue++;
-			if(Value > MaxValue)
-			{
-				MaxValue = Value;
-				Answer = OutputIndex;
-			}
-		}
-
-		Assert((Guess != 123) && (Answer != 124));
-
-		if(Answer != Guess)
-		{
-			++Errors;
-		}
-	}
-
-	r32 ErrorRate = (r32)Errors / (r32)TotalTrials;
-	r32 SuccessRatePercent = 100.0f*(1 - ErrorRate);
-
-	printf("Success rate: %3.2f%%\n", SuccessRatePercent);
-
-	PoolEndTempMemory(TempMem);
-}
-
-internal command_line_options
-ParseCommandLineOptions(s32 ArgC, char **ArgV)
-{
-	command_line_options Result = {};
-	Result.HiddenLayerNeurons = 100;
-	Result.EpochCount = 0;
-	Result.BatchSize = 10;
-	Result.LearningRate = 1.0f;
-	Result.Regularization = 5.0f;
-
-	for(s32 ArgumentIndex = 1;
-		ArgumentIndex < ArgC;
-		++ArgumentIndex)
-	{
-		char *Argument = ArgV[ArgumentIndex];
-		if(StringCompare(Argument, "-s"))
-		{
-			Result.SaveNetwork = ArgV[++ArgumentIndex];
-		}
-		else if(StringCompare(Argument, "-l"))
-		{
-			Result.LoadNetwork = ArgV[++ArgumentIndex];
-		}
-		else if(StringCompare(Argument, "-hiddenlayer"))
-		{
-			Result.HiddenLayerNeurons = atoi(ArgV[++ArgumentIndex]);
-		}
-		else if(StringCompare(Argument, "-epochs"))
-		{
-			Result.EpochCount = atoi(ArgV[++ArgumentIndex]);
-		}
-		else if(StringCompare(Argument, "-batch"))
-		{
-			Result.BatchSize = atoi(ArgV[++ArgumentIndex]);
-		}
-		else if(StringCompare(Argument, "-learningrate"))
-		{
-			Result.LearningRate = (r32)atof(ArgV[++ArgumentIndex]);
-		}
-		else if(StringCompare(Argument, "-regularization"))
-		{
-			Result.Regularization = (r32)atof(ArgV[++ArgumentIndex]);
-		}
-		else
-		{
-			InvalidCodePath;
-		}
-	}
-
-	return Result;
-}
-
-s32 main(s32 ArgC, char **ArgV)
-{
-	command_line_options Options = ParseCommandLineOptions(ArgC, ArgV);
-
-	umm PermanentMemorySize = Gigabytes(1);
-	umm TemporaryMemorySize = Megabytes(128);
-	umm TotalSize = PermanentMemorySize + TemporaryMemorySize;
-	u8 *MainPoolBase = (u8 *)calloc(1, TotalSize);
-	u8 *TempPoolBase = MainPoolBase + PermanentMemorySize;
-	memory_pool MainPool = {};
-	memory_pool TempPool = {};
-	PoolInitialize(&MainPool, MainPoolBase, PermanentMemorySize);
-	PoolInitialize(&TempPool, TempPoolBase, TemporaryMemorySize);
-
-	data_set TotalTrainingSet = LoadMNISTData(&MainPool, &TempPool, "train-images.idx3-ubyte", "train-labels.idx1-ubyte");
-	data_set TrainingSet = TotalTrainingSet;
-	TrainingSet.DataCount = 50000;
-
-	data_set VerificationSet = {};
-	VerificationSet.DataCount = TotalTrainingSet.DataCount - TrainingSet.DataCount;
-	VerificationSet.InputData = TotalTrainingSet.InputData + TrainingSet.DataCount;
-	VerificationSet.OutputData = TotalTrainingSet.OutputData + TrainingSet.DataCount;
-
-	data_set TestSet = LoadMNISTData(&MainPool, &TempPool, "t10k-images.idx3-ubyte", "t10k-labels.idx1-ubyte");
-	
-	neural_network Network = {};
-	if(Options.LoadNetwork)
-	{
-		Network = LoadNetwork(&MainPool, Options.LoadNetwork);
-		Assert(TrainingSet.InputData[0].Dimension == Network.Layers[0]);
-		Assert(TrainingSet.OutputData[0].Dimension == Network.Layers[2]);
-	}
-	else
-	{
-		u32 LayerCount[] =
-		{
-			TrainingSet.InputData[0].Dimension,
-			Options.HiddenLayerNeurons,
-			TrainingSet.OutputData[0].Dimension
-		};
-		Network = CreateNetwork(&MainPool, LayerCount, ArrayCount(LayerCount));
-	}
-
-	TestNetwork(&MainPool, Network, TestSet);
-
-	for(u32 EpochIndex = 0;
-	    EpochIndex < Options.EpochCount;
-	    ++EpochIndex)
-	{
-		printf("Epoch %d ... ", EpochIndex);
-		temp_memory TempMem = PoolBeginTempMemory(&MainPool);
-		batch *Batches = CreateBatches(&MainPool, TrainingSet, Options.BatchSize);
-		u32 BatchCount = (TrainingSet.DataCount / Options.BatchSize);
-		for(u32 BatchIndex = 0;
-		    BatchIndex < BatchCount;
-		    ++BatchIndex)
-		{
-			batch *Batch = Batches + BatchIndex;
-			GradientDescentBatch(&MainPool, Network, Batch->Input, Batch->Output,
-			                     Options.LearningRate, Options.Regularization, TrainingSet.DataCount);
-		}
-
-		PoolEndTempMemory(TempMem);
-		printf("done\n");
-	
-		TestNetwork(&MainPool, Network, TestSet);
-	}
-
-	if(Options.SaveNetwork)
-	{
-		SerializeNetworkToDisk(&MainPool, Network, Options.SaveNetwork);
-	}
-
-	PoolCheckMemory(&MainPool);
-	PoolCheckMemory(&TempPool);
-	return 0;
-}
\ No newline at end of file
+
+#include <stdlib.h>
+#include <string.h>
+#include "nn.h"
+
+#include "nn_io.cpp"
+
+inline activation_function
+LayerActivation(neural_network Network, u32 LayerIndex)
+{
+	activation_function Result = Network.Activations ? Network.Activations[LayerIndex] : Activation_Sigmoid;
+	return Result;
+}
+
+internal b32
+NetworkIsAllSigmoid(neural_network Network)
+{
+	b32 Result = true;
+	for(u32 LayerIndex = 1;
+	    LayerIndex < Network.LayerCount;
+	    ++LayerIndex)
+	{
+		Result &= (LayerActivation(Network, LayerIndex) == Activation_Sigmoid);
+	}
+	return Result;
+}
+
+inline layer_type
+LayerType(neural_network Network, u32 LayerIndex)
+{
+	layer_type Result = Network.Shapes ? Network.Shapes[LayerIndex].Type : LayerType_Dense;
+	return Result;
+}
+
+internal b32
+NetworkIsDense(neural_network Network)
+{
+	b32 Result = true;
+	for(u32 LayerIndex = 1;
+	    LayerIndex < Network.LayerCount;
+	    ++LayerIndex)
+	{
+		Result &= (LayerType(Network, LayerIndex) == LayerType_Dense);
+	}
+	return Result;
+}
+
+// NOTE: The weight products' flops, dense as stored whatever pruning or
+//	factoring the layer has.
+internal u64
+LayerFlopsPerInput(neural_network Network, u32 LayerIndex)
+{
+	u64 Result = 0;
+	matrix Weights = Network.WeightMatrices[LayerIndex];
+	switch(LayerType(Network, LayerIndex))
+	{
+		case LayerType_Dense: {Result = 2*(u64)Weights.RowCount*Weights.ColumnCount;} break;
+		case LayerType_Convolution:
+		{
+			Result = 2*(u64)Weights.RowCount*Weights.ColumnCount*ImagePixelCount(Network.Shapes[LayerIndex]);
+		} break;
+		case LayerType_MaxPool: {Result = 0;} break;
+
+		InvalidDefaultCase;
+	}
+	return Result;
+}
+
+internal neural_network
+CreateNetwork(memory_pool *Pool, u32 *Layers, u32 LayerCount, cost_function CostFn = CostFn_CrossEntropy,
+              activation_function *Activations = 0, layer_shape *Shapes = 0)
+{
+	Assert(LayerCount >= 2);
+	
+	neural_network Result = {};
+	Result.CostFn = CostFn;
+
+	Result.LayerCount = LayerCount;
+	Result.Layers = PoolPushArray(Pool, u32, Result.LayerCount);
+
+	u32 *LayerDest = Result.Layers;
+	u32 *LayerSource = Layers;
+	for(u32 LayerIndex = 0;
+	    LayerIndex < Result.LayerCount;
+	    ++LayerIndex)
+	{
+		*LayerDest++ = *LayerSource++;
+	}
+
+	Result.WeightMatrices = PoolPushArray(Pool, matrix, Result.LayerCount);
+	Result.BiasVectors = PoolPushArray(Pool, vec, Result.LayerCount);
+
+	if(Activations)
+	{
+		Result.Activations = PoolPushArray(Pool, activation_function, Result.LayerCount);
+		for(u32 LayerIndex = 0;
+		    LayerIndex < Result.LayerCount;
+		    ++LayerIndex)
+		{
+			Result.Activations[LayerIndex] = Activations[LayerIndex];
+		}
+	}
+
+	if(Shapes)
+	{
+		Result.Shapes = PoolPushArray(Pool, layer_shape, Result.LayerCount);
+		for(u32 LayerIndex = 0;
+		    LayerIndex < Result.LayerCount;
+		    ++LayerIndex)
+		{
+			Result.Shapes[LayerIndex] = Shapes[LayerIndex];
+		}
+	}
+
+	for(u32 LayerIndex = 1;
+	    LayerIndex < Result.LayerCount;
+	    ++LayerIndex)
+	{
+		u32 LayerSize = Result.Layers[LayerIndex];
+		u32 LastLayerSize = Result.Layers[LayerIndex - 1];
+
+		// NOTE: A convolution's weights are a filter per channel, whose
+		//	taps are all the fan-in it has. Pools have no weights.
+		layer_type Type = LayerType(Result, LayerIndex);
+		if(Type == LayerType_MaxPool)
+		{
+			Result.WeightMatrices[LayerIndex] = {};
+			Result.BiasVectors[LayerIndex] = {};
+			continue;
+		}
+		else if(Type == LayerType_Convolution)
+		{
+			LayerSize = Result.Shapes[LayerIndex].Channels;
+			LastLayerSize = ConvolutionTapCount(Result.Shapes[LayerIndex - 1], Result.Shapes[LayerIndex]);
+		}
+
+		// NOTE: ReLUs zero half their inputs, so their weights start out
+		//	sqrt(2) wider to keep the same variance going forward.
+		r32 WeightStandardDeviation = 1.0f / SquareRoot((r32)LastLayerSize);
+		activation_function Activation = LayerActivation(Result, LayerIndex);
+		if((Activation == Activation_ReLU) || (Activation == Activation_LeakyReLU))
+		{
+			WeightStandardDeviation = SquareRoot(2.0f / (r32)LastLayerSize);
+		}
+		Result.WeightMatrices[LayerIndex] = MatrixRand(Pool, LayerSize, LastLayerSize, 0.0f, WeightStandardDeviation);
+		Result.BiasVectors[LayerIndex] = VecRand(Pool, LayerSize, 0.0f, 1.0f);
+	}
+
+	return Result;
+}
+
+internal feed_forward_result
+FeedForward(memory_pool *Pool, neural_network Network, vec Input)
+{
+	Assert(Input.Dimension == Network.Layers[0]);
+	Assert(NetworkIsDense(Network));
+
+	feed_forward_result Result = {};
+
+	Result.Activations = PoolPushArray(Pool, vec, Network.LayerCount);
+	Result.WeightedInputs = PoolPushArray(Pool, vec, Network.LayerCount);
+
+	vec *Activations = Result.Activations;
+	vec *WeightedInputs = Result.WeightedInputs;
+
+	vec *OldActivation = Activations;
+	*Activations++ = Input;
+	*WeightedInputs++ = Input;
+
+	for(u32 Index = 1;
+	    Index < Network.LayerCount;
+	    ++Index)
+	{
+		matrix *Weight = Network.WeightMatrices + Index;
+		vec *Bias = Network.BiasVectors + Index;
+
+		*WeightedInputs = Plus(Pool, Mult(Pool, *Weight, *OldActivation), *Bias);
+		if(LayerActivation(Network, Index) == Activation_Sigmoid)
+		{
+			*Activations = Sigmoid(Pool, *WeightedInputs);
+		}
+		else
+		{
+			*Activations = VecRaw_(Pool, WeightedInputs->Dimension);
+			ActivateInto(Matrix(Activations->Data, Activations->Dimension, 1),
+			             Matrix(WeightedInputs->Data, WeightedInputs->Dimension, 1),
+			             LayerActivation(Network, Index));
+		}
+		OldActivation = Activations;
+
+		++WeightedInputs;
+		++Activations;
+	}
+
+	return Result;
+}
+
+internal void
+FeedForwardLayer(memory_pool *Pool, parallel_context *Parallel, neural_network Network, u32 Index,
+                 matrix Input, b32 HasSparseInputs, sparse_matrix SparseInputs,
+                 matrix *WeightedInput, matrix *Activation)
+{
+	TRACE_BLOCK_ARG("Layer forward", Index);
+
+	matrix *Weight = Network.WeightMatrices + Index;
+	vec *Bias = Network.BiasVectors + Index;
+
+	layer_type Type = LayerType(Network, Index);
+	if(Type == LayerType_MaxPool)
+	{
+		// NOTE: No activation function, so the weighted input is the output.
+		*Activation = MatrixRaw_(Pool, Network.Layers[Index], Input.ColumnCount);
+		MaxPoolInto(*Activation, Input, Network.Shapes[Index - 1], Network.Shapes[Index]);
+		*WeightedInput = *Activation;
+		return;
+	}
+	else if(Type == LayerType_Convolution)
+	{
+		layer_shape Shape = Network.Shapes[Index];
+		*WeightedInput = MatrixPacked_(Pool, Network.Layers[Index], Input.ColumnCount);
+		ConvolveInto(Pool, Parallel, *WeightedInput, *Weight, Input, Network.Shapes[Index - 1], Shape);
+		matrix Pixels = PixelColumns(*WeightedInput, Shape.Channels);
+		EvaluateInto(Pixels, LazyMVPlus(Lazy(Pixels), *Bias));
+		*Activation = Activate(Pool, *WeightedInput, LayerActivation(Network, Index));
+		return;
+	}
+
+	block_sparse_matrix *BlockSparseWeight = 0;
+	if(Network.BlockSparseWeights &&
+	   (BlockSparseDensity(Network.BlockSparseWeights[Index]) <= BLOCK_SPARSE_MAX_DENSITY))
+	{
+		BlockSparseWeight = Network.BlockSparseWeights + Index;
+	}
+
+	b32 SparseInput = ((Index == 1) && HasSparseInputs);
+	if(SparseInput && BlockSparseWeight)
+	{
+		// NOTE: Both products skip work in proportion to how sparse their
+		//	side is, so the sparser side wins.
+		r32 InputDensity = (r32)SparseNonZeroCount(SparseInputs) / ((r32)Input.RowCount*Input.ColumnCount);
+		SparseInput = (InputDensity < BlockSparseDensity(*BlockSparseWeight));
+	}
+
+	jit_layer_kernel *JitKernel = 0;
+	if(!SparseInput && !BlockSparseWeight && !(Network.Ranks && Network.Ranks[Index]) &&
+	   (LayerActivation(Network, Index) == Activation_Sigmoid))
+	{
+		JitKernel = FindJitLayerKernel(*Weight, Input);
+	}
+
+	matrix WeightedSum;
+	if(JitKernel)
+	{
+		// NOTE: The product, the bias and the sigmoid in one generated kernel.
+		RunJitLayerKernel(Pool, JitKernel, *Weight, *Bias, Input, WeightedInput, Activation);
+	}
+	else if(Network.Ranks && Network.Ranks[Index])
+	{
+		// NOTE: Two skinny products through the rank instead of one wide one.
+		matrix Projected;
+		if((Index == 1) && HasSparseInputs)
+		{
+			Projected = ParallelSparseMult(Pool, Parallel, Network.RightFactors[Index], SparseInputs);
+		}
+		else
+		{
+			Projected = ParallelMult(Pool, Parallel, Network.RightFactors[Index], Input);
+		}
+		WeightedSum = ParallelMult(Pool, Parallel, Network.LeftFactors[Index], Projected);
+	}
+	else if(SparseInput)
+	{
+		WeightedSum = ParallelSparseMult(Pool, Parallel, *Weight, SparseInputs);
+	}
+	else if(BlockSparseWeight)
+	{
+		WeightedSum = ParallelBlockSparseMult(Pool, Parallel, *BlockSparseWeight, Input);
+	}
+	else
+	{
+		WeightedSum = ParallelMult(Pool, Parallel, *Weight, Input);
+	}
+	if(!JitKernel)
+	{
+		EvaluateInto(WeightedSum, LazyMVPlus(Lazy(WeightedSum), *Bias));
+		*WeightedInput = WeightedSum;
+		*Activation = Activate(Pool, *WeightedInput, LayerActivation(Network, Index));
+	}
+}
+
+internal feed_forward_batch_result
+FeedForwardBatch(memory_pool *Pool, parallel_context *Parallel, neural_network Network, matrix Inputs)
+{
+	TIMED_BLOCK("FeedForwardBatch", 0, 0);
+
+	Assert(Inputs.RowCount == Network.Layers[0]);
+
+	feed_forward_batch_result Result = {};
+
+	Result.Activations = PoolPushArray(Pool, matrix, Network.LayerCount);
+	Result.WeightedInputs = PoolPushArray(Pool, matrix, Network.LayerCount);
+
+	Result.Activations[0] = Inputs;
+	Result.WeightedInputs[0] = Inputs;
+
+	if((Parallel->SparseInputDensity > 0.0f) && (LayerType(Network, 1) == LayerType_Dense))
+	{
+		Result.HasSparseInputs = MakeSparseMatrix(Pool, Inputs, Parallel->SparseInputDensity, &Result.SparseInputs);
+	}
+
+	for(u32 Index = 1;
+	    Index < Network.LayerCount;
+	    ++Index)
+	{
+		FeedForwardLayer(Pool, Parallel, Network, Index, Result.Activations[Index - 1],
+		                 Result.HasSparseInputs, Result.SparseInputs,
+		                 Result.WeightedInputs + Index, Result.Activations + Index);
+	}
+
+	return Result;
+}
+
+internal void
+SoftenOutputsInto(matrix Result, matrix WeightedInputs, r32 Temperature)
+{
+	EvaluateInto(Result, LazyScale(1.0f / Temperature, Lazy(WeightedInputs)));
+	SoftmaxInto(Result, Result);
+}
+
+internal matrix
+OutputErrorBatch(memory_pool *Pool, neural_network Network, matrix WeightedInputs, matrix Activations,
+                 matrix DesiredOutputs)
+{
+	TRACE_BLOCK_ARG("Layer backward", Network.LayerCount - 1);
+
+	u32 OutputCount = Network.Layers[Network.LayerCount - 1];
+	b32 Distilling = (Network.DistillTemperature > 0.0f);
+	matrix SoftTargets = {};
+	if(Distilling)
+	{
+		Assert(DesiredOutputs.RowCount == 2*OutputCount);
+		SoftTargets = SubMatrix(DesiredOutputs, OutputCount, 0, OutputCount, DesiredOutputs.ColumnCount);
+		DesiredOutputs = SubMatrix(DesiredOutputs, 0, 0, OutputCount, DesiredOutputs.ColumnCount);
+	}
+
+	activation_function Activation = LayerActivation(Network, Network.LayerCount - 1);
+	matrix Result = {};
+	switch(Network.CostFn)
+	{
+		case CostFn_Quadratic:
+		{
+			if(Activation == Activation_Sigmoid)
+			{
+				Result = Evaluate(Pool, LazyHadamard(LazyMinus(Lazy(Activations), Lazy(DesiredOutputs)),
+				                                     LazySigmoidPrime(Lazy(WeightedInputs))));
+			}
+			else
+			{
+				Result = Minus(Pool, Activations, DesiredOutputs);
+				HadamardActivationPrime(Result, WeightedInputs, Activation);
+			}
+		} break;
+
+		case CostFn_CrossEntropy:
+		{
+			// NOTE: The cost's derivative cancels the sigmoid's or the
+			//	softmax's; NetworkActivationsValid keeps it to those.
+			Result = Minus(Pool, Activations, DesiredOutputs);
+		} break;
+
+		InvalidDefaultCase;
+	}
+
+	// NOTE: The soft term is the cross entropy between the student's and the
+	//	teacher's outputs both softened by T, whose gradient at z is
+	//	(softmax(z/T) - p)/T. It's scaled by T^2 so its size doesn't shrink
+	//	as T grows, and the label's term above stays at T = 1.
+	if(Distilling)
+	{
+		r32 Temperature = Network.DistillTemperature;
+		r32 Weight = Network.DistillWeight;
+
+		temp_memory TempMem = PoolBeginTempMemory(Pool);
+		matrix Soft = MatrixRaw_(Pool, OutputCount, WeightedInputs.ColumnCount);
+		SoftenOutputsInto(Soft, WeightedInputs, Temperature);
+		EvaluateInto(Result, LazyPlus(LazyScale(1.0f - Weight, Lazy(Result)),
+		                              LazyScale(Weight*Temperature, LazyMinus(Lazy(Soft), Lazy(SoftTargets)))));
+		PoolEndTempMemory(TempMem);
+	}
+
+	return Result;
+}
+
+// NOTE: Takes the error at LayerIndex's outputs back to LayerIndex - 1's
+//	weighted inputs, given that layer's outputs and weighted inputs.
+internal void
+BackPropagateLayerError(memory_pool *Pool, parallel_context *Parallel, neural_network Network, u32 LayerIndex,
+                        matrix Result, matrix Error, matrix Input, matrix InputWeightedInput)
+{
+	TRACE_BLOCK_ARG("Layer backward", LayerIndex - 1);
+
+	switch(LayerType(Network, LayerIndex))
+	{
+		case LayerType_Dense:
+		{
+			// NOTE: The error goes over the product it's computed from.
+			ParallelTransposeMultInto(Pool, Parallel, Result, Network.WeightMatrices[LayerIndex], Error);
+		} break;
+
+		case LayerType_Convolution:
+		{
+			ConvolutionErrorInto(Pool, Parallel, Result, Network.WeightMatrices[LayerIndex], Error,
+			                     Network.Shapes[LayerIndex - 1], Network.Shapes[LayerIndex]);
+		} break;
+
+		case LayerType_MaxPool:
+		{
+			MaxPoolErrorInto(Result, Error, Input, Network.Shapes[LayerIndex - 1], Network.Shapes[LayerIndex]);
+		} break;
+
+		InvalidDefaultCase;
+	}
+
+	if(LayerType(Network, LayerIndex - 1) != LayerType_MaxPool)
+	{
+		HadamardActivationPrime(Result, InputWeightedInput, LayerActivation(Network, LayerIndex - 1));
+	}
+}
+
+internal back_propagate_batch_result
+BackPropagateBatch(memory_pool *Pool, parallel_context *Parallel, neural_network Network,
+                   matrix Inputs, matrix DesiredOutputs)
+{
+	TIMED_BLOCK("BackPropagateBatch", 0, 0);
+
+	back_propagate_batch_result Result = {};
+	feed_forward_batch_result FeedForwardResult = FeedForwardBatch(Pool, Parallel, Network, Inputs);
+	Result.WeightedInputs = FeedForwardResult.WeightedInputs;
+	Result.Activations = FeedForwardResult.Activations;
+	Result.HasSparseInputs = FeedForwardResult.HasSparseInputs;
+	Result.SparseInputs = FeedForwardResult.SparseInputs;
+
+	Result.Errors = PoolPushArray(Pool, matrix, Network.LayerCount);
+	matrix *Error = Result.Errors + (Network.LayerCount - 1);
+	*Error = OutputErrorBatch(Pool, Network, FeedForwardResult.WeightedInputs[Network.LayerCount - 1],
+	                          FeedForwardResult.Activations[Network.LayerCount - 1], DesiredOutputs);
+
+	for(u32 LayerIndex = Network.LayerCount - 2;
+	    LayerIndex > 0;
+	    --LayerIndex)
+	{
+		matrix *OldError = Error;
+		--Error;
+
+		*Error = MatrixRaw_(Pool, Network.Layers[LayerIndex], Inputs.ColumnCount);
+		BackPropagateLayerError(Pool, Parallel, Network, LayerIndex + 1, *Error, *OldError,
+		                        FeedForwardResult.Activations[LayerIndex], FeedForwardResult.WeightedInputs[LayerIndex]);
+	}
+
+	return Result;
+}
+
+internal void
+AccumulateLayerGradients(memory_pool *Pool, parallel_context *Parallel, neural_network Network,
+                         network_gradients Gradients, u32 LayerIndex, matrix Error, matrix Activation,
+                         b32 SparseActivation, sparse_matrix SparseInputs, b32 Accumulate)
+{
+	TRACE_BLOCK_ARG("Gradient", LayerIndex);
+
+	layer_type Type = LayerType(Network, LayerIndex);
+	if(Type == LayerType_MaxPool)
+	{
+		return;
+	}
+	else if(Type == LayerType_Convolution)
+	{
+		ConvolutionGradientsInto(Pool, Parallel, Gradients.WeightGradients[LayerIndex], Gradients.BiasGradients[LayerIndex],
+		                         Error, Activation, Network.Shapes[LayerIndex - 1], Network.Shapes[LayerIndex],
+		                         Accumulate);
+		return;
+	}
+
+	if(!Accumulate)
+	{
+		if(SparseActivation)
+		{
+			ParallelSparseMultTransposeInto(Pool, Parallel, Gradients.WeightGradients[LayerIndex],
+			                                Error, SparseInputs);
+		}
+		else
+		{
+			ParallelMultTransposeInto(Pool, Parallel, Gradients.WeightGradients[LayerIndex], Error, Activation);
+		}
+		ParallelMatrixSumColumnsInto(Pool, Parallel, Gradients.BiasGradients[LayerIndex], Error);
+	}
+	else
+	{
+		matrix WeightGradient;
+		if(SparseActivation)
+		{
+			WeightGradient = ParallelSparseMultTranspose(Pool, Parallel, Error, SparseInputs);
+		}
+		else
+		{
+			WeightGradient = ParallelMultTranspose(Pool, Parallel, Error, Activation);
+		}
+		MatrixPlusEquals(Gradients.WeightGradients[LayerIndex], WeightGradient);
+		VectorPlusEquals(Gradients.BiasGradients[LayerIndex],
+		                 ParallelMatrixSumColumns(Pool, Parallel, Error));
+	}
+}
+
+internal u32
+RecomputeSegmentFor(u32 LayerCount)
+{
+	// NOTE: sqrt(L) segments of sqrt(L) layers keeps the fewest activations
+	//	for one extra forward pass.
+	u32 Result = (u32)(SquareRoot((r32)(LayerCount - 1)) + 0.5f);
+	if(Result < 2)
+	{
+		Result = 2;
+	}
+	return Result;
+}
+
+internal void
+RecomputeGradientsBatch(memory_pool *Pool, parallel_context *Parallel, neural_network Network,
+                        matrix Inputs, matrix DesiredOutputs, network_gradients Gradients, b32 Accumulate)
+{
+	TIMED_BLOCK("RecomputeGradientsBatch", 0, 0);
+
+	u32 OutputLayer = Network.LayerCount - 1;
+	u32 Segment = Parallel->RecomputeSegment;
+	u32 SegmentCount = (OutputLayer + Segment - 1) / Segment;
+	u32 TrialCount = Inputs.ColumnCount;
+
+	// NOTE: Entries are only valid at the checkpoints, plus the segment being
+	//	recomputed.
+	matrix *WeightedInputs = PoolPushArray(Pool, matrix, Network.LayerCount);
+	matrix *Activations = PoolPushArray(Pool, matrix, Network.LayerCount);
+	WeightedInputs[0] = Inputs;
+	Activations[0] = Inputs;
+
+	sparse_matrix SparseInputs = {};
+	b32 HasSparseInputs = false;
+	if((Parallel->SparseInputDensity > 0.0f) && (LayerType(Network, 1) == LayerType_Dense))
+	{
+		HasSparseInputs = MakeSparseMatrix(Pool, Inputs, Parallel->SparseInputDensity, &SparseInputs);
+	}
+
+	for(u32 SegmentIndex = 0;
+	    SegmentIndex < SegmentCount;
+	    ++SegmentIndex)
+	{
+		u32 Checkpoint = SegmentIndex*Segment;
+		u32 Next = Minimum(Checkpoint + Segment, OutputLayer);
+
+		WeightedInputs[Next] = MatrixRaw_(Pool, Network.Layers[Next], TrialCount);
+		Activations[Next] = MatrixRaw_(Pool, Network.Layers[Next], TrialCount);
+
+		temp_memory SegmentMem = PoolBeginTempMemory(Pool);
+
+		matrix WeightedInput = {};
+		matrix Activation = Activations[Checkpoint];
+		for(u32 LayerIndex = Checkpoint + 1;
+		    LayerIndex <= Next;
+		    ++LayerIndex)
+		{
+			FeedForwardLayer(Pool, Parallel, Network, LayerIndex, Activation, HasSparseInputs, SparseInputs,
+			                 &WeightedInput, &Activation);
+		}
+		EvaluateInto(WeightedInputs[Next], Lazy(WeightedInput));
+		EvaluateInto(Activations[Next], Lazy(Activation));
+
+		PoolEndTempMemory(SegmentMem);
+	}
+
+	matrix Error = OutputErrorBatch(Pool, Network, WeightedInputs[OutputLayer], Activations[OutputLayer],
+	                                DesiredOutputs);
+
+	for(u32 SegmentIndex = SegmentCount;
+	    SegmentIndex > 0;
+	    --SegmentIndex)
+	{
+		u32 Checkpoint = (SegmentIndex - 1)*Segment;
+		u32 Next = Minimum(Checkpoint + Segment, OutputLayer);
+
+		// NOTE: The error handed down to the next segment has to outlive this
+		//	one's recomputed layers.
+		matrix CheckpointError = {};
+		if(Checkpoint > 0)
+		{
+			CheckpointError = MatrixRaw_(Pool, Network.Layers[Checkpoint], TrialCount);
+		}
+
+		temp_memory SegmentMem = PoolBeginTempMemory(Pool);
+
+		for(u32 LayerIndex = Checkpoint + 1;
+		    LayerIndex < Next;
+		    ++LayerIndex)
+		{
+			FeedForwardLayer(Pool, Parallel, Network, LayerIndex, Activations[LayerIndex - 1],
+			                 HasSparseInputs, SparseInputs,
+			                 WeightedInputs + LayerIndex, Activations + LayerIndex);
+		}
+
+		for(u32 LayerIndex = Next;
+		    LayerIndex > Checkpoint;
+		    --LayerIndex)
+		{
+			AccumulateLayerGradients(Pool, Parallel, Network, Gradients, LayerIndex, Error, Activations[LayerIndex - 1],
+			                         ((LayerIndex == 1) && HasSparseInputs), SparseInputs, Accumulate);
+
+			if(LayerIndex > 1)
+			{
+				matrix PreviousError = CheckpointError;
+				if(LayerIndex - 1 > Checkpoint)
+				{
+					PreviousError = MatrixRaw_(Pool, Network.Layers[LayerIndex - 1], TrialCount);
+				}
+				BackPropagateLayerError(Pool, Parallel, Network, LayerIndex, PreviousError, Error,
+				                        Activations[LayerIndex - 1], WeightedInputs[LayerIndex - 1]);
+				Error = PreviousError;
+			}
+		}
+
+		PoolEndTempMemory(SegmentMem);
+	}
+}
+
+internal network_gradients
+PushNetworkGradients(memory_pool *Pool, neural_network Network)
+{
+	network_gradients Result = {};
+	Result.WeightGradients = PoolPushArray(Pool, matrix, Network.LayerCount);
+	Result.BiasGradients = PoolPushArray(Pool, vec, Network.LayerCount);
+	for(u32 LayerIndex = 1;
+	    LayerIndex < Network.LayerCount;
+	    ++LayerIndex)
+	{
+		matrix Weights = Network.WeightMatrices[LayerIndex];
+		Result.WeightGradients[LayerIndex] = MatrixRaw_(Pool, Weights.RowCount, Weights.ColumnCount);
+		Result.BiasGradients[LayerIndex] = VecRaw_(Pool, Network.BiasVectors[LayerIndex].Dimension);
+	}
+	return Result;
+}
+
+internal network_gradients
+ComputeGradientsBatch(memory_pool *Pool, parallel_context *Parallel, neural_network Network,
+                      matrix Inputs, matrix Outputs)
+{
+	TIMED_BLOCK("ComputeGradientsBatch", 0, 0);
+
+	network_gradients Result = PushNetworkGradients(Pool, Network);
+
+	u32 TrialCount = Inputs.ColumnCount;
+	u32 MicroBatchSize = TrialCount;
+	if((Parallel->ReductionMode == ReductionMode_Fast) &&
+	   Parallel->MicroBatchSize &&
+	   (Parallel->MicroBatchSize < TrialCount))
+	{
+		MicroBatchSize = Parallel->MicroBatchSize;
+	}
+
+	for(u32 FirstTrial = 0;
+	    FirstTrial < TrialCount;
+	    FirstTrial += MicroBatchSize)
+	{
+		TRACE_BLOCK_ARG("Micro-batch", FirstTrial);
+
+		u32 MicroTrialCount = Minimum(MicroBatchSize, TrialCount - FirstTrial);
+		temp_memory MicroMem = PoolBeginTempMemory(Pool);
+
+		matrix MicroInputs = MatrixColumns(Inputs, FirstTrial, MicroTrialCount);
+		matrix MicroOutputs = MatrixColumns(Outputs, FirstTrial, MicroTrialCount);
+		if((Parallel->RecomputeSegment > 1) &&
+		   (Parallel->RecomputeSegment < (Network.LayerCount - 1)))
+		{
+			RecomputeGradientsBatch(Pool, Parallel, Network, MicroInputs, MicroOutputs, Result, (FirstTrial != 0));
+		}
+		else
+		{
+			back_propagate_batch_result BackPropagateResult =
+				BackPropagateBatch(Pool, Parallel, Network, MicroInputs, MicroOutputs);
+
+			for(u32 LayerIndex = 1;
+			    LayerIndex < Network.LayerCount;
+			    ++LayerIndex)
+			{
+				AccumulateLayerGradients(Pool, Parallel, Network, Result, LayerIndex, BackPropagateResult.Errors[LayerIndex],
+				                         BackPropagateResult.Activations[LayerIndex - 1],
+				                         ((LayerIndex == 1) && BackPropagateResult.HasSparseInputs),
+				                         BackPropagateResult.SparseInputs, (FirstTrial != 0));
+			}
+		}
+
+		PoolEndTempMemory(MicroMem);
+	}
+
+	return Result;
+}
+
+internal void
+ApplyGradients(neural_network Network, network_gradients Gradients, u32 TrialCount,
+               r32 LearningRate, r32 Regularization, u32 TotalTrials)
+{
+	for(u32 LayerIndex = 1;
+	    LayerIndex < Network.LayerCount;
+	    ++LayerIndex)
+	{
+		if(LayerType(Network, LayerIndex) == LayerType_MaxPool)
+		{
+			continue;
+		}
+
+		TRACE_BLOCK_ARG("Weight update", LayerIndex);
+
+		matrix *Weight = Network.WeightMatrices + LayerIndex;
+		vec *Bias = Network.BiasVectors + LayerIndex;
+
+		r32 GradientScale = -LearningRate/TrialCount;
+		r32 WeightDecay = (1.0f - (LearningRate*Regularization)/TotalTrials);
+		lazy<expr_operand> WeightGradient = Lazy(Gradients.WeightGradients[LayerIndex]);
+		if(Network.WeightMasks)
+		{
+			// NOTE: Pruned weights would grow back from their gradients.
+			EvaluateInto(*Weight, LazyHadamard(LazyPlus(LazyScale(WeightDecay, Lazy(*Weight)),
+			                                            LazyScale(GradientScale, WeightGradient)),
+			                                   Lazy(Network.WeightMasks[LayerIndex])));
+			if(Network.BlockSparseWeights)
+			{
+				BlockSparseCopyValues(Network.BlockSparseWeights[LayerIndex], *Weight);
+			}
+		}
+		else
+		{
+			EvaluateInto(*Weight, LazyPlus(LazyScale(WeightDecay, Lazy(*Weight)),
+			                               LazyScale(GradientScale, WeightGradient)));
+		}
+
+		EvaluateInto(*Bias, LazyPlus(Lazy(*Bias), LazyScale(GradientScale, Lazy(Gradients.BiasGradients[LayerIndex]))));
+	}
+}
+
+internal void
+GradientDescentBatch(memory_pool *Pool, parallel_context *Parallel, neural_network Network,
+                     matrix Inputs, matrix Outputs,
+                     r32 LearningRate, r32 Regularization, u32 TotalTrials)
+{
+	TIMED_BLOCK("GradientDescentBatch", 0, 0);
+
+	temp_memory TempMem = PoolBeginTempMemory(Pool);
+
+	network_gradients Gradients = ComputeGradientsBatch(Pool, Parallel, Network, Inputs, Outputs);
+	ApplyGradients(Network, Gradients, Inputs.ColumnCount, LearningRate, Regularization, TotalTrials);
+
+	PoolEndTempMemory(TempMem);
+}
+
+internal void
+PrintFeedForwardResult(neural_network Network, feed_forward_result FeedForwardResult)
+{
+	PrintVec(FeedForwardResult.Activations[Network.LayerCount - 1]);
+}
+
+internal void
+PrintBackPropagateBatchResult(neural_network Network, back_propagate_batch_result BackPropagateBatchResult)
+{
+	u32 LayerCount = Network.LayerCount;
+
+	printf("WeightedInputs:\n");
+	for(u32 LayerIndex = 0;
+	    LayerIndex < LayerCount;
+	    ++LayerIndex)
+	{
+		PrintMatrix(BackPropagateBatchResult.WeightedInputs[LayerIndex]);
+	}
+
+	printf("Activations:\n");
+	for(u32 LayerIndex = 0;
+	    LayerIndex < LayerCount;
+	    ++LayerIndex)
+	{
+		PrintMatrix(BackPropagateBatchResult.Activations[LayerIndex]);
+	}
+
+	printf("Errors:\n");
+	for(u32 LayerIndex = 1;
+	    LayerIndex < LayerCount;
+	    ++LayerIndex)
+	{
+		PrintMatrix(BackPropagateBatchResult.Errors[LayerIndex]);
+	}
+}
+
+internal batch
+CreateMiniBatch(memory_pool *Pool, data_set DataSet, u32 Size)
+{
+	Assert(Size <= DataSet.DataCount);
+
+	batch Result = {};
+	Result.Input = MatrixRaw_(Pool, DataSet.Inputs.RowCount, Size);
+	Result.Output = MatrixRaw_(Pool, DataSet.Outputs.RowCount, Size);
+
+	temp_memory TempMem = PoolBeginTempMemory(Pool);
+	u32 *Indexes = PoolPushArray(Pool, u32, DataSet.DataCount);
+
+	u32 *IndexAt = Indexes;
+	for(u32 Index = 0;
+	    Index < DataSet.DataCount;
+	    ++Index)
+	{
+		*IndexAt++ = Index;
+	}
+
+	for(u32 Index = 0;
+	    Index < Size;
+	    ++Index)
+	{
+		u32 NextElementIndex = RandomU32InRangeCloseOpen(Index, DataSet.DataCount);
+		u32 NextElement = Indexes[NextElementIndex];
+		Indexes[NextElementIndex] = Indexes[Index];
+
+		r32 *InputDest = MatrixColumnData(Result.Input, Index);
+		r32 *OutputDest = MatrixColumnData(Result.Output, Index);
+
+		vec InputVec = MatrixColumn(DataSet.Inputs, NextElement);
+		vec OutputVec = MatrixColumn(DataSet.Outputs, NextElement);
+
+		r32 *InputSource = InputVec.Data;
+		for(u32 DataIndex = 0;
+		    DataIndex < InputVec.Dimension;
+		    ++DataIndex)
+		{
+			*InputDest++ = *InputSource++;
+		}
+
+		r32 *OutputSource = OutputVec.Data;
+		for(u32 DataIndex = 0;
+		    DataIndex < OutputVec.Dimension;
+		    ++DataIndex)
+		{
+			*OutputDest++ = *OutputSource++;
+		}
+	}
+
+	PoolEndTempMemory(TempMem);
+	return Result;
+}
+
+internal batch *
+CreateBatches(memory_pool *Pool, data_set DataSet, u32 Size)
+{
+	TRACE_BLOCK("Create batches");
+	TIMED_BLOCK("CreateBatches",
+	            2*(u64)DataSet.DataCount*(DataSet.Inputs.RowCount + DataSet.Outputs.RowCount)*sizeof(r32),
+	            0);
+
+	Assert((DataSet.DataCount / Size)*Size == DataSet.DataCount);
+
+	u32 BatchCount = DataSet.DataCount / Size;
+	batch *Result = PoolPushArray(Pool, batch, BatchCount);
+
+	for(u32 BatchIndex = 0;
+	    BatchIndex < BatchCount;
+	    ++BatchIndex)
+	{
+		batch *Batch = Result + BatchIndex;
+		Batch->Input = MatrixRaw_(Pool, DataSet.Inputs.RowCount, Size);
+		Batch->Output = MatrixRaw_(Pool, DataSet.Outputs.RowCount, Size);
+	}
+
+	temp_memory TempMem = PoolBeginTempMemory(Pool);
+	u32 *Indexes = PoolPushArray(Pool, u32, DataSet.DataCount);
+
+	u32 *IndexAt = Indexes;
+	for(u32 Index = 0;
+	    Index < DataSet.DataCount;
+	    ++Index)
+	{
+		*IndexAt++ = Index;
+	}
+
+	for(u32 Index = 0;
+	    Index < DataSet.DataCount;
+	    ++Index)
+	{
+		u32 NextElementIndex = RandomU32InRangeCloseOpen(Index, DataSet.DataCount);
+		u32 NextElement = Indexes[NextElementIndex];
+		Indexes[NextElementIndex] = Indexes[Index];
+		Indexes[Index] = NextElement;
+	}
+
+	for(u32 Index = 0;
+	    Index < DataSet.DataCount;
+	    ++Index)
+	{
+		u32 NextElement = Indexes[Index];
+
+		batch *Batch = Result + (Index / Size);
+		r32 *InputDest = MatrixColumnData(Batch->Input, Index % Size);
+		r32 *OutputDest = MatrixColumnData(Batch->Output, Index % Size);
+	
+		vec InputVec = MatrixColumn(DataSet.Inputs, NextElement);
+		vec OutputVec = MatrixColumn(DataSet.Outputs, NextElement);
+
+		r32 *InputSource = InputVec.Data;
+		for(u32 DataIndex = 0;
+		    DataIndex < InputVec.Dimension;
+		    ++DataIndex)
+		{
+			*InputDest++ = *InputSource++;
+		}
+
+		r32 *OutputSource = OutputVec.Data;
+		for(u32 DataIndex = 0;
+		    DataIndex < OutputVec.Dimension;
+		    ++DataIndex)
+		{
+			*OutputDest++ = *OutputSource++;
+		}
+	}
+
+	PoolEndTempMemory(TempMem);
+	return Result;
+}
+
+internal r32
+ComputeSuccessRate(matrix Outputs, matrix Answers)
+{
+	u32 TotalTrials = Outputs.ColumnCount;
+	u32 Errors = 0;
+
+	for(u32 TrialIndex = 0;
+	    TrialIndex < TotalTrials;
+	    ++TrialIndex)
+	{
+		u32 Guess = 123;
+		r32 MaxValue = 0.0f;
+		r32 *OutputValue = MatrixColumnData(Outputs, TrialIndex);
+		for(u32 OutputIndex = 0;
+		    OutputIndex < Outputs.RowCount;
+		    ++OutputIndex)
+		{
+			r32 Value = *OutputValue++;
+			if(Value > MaxValue)
+			{
+				MaxValue = Value;
+				Guess = OutputIndex;
+			}
+		}
+
+		u32 Answer = 124;
+		MaxValue = 0.0f;
+		r32 *AnswerValue = MatrixColumnData(Answers, TrialIndex);
+		for(u32 OutputIndex = 0;
+		    OutputIndex < Answers.RowCount;
+		    ++OutputIndex)
+		{
+			r32 Value = *AnswerValue++;
+			if(Value > MaxValue)
+			{
+				MaxValue = Value;
+				Answer = OutputIndex;
+			}
+		}
+
+		Assert((Guess != 123) && (Answer != 124));
+
+		if(Answer != Guess)
+		{
+			++Errors;
+		}
+	}
+
+	r32 ErrorRate = (r32)Errors / (r32)TotalTrials;
+	r32 SuccessRatePercent = 100.0f*(1 - ErrorRate);
+	return SuccessRatePercent;
+}
+
+internal r32
+EvaluateNetwork(memory_pool *Pool, parallel_context *Parallel, neural_network Network, data_set TestSet)
+{
+	TRACE_BLOCK("Evaluate");
+	TIMED_BLOCK("EvaluateNetwork", 0, 0);
+
+	temp_memory TempMem = PoolBeginTempMemory(Pool);
+
+	// NOTE: Order doesn't matter here, so the set is fed in place instead of
+	//	being shuffled into a batch.
+	feed_forward_batch_result FeedForward = FeedForwardBatch(Pool, Parallel, Network, TestSet.Inputs);
+	r32 SuccessRatePercent = ComputeSuccessRate(FeedForward.Activations[Network.LayerCount - 1], TestSet.Outputs);
+
+	PoolEndTempMemory(TempMem);
+	return SuccessRatePercent;
+}
+
+internal void
+TestNetwork(memory_pool *Pool, parallel_context *Parallel, neural_network Network, data_set TestSet)
+{
+	r32 SuccessRatePercent = EvaluateNetwork(Pool, Parallel, Network, TestSet);
+	printf("Success rate: %3.2f%%\n", SuccessRatePercent);
+}
+
+#include "nn_tune.cpp"
+#include "nn_prune.cpp"
+#include "nn_lowrank.cpp"
+#include "nn_static.cpp"
+#include "nn_export.cpp"
+#include "nn_jit.cpp"
+#include "nn_graph.cpp"
+#include "nn_recompute.cpp"
+#include "nn_activation.cpp"
+#include "nn_conv.cpp"
+#include "nn_mixed.cpp"
+#include "nn_binary.cpp"
+#include "nn_distill.cpp"
+
+internal command_line_options
+ParseCommandLineOptions(s32 ArgC, char **ArgV)
+{
+	command_line_options Result = {};
+	Result.HiddenLayerNeurons = 100;
+	Result.HiddenLayerCount = 1;
+	Result.EpochCount = 0;
+	Result.BatchSize = 10;
+	// NOTE: Zero until -learningrate gives one; the default depends on
+	//	whether the weights train binary (see main).
+	Result.LearningRate = 0.0f;
+	Result.Regularization = 5.0f;
+	Result.ThreadCount = 1;
+	Result.Deterministic = false;
+	Result.SparseInputDensity = SPARSE_INPUT_DEFAULT_DENSITY;
+	Result.ExportName = EXPORT_DEFAULT_NAME;
+	Result.DistillTemperature = DISTILL_DEFAULT_TEMPERATURE;
+	Result.DistillWeight = DISTILL_DEFAULT_WEIGHT;
+
+	for(s32 ArgumentIndex = 1;
+		ArgumentIndex < ArgC;
+		++ArgumentIndex)
+	{
+		char *Argument = ArgV[ArgumentIndex];
+		if(StringCompare(Argument, "-s"))
+		{
+			Result.SaveNetwork = ArgV[++ArgumentIndex];
+		}
+		else if(StringCompare(Argument, "-l"))
+		{
+			Result.LoadNetwork = ArgV[++ArgumentIndex];
+		}
+		else if(StringCompare(Argument, "-hiddenlayer"))
+		{
+			Result.HiddenLayerNeurons = atoi(ArgV[++ArgumentIndex]);
+		}
+		else if(StringCompare(Argument, "-hiddenlayers"))
+		{
+			Result.HiddenLayerCount = atoi(ArgV[++ArgumentIndex]);
+		}
+		else if(StringCompare(Argument, "-epochs"))
+		{
+			Result.EpochCount = atoi(ArgV[++ArgumentIndex]);
+		}
+		else if(StringCompare(Argument, "-batch"))
+		{
+			Result.BatchSize = atoi(ArgV[++ArgumentIndex]);
+		}
+		else if(StringCompare(Argument, "-learningrate"))
+		{
+			Result.LearningRate = (r32)atof(ArgV[++ArgumentIndex]);
+		}
+		else if(StringCompare(Argument, "-regularization"))
+		{
+			Result.Regularization = (r32)atof(ArgV[++ArgumentIndex]);
+		}
+		else if(StringCompare(Argument, "-threads"))
+		{
+			Result.ThreadCount = atoi(ArgV[++ArgumentIndex]);
+		}
+		else if(StringCompare(Argument, "-deterministic"))
+		{
+			Result.Deterministic = true;
+		}
+		else if(StringCompare(Argument, "-profile"))
+		{
+			Result.Profile = true;
+		}
+		else if(StringCompare(Argument, "-perf"))
+		{
+			Result.Profile = true;
+			Result.PerfCounters = true;
+		}
+		else if(StringCompare(Argument, "-hugepages"))
+		{
+			Result.HugePages = true;
+		}
+		else if(StringCompare(Argument, "-hugetlb"))
+		{
+			Result.HugeTLB = true;
+		}
+		else if(StringCompare(Argument, "-memstats"))
+		{
+			Result.MemoryStats = true;
+		}
+		else if(StringCompare(Argument, "-trace"))
+		{
+			Result.Trace = ArgV[++ArgumentIndex];
+		}
+		else if(StringCompare(Argument, "-checkpoint"))
+		{
+			Result.Checkpoint = ArgV[++ArgumentIndex];
+		}
+		else if(StringCompare(Argument, "-checkpointbatches"))
+		{
+			Result.CheckpointBatches = atoi(ArgV[++ArgumentIndex]);
+		}
+		else if(StringCompare(Argument, "-checkpointseconds"))
+		{
+			Result.CheckpointSeconds = (r32)atof(ArgV[++ArgumentIndex]);
+		}
+		else if(StringCompare(Argument, "-sparseinput"))
+		{
+			Result.SparseInputDensity = (r32)atof(ArgV[++ArgumentIndex]);
+		}
+		else if(StringCompare(Argument, "-tune"))
+		{
+			Result.TuneCache = TUNING_CACHE_DEFAULT_FILENAME;
+		}
+		else if(StringCompare(Argument, "-tunecache"))
+		{
+			Result.TuneCache = ArgV[++ArgumentIndex];
+		}
+		else if(StringCompare(Argument, "-retune"))
+		{
+			if(!Result.TuneCache)
+			{
+				Result.TuneCache = TUNING_CACHE_DEFAULT_FILENAME;
+			}
+			Result.Retune = true;
+		}
+		else if(StringCompare(Argument, "-prune"))
+		{
+			Result.PruneSparsity = (r32)atof(ArgV[++ArgumentIndex]);
+		}
+		else if(StringCompare(Argument, "-pruneblocks"))
+		{
+			Result.PruneBlocks = true;
+		}
+		else if(StringCompare(Argument, "-prunereport"))
+		{
+			Result.PruneReport = true;
+		}
+		else if(StringCompare(Argument, "-lowrank"))
+		{
+			Result.LowRank = atoi(ArgV[++ArgumentIndex]);
+		}
+		else if(StringCompare(Argument, "-lowrankenergy"))
+		{
+			Result.LowRankEnergy = (r32)atof(ArgV[++ArgumentIndex]);
+		}
+		else if(StringCompare(Argument, "-lowrankreport"))
+		{
+			Result.LowRankReport = true;
+		}
+		else if(StringCompare(Argument, "-static"))
+		{
+			Result.Static = true;
+		}
+		else if(StringCompare(Argument, "-staticbench"))
+		{
+			Result.StaticBenchmark = true;
+		}
+		else if(StringCompare(Argument, "-exportc"))
+		{
+			Result.ExportHeader = ArgV[++ArgumentIndex];
+		}
+		else if(StringCompare(Argument, "-exportname"))
+		{
+			Result.ExportName = ArgV[++ArgumentIndex];
+		}
+		else if(StringCompare(Argument, "-jit"))
+		{
+			Result.Jit = true;
+		}
+		else if(StringCompare(Argument, "-jitbench"))
+		{
+			Result.JitBenchmark = true;
+		}
+		else if(StringCompare(Argument, "-graph"))
+		{
+			Result.Graph = true;
+		}
+		else if(StringCompare(Argument, "-graphbench"))
+		{
+			Result.GraphBenchmark = true;
+		}
+		else if(StringCompare(Argument, "-recompute"))
+		{
+			// NOTE: A segment length, or auto for sqrt(layers).
+			char *Segment = ArgV[++ArgumentIndex];
+			Result.Recompute = true;
+			Result.RecomputeSegment = StringCompare(Segment, "auto") ? 0 : atoi(Segment);
+		}
+		else if(StringCompare(Argument, "-activation"))
+		{
+			Result.Activation = ArgV[++ArgumentIndex];
+		}
+		else if(StringCompare(Argument, "-activationbench"))
+		{
+			Result.ActivationBenchmark = true;
+		}
+		else if(StringCompare(Argument, "-conv"))
+		{
+			Result.Convolution = ArgV[++ArgumentIndex];
+		}
+		else if(StringCompare(Argument, "-convbench"))
+		{
+			Result.ConvolutionBenchmark = true;
+		}
+		else if(StringCompare(Argument, "-bf16"))
+		{
+			Result.BF16 = true;
+		}
+		else if(StringCompare(Argument, "-bf16bench"))
+		{
+			Result.BF16Benchmark = true;
+		}
+		else if(StringCompare(Argument, "-binary"))
+		{
+			Result.Binary = true;
+		}
+		else if(StringCompare(Argument, "-ternary"))
+		{
+			Result.Ternary = true;
+		}
+		else if(StringCompare(Argument, "-binarybench"))
+		{
+			Result.BinaryBenchmark = true;
+		}
+		else if(StringCompare(Argument, "-teacher"))
+		{
+			Result.Teacher = ArgV[++ArgumentIndex];
+		}
+		else if(StringCompare(Argument, "-temperature"))
+		{
+			Result.DistillTemperature = (r32)atof(ArgV[++ArgumentIndex]);
+		}
+		else if(StringCompare(Argument, "-distillweight"))
+		{
+			Result.DistillWeight = (r32)atof(ArgV[++ArgumentIndex]);
+		}
+		else if(StringCompare(Argument, "-datacache"))
+		{
+			Result.DataCache = true;
+		}
+		else
+		{
+			InvalidCodePath;
+		}
+	}
+
+	return Result;
+}
+
+// NOTE: Tools that include nn.cpp for its code, like nn_export_harness.cpp,
+//	bring their own main.
+#if !NN_NO_MAIN
+s32 main(s32 ArgC, char **ArgV)
+{
+	command_line_options Options = ParseCommandLineOptions(ArgC, ArgV);
+
+	// NOTE: The main thread, the workers and the checkpoint writer can each
+	//	take one of the thread scratch pools (see nn_memory.h).
+	if((Options.ThreadCount < 1) || ((Options.ThreadCount + 1) > THREAD_SCRATCH_MAX_COUNT))
+	{
+		fprintf(stderr, "-threads has to be between 1 and %u\n", THREAD_SCRATCH_MAX_COUNT - 1);
+		return 1;
+	}
+
+	InitializeMathKernels();
+	printf("Math kernels: %s\n", CpuLevelNames[GlobalMathKernels.Level]);
+
+	// NOTE: Address space only, pages are committed as the pools grow.
+	u32 PoolFlags = 0;
+	if(Options.HugePages)
+	{
+		PoolFlags |= PlatformMemory_HugePages;
+	}
+	if(Options.HugeTLB)
+	{
+		PoolFlags |= PlatformMemory_HugeTLB;
+	}
+	memory_pool MainPool = {};
+	memory_pool TempPool = {};
+	if(!PoolReserve(&MainPool, Gigabytes(64), PoolFlags) ||
+	   !PoolReserve(&TempPool, Gigabytes(16), PoolFlags))
+	{
+		fprintf(stderr, "Could not reserve memory pools\n");
+		return 1;
+	}
+
+	if(Options.Trace)
+	{
+		// NOTE: The main thread, the work queue's workers and the checkpoint
+		//	writer.
+		TraceBegin(&MainPool, Options.Trace, Options.ThreadCount + 1);
+	}
+
+	if(Options.PerfCounters)
+	{
+		EnableProfilePerfCounters();
+	}
+
+	platform_work_queue WorkQueue = {};
+	PlatformMakeQueue(&WorkQueue, Options.ThreadCount);
+	parallel_context Parallel = {};
+	Parallel.Queue = &WorkQueue;
+	Parallel.ReductionMode = Options.Deterministic ? ReductionMode_Deterministic : ReductionMode_Fast;
+	Parallel.ColumnSplit = 1;
+	Parallel.SparseInputDensity = Options.SparseInputDensity;
+
+	// NOTE: Cached data sets are mapped read-only and shared with every other
+	//	job using the same cache.
+	u64 LoadStart = PlatformGetWallClock();
+	data_set TotalTrainingSet = {};
+	data_set TestSet = {};
+	if(Options.DataCache)
+	{
+		TotalTrainingSet = LoadCachedMNISTData(&MainPool, &TempPool, "train-images.idx3-ubyte", "train-labels.idx1-ubyte");
+		TestSet = LoadCachedMNISTData(&MainPool, &TempPool, "t10k-images.idx3-ubyte", "t10k-labels.idx1-ubyte");
+	}
+	else
+	{
+		TotalTrainingSet = LoadMNISTData(&MainPool, &TempPool, "train-images.idx3-ubyte", "train-labels.idx1-ubyte");
+		TestSet = LoadMNISTData(&MainPool, &TempPool, "t10k-images.idx3-ubyte", "t10k-labels.idx1-ubyte");
+	}
+	printf("Data sets loaded in %.2fms%s\n", 1000.0f*PlatformGetSecondsElapsed(LoadStart, PlatformGetWallClock()),
+	       Options.DataCache ? " (cached)" : "");
+
+	data_set TrainingSet = TotalTrainingSet;
+	TrainingSet.DataCount = 50000;
+	TrainingSet.Inputs = MatrixColumns(TotalTrainingSet.Inputs, 0, TrainingSet.DataCount);
+	TrainingSet.Outputs = MatrixColumns(TotalTrainingSet.Outputs, 0, TrainingSet.DataCount);
+
+	data_set VerificationSet = {};
+	VerificationSet.DataCount = TotalTrainingSet.DataCount - TrainingSet.DataCount;
+	VerificationSet.Inputs = MatrixColumns(TotalTrainingSet.Inputs, TrainingSet.DataCount, VerificationSet.DataCount);
+	VerificationSet.Outputs = MatrixColumns(TotalTrainingSet.Outputs, TrainingSet.DataCount, VerificationSet.DataCount);
+	
+	neural_network Network = {};
+	if(Options.LoadNetwork)
+	{
+		Network = LoadNetwork(&MainPool, Options.LoadNetwork);
+		if(!Network.LayerCount)
+		{
+			return 1;
+		}
+		Assert(TrainingSet.Inputs.RowCount == Network.Layers[0]);
+		Assert(TrainingSet.Outputs.RowCount == Network.Layers[Network.LayerCount - 1]);
+		if(!NetworkActivationsValid(Network))
+		{
+			return 1;
+		}
+		if(Options.Activation)
+		{
+			printf("Ignoring -activation; %s keeps the activations it was trained with\n", Options.LoadNetwork);
+		}
+		if(Options.Convolution)
+		{
+			printf("Ignoring -conv; %s keeps the layers it was trained with\n", Options.LoadNetwork);
+		}
+
+		// NOTE: Packed networks stay binary or ternary, as they were saved.
+		if(Network.PackedWeights && !Options.Binary && !Options.Ternary)
+		{
+			Options.Ternary = Network.PackedWeights[1].Ternary;
+			Options.Binary = !Options.Ternary;
+		}
+	}
+	else
+	{
+		u32 LayerCount = Options.HiddenLayerCount + 2;
+		u32 *Layers = 0;
+		layer_shape *Shapes = 0;
+		if(Options.Convolution)
+		{
+			Shapes = BuildConvolutionLayers(&MainPool, Options.Convolution, TrainingSet.ImageWidth,
+			                                TrainingSet.ImageHeight, Options.HiddenLayerCount,
+			                                Options.HiddenLayerNeurons, TrainingSet.Outputs.RowCount,
+			                                &Layers, &LayerCount);
+			if(!Shapes)
+			{
+				return 1;
+			}
+		}
+		else
+		{
+			Layers = PoolPushArray(&MainPool, u32, LayerCount);
+			Layers[0] = TrainingSet.Inputs.RowCount;
+			for(u32 LayerIndex = 1;
+			    LayerIndex < (LayerCount - 1);
+			    ++LayerIndex)
+			{
+				Layers[LayerIndex] = Options.HiddenLayerNeurons;
+			}
+			Layers[LayerCount - 1] = TrainingSet.Outputs.RowCount;
+		}
+
+		activation_function *Activations = 0;
+		if(Options.Activation)
+		{
+			Activations = ResolveActivations(&MainPool, Options.Activation, LayerCount);
+			if(!Activations)
+			{
+				return 1;
+			}
+		}
+		else if((Options.Binary || Options.Ternary) && !Options.Convolution)
+		{
+			Activations = BinaryActivations(&MainPool, LayerCount, Activation_Sigmoid);
+		}
+		Network = CreateNetwork(&MainPool, Layers, LayerCount, CostFn_CrossEntropy, Activations, Shapes);
+		if(!NetworkActivationsValid(Network))
+		{
+			return 1;
+		}
+	}
+
+	// NOTE: The student trains on the teacher's targets from the first batch.
+	//	Everything else, tuning and benchmarks included, takes the labels.
+	neural_network Teacher = {};
+	data_set EpochSet = TrainingSet;
+	if(Options.Teacher)
+	{
+		Teacher = LoadNetwork(&MainPool, Options.Teacher);
+		if(!Teacher.LayerCount || !NetworkActivationsValid(Teacher))
+		{
+			return 1;
+		}
+		if(!DistillationSupports(Teacher, Network))
+		{
+			fprintf(stderr, "%s doesn't take the same inputs or give the same outputs as the network it would teach\n",
+			        Options.Teacher);
+			return 1;
+		}
+		if(Options.DistillTemperature <= 0.0f)
+		{
+			fprintf(stderr, "-temperature has to be positive\n");
+			return 1;
+		}
+
+		EpochSet = DistillTrainingSet(&MainPool, &Parallel, Teacher, TrainingSet, Options.DistillTemperature);
+		printf("Distilling %s at temperature %.2f, %.0f%% teacher\n", Options.Teacher,
+		       Options.DistillTemperature, 100.0f*Options.DistillWeight);
+		if(Options.Static || Options.Graph)
+		{
+			printf("-static and -graph don't apply to -teacher training\n");
+			Options.Static = false;
+			Options.Graph = false;
+		}
+	}
+
+	if(!NetworkIsDense(Network))
+	{
+		PrintConvolutionNetwork(Network);
+
+		// NOTE: Pruning and factoring work on dense weight matrices.
+		if((Options.PruneSparsity > 0.0f) || Options.PruneReport ||
+		   Options.LowRank || (Options.LowRankEnergy > 0.0f) || Options.LowRankReport)
+		{
+			printf("Ignoring pruning and low-rank factoring; they only take dense networks\n");
+			Options.PruneSparsity = 0.0f;
+			Options.PruneReport = false;
+			Options.LowRank = 0;
+			Options.LowRankEnergy = 0.0f;
+			Options.LowRankReport = false;
+		}
+	}
+
+	if((Options.Binary || Options.Ternary) &&
+	   ((Options.PruneSparsity > 0.0f) || Options.PruneReport ||
+	    Options.LowRank || (Options.LowRankEnergy > 0.0f) || Options.LowRankReport))
+	{
+		printf("Ignoring pruning and low-rank factoring; binary and ternary networks keep every weight as bits\n");
+		Options.PruneSparsity = 0.0f;
+		Options.PruneReport = false;
+		Options.LowRank = 0;
+		Options.LowRankEnergy = 0.0f;
+		Options.LowRankReport = false;
+	}
+
+	if(Network.Ranks && Options.EpochCount)
+	{
+		printf("Training the factored layers as dense products; pass -lowrank to factor them again\n");
+		Network.Ranks = 0;
+	}
+
+	// NOTE: Any epochs after pruning fine-tune what is left.
+	if(Options.PruneSparsity > 0.0f)
+	{
+		PruneNetwork(&MainPool, &Network, Options.PruneSparsity, Options.PruneBlocks);
+	}
+
+	if(Options.TuneCache)
+	{
+		TuneKernels(&MainPool, &Parallel, Network, TrainingSet, Options.BatchSize,
+		            Options.TuneCache, Options.Retune);
+	}
+
+	if(Options.Jit)
+	{
+		CompileJitKernels(Network, Options.BatchSize);
+	}
+
+	if(Options.Recompute)
+	{
+		Parallel.RecomputeSegment = Options.RecomputeSegment;
+		if(!Parallel.RecomputeSegment)
+		{
+			Parallel.RecomputeSegment = RecomputeSegmentFor(Network.LayerCount);
+		}
+		ReportRecompute(&MainPool, &Parallel, Network, TrainingSet, Options.BatchSize);
+	}
+
+	// NOTE: Binary training goes first, then mixed precision; -static and
+	//	-graph are r32 only.
+	binary_network *Binary = 0;
+	if(Options.Binary || Options.Ternary)
+	{
+		if(BinaryNetworkSupports(Network))
+		{
+			Binary = PushBinaryNetwork(&MainPool, &Network, Options.Ternary);
+			printf("Training with %s weights\n", Options.Ternary ? "ternary" : "binary");
+			if(Options.BF16 || Options.Static || Options.Graph)
+			{
+				printf("-bf16, -static and -graph don't apply to -binary or -ternary training\n");
+			}
+		}
+		else
+		{
+			printf("-binary and -ternary only train dense, unpruned, unfactored networks; training this one in r32\n");
+		}
+	}
+
+	if(Options.LearningRate == 0.0f)
+	{
+		Options.LearningRate = Binary ? BINARY_DEFAULT_LEARNING_RATE : 1.0f;
+	}
+
+	mixed_network *Mixed = 0;
+	if(Options.BF16 && !Binary)
+	{
+		if(MixedNetworkSupports(Network))
+		{
+			Mixed = PushMixedNetwork(&MainPool, Network);
+			printf("Training with bf16 activations and errors, %s error products\n",
+			       GlobalMathKernels.HardwareBF16 ? "AVX512-BF16" : "software");
+			if(Options.Recompute)
+			{
+				printf("-recompute doesn't apply to -bf16 training\n");
+			}
+			if(Options.Static || Options.Graph)
+			{
+				printf("-static and -graph don't apply to -bf16 training\n");
+			}
+		}
+		else
+		{
+			printf("-bf16 only trains dense, unfactored networks without sign activations; training this one in r32\n");
+		}
+	}
+
+	// NOTE: The static network trains on its own copy of the weights, which
+	//	goes back into Network before anything else reads them.
+	production_network *StaticNetwork = 0;
+	if(Options.Static && !Binary && !Mixed)
+	{
+		StaticNetwork = PushStaticNetwork<production_network>(&MainPool);
+		if(StaticNetworkMatches(StaticNetwork, Network))
+		{
+			LoadStaticNetwork(StaticNetwork, Network);
+			if(Options.ThreadCount > 1)
+			{
+				printf("-static trains on one thread; -threads %u only applies to testing\n", Options.ThreadCount);
+			}
+			if(Options.Graph)
+			{
+				printf("-graph doesn't apply to -static training\n");
+			}
+		}
+		else
+		{
+			printf("-static is compiled for a ");
+			PrintStaticTopology(StaticNetwork);
+			printf(" sigmoid network, dense and unfactored; training this one generically\n");
+			StaticNetwork = 0;
+		}
+	}
+
+	compute_graph *Graph = 0;
+	if(Options.Graph && !Binary && !StaticNetwork && !Mixed)
+	{
+		if(GraphSupportsNetwork(Network))
+		{
+			Graph = CompileTrainingGraph(&MainPool, Network, Options.BatchSize);
+		}
+		else
+		{
+			printf("-graph only trains dense, unfactored sigmoid networks; training this one the usual way\n");
+		}
+	}
+
+	TestNetwork(&MainPool, &Parallel, Network, TestSet);
+	if(Binary)
+	{
+		TestPackedNetwork(&MainPool, &Parallel, Network, TestSet);
+	}
+
+	// NOTE: With no interval given, checkpoint once per epoch.
+	platform_work_queue CheckpointQueue = {};
+	network_checkpoint *Checkpoint = 0;
+	if(Options.Checkpoint)
+	{
+		PlatformMakeQueue(&CheckpointQueue, 2);
+		Checkpoint = CreateCheckpoint(&MainPool, &CheckpointQueue, Network, Options.Checkpoint);
+	}
+	u32 BatchesSinceCheckpoint = 0;
+	u64 LastCheckpointClock = PlatformGetWallClock();
+
+	if(Options.Teacher)
+	{
+		Network.DistillTemperature = Options.DistillTemperature;
+		Network.DistillWeight = Options.DistillWeight;
+	}
+
+	for(u32 EpochIndex = 0;
+	    EpochIndex < Options.EpochCount;
+	    ++EpochIndex)
+	{
+		TRACE_BLOCK_ARG("Epoch", EpochIndex);
+
+		printf("Epoch %d ... ", EpochIndex);
+		u64 EpochStart = PlatformGetWallClock();
+		BeginProfileEpoch();
+		temp_memory TempMem = PoolBeginTempMemory(&MainPool);
+		batch *Batches = CreateBatches(&MainPool, EpochSet, Options.BatchSize);
+		u32 BatchCount = (TrainingSet.DataCount / Options.BatchSize);
+		for(u32 BatchIndex = 0;
+		    BatchIndex < BatchCount;
+		    ++BatchIndex)
+		{
+			TRACE_BLOCK_ARG("Batch", BatchIndex);
+
+			batch *Batch = Batches + BatchIndex;
+			if(Binary)
+			{
+				BinaryGradientDescentBatch(&MainPool, &Parallel, Binary, Network, Batch->Input, Batch->Output,
+				                           Options.LearningRate, Options.Regularization, TrainingSet.DataCount);
+			}
+			else if(Mixed)
+			{
+				MixedGradientDescentBatch(&MainPool, &Parallel, Mixed, Network, Batch->Input, Batch->Output,
+				                          Options.LearningRate, Options.Regularization, TrainingSet.DataCount);
+			}
+			else if(StaticNetwork)
+			{
+				StaticGradientDescentBatch(StaticNetwork, Batch->Input, Batch->Output,
+				                           Options.LearningRate, Options.Regularization, TrainingSet.DataCount);
+			}
+			else if(Graph)
+			{
+				GraphGradientDescentBatch(&MainPool, &Parallel, Graph, Network, Batch->Input, Batch->Output,
+				                          Options.LearningRate, Options.Regularization, TrainingSet.DataCount);
+			}
+			else
+			{
+				GradientDescentBatch(&MainPool, &Parallel, Network, Batch->Input, Batch->Output,
+				                     Options.LearningRate, Options.Regularization, TrainingSet.DataCount);
+			}
+
+			if(Checkpoint)
+			{
+				++BatchesSinceCheckpoint;
+				b32 CheckpointDue = false;
+				if(Options.CheckpointBatches &&
+				   (BatchesSinceCheckpoint >= Options.CheckpointBatches))
+				{
+					CheckpointDue = true;
+				}
+				if((Options.CheckpointSeconds > 0.0f) &&
+				   (PlatformGetSecondsElapsed(LastCheckpointClock, PlatformGetWallClock()) >= Options.CheckpointSeconds))
+				{
+					CheckpointDue = true;
+				}
+
+				if(CheckpointDue)
+				{
+					if(StaticNetwork)
+					{
+						StoreStaticNetwork(Network, StaticNetwork);
+					}
+					// NOTE: A dropped snapshot stays due, so the next batch tries
+					//	again instead of waiting out another interval.
+					if(BeginCheckpoint(Checkpoint, Network))
+					{
+						BatchesSinceCheckpoint = 0;
+						LastCheckpointClock = PlatformGetWallClock();
+					}
+				}
+			}
+
+			TRACE_COUNTER("MainPool bytes", MainPool.Size);
+			TraceFlushIfNeeded();
+		}
+
+		if(StaticNetwork)
+		{
+			StoreStaticNetwork(Network, StaticNetwork);
+		}
+
+		if(Binary)
+		{
+			PackBinaryNetwork(Binary, Network);
+		}
+
+		if(Checkpoint && !Options.CheckpointBatches && (Options.CheckpointSeconds <= 0.0f))
+		{
+			BeginCheckpoint(Checkpoint, Network);
+		}
+
+		PoolEndTempMemory(TempMem);
+		printf("done (%.2fs)\n", PlatformGetSecondsElapsed(EpochStart, PlatformGetWallClock()));
+	
+		TestNetwork(&MainPool, &Parallel, Network, TestSet);
+		if(Binary)
+		{
+			TestPackedNetwork(&MainPool, &Parallel, Network, TestSet);
+		}
+		EndProfileEpoch(Options.Profile);
+	}
+
+	if(Checkpoint)
+	{
+		EndCheckpoints(Checkpoint);
+	}
+
+	if(Options.Teacher)
+	{
+		Network.DistillTemperature = 0.0f;
+		Network.DistillWeight = 0.0f;
+		ReportDistillation(&MainPool, &Parallel, Teacher, Network, TestSet,
+		                   Options.DistillTemperature, Options.DistillWeight);
+	}
+
+	if(Options.StaticBenchmark)
+	{
+		BenchmarkStaticNetwork(&MainPool, &Parallel, Network, TrainingSet, TestSet, Options.BatchSize,
+		                       Options.LearningRate, Options.Regularization);
+	}
+
+	if(Options.JitBenchmark)
+	{
+		BenchmarkJitKernels(&MainPool, &Parallel, Network, TrainingSet, Options.BatchSize);
+	}
+
+	if(Options.GraphBenchmark)
+	{
+		BenchmarkComputeGraph(&MainPool, &Parallel, Network, TrainingSet, Options.BatchSize,
+		                      Options.LearningRate, Options.Regularization);
+	}
+
+	if(Options.ActivationBenchmark)
+	{
+		BenchmarkActivations(&MainPool, &Parallel, Network, TrainingSet, TestSet, Options.BatchSize,
+		                     Options.LearningRate, Options.Regularization);
+	}
+
+	if(Options.ConvolutionBenchmark)
+	{
+		BenchmarkConvolutionLayers(&MainPool, &Parallel, Network, TrainingSet, Options.BatchSize);
+	}
+
+	if(Options.BF16Benchmark)
+	{
+		BenchmarkMixedPrecision(&MainPool, &Parallel, Network, TrainingSet, TestSet, Options.BatchSize,
+		                        Options.LearningRate, Options.Regularization);
+	}
+
+	if(Options.BinaryBenchmark)
+	{
+		BenchmarkBinaryNetwork(&MainPool, &Parallel, Network, TrainingSet, TestSet, Options.BatchSize,
+		                       Options.LearningRate, Options.Regularization, Options.EpochCount);
+	}
+
+	if(Options.PruneReport)
+	{
+		ReportPruning(&MainPool, &Parallel, Network, TestSet);
+	}
+
+	if(Options.LowRankReport)
+	{
+		ReportLowRank(&MainPool, &Parallel, Network, TestSet);
+	}
+
+	// NOTE: Factoring is a compression pass on the finished weights.
+	if(Options.LowRank || (Options.LowRankEnergy > 0.0f))
+	{
+		FactorNetwork(&MainPool, &Network, Options.LowRank, Options.LowRankEnergy);
+		TestNetwork(&MainPool, &Parallel, Network, TestSet);
+	}
+
+	if(Options.SaveNetwork)
+	{
+		SerializeNetworkToDisk(&MainPool, Network, Options.SaveNetwork);
+	}
+
+	if(Options.ExportHeader)
+	{
+		ExportNetworkHeader(Network, Options.ExportHeader, Options.ExportName);
+	}
+
+	TraceEnd();
+
+	if(Options.MemoryStats)
+	{
+		PrintPoolStats("MainPool", &MainPool);
+		PrintPoolStats("TempPool", &TempPool);
+		for(u32 ScratchIndex = 0;
+		    ScratchIndex < GlobalThreadScratchCount;
+		    ++ScratchIndex)
+		{
+			char ScratchName[32];
+			snprintf(ScratchName, sizeof(ScratchName), "Thread %u scratch", ScratchIndex);
+			PrintPoolStats(ScratchName, GlobalThreadScratchPools + ScratchIndex);
+		}
+		PrintPoolAllocationSites();
+	}
+
+	PoolCheckMemory(&MainPool);
+	PoolCheckMemory(&TempPool);
+	return 0;
+}
+#endif
+
+#if NN_INTERNAL
+debug_record GlobalDebugRecords[__COUNTER__];
+u32 const GlobalDebugRecordCount = ArrayCount(GlobalDebugRecords);
+#endif
@@ -0,0 +1,224 @@
+
+/*
+	NOTE: Per-layer activations. -activation takes either one name, which
+		every hidden layer uses under a sigmoid output, or a comma separated
+		name for each weight layer, first hidden to output:
+
+		-activation relu
+		-activation relu,tanh,softmax
+
+	The names are ActivationNames'. Softmax normalizes a whole column, so it
+		can only be the output layer, and only under cross-entropy, whose
+		derivative cancels it the way it cancels the sigmoid's; those two are
+		also the only outputs cross-entropy takes. Quadratic cost trains any
+		element-wise output.
+
+	-activationbench trains a fresh network of the same shape for each of a
+		few activation pairs from the same seed and reports the seconds per
+		epoch, and the epochs and seconds until the test set reaches
+		ACTIVATION_BENCHMARK_TARGET percent.
+*/
+
+#define ACTIVATION_BENCHMARK_TARGET 98.0f
+#define ACTIVATION_BENCHMARK_MAX_EPOCHS 30
+
+internal b32
+ParseActivationName(char *Name, umm Length, activation_function *Activation)
+{
+	for(u32 ActivationIndex = 0;
+	    ActivationIndex < Activation_Count;
+	    ++ActivationIndex)
+	{
+		char *Candidate = ActivationNames[ActivationIndex];
+		if((strlen(Candidate) == Length) && (strncmp(Candidate, Name, Length) == 0))
+		{
+			*Activation = (activation_function)ActivationIndex;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+internal b32
+NetworkActivationsValid(neural_network Network)
+{
+	u32 OutputLayer = Network.LayerCount - 1;
+	for(u32 LayerIndex = 1;
+	    LayerIndex < OutputLayer;
+	    ++LayerIndex)
+	{
+		if(LayerActivation(Network, LayerIndex) == Activation_Softmax)
+		{
+			fprintf(stderr, "Softmax can only be the output layer's activation\n");
+			return false;
+		}
+	}
+
+	activation_function Output = LayerActivation(Network, OutputLayer);
+	if((Network.CostFn == CostFn_CrossEntropy) &&
+	   (Output != Activation_Sigmoid) && (Output != Activation_Softmax))
+	{
+		fprintf(stderr, "Cross-entropy needs a sigmoid or softmax output, not %s\n", ActivationNames[Output]);
+		return false;
+	}
+	if((Network.CostFn != CostFn_CrossEntropy) && (Output == Activation_Softmax))
+	{
+		fprintf(stderr, "A softmax output needs the cross-entropy cost\n");
+		return false;
+	}
+
+	return true;
+}
+
+// NOTE: Returns one activation per layer, the input layer's unused, or 0 if
+//	the list doesn't fit the layers.
+internal activation_function *
+ResolveActivations(memory_pool *Pool, char *List, u32 LayerCount)
+{
+	activation_function *Result = PoolPushArray(Pool, activation_function, LayerCount);
+	Result[0] = Activation_Sigmoid;
+
+	u32 WeightLayerCount = LayerCount - 1;
+	u32 NameCount = 0;
+	char *Name = List;
+	for(;;)
+	{
+		char *End = Name;
+		while(*End && (*End != ','))
+		{
+			++End;
+		}
+
+		activation_function Activation;
+		if(!ParseActivationName(Name, (umm)(End - Name), &Activation))
+		{
+			fprintf(stderr, "Unknown activation in %s; the activations are sigmoid, relu, leakyrelu, tanh, softmax and sign\n",
+			        List);
+			return 0;
+		}
+		if(NameCount < WeightLayerCount)
+		{
+			Result[NameCount + 1] = Activation;
+		}
+		++NameCount;
+
+		if(!*End)
+		{
+			break;
+		}
+		Name = End + 1;
+	}
+
+	if(NameCount == 1)
+	{
+		for(u32 LayerIndex = 1;
+		    LayerIndex < WeightLayerCount;
+		    ++LayerIndex)
+		{
+			Result[LayerIndex] = Result[1];
+		}
+		Result[WeightLayerCount] = Activation_Sigmoid;
+	}
+	else if(NameCount != WeightLayerCount)
+	{
+		fprintf(stderr, "-activation %s names %u layers, but the network has %u weight layers\n",
+		        List, NameCount, WeightLayerCount);
+		return 0;
+	}
+
+	return Result;
+}
+
+internal void
+BenchmarkActivations(memory_pool *Pool, parallel_context *Parallel, neural_network Network,
+                     data_set TrainingSet, data_set TestSet, u32 BatchSize,
+                     r32 LearningRate, r32 Regularization)
+{
+	TRACE_BLOCK("Activation benchmark");
+
+	activation_function Pairs[][2] =
+	{
+		{Activation_Sigmoid, Activation_Sigmoid},
+		{Activation_Sigmoid, Activation_Softmax},
+		{Activation_ReLU, Activation_Softmax},
+		{Activation_LeakyReLU, Activation_Softmax},
+		{Activation_Tanh, Activation_Softmax},
+	};
+
+	// NOTE: Every pair starts from the same seed, so they see the same
+	//	batches; the training run's random series is put back after.
+	random_series OldRandom = *DefaultRandom;
+
+	printf("Activation benchmark, %u hidden layer(s) of %u, batches of %u, to %.0f%% or %u epochs:\n",
+	       Network.LayerCount - 2, Network.Layers[1], BatchSize,
+	       ACTIVATION_BENCHMARK_TARGET, ACTIVATION_BENCHMARK_MAX_EPOCHS);
+	printf("  %-20s %10s %10s %12s %10s\n", "hidden/output", "s/epoch", "epochs", "s to target", "final %");
+
+	for(u32 PairIndex = 0;
+	    PairIndex < ArrayCount(Pairs);
+	    ++PairIndex)
+	{
+		temp_memory TempMem = PoolBeginTempMemory(Pool);
+
+		activation_function *Activations = PoolPushArray(Pool, activation_function, Network.LayerCount);
+		Activations[0] = Activation_Sigmoid;
+		for(u32 LayerIndex = 1;
+		    LayerIndex < Network.LayerCount;
+		    ++LayerIndex)
+		{
+			Activations[LayerIndex] = Pairs[PairIndex][LayerIndex == (Network.LayerCount - 1)];
+		}
+
+		*DefaultRandom = SeedRandom();
+		neural_network Candidate = CreateNetwork(Pool, Network.Layers, Network.LayerCount,
+		                                         CostFn_CrossEntropy, Activations, Network.Shapes);
+
+		r32 TrainingSeconds = 0.0f;
+		r32 TargetSeconds = 0.0f;
+		u32 TargetEpochs = 0;
+		u32 EpochCount = 0;
+		r32 SuccessRatePercent = 0.0f;
+		while((EpochCount < ACTIVATION_BENCHMARK_MAX_EPOCHS) && !TargetEpochs)
+		{
+			temp_memory EpochMem = PoolBeginTempMemory(Pool);
+			u64 Start = PlatformGetWallClock();
+			batch *Batches = CreateBatches(Pool, TrainingSet, BatchSize);
+			u32 BatchCount = (TrainingSet.DataCount / BatchSize);
+			for(u32 BatchIndex = 0;
+			    BatchIndex < BatchCount;
+			    ++BatchIndex)
+			{
+				GradientDescentBatch(Pool, Parallel, Candidate, Batches[BatchIndex].Input, Batches[BatchIndex].Output,
+				                     LearningRate, Regularization, TrainingSet.DataCount);
+			}
+			TrainingSeconds += PlatformGetSecondsElapsed(Start, PlatformGetWallClock());
+			PoolEndTempMemory(EpochMem);
+			++EpochCount;
+
+			SuccessRatePercent = EvaluateNetwork(Pool, Parallel, Candidate, TestSet);
+			if(SuccessRatePercent >= ACTIVATION_BENCHMARK_TARGET)
+			{
+				TargetEpochs = EpochCount;
+				TargetSeconds = TrainingSeconds;
+			}
+		}
+
+		char Name[32];
+		snprintf(Name, sizeof(Name), "%s/%s", ActivationNames[Pairs[PairIndex][0]], ActivationNames[Pairs[PairIndex][1]]);
+		if(TargetEpochs)
+		{
+			printf("  %-20s %10.2f %10u %12.2f %10.2f\n", Name, TrainingSeconds/EpochCount,
+			       TargetEpochs, TargetSeconds, SuccessRatePercent);
+		}
+		else
+		{
+			printf("  %-20s %10.2f %10s %12s %10.2f\n", Name, TrainingSeconds/EpochCount,
+			       "-", "-", SuccessRatePercent);
+		}
+
+		PoolEndTempMemory(TempMem);
+	}
+
+	*DefaultRandom = OldRandom;
+}
@@ -0,0 +1,241 @@
+#pragma once
+
+/*
+	NOTE: bf16 matrices for mixed precision training (see nn_mixed.cpp). A
+		bf16 is the top half of an r32: the same sign and exponent, so the
+		same range, with 8 bits of mantissa instead of 24. They are only
+		ever stored; every product widens them back to r32 as it loads them
+		and sums in r32.
+
+	The layout is the matrix one, column-major with the same padded
+		strides, at half the bytes.
+
+	All three products split the result's columns across the work queue,
+		so none of them needs a reduction: Mult and TransposeMult by the B
+		columns, MultTranspose, the weight gradient, by the B rows.
+*/
+
+struct matrix_bf16
+{
+	u32 RowCount;
+	u32 ColumnCount;
+	u32 Stride;
+	bf16 *Data;
+};
+
+inline bf16 *
+MatrixBF16ColumnData(matrix_bf16 A, u32 ColumnIndex)
+{
+	bf16 *Result = A.Data + (umm)ColumnIndex*A.Stride;
+	return Result;
+}
+
+inline matrix_bf16
+MatrixBF16RawAt(char *Site, memory_pool *Pool, u32 Rows, u32 Columns)
+{
+	matrix_bf16 Result = {};
+	Result.Stride = MatrixStrideFor(Rows);
+	Result.Data = PoolPushArrayAlignedAt(Site, Pool, bf16, (umm)Result.Stride*Columns);
+	Result.ColumnCount = Columns;
+	Result.RowCount = Rows;
+	return Result;
+}
+#define MatrixBF16Raw_(...) MatrixBF16RawAt(POOL_CALL_SITE, __VA_ARGS__)
+
+inline matrix_bf16
+MatrixBF16Columns(matrix_bf16 A, u32 FirstColumn, u32 ColumnCount)
+{
+	matrix_bf16 Result = A;
+	Result.Data = MatrixBF16ColumnData(A, FirstColumn);
+	Result.ColumnCount = ColumnCount;
+	return Result;
+}
+
+inline matrix_bf16
+MatrixBF16Rows(matrix_bf16 A, u32 FirstRow, u32 RowCount)
+{
+	matrix_bf16 Result = A;
+	Result.Data = A.Data + FirstRow;
+	Result.RowCount = RowCount;
+	return Result;
+}
+
+internal void
+ToBF16Into(matrix_bf16 Result, matrix A)
+{
+	TIMED_BLOCK("ToBF16", (u64)A.RowCount*A.ColumnCount*(sizeof(r32) + sizeof(bf16)), 0);
+
+	Assert((Result.RowCount == A.RowCount) && (Result.ColumnCount == A.ColumnCount));
+	for(u32 ColumnIndex = 0;
+	    ColumnIndex < A.ColumnCount;
+	    ++ColumnIndex)
+	{
+		GlobalMathKernels.ToBF16(MatrixBF16ColumnData(Result, ColumnIndex), MatrixColumnData(A, ColumnIndex), A.RowCount);
+	}
+}
+
+inline matrix_bf16
+ToBF16At(char *Site, memory_pool *Pool, matrix A)
+{
+	matrix_bf16 Result = MatrixBF16RawAt(Site, Pool, A.RowCount, A.ColumnCount);
+	ToBF16Into(Result, A);
+	return Result;
+}
+#define ToBF16(...) ToBF16At(POOL_CALL_SITE, __VA_ARGS__)
+
+internal void
+FromBF16Into(matrix Result, matrix_bf16 A)
+{
+	TIMED_BLOCK("FromBF16", (u64)A.RowCount*A.ColumnCount*(sizeof(r32) + sizeof(bf16)), 0);
+
+	Assert((Result.RowCount == A.RowCount) && (Result.ColumnCount == A.ColumnCount));
+	for(u32 ColumnIndex = 0;
+	    ColumnIndex < A.ColumnCount;
+	    ++ColumnIndex)
+	{
+		GlobalMathKernels.FromBF16(MatrixColumnData(Result, ColumnIndex), MatrixBF16ColumnData(A, ColumnIndex), A.RowCount);
+	}
+}
+
+inline matrix
+FromBF16At(char *Site, memory_pool *Pool, matrix_bf16 A)
+{
+	matrix Result = MatrixRawAt(Site, Pool, A.RowCount, A.ColumnCount);
+	FromBF16Into(Result, A);
+	return Result;
+}
+#define FromBF16(...) FromBF16At(POOL_CALL_SITE, __VA_ARGS__)
+
+internal void
+MultBF16Into(matrix Result, matrix_bf16 A, matrix_bf16 B)
+{
+	TIMED_BLOCK("MultBF16",
+	            ((u64)A.RowCount*A.ColumnCount + (u64)B.RowCount*B.ColumnCount)*sizeof(bf16) +
+	            (u64)A.RowCount*B.ColumnCount*sizeof(r32),
+	            2*(u64)A.RowCount*A.ColumnCount*B.ColumnCount);
+
+	Assert(A.ColumnCount == B.RowCount);
+	Assert((Result.RowCount == A.RowCount) && (Result.ColumnCount == B.ColumnCount));
+
+	GlobalMathKernels.GemmBF16(Result.Data, Result.Stride, A.Data, A.Stride,
+	                           B.Data, 1, B.Stride, A.RowCount, B.ColumnCount, A.ColumnCount);
+}
+
+internal void
+TransposeMultBF16Into(matrix Result, matrix_bf16 A, matrix_bf16 B)
+{
+	TIMED_BLOCK("TransposeMultBF16",
+	            ((u64)A.RowCount*A.ColumnCount + (u64)B.RowCount*B.ColumnCount)*sizeof(bf16) +
+	            (u64)A.ColumnCount*B.ColumnCount*sizeof(r32),
+	            2*(u64)A.ColumnCount*A.RowCount*B.ColumnCount);
+
+	Assert(A.RowCount == B.RowCount);
+	Assert((Result.RowCount == A.ColumnCount) && (Result.ColumnCount == B.ColumnCount));
+
+	for(u32 ColumnIndex = 0;
+	    ColumnIndex < Result.ColumnCount;
+	    ++ColumnIndex)
+	{
+		r32 *Dest = MatrixColumnData(Result, ColumnIndex);
+		bf16 *SourceB = MatrixBF16ColumnData(B, ColumnIndex);
+		for(u32 RowIndex = 0;
+		    RowIndex < Result.RowCount;
+		    ++RowIndex)
+		{
+			*Dest++ = GlobalMathKernels.DotBF16(MatrixBF16ColumnData(A, RowIndex), SourceB, A.RowCount);
+		}
+	}
+}
+
+internal void
+MultTransposeBF16Into(matrix Result, matrix_bf16 A, matrix_bf16 B)
+{
+	TIMED_BLOCK("MultTransposeBF16",
+	            ((u64)A.RowCount*A.ColumnCount + (u64)B.RowCount*B.ColumnCount)*sizeof(bf16) +
+	            (u64)A.RowCount*B.RowCount*sizeof(r32),
+	            2*(u64)A.RowCount*A.ColumnCount*B.RowCount);
+
+	Assert(A.ColumnCount == B.ColumnCount);
+	Assert((Result.RowCount == A.RowCount) && (Result.ColumnCount == B.RowCount));
+
+	GlobalMathKernels.GemmBF16(Result.Data, Result.Stride, A.Data, A.Stride,
+	                           B.Data, B.Stride, 1, A.RowCount, B.RowCount, A.ColumnCount);
+}
+
+enum bf16_product_kernel
+{
+	BF16ProductKernel_Mult,
+	BF16ProductKernel_TransposeMult,
+	BF16ProductKernel_MultTranspose,
+};
+
+struct bf16_product_work
+{
+	bf16_product_kernel Kernel;
+	matrix Result;
+	matrix_bf16 A;
+	matrix_bf16 B;
+};
+
+internal void
+DoBF16Product(bf16_product_work *Work)
+{
+	switch(Work->Kernel)
+	{
+		case BF16ProductKernel_Mult: {MultBF16Into(Work->Result, Work->A, Work->B);} break;
+		case BF16ProductKernel_TransposeMult: {TransposeMultBF16Into(Work->Result, Work->A, Work->B);} break;
+		case BF16ProductKernel_MultTranspose: {MultTransposeBF16Into(Work->Result, Work->A, Work->B);} break;
+
+		InvalidDefaultCase;
+	}
+}
+
+internal PLATFORM_WORK_QUEUE_CALLBACK(DoBF16ProductWork)
+{
+	TRACE_BLOCK("BF16 product columns");
+
+	bf16_product_work *Work = (bf16_product_work *)Data;
+	DoBF16Product(Work);
+}
+
+internal void
+ParallelBF16ProductInto(memory_pool *Pool, parallel_context *Parallel, bf16_product_kernel Kernel,
+                        matrix Result, matrix_bf16 A, matrix_bf16 B)
+{
+	u32 ColumnCount = Result.ColumnCount;
+
+	platform_work_queue *Queue = Parallel->Queue;
+	u32 WorkCount = Minimum(Queue->ThreadCount*Parallel->ColumnSplit, ColumnCount);
+	if(WorkCount <= 1)
+	{
+		bf16_product_work Work = {Kernel, Result, A, B};
+		DoBF16Product(&Work);
+	}
+	else
+	{
+		u32 WorkColumns = (ColumnCount + WorkCount - 1) / WorkCount;
+		WorkColumns = (WorkColumns + 3) & ~3;
+
+		for(u32 FirstColumn = 0;
+		    FirstColumn < ColumnCount;
+		    FirstColumn += WorkColumns)
+		{
+			u32 RangeColumns = Minimum(WorkColumns, ColumnCount - FirstColumn);
+
+			bf16_product_work *Work = PoolPushStruct(Pool, bf16_product_work);
+			Work->Kernel = Kernel;
+			Work->Result = MatrixColumns(Result, FirstColumn, RangeColumns);
+			Work->A = A;
+			if(Kernel == BF16ProductKernel_MultTranspose)
+			{
+				Work->B = MatrixBF16Rows(B, FirstColumn, RangeColumns);
+			}
+			else
+			{
+				Work->B = MatrixBF16Columns(B, FirstColumn, RangeColumns);
+			}
+			PlatformAddEntry(Queue, DoBF16ProductWork, Work);
+		}
+		PlatformCompleteAllWork(Queue);
+	}
+}
@@ -0,0 +1,450 @@
+
+/*
+	NOTE: Binary and ternary networks. -binary trains weights that are +-a
+		per unit, -ternary ones that are +-a or zero, and both default the
+		hidden layers to Sign, so they pass on +-1. Packed into bits (see
+		nn_binary.h), a hidden layer's products are XNOR and popcount on
+		64 weights at a time, and the network file holds a bit per weight,
+		two for ternary, instead of an r32.
+
+	Training keeps r32 latent weights. Every batch runs GradientDescentBatch's
+		forward and backward passes on the quantized weights, applies the
+		gradients to the latent ones as if they had been used instead, and
+		quantizes them again, clipping them to +-BINARY_LATENT_LIMIT on the
+		way (see QuantizeWeightsInto). That, and Sign's derivative through
+		(-1, 1), are the straight-through estimators. The quantized weights
+		sit in WeightMatrices as r32s, so everything else, testing,
+		checkpoints, other benchmarks, sees the network that gets exported.
+		Biases stay r32 throughout. Steps of the r32 default learning rate, 1,
+		throw the latent weights from limit to limit, so without
+		-learningrate binary and ternary training use
+		BINARY_DEFAULT_LEARNING_RATE.
+
+	The packed engine, PackedFeedForwardBatch:
+		- Layer 1 sees the data set's inputs, which aren't +-1, so it is
+			FeedForwardLayer's r32 product with the quantized weights, sparse
+			inputs and all. Its signs are packed.
+		- Every hidden layer after it is the XNOR product on the packed
+			signs, plus the bias, and packs its own signs for the next.
+		- The output layer is the same product, plus the bias, through the
+			output activation.
+		Sums of +-1 are exact integers, so the only difference from the r32
+		path is where the scale is rounded in; a weighted input within
+		rounding of zero can come out the other sign. -binarybench reports
+		how often that changes the answer.
+
+	The popcounts are CountDifferentBits: 64-bit POPCNT from SSE4.2 up, and
+		AVX512-VPOPCNTDQ's eight lanes at a time when the CPU has it (see
+		InitializeMathKernels).
+*/
+
+#define BINARY_DEFAULT_LEARNING_RATE 0.1f
+#define BINARY_BENCHMARK_REPEATS 5
+
+struct binary_network
+{
+	b32 Ternary;
+
+	// NOTE: What the updates go into; Network.WeightMatrices holds their
+	//	quantized copies.
+	matrix *LatentWeights;
+	packed_matrix *PackedWeights;
+};
+
+internal b32
+BinaryNetworkSupports(neural_network Network)
+{
+	b32 Result = (NetworkIsDense(Network) && !Network.Ranks && !Network.WeightMasks);
+	return Result;
+}
+
+internal b32
+PackedInferenceSupports(neural_network Network)
+{
+	// NOTE: Layer 1 is r32 and packs its signs for the next, so there has
+	//	to be a next.
+	b32 Result = (Network.PackedWeights && NetworkIsDense(Network) && (Network.LayerCount > 2));
+	for(u32 LayerIndex = 1;
+	    LayerIndex < (Network.LayerCount - 1);
+	    ++LayerIndex)
+	{
+		Result &= (LayerActivation(Network, LayerIndex) == Activation_Sign);
+	}
+	return Result;
+}
+
+// NOTE: Sign on every hidden layer, the output layer left as it was.
+internal activation_function *
+BinaryActivations(memory_pool *Pool, u32 LayerCount, activation_function OutputActivation)
+{
+	activation_function *Result = PoolPushArray(Pool, activation_function, LayerCount);
+	Result[0] = Activation_Sigmoid;
+	for(u32 LayerIndex = 1;
+	    LayerIndex < (LayerCount - 1);
+	    ++LayerIndex)
+	{
+		Result[LayerIndex] = Activation_Sign;
+	}
+	Result[LayerCount - 1] = OutputActivation;
+	return Result;
+}
+
+internal void
+QuantizeBinaryNetwork(memory_pool *Pool, binary_network *Binary, neural_network Network)
+{
+	for(u32 LayerIndex = 1;
+	    LayerIndex < Network.LayerCount;
+	    ++LayerIndex)
+	{
+		QuantizeWeightsInto(Pool, Network.WeightMatrices[LayerIndex], Binary->LatentWeights[LayerIndex],
+		                    Binary->Ternary);
+	}
+}
+
+// NOTE: Only inference and saving read the bits, so they are packed after
+//	every epoch rather than every batch.
+internal void
+PackBinaryNetwork(binary_network *Binary, neural_network Network)
+{
+	TRACE_BLOCK("Pack binary network");
+
+	for(u32 LayerIndex = 1;
+	    LayerIndex < Network.LayerCount;
+	    ++LayerIndex)
+	{
+		PackWeightsInto(Binary->PackedWeights[LayerIndex], Network.WeightMatrices[LayerIndex]);
+	}
+}
+
+internal binary_network *
+PushBinaryNetwork(memory_pool *Pool, neural_network *Network, b32 Ternary)
+{
+	Assert(BinaryNetworkSupports(*Network));
+
+	binary_network *Result = PoolPushStruct(Pool, binary_network);
+	Result->Ternary = Ternary;
+	Result->LatentWeights = PoolPushArray(Pool, matrix, Network->LayerCount);
+	Result->PackedWeights = PoolPushArray(Pool, packed_matrix, Network->LayerCount);
+	for(u32 LayerIndex = 1;
+	    LayerIndex < Network->LayerCount;
+	    ++LayerIndex)
+	{
+		matrix Source = Network->WeightMatrices[LayerIndex];
+		matrix Latent = MatrixRaw_(Pool, Source.RowCount, Source.ColumnCount);
+		for(u32 ColumnIndex = 0;
+		    ColumnIndex < Source.ColumnCount;
+		    ++ColumnIndex)
+		{
+			memcpy(MatrixColumnData(Latent, ColumnIndex), MatrixColumnData(Source, ColumnIndex),
+			       Source.RowCount*sizeof(r32));
+		}
+		Result->LatentWeights[LayerIndex] = Latent;
+		Result->PackedWeights[LayerIndex] = PushPackedMatrix(Pool, Source.RowCount, Source.ColumnCount, Ternary);
+	}
+
+	// NOTE: A loaded packed network's weights are quantized already, and
+	//	their scales summed again in r32 could round differently.
+	if(!Network->PackedWeights || (Network->PackedWeights[1].Ternary != Ternary))
+	{
+		QuantizeBinaryNetwork(Pool, Result, *Network);
+	}
+	PackBinaryNetwork(Result, *Network);
+	Network->PackedWeights = Result->PackedWeights;
+
+	return Result;
+}
+
+internal void
+BinaryGradientDescentBatch(memory_pool *Pool, parallel_context *Parallel, binary_network *Binary,
+                           neural_network Network, matrix Inputs, matrix Outputs,
+                           r32 LearningRate, r32 Regularization, u32 TotalTrials)
+{
+	TIMED_BLOCK("BinaryGradientDescentBatch", 0, 0);
+
+	temp_memory TempMem = PoolBeginTempMemory(Pool);
+
+	network_gradients Gradients = ComputeGradientsBatch(Pool, Parallel, Network, Inputs, Outputs);
+
+	neural_network Latent = Network;
+	Latent.WeightMatrices = Binary->LatentWeights;
+	ApplyGradients(Latent, Gradients, Inputs.ColumnCount, LearningRate, Regularization, TotalTrials);
+	QuantizeBinaryNetwork(Pool, Binary, Network);
+
+	PoolEndTempMemory(TempMem);
+}
+
+struct packed_feed_forward_work
+{
+	neural_network Network;
+	matrix FirstLayer;
+	matrix Output;
+
+	u64 *InputBits;
+	u64 *OutputBits;
+	r32 *Row;
+};
+
+internal void
+PackedFeedForwardColumns(packed_feed_forward_work *Work)
+{
+	neural_network Network = Work->Network;
+	u32 OutputLayer = Network.LayerCount - 1;
+
+	for(u32 ColumnIndex = 0;
+	    ColumnIndex < Work->FirstLayer.ColumnCount;
+	    ++ColumnIndex)
+	{
+		u64 *InputBits = Work->InputBits;
+		u64 *OutputBits = Work->OutputBits;
+		PackSignBits(InputBits, MatrixColumnData(Work->FirstLayer, ColumnIndex), Work->FirstLayer.RowCount);
+
+		for(u32 LayerIndex = 2;
+		    LayerIndex <= OutputLayer;
+		    ++LayerIndex)
+		{
+			vec Bias = Network.BiasVectors[LayerIndex];
+			r32 *Row = (LayerIndex == OutputLayer) ? MatrixColumnData(Work->Output, ColumnIndex) : Work->Row;
+			PackedMultVectorInto(Row, Network.PackedWeights[LayerIndex], InputBits);
+			for(u32 RowIndex = 0;
+			    RowIndex < Bias.Dimension;
+			    ++RowIndex)
+			{
+				Row[RowIndex] += Bias.Data[RowIndex];
+			}
+
+			if(LayerIndex < OutputLayer)
+			{
+				PackSignBits(OutputBits, Row, Bias.Dimension);
+
+				u64 *Swap = InputBits;
+				InputBits = OutputBits;
+				OutputBits = Swap;
+			}
+		}
+	}
+}
+
+internal PLATFORM_WORK_QUEUE_CALLBACK(DoPackedFeedForwardWork)
+{
+	TRACE_BLOCK("Packed forward columns");
+
+	packed_feed_forward_work *Work = (packed_feed_forward_work *)Data;
+	PackedFeedForwardColumns(Work);
+}
+
+internal packed_feed_forward_work *
+PushPackedFeedForwardWork(memory_pool *Pool, neural_network Network, matrix FirstLayer, matrix Output)
+{
+	u32 MaxLayerSize = 0;
+	for(u32 LayerIndex = 1;
+	    LayerIndex < Network.LayerCount;
+	    ++LayerIndex)
+	{
+		MaxLayerSize = Maximum(MaxLayerSize, Network.Layers[LayerIndex]);
+	}
+
+	packed_feed_forward_work *Result = PoolPushStruct(Pool, packed_feed_forward_work);
+	Result->Network = Network;
+	Result->FirstLayer = FirstLayer;
+	Result->Output = Output;
+	Result->InputBits = PoolPushArrayAligned(Pool, u64, PackedWordCount(MaxLayerSize));
+	Result->OutputBits = PoolPushArrayAligned(Pool, u64, PackedWordCount(MaxLayerSize));
+	Result->Row = PoolPushArrayAligned(Pool, r32, MaxLayerSize);
+	return Result;
+}
+
+// NOTE: The output layer's activations, from the packed weights.
+internal matrix
+PackedFeedForwardBatch(memory_pool *Pool, parallel_context *Parallel, neural_network Network, matrix Inputs)
+{
+	TIMED_BLOCK("PackedFeedForwardBatch", 0, 0);
+
+	Assert(PackedInferenceSupports(Network));
+	Assert(Inputs.RowCount == Network.Layers[0]);
+
+	sparse_matrix SparseInputs = {};
+	b32 HasSparseInputs = false;
+	if(Parallel->SparseInputDensity > 0.0f)
+	{
+		HasSparseInputs = MakeSparseMatrix(Pool, Inputs, Parallel->SparseInputDensity, &SparseInputs);
+	}
+	matrix FirstLayer;
+	matrix FirstActivation;
+	FeedForwardLayer(Pool, Parallel, Network, 1, Inputs, HasSparseInputs, SparseInputs, &FirstLayer, &FirstActivation);
+
+	u32 OutputLayer = Network.LayerCount - 1;
+	u32 ColumnCount = Inputs.ColumnCount;
+	matrix WeightedInput = MatrixRaw_(Pool, Network.Layers[OutputLayer], ColumnCount);
+
+	platform_work_queue *Queue = Parallel->Queue;
+	u32 WorkCount = Minimum(Queue->ThreadCount*Parallel->ColumnSplit, ColumnCount);
+	if(WorkCount <= 1)
+	{
+		PackedFeedForwardColumns(PushPackedFeedForwardWork(Pool, Network, FirstLayer, WeightedInput));
+	}
+	else
+	{
+		u32 WorkColumns = (ColumnCount + WorkCount - 1) / WorkCount;
+		WorkColumns = (WorkColumns + 3) & ~3;
+
+		for(u32 FirstColumn = 0;
+		    FirstColumn < ColumnCount;
+		    FirstColumn += WorkColumns)
+		{
+			u32 RangeColumns = Minimum(WorkColumns, ColumnCount - FirstColumn);
+			packed_feed_forward_work *Work =
+				PushPackedFeedForwardWork(Pool, Network, MatrixColumns(FirstLayer, FirstColumn, RangeColumns),
+				                          MatrixColumns(WeightedInput, FirstColumn, RangeColumns));
+			PlatformAddEntry(Queue, DoPackedFeedForwardWork, Work);
+		}
+		PlatformCompleteAllWork(Queue);
+	}
+
+	matrix Result = Activate(Pool, WeightedInput, LayerActivation(Network, OutputLayer));
+	return Result;
+}
+
+internal r32
+EvaluatePackedNetwork(memory_pool *Pool, parallel_context *Parallel, neural_network Network, data_set TestSet)
+{
+	temp_memory TempMem = PoolBeginTempMemory(Pool);
+
+	matrix Outputs = PackedFeedForwardBatch(Pool, Parallel, Network, TestSet.Inputs);
+	r32 SuccessRatePercent = ComputeSuccessRate(Outputs, TestSet.Outputs);
+
+	PoolEndTempMemory(TempMem);
+	return SuccessRatePercent;
+}
+
+internal r32
+TimePackedInference(memory_pool *Pool, parallel_context *Parallel, neural_network Network, data_set TestSet)
+{
+	r32 Best = 1e30f;
+	for(u32 Repeat = 0;
+	    Repeat < BINARY_BENCHMARK_REPEATS;
+	    ++Repeat)
+	{
+		temp_memory TempMem = PoolBeginTempMemory(Pool);
+		u64 Start = PlatformGetWallClock();
+		PackedFeedForwardBatch(Pool, Parallel, Network, TestSet.Inputs);
+		r32 Seconds = PlatformGetSecondsElapsed(Start, PlatformGetWallClock());
+		if(Seconds < Best)
+		{
+			Best = Seconds;
+		}
+		PoolEndTempMemory(TempMem);
+	}
+	return Best;
+}
+
+internal void
+ReportPackedKernel(memory_pool *Pool, parallel_context *Parallel, neural_network Network, data_set TestSet,
+                   matrix Answers, char *KernelName, r32 ReferenceSeconds)
+{
+	temp_memory TempMem = PoolBeginTempMemory(Pool);
+
+	r32 Seconds = TimePackedInference(Pool, Parallel, Network, TestSet);
+	matrix Outputs = PackedFeedForwardBatch(Pool, Parallel, Network, TestSet.Inputs);
+	printf("  XNOR, %-16s %7.2f%% %9.2fms %7.2fx   %.2f%% agree with r32\n", KernelName,
+	       ComputeSuccessRate(Outputs, TestSet.Outputs), 1000.0f*Seconds, ReferenceSeconds/Seconds,
+	       ComputeSuccessRate(Outputs, Answers));
+
+	PoolEndTempMemory(TempMem);
+}
+
+// NOTE: Trains an r32 sigmoid network of the same size, with the same output
+//	layer, for as many epochs, and compares the two on the test set.
+internal void
+BenchmarkBinaryNetwork(memory_pool *Pool, parallel_context *Parallel, neural_network Network,
+                       data_set TrainingSet, data_set TestSet, u32 BatchSize, r32 LearningRate,
+                       r32 Regularization, u32 EpochCount)
+{
+	TRACE_BLOCK("Binary network benchmark");
+
+	if(!PackedInferenceSupports(Network))
+	{
+		printf("-binarybench needs a -binary or -ternary network with sign hidden layers; skipping it\n");
+		return;
+	}
+
+	temp_memory TempMem = PoolBeginTempMemory(Pool);
+
+	u32 OutputLayer = Network.LayerCount - 1;
+	activation_function *Activations = PoolPushArray(Pool, activation_function, Network.LayerCount);
+	for(u32 LayerIndex = 0;
+	    LayerIndex < OutputLayer;
+	    ++LayerIndex)
+	{
+		Activations[LayerIndex] = Activation_Sigmoid;
+	}
+	Activations[OutputLayer] = LayerActivation(Network, OutputLayer);
+	neural_network Reference = CreateNetwork(Pool, Network.Layers, Network.LayerCount, Network.CostFn, Activations);
+
+	u32 ReferenceEpochs = Maximum(EpochCount, 1);
+	u32 BatchCount = TrainingSet.DataCount / BatchSize;
+	for(u32 EpochIndex = 0;
+	    EpochIndex < ReferenceEpochs;
+	    ++EpochIndex)
+	{
+		temp_memory EpochMem = PoolBeginTempMemory(Pool);
+		batch *Batches = CreateBatches(Pool, TrainingSet, BatchSize);
+		for(u32 BatchIndex = 0;
+		    BatchIndex < BatchCount;
+		    ++BatchIndex)
+		{
+			GradientDescentBatch(Pool, Parallel, Reference, Batches[BatchIndex].Input, Batches[BatchIndex].Output,
+			                     LearningRate, Regularization, TrainingSet.DataCount);
+		}
+		PoolEndTempMemory(EpochMem);
+	}
+
+	b32 Ternary = Network.PackedWeights[1].Ternary;
+	r32 ReferenceSeconds = TimeInference(Pool, Parallel, Reference, TestSet);
+	r32 QuantizedSeconds = TimeInference(Pool, Parallel, Network, TestSet);
+
+	printf("Binary network benchmark, %s weights, %u test trials, %u thread(s), reference trained for %u epoch(s):\n",
+	       Ternary ? "ternary" : "binary", TestSet.DataCount, Parallel->Queue->ThreadCount, ReferenceEpochs);
+	printf("  %-22s %8s %11s %8s\n", "", "success", "inference", "speedup");
+	printf("  %-22s %7.2f%% %9.2fms %7.2fx\n", "r32 sigmoid reference",
+	       EvaluateNetwork(Pool, Parallel, Reference, TestSet), 1000.0f*ReferenceSeconds, 1.0f);
+	printf("  %-22s %7.2f%% %9.2fms %7.2fx\n", Ternary ? "ternary, r32 products" : "binary, r32 products",
+	       EvaluateNetwork(Pool, Parallel, Network, TestSet), 1000.0f*QuantizedSeconds,
+	       ReferenceSeconds/QuantizedSeconds);
+
+	// NOTE: Agreement is with the same weights through the r32 products.
+	feed_forward_batch_result FeedForward = FeedForwardBatch(Pool, Parallel, Network, TestSet.Inputs);
+	matrix Answers = FeedForward.Activations[OutputLayer];
+
+	math_count_different_bits_kernel *CountDifferentBits = GlobalMathKernels.CountDifferentBits;
+	if(GlobalMathKernels.Level == CpuLevel_Scalar)
+	{
+		ReportPackedKernel(Pool, Parallel, Network, TestSet, Answers, "scalar popcount", ReferenceSeconds);
+	}
+	else
+	{
+		GlobalMathKernels.CountDifferentBits = CountDifferentBits_POPCNT;
+		ReportPackedKernel(Pool, Parallel, Network, TestSet, Answers, "64-bit POPCNT", ReferenceSeconds);
+		if(GlobalMathKernels.HardwareVPOPCNT)
+		{
+			GlobalMathKernels.CountDifferentBits = CountDifferentBits_AVX512VPOPCNT;
+			ReportPackedKernel(Pool, Parallel, Network, TestSet, Answers, "AVX512-VPOPCNTDQ", ReferenceSeconds);
+		}
+	}
+	GlobalMathKernels.CountDifferentBits = CountDifferentBits;
+
+	u32 DenseBytes = NetworkGetTotalFileSize(Reference);
+	u32 PackedBytes = NetworkGetTotalFileSize(Network, NetworkFormat_Packed);
+	printf("  saved: %.1fKB packed instead of %.1fKB dense (%.1fx smaller)\n", (r32)PackedBytes/1024.0f,
+	       (r32)DenseBytes/1024.0f, (r32)DenseBytes/(r32)PackedBytes);
+
+	PoolEndTempMemory(TempMem);
+}
+
+internal void
+TestPackedNetwork(memory_pool *Pool, parallel_context *Parallel, neural_network Network, data_set TestSet)
+{
+	if(PackedInferenceSupports(Network))
+	{
+		printf("Packed inference success rate: %3.2f%%\n", EvaluatePackedNetwork(Pool, Parallel, Network, TestSet));
+	}
+}
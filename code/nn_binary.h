@@ -0,0 +1,290 @@
+#pragma once
+
+/*
+	NOTE: Bit-packed binary and ternary weight matrices (see nn_binary.cpp).
+		Each row is one unit's weights, WordCount 64-bit words of them, with
+		weight j in bit j%64 of word j/64. Signs has a bit set where the
+		weight is positive. Ternary matrices also have Masks, set where the
+		weight isn't zero; binary ones have none, so every weight is
+		+-Scales[Row]. Bits past ColumnCount are zero in both.
+
+	Inputs of +-1 pack the same way, +1 as a set bit. A row's dot with them
+		is then ColumnCount - 2*(the bits that differ), or for a ternary row
+		NonZeroCounts[Row] - 2*(the bits that differ under its mask), and
+		Scales[Row] times that is the weighted sum the r32 weights give, up
+		to rounding.
+*/
+
+struct packed_matrix
+{
+	u32 RowCount;
+	u32 ColumnCount;
+	u32 WordCount;
+	b32 Ternary;
+
+	r32 *Scales;
+	u64 *Signs;
+	u64 *Masks;
+
+	// NOTE: Not saved; LoadNetwork counts them from the masks.
+	u32 *NonZeroCounts;
+};
+
+inline u32
+PackedWordCount(u32 BitCount)
+{
+	u32 Result = (BitCount + 63) / 64;
+	return Result;
+}
+
+inline packed_matrix
+PushPackedMatrix(memory_pool *Pool, u32 Rows, u32 Columns, b32 Ternary)
+{
+	packed_matrix Result = {};
+	Result.RowCount = Rows;
+	Result.ColumnCount = Columns;
+	Result.WordCount = PackedWordCount(Columns);
+	Result.Ternary = Ternary;
+	Result.Scales = PoolPushArray(Pool, r32, Rows);
+	Result.Signs = PoolPushArrayAligned(Pool, u64, (umm)Rows*Result.WordCount);
+	if(Ternary)
+	{
+		Result.Masks = PoolPushArrayAligned(Pool, u64, (umm)Rows*Result.WordCount);
+		Result.NonZeroCounts = PoolPushArray(Pool, u32, Rows);
+	}
+	return Result;
+}
+
+internal void
+CountPackedNonZeros(packed_matrix A)
+{
+	if(A.Ternary)
+	{
+		for(u32 RowIndex = 0;
+		    RowIndex < A.RowCount;
+		    ++RowIndex)
+		{
+			u64 *Mask = A.Masks + (umm)RowIndex*A.WordCount;
+			u32 Count = 0;
+			for(u32 WordIndex = 0;
+			    WordIndex < A.WordCount;
+			    ++WordIndex)
+			{
+				Count += CountSetBits64(Mask[WordIndex]);
+			}
+			A.NonZeroCounts[RowIndex] = Count;
+		}
+	}
+}
+
+#define BINARY_LATENT_LIMIT 1.0f
+
+// NOTE: Each row gets one scale, the mean magnitude of the weights it keeps,
+//	as in XNOR-Net. Ternary rows first zero the weights under 0.7 of the
+//	row's mean magnitude, as in ternary weight networks. A weight of exactly
+//	zero counts as negative, the same as Sign. The first pass also clips the
+//	latent weights to +-BINARY_LATENT_LIMIT, so they stay near enough to
+//	zero to flip.
+internal void
+QuantizeWeightsInto(memory_pool *Pool, matrix Result, matrix Latent, b32 Ternary)
+{
+	TIMED_BLOCK("QuantizeWeights", (Ternary ? 5 : 4)*(u64)Latent.RowCount*Latent.ColumnCount*sizeof(r32), 0);
+
+	Assert((Result.RowCount == Latent.RowCount) && (Result.ColumnCount == Latent.ColumnCount));
+
+	temp_memory TempMem = PoolBeginTempMemory(Pool);
+
+	u32 RowCount = Latent.RowCount;
+	r32 *Thresholds = PoolPushArray(Pool, r32, RowCount);
+	r32 *Sums = PoolPushArray(Pool, r32, RowCount);
+	r32 *Counts = PoolPushArray(Pool, r32, RowCount);
+	for(u32 RowIndex = 0;
+	    RowIndex < RowCount;
+	    ++RowIndex)
+	{
+		Sums[RowIndex] = 0.0f;
+		Counts[RowIndex] = 0.0f;
+	}
+
+	for(u32 ColumnIndex = 0;
+	    ColumnIndex < Latent.ColumnCount;
+	    ++ColumnIndex)
+	{
+		GlobalMathKernels.ClipAbsSum(MatrixColumnData(Latent, ColumnIndex), Sums, BINARY_LATENT_LIMIT, RowCount);
+	}
+
+	if(Ternary)
+	{
+		r32 ThresholdScale = 0.7f / (r32)Latent.ColumnCount;
+		for(u32 RowIndex = 0;
+		    RowIndex < RowCount;
+		    ++RowIndex)
+		{
+			Thresholds[RowIndex] = ThresholdScale*Sums[RowIndex];
+			Sums[RowIndex] = 0.0f;
+		}
+
+		for(u32 ColumnIndex = 0;
+		    ColumnIndex < Latent.ColumnCount;
+		    ++ColumnIndex)
+		{
+			GlobalMathKernels.KeptAbsSum(Sums, Counts, MatrixColumnData(Latent, ColumnIndex), Thresholds, RowCount);
+		}
+
+		for(u32 RowIndex = 0;
+		    RowIndex < RowCount;
+		    ++RowIndex)
+		{
+			Sums[RowIndex] = (Counts[RowIndex] > 0.0f) ? (Sums[RowIndex] / Counts[RowIndex]) : 0.0f;
+		}
+	}
+	else
+	{
+		for(u32 RowIndex = 0;
+		    RowIndex < RowCount;
+		    ++RowIndex)
+		{
+			Thresholds[RowIndex] = -1.0f;
+			Sums[RowIndex] /= (r32)Latent.ColumnCount;
+		}
+	}
+
+	for(u32 ColumnIndex = 0;
+	    ColumnIndex < Latent.ColumnCount;
+	    ++ColumnIndex)
+	{
+		GlobalMathKernels.Quantize(MatrixColumnData(Result, ColumnIndex), MatrixColumnData(Latent, ColumnIndex),
+		                           Sums, Thresholds, RowCount);
+	}
+
+	PoolEndTempMemory(TempMem);
+}
+
+// NOTE: Weights already quantized to +-scale, or zero for ternary, per row.
+internal void
+PackWeightsInto(packed_matrix Result, matrix Quantized)
+{
+	TIMED_BLOCK("PackWeights", 0, 0);
+
+	Assert((Result.RowCount == Quantized.RowCount) && (Result.ColumnCount == Quantized.ColumnCount));
+
+	umm WordTotal = (umm)Result.RowCount*Result.WordCount;
+	memset(Result.Signs, 0, WordTotal*sizeof(u64));
+	if(Result.Ternary)
+	{
+		memset(Result.Masks, 0, WordTotal*sizeof(u64));
+	}
+	for(u32 RowIndex = 0;
+	    RowIndex < Result.RowCount;
+	    ++RowIndex)
+	{
+		Result.Scales[RowIndex] = 0.0f;
+	}
+
+	for(u32 ColumnIndex = 0;
+	    ColumnIndex < Quantized.ColumnCount;
+	    ++ColumnIndex)
+	{
+		r32 *Source = MatrixColumnData(Quantized, ColumnIndex);
+		u32 WordIndex = ColumnIndex / 64;
+		u64 Bit = (u64)1 << (ColumnIndex % 64);
+		for(u32 RowIndex = 0;
+		    RowIndex < Result.RowCount;
+		    ++RowIndex)
+		{
+			r32 Value = Source[RowIndex];
+			umm Word = (umm)RowIndex*Result.WordCount + WordIndex;
+			if(Value > 0.0f)
+			{
+				Result.Signs[Word] |= Bit;
+			}
+			if(Value != 0.0f)
+			{
+				if(Result.Ternary)
+				{
+					Result.Masks[Word] |= Bit;
+				}
+				Result.Scales[RowIndex] = AbsoluteValue(Value);
+			}
+		}
+	}
+
+	CountPackedNonZeros(Result);
+}
+
+internal matrix
+UnpackWeights(memory_pool *Pool, packed_matrix A)
+{
+	matrix Result = MatrixRaw_(Pool, A.RowCount, A.ColumnCount);
+	for(u32 ColumnIndex = 0;
+	    ColumnIndex < A.ColumnCount;
+	    ++ColumnIndex)
+	{
+		r32 *Dest = MatrixColumnData(Result, ColumnIndex);
+		u32 WordIndex = ColumnIndex / 64;
+		u64 Bit = (u64)1 << (ColumnIndex % 64);
+		for(u32 RowIndex = 0;
+		    RowIndex < A.RowCount;
+		    ++RowIndex)
+		{
+			umm Word = (umm)RowIndex*A.WordCount + WordIndex;
+			r32 Scale = A.Scales[RowIndex];
+			if(A.Ternary && !(A.Masks[Word] & Bit))
+			{
+				Dest[RowIndex] = 0.0f;
+			}
+			else
+			{
+				Dest[RowIndex] = (A.Signs[Word] & Bit) ? Scale : -Scale;
+			}
+		}
+	}
+	return Result;
+}
+
+// NOTE: A set bit wherever Source is positive, which is where Sign gives +1.
+internal void
+PackSignBits(u64 *Dest, r32 *Source, u32 Count)
+{
+	u32 WordCount = PackedWordCount(Count);
+	for(u32 WordIndex = 0;
+	    WordIndex < WordCount;
+	    ++WordIndex)
+	{
+		u32 First = WordIndex*64;
+		u32 BitCount = Minimum(64, Count - First);
+		u64 Word = 0;
+		for(u32 BitIndex = 0;
+		    BitIndex < BitCount;
+		    ++BitIndex)
+		{
+			Word |= (u64)(Source[First + BitIndex] > 0.0f) << BitIndex;
+		}
+		Dest[WordIndex] = Word;
+	}
+}
+
+// NOTE: Result = A*Input for one packed column of +-1 inputs.
+internal void
+PackedMultVectorInto(r32 *Result, packed_matrix A, u64 *Input)
+{
+	for(u32 RowIndex = 0;
+	    RowIndex < A.RowCount;
+	    ++RowIndex)
+	{
+		umm FirstWord = (umm)RowIndex*A.WordCount;
+		s32 Dot;
+		if(A.Ternary)
+		{
+			u32 Different = GlobalMathKernels.CountDifferentBits(A.Signs + FirstWord, Input, A.Masks + FirstWord,
+			                                                     A.WordCount);
+			Dot = (s32)A.NonZeroCounts[RowIndex] - 2*(s32)Different;
+		}
+		else
+		{
+			u32 Different = GlobalMathKernels.CountDifferentBits(A.Signs + FirstWord, Input, 0, A.WordCount);
+			Dot = (s32)A.ColumnCount - 2*(s32)Different;
+		}
+		Result[RowIndex] = A.Scales[RowIndex]*(r32)Dot;
+	}
+}
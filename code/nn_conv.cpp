@@ -0,0 +1,299 @@
+
+/*
+	NOTE: Convolutional networks. -conv lists the image layers that go
+		between the input image and the dense hidden layers, comma separated:
+		CxK is a convolution to C channels with KxK filters, poolK a KxK max
+		pool. -hiddenlayers and -hiddenlayer still give the dense layers after
+		them, and -hiddenlayers 0 goes straight to the output.
+
+		-conv 8x5,pool2
+		-conv 8x5,pool2,16x5,pool2 -hiddenlayers 0
+
+	The layers themselves are in nn_conv.h. -convbench times each image layer
+		of the network on one real batch: both forward paths of every
+		convolution, whichever one training uses, and the backward steps.
+*/
+
+#define CONVOLUTION_BENCHMARK_REPEATS 5
+#define CONVOLUTION_BENCHMARK_ITERATIONS 10
+
+// NOTE: Returns the shapes, with the layer sizes in *Layers, or 0 if the spec
+//	doesn't fit the images.
+internal layer_shape *
+BuildConvolutionLayers(memory_pool *Pool, char *Spec, u32 ImageWidth, u32 ImageHeight,
+                       u32 HiddenLayerCount, u32 HiddenLayerNeurons, u32 OutputCount,
+                       u32 **Layers, u32 *LayerCount)
+{
+	u32 ImageLayerCount = 1;
+	for(char *Scan = Spec;
+	    *Scan;
+	    ++Scan)
+	{
+		ImageLayerCount += (*Scan == ',');
+	}
+
+	*LayerCount = 1 + ImageLayerCount + HiddenLayerCount + 1;
+	*Layers = PoolPushArray(Pool, u32, *LayerCount);
+	layer_shape *Result = PoolPushArray(Pool, layer_shape, *LayerCount);
+
+	layer_shape Shape = {};
+	Shape.Type = LayerType_Dense;
+	Shape.Width = ImageWidth;
+	Shape.Height = ImageHeight;
+	Shape.Channels = 1;
+	Result[0] = Shape;
+
+	char *Token = Spec;
+	for(u32 LayerIndex = 1;
+	    LayerIndex <= ImageLayerCount;
+	    ++LayerIndex)
+	{
+		layer_shape Input = Shape;
+		char *End = Token;
+		if(strncmp(Token, "pool", 4) == 0)
+		{
+			Shape.Type = LayerType_MaxPool;
+			Shape.KernelSize = (u32)strtoul(Token + 4, &End, 10);
+			if(Shape.KernelSize)
+			{
+				Shape.Width = Input.Width / Shape.KernelSize;
+				Shape.Height = Input.Height / Shape.KernelSize;
+			}
+		}
+		else
+		{
+			Shape.Type = LayerType_Convolution;
+			Shape.Channels = (u32)strtoul(Token, &End, 10);
+			Shape.KernelSize = 0;
+			if(*End == 'x')
+			{
+				Shape.KernelSize = (u32)strtoul(End + 1, &End, 10);
+			}
+			if(Shape.KernelSize && (Shape.KernelSize <= Input.Width) && (Shape.KernelSize <= Input.Height))
+			{
+				Shape.Width = Input.Width - Shape.KernelSize + 1;
+				Shape.Height = Input.Height - Shape.KernelSize + 1;
+			}
+			else
+			{
+				Shape.KernelSize = 0;
+			}
+		}
+
+		if(((*End != ',') && (*End != 0)) || !Shape.KernelSize || !Shape.Channels ||
+		   !Shape.Width || !Shape.Height)
+		{
+			fprintf(stderr, "-conv %s: layer %u doesn't fit a %ux%ux%u image; "
+			        "layers are CxK convolutions or poolK pools\n",
+			        Spec, LayerIndex, Input.Width, Input.Height, Input.Channels);
+			return 0;
+		}
+
+		Result[LayerIndex] = Shape;
+		(*Layers)[LayerIndex] = ImagePixelCount(Shape)*Shape.Channels;
+		Token = End + 1;
+	}
+
+	(*Layers)[0] = ImageWidth*ImageHeight;
+	for(u32 LayerIndex = ImageLayerCount + 1;
+	    LayerIndex < *LayerCount;
+	    ++LayerIndex)
+	{
+		u32 LayerSize = (LayerIndex == (*LayerCount - 1)) ? OutputCount : HiddenLayerNeurons;
+
+		layer_shape Dense = {};
+		Dense.Type = LayerType_Dense;
+		Dense.Width = LayerSize;
+		Dense.Height = 1;
+		Dense.Channels = 1;
+		Result[LayerIndex] = Dense;
+		(*Layers)[LayerIndex] = LayerSize;
+	}
+
+	return Result;
+}
+
+internal void
+PrintConvolutionNetwork(neural_network Network)
+{
+	u64 TotalFlops = 0;
+	printf("Layers:\n");
+	for(u32 LayerIndex = 0;
+	    LayerIndex < Network.LayerCount;
+	    ++LayerIndex)
+	{
+		layer_shape Shape = Network.Shapes[LayerIndex];
+		u64 Flops = LayerIndex ? LayerFlopsPerInput(Network, LayerIndex) : 0;
+		TotalFlops += Flops;
+
+		char Kind[32];
+		if(LayerIndex == 0)
+		{
+			snprintf(Kind, sizeof(Kind), "input");
+		}
+		else if(Shape.Type == LayerType_Dense)
+		{
+			snprintf(Kind, sizeof(Kind), "dense");
+		}
+		else
+		{
+			snprintf(Kind, sizeof(Kind), "%s %ux%u", LayerTypeNames[Shape.Type], Shape.KernelSize, Shape.KernelSize);
+		}
+		printf("  %u: %-12s %4u x %4u x %4u %10.3f MFLOP/image\n", LayerIndex, Kind,
+		       Shape.Width, Shape.Height, Shape.Channels, 1e-6*(r64)Flops);
+	}
+	printf("  %.3f MFLOP per image forward\n", 1e-6*(r64)TotalFlops);
+}
+
+internal void
+BenchmarkConvolutionLayers(memory_pool *Pool, parallel_context *Parallel, neural_network Network,
+                           data_set TrainingSet, u32 BatchSize)
+{
+	TRACE_BLOCK("Convolution benchmark");
+
+	if(NetworkIsDense(Network))
+	{
+		printf("The network has no convolution or pooling layers to benchmark\n");
+		return;
+	}
+
+	temp_memory TempMem = PoolBeginTempMemory(Pool);
+
+	matrix Inputs = MatrixColumns(TrainingSet.Inputs, 0, BatchSize);
+	feed_forward_batch_result FeedForward = FeedForwardBatch(Pool, Parallel, Network, Inputs);
+
+	printf("Image layer benchmark, batches of %u, %u thread(s), us per batch:\n",
+	       BatchSize, Parallel->Queue->ThreadCount);
+	printf("  %-18s %10s %10s %8s %8s %10s %10s %9s\n", "", "im2col", "direct", "speedup", "differ",
+	       "gradient", "error", "GFLOP/s");
+
+	for(u32 LayerIndex = 1;
+	    LayerIndex < Network.LayerCount;
+	    ++LayerIndex)
+	{
+		layer_type Type = LayerType(Network, LayerIndex);
+		if(Type == LayerType_Dense)
+		{
+			continue;
+		}
+
+		layer_shape InputShape = Network.Shapes[LayerIndex - 1];
+		layer_shape Shape = Network.Shapes[LayerIndex];
+		matrix Input = FeedForward.Activations[LayerIndex - 1];
+		matrix Weights = Network.WeightMatrices[LayerIndex];
+		matrix Error = FeedForward.Activations[LayerIndex];
+		matrix InputError = MatrixRaw_(Pool, Network.Layers[LayerIndex - 1], BatchSize);
+
+		char Name[32];
+		snprintf(Name, sizeof(Name), "%u: %s %ux%u", LayerIndex, LayerTypeNames[Type],
+		         Shape.KernelSize, Shape.KernelSize);
+
+		// NOTE: Four timings per layer: forward both ways, then the weight
+		//	gradient and the error going back. Pools only have a forward and
+		//	an error.
+		r32 Seconds[4] = {1e30f, 1e30f, 1e30f, 1e30f};
+		for(u32 Repeat = 0;
+		    Repeat < CONVOLUTION_BENCHMARK_REPEATS;
+		    ++Repeat)
+		{
+			for(u32 Timing = 0;
+			    Timing < ArrayCount(Seconds);
+			    ++Timing)
+			{
+				if((Type == LayerType_MaxPool) && ((Timing == 1) || (Timing == 2)))
+				{
+					continue;
+				}
+
+				u64 Start = PlatformGetWallClock();
+				for(u32 Iteration = 0;
+				    Iteration < CONVOLUTION_BENCHMARK_ITERATIONS;
+				    ++Iteration)
+				{
+					temp_memory IterationMem = PoolBeginTempMemory(Pool);
+					if(Type == LayerType_MaxPool)
+					{
+						if(Timing == 0)
+						{
+							MaxPoolInto(MatrixRaw_(Pool, Network.Layers[LayerIndex], BatchSize), Input, InputShape, Shape);
+						}
+						else
+						{
+							MaxPoolErrorInto(InputError, Error, Input, InputShape, Shape);
+						}
+					}
+					else
+					{
+						switch(Timing)
+						{
+							case 0:
+							{
+								matrix Result = MatrixPacked_(Pool, Network.Layers[LayerIndex], BatchSize);
+								ConvolveIm2ColInto(Pool, Parallel, Result, Weights, Input, InputShape, Shape);
+							} break;
+
+							case 1:
+							{
+								matrix Result = MatrixPacked_(Pool, Network.Layers[LayerIndex], BatchSize);
+								ConvolveDirectInto(Pool, Parallel, Result, Weights, Input, InputShape, Shape);
+							} break;
+
+							case 2:
+							{
+								matrix WeightGradient = MatrixRaw_(Pool, Weights.RowCount, Weights.ColumnCount);
+								vec BiasGradient = VecRaw_(Pool, Weights.RowCount);
+								ConvolutionGradientsInto(Pool, Parallel, WeightGradient, BiasGradient, Error, Input,
+								                         InputShape, Shape, false);
+							} break;
+
+							case 3:
+							{
+								ConvolutionErrorInto(Pool, Parallel, InputError, Weights, Error, InputShape, Shape);
+							} break;
+
+							InvalidDefaultCase;
+						}
+					}
+					PoolEndTempMemory(IterationMem);
+				}
+				r32 Elapsed = PlatformGetSecondsElapsed(Start, PlatformGetWallClock()) / CONVOLUTION_BENCHMARK_ITERATIONS;
+				if(Elapsed < Seconds[Timing])
+				{
+					Seconds[Timing] = Elapsed;
+				}
+			}
+		}
+
+		if(Type == LayerType_MaxPool)
+		{
+			printf("  %-18s %10.2f %10s %8s %8s %10s %10.2f %9s\n", Name, 1e6f*Seconds[0], "-", "-", "-", "-",
+			       1e6f*Seconds[3], "-");
+		}
+		else
+		{
+			matrix Im2ColResult = MatrixPacked_(Pool, Network.Layers[LayerIndex], BatchSize);
+			matrix DirectResult = MatrixPacked_(Pool, Network.Layers[LayerIndex], BatchSize);
+			ConvolveIm2ColInto(Pool, Parallel, Im2ColResult, Weights, Input, InputShape, Shape);
+			ConvolveDirectInto(Pool, Parallel, DirectResult, Weights, Input, InputShape, Shape);
+
+			u32 DifferentCount = 0;
+			r32 MaxDifference = 0.0f;
+			CompareMatrices(Im2ColResult, DirectResult, &DifferentCount, &MaxDifference);
+
+			// NOTE: The GFLOP/s of the forward path training uses.
+			b32 Direct = ConvolutionIsDirect(InputShape, Shape);
+			r64 Flops = (r64)LayerFlopsPerInput(Network, LayerIndex)*BatchSize;
+			r32 ForwardSeconds = Direct ? Seconds[1] : Seconds[0];
+
+			char Differences[16];
+			snprintf(Differences, sizeof(Differences), "%u", DifferentCount);
+			printf("  %-18s %9.2f%s %9.2f%s %7.2fx %8s %10.2f %10.2f %9.2f\n", Name,
+			       1e6f*Seconds[0], Direct ? " " : "*", 1e6f*Seconds[1], Direct ? "*" : " ",
+			       Seconds[0]/Seconds[1], Differences, 1e6f*Seconds[2], 1e6f*Seconds[3],
+			       1e-9*Flops/ForwardSeconds);
+		}
+	}
+	printf("  * the forward path training uses\n");
+
+	PoolEndTempMemory(TempMem);
+}
@@ -0,0 +1,509 @@
+#pragma once
+
+/*
+	NOTE: Convolution and max pooling layers. Images go through the batch
+		matrices like everything else, one column per trial, each column an
+		image with its channels last: value (X, Y, Channel) is at
+		(Y*Width + X)*Channels + Channel. MNIST's one channel images already
+		are.
+
+	Convolutions are valid and stride one. The weights are OutputChannels x
+		KernelSize*KernelSize*InputChannels, a filter per row with the taps in
+		(KY, KX, InputChannel) order, and there is a bias per output channel.
+		With the channels last, a packed batch of N output images is the same
+		memory as an OutputChannels x N*Width*Height matrix with a column per
+		pixel, which is exactly the product of the weights with the im2col
+		matrix, a column per pixel holding its window. So the GEMM writes
+		straight into the layer's output, and the bias is a column vector added
+		to every pixel. Matrices viewed this way have to be packed, with
+		Stride == RowCount.
+
+	The im2col matrix is built a slice of images at a time, about
+		CONVOLUTION_IM2COL_FLOATS, so it stays in cache and the test set never
+		needs all of it at once. Filters of at most CONVOLUTION_DIRECT_MAX_TAPS
+		weights, where im2col costs about as much as the product, skip it:
+		the direct kernel reads each window straight out of the image with the
+		GEMM's arithmetic, so both paths give the same bits at every level.
+
+	Backprop always goes through im2col. The weight gradient is the error
+		times the im2col matrix transposed, and the error going back is the
+		filters transposed times the error, added back into the images by
+		col2im.
+
+	Max pooling takes non-overlapping KernelSize windows and has no weights
+		and no activation function. Each window's error goes back to the first
+		of its inputs holding the maximum.
+*/
+
+enum layer_type
+{
+	LayerType_Dense,
+	LayerType_Convolution,
+	LayerType_MaxPool,
+
+	LayerType_Count,
+};
+
+global_variable char *LayerTypeNames[LayerType_Count] =
+{
+	"dense",
+	"conv",
+	"maxpool",
+};
+
+// NOTE: The image a layer outputs. Dense layers are Width x 1 x 1, except the
+//	input layer, which is the image the first convolution reads.
+struct layer_shape
+{
+	layer_type Type;
+	u32 Width;
+	u32 Height;
+	u32 Channels;
+
+	// NOTE: The filter's size for a convolution, the window's for a pool.
+	u32 KernelSize;
+};
+
+#define CONVOLUTION_IM2COL_FLOATS (256*1024)
+#define CONVOLUTION_DIRECT_MAX_TAPS 32
+
+inline u32
+ImagePixelCount(layer_shape Shape)
+{
+	u32 Result = Shape.Width*Shape.Height;
+	return Result;
+}
+
+inline u32
+ConvolutionTapCount(layer_shape Input, layer_shape Output)
+{
+	u32 Result = Output.KernelSize*Output.KernelSize*Input.Channels;
+	return Result;
+}
+
+inline b32
+ConvolutionIsDirect(layer_shape Input, layer_shape Output)
+{
+	b32 Result = (ConvolutionTapCount(Input, Output) <= CONVOLUTION_DIRECT_MAX_TAPS);
+	return Result;
+}
+
+inline matrix
+MatrixPackedAt(char *Site, memory_pool *Pool, u32 Rows, u32 Columns)
+{
+	matrix Result = Matrix(PoolPushArrayAlignedAt(Site, Pool, r32, (umm)Rows*Columns), Rows, Columns);
+	return Result;
+}
+#define MatrixPacked_(...) MatrixPackedAt(POOL_CALL_SITE, __VA_ARGS__)
+
+// NOTE: A packed batch of images as a matrix with a column per pixel.
+inline matrix
+PixelColumns(matrix Images, u32 Channels)
+{
+	Assert(Images.Stride == Images.RowCount);
+	Assert((Images.RowCount % Channels) == 0);
+
+	matrix Result = Matrix(Images.Data, Channels, (Images.RowCount / Channels)*Images.ColumnCount);
+	return Result;
+}
+
+internal matrix
+PackedPixelColumns(memory_pool *Pool, matrix Images, u32 Channels)
+{
+	if(Images.Stride != Images.RowCount)
+	{
+		matrix Packed = MatrixPacked_(Pool, Images.RowCount, Images.ColumnCount);
+		EvaluateInto(Packed, Lazy(Images));
+		Images = Packed;
+	}
+
+	matrix Result = PixelColumns(Images, Channels);
+	return Result;
+}
+
+inline u32
+ConvolutionSliceImages(layer_shape Input, layer_shape Output)
+{
+	u32 Result = CONVOLUTION_IM2COL_FLOATS / (ConvolutionTapCount(Input, Output)*ImagePixelCount(Output));
+	if(Result < 1)
+	{
+		Result = 1;
+	}
+	return Result;
+}
+
+internal void
+Im2ColInto(matrix Columns, matrix Images, u32 FirstImage, layer_shape Input, layer_shape Output)
+{
+	TIMED_BLOCK("Im2ColInto", 2*(umm)Columns.RowCount*Columns.ColumnCount*sizeof(r32), 0);
+
+	u32 RowTapCount = Output.KernelSize*Input.Channels;
+	umm InputRowStep = (umm)Input.Width*Input.Channels;
+	u32 ImageCount = Columns.ColumnCount / ImagePixelCount(Output);
+	Assert(Columns.RowCount == ConvolutionTapCount(Input, Output));
+
+	u32 ColumnIndex = 0;
+	for(u32 ImageIndex = 0;
+	    ImageIndex < ImageCount;
+	    ++ImageIndex)
+	{
+		r32 *Image = MatrixColumnData(Images, FirstImage + ImageIndex);
+		for(u32 Y = 0;
+		    Y < Output.Height;
+		    ++Y)
+		{
+			for(u32 X = 0;
+			    X < Output.Width;
+			    ++X)
+			{
+				r32 *Dest = MatrixColumnData(Columns, ColumnIndex++);
+				r32 *Window = Image + Y*InputRowStep + (umm)X*Input.Channels;
+				for(u32 KY = 0;
+				    KY < Output.KernelSize;
+				    ++KY)
+				{
+					memcpy(Dest, Window + KY*InputRowStep, RowTapCount*sizeof(r32));
+					Dest += RowTapCount;
+				}
+			}
+		}
+	}
+}
+
+// NOTE: Overwrites the images, adding up every window's share of each value.
+internal void
+Col2ImInto(matrix Images, u32 FirstImage, matrix Columns, layer_shape Input, layer_shape Output)
+{
+	TIMED_BLOCK("Col2ImInto", 3*(umm)Columns.RowCount*Columns.ColumnCount*sizeof(r32),
+	            (umm)Columns.RowCount*Columns.ColumnCount);
+
+	u32 RowTapCount = Output.KernelSize*Input.Channels;
+	umm InputRowStep = (umm)Input.Width*Input.Channels;
+	u32 ImageCount = Columns.ColumnCount / ImagePixelCount(Output);
+
+	u32 ColumnIndex = 0;
+	for(u32 ImageIndex = 0;
+	    ImageIndex < ImageCount;
+	    ++ImageIndex)
+	{
+		r32 *Image = MatrixColumnData(Images, FirstImage + ImageIndex);
+		memset(Image, 0, Images.RowCount*sizeof(r32));
+
+		for(u32 Y = 0;
+		    Y < Output.Height;
+		    ++Y)
+		{
+			for(u32 X = 0;
+			    X < Output.Width;
+			    ++X)
+			{
+				r32 *Source = MatrixColumnData(Columns, ColumnIndex++);
+				r32 *Window = Image + Y*InputRowStep + (umm)X*Input.Channels;
+				for(u32 KY = 0;
+				    KY < Output.KernelSize;
+				    ++KY)
+				{
+					r32 *Dest = Window + KY*InputRowStep;
+					for(u32 Tap = 0;
+					    Tap < RowTapCount;
+					    ++Tap)
+					{
+						Dest[Tap] += *Source++;
+					}
+				}
+			}
+		}
+	}
+}
+
+internal void
+ConvolveIm2ColInto(memory_pool *Pool, parallel_context *Parallel, matrix Result, matrix Weights,
+                   matrix Images, layer_shape Input, layer_shape Output)
+{
+	u32 PixelCount = ImagePixelCount(Output);
+	matrix ResultPixels = PixelColumns(Result, Output.Channels);
+	u32 SliceImages = ConvolutionSliceImages(Input, Output);
+	for(u32 FirstImage = 0;
+	    FirstImage < Images.ColumnCount;
+	    FirstImage += SliceImages)
+	{
+		u32 ImageCount = Minimum(SliceImages, Images.ColumnCount - FirstImage);
+		temp_memory TempMem = PoolBeginTempMemory(Pool);
+
+		matrix Columns = MatrixRaw_(Pool, Weights.ColumnCount, ImageCount*PixelCount);
+		Im2ColInto(Columns, Images, FirstImage, Input, Output);
+		ParallelMultInto(Pool, Parallel, MatrixColumns(ResultPixels, FirstImage*PixelCount, ImageCount*PixelCount),
+		                 Weights, Columns);
+
+		PoolEndTempMemory(TempMem);
+	}
+}
+
+struct convolution_work
+{
+	matrix Result;
+	matrix Weights;
+	matrix Images;
+	layer_shape Input;
+	layer_shape Output;
+};
+
+internal void
+DoConvolution(convolution_work *Work)
+{
+	for(u32 ImageIndex = 0;
+	    ImageIndex < Work->Images.ColumnCount;
+	    ++ImageIndex)
+	{
+		GlobalMathKernels.Convolve(MatrixColumnData(Work->Result, ImageIndex),
+		                           Work->Weights.Data, Work->Weights.Stride,
+		                           MatrixColumnData(Work->Images, ImageIndex),
+		                           Work->Input.Width, Work->Input.Channels,
+		                           Work->Output.Width, Work->Output.Height, Work->Output.Channels,
+		                           Work->Output.KernelSize);
+	}
+}
+
+internal PLATFORM_WORK_QUEUE_CALLBACK(DoConvolutionWork)
+{
+	TRACE_BLOCK("Convolve images");
+
+	convolution_work *Work = (convolution_work *)Data;
+	DoConvolution(Work);
+}
+
+internal void
+ConvolveDirectInto(memory_pool *Pool, parallel_context *Parallel, matrix Result, matrix Weights,
+                   matrix Images, layer_shape Input, layer_shape Output)
+{
+	Assert(Result.Stride == Result.RowCount);
+
+	u32 ImageCount = Images.ColumnCount;
+	platform_work_queue *Queue = Parallel->Queue;
+	u32 WorkCount = Minimum(Queue->ThreadCount*Parallel->ColumnSplit, ImageCount);
+	if(WorkCount <= 1)
+	{
+		convolution_work Work = {Result, Weights, Images, Input, Output};
+		DoConvolution(&Work);
+	}
+	else
+	{
+		u32 WorkImages = (ImageCount + WorkCount - 1) / WorkCount;
+		for(u32 FirstImage = 0;
+		    FirstImage < ImageCount;
+		    FirstImage += WorkImages)
+		{
+			u32 RangeImages = Minimum(WorkImages, ImageCount - FirstImage);
+
+			convolution_work *Work = PoolPushStruct(Pool, convolution_work);
+			Work->Result = MatrixColumns(Result, FirstImage, RangeImages);
+			Work->Weights = Weights;
+			Work->Images = MatrixColumns(Images, FirstImage, RangeImages);
+			Work->Input = Input;
+			Work->Output = Output;
+			PlatformAddEntry(Queue, DoConvolutionWork, Work);
+		}
+		PlatformCompleteAllWork(Queue);
+	}
+}
+
+// NOTE: Result is a packed batch of output images, before the biases.
+internal void
+ConvolveInto(memory_pool *Pool, parallel_context *Parallel, matrix Result, matrix Weights,
+             matrix Images, layer_shape Input, layer_shape Output)
+{
+	TIMED_BLOCK("ConvolveInto", 0,
+	            2*(umm)Weights.RowCount*Weights.ColumnCount*ImagePixelCount(Output)*Images.ColumnCount);
+
+	if(ConvolutionIsDirect(Input, Output))
+	{
+		ConvolveDirectInto(Pool, Parallel, Result, Weights, Images, Input, Output);
+	}
+	else
+	{
+		ConvolveIm2ColInto(Pool, Parallel, Result, Weights, Images, Input, Output);
+	}
+}
+
+internal void
+ConvolutionGradientsInto(memory_pool *Pool, parallel_context *Parallel, matrix WeightGradient, vec BiasGradient,
+                         matrix Error, matrix Images, layer_shape Input, layer_shape Output, b32 Accumulate)
+{
+	TIMED_BLOCK("ConvolutionGradientsInto", 0,
+	            2*(umm)WeightGradient.RowCount*WeightGradient.ColumnCount*ImagePixelCount(Output)*Images.ColumnCount);
+
+	temp_memory TempMem = PoolBeginTempMemory(Pool);
+
+	u32 PixelCount = ImagePixelCount(Output);
+	matrix ErrorPixels = PackedPixelColumns(Pool, Error, Output.Channels);
+	u32 SliceImages = ConvolutionSliceImages(Input, Output);
+	for(u32 FirstImage = 0;
+	    FirstImage < Images.ColumnCount;
+	    FirstImage += SliceImages)
+	{
+		u32 ImageCount = Minimum(SliceImages, Images.ColumnCount - FirstImage);
+		temp_memory SliceMem = PoolBeginTempMemory(Pool);
+
+		matrix Columns = MatrixRaw_(Pool, WeightGradient.ColumnCount, ImageCount*PixelCount);
+		Im2ColInto(Columns, Images, FirstImage, Input, Output);
+		matrix SliceError = MatrixColumns(ErrorPixels, FirstImage*PixelCount, ImageCount*PixelCount);
+		if(!Accumulate && (FirstImage == 0))
+		{
+			ParallelMultTransposeInto(Pool, Parallel, WeightGradient, SliceError, Columns);
+		}
+		else
+		{
+			MatrixPlusEquals(WeightGradient, ParallelMultTranspose(Pool, Parallel, SliceError, Columns));
+		}
+
+		PoolEndTempMemory(SliceMem);
+	}
+
+	if(!Accumulate)
+	{
+		ParallelMatrixSumColumnsInto(Pool, Parallel, BiasGradient, ErrorPixels);
+	}
+	else
+	{
+		VectorPlusEquals(BiasGradient, ParallelMatrixSumColumns(Pool, Parallel, ErrorPixels));
+	}
+
+	PoolEndTempMemory(TempMem);
+}
+
+// NOTE: Result is the error at the convolution's input images.
+internal void
+ConvolutionErrorInto(memory_pool *Pool, parallel_context *Parallel, matrix Result, matrix Weights,
+                     matrix Error, layer_shape Input, layer_shape Output)
+{
+	TIMED_BLOCK("ConvolutionErrorInto", 0,
+	            2*(umm)Weights.RowCount*Weights.ColumnCount*ImagePixelCount(Output)*Error.ColumnCount);
+
+	temp_memory TempMem = PoolBeginTempMemory(Pool);
+
+	u32 PixelCount = ImagePixelCount(Output);
+	matrix ErrorPixels = PackedPixelColumns(Pool, Error, Output.Channels);
+	u32 SliceImages = ConvolutionSliceImages(Input, Output);
+	for(u32 FirstImage = 0;
+	    FirstImage < Error.ColumnCount;
+	    FirstImage += SliceImages)
+	{
+		u32 ImageCount = Minimum(SliceImages, Error.ColumnCount - FirstImage);
+		temp_memory SliceMem = PoolBeginTempMemory(Pool);
+
+		matrix SliceError = MatrixColumns(ErrorPixels, FirstImage*PixelCount, ImageCount*PixelCount);
+		matrix Columns = ParallelTransposeMult(Pool, Parallel, Weights, SliceError);
+		Col2ImInto(Result, FirstImage, Columns, Input, Output);
+
+		PoolEndTempMemory(SliceMem);
+	}
+
+	PoolEndTempMemory(TempMem);
+}
+
+internal void
+MaxPoolInto(matrix Result, matrix Images, layer_shape Input, layer_shape Output)
+{
+	TIMED_BLOCK("MaxPoolInto", ((umm)Images.RowCount + Result.RowCount)*Images.ColumnCount*sizeof(r32), 0);
+
+	u32 Channels = Input.Channels;
+	umm InputRowStep = (umm)Input.Width*Channels;
+	for(u32 ImageIndex = 0;
+	    ImageIndex < Images.ColumnCount;
+	    ++ImageIndex)
+	{
+		r32 *Image = MatrixColumnData(Images, ImageIndex);
+		r32 *Dest = MatrixColumnData(Result, ImageIndex);
+		for(u32 Y = 0;
+		    Y < Output.Height;
+		    ++Y)
+		{
+			for(u32 X = 0;
+			    X < Output.Width;
+			    ++X)
+			{
+				r32 *Window = Image + (umm)Y*Output.KernelSize*InputRowStep + (umm)X*Output.KernelSize*Channels;
+				for(u32 Channel = 0;
+				    Channel < Channels;
+				    ++Channel)
+				{
+					Dest[Channel] = Window[Channel];
+				}
+				for(u32 KY = 0;
+				    KY < Output.KernelSize;
+				    ++KY)
+				{
+					r32 *Row = Window + KY*InputRowStep;
+					for(u32 KX = 0;
+					    KX < Output.KernelSize;
+					    ++KX)
+					{
+						r32 *Value = Row + (umm)KX*Channels;
+						for(u32 Channel = 0;
+						    Channel < Channels;
+						    ++Channel)
+						{
+							Dest[Channel] = Maximum(Dest[Channel], Value[Channel]);
+						}
+					}
+				}
+				Dest += Channels;
+			}
+		}
+	}
+}
+
+// NOTE: Result is the error at the pool's input images.
+internal void
+MaxPoolErrorInto(matrix Result, matrix Error, matrix Images, layer_shape Input, layer_shape Output)
+{
+	TIMED_BLOCK("MaxPoolErrorInto", ((umm)2*Images.RowCount + Error.RowCount)*Images.ColumnCount*sizeof(r32), 0);
+
+	u32 Channels = Input.Channels;
+	umm InputRowStep = (umm)Input.Width*Channels;
+	for(u32 ImageIndex = 0;
+	    ImageIndex < Images.ColumnCount;
+	    ++ImageIndex)
+	{
+		r32 *Image = MatrixColumnData(Images, ImageIndex);
+		r32 *ImageError = MatrixColumnData(Result, ImageIndex);
+		r32 *Source = MatrixColumnData(Error, ImageIndex);
+		memset(ImageError, 0, Result.RowCount*sizeof(r32));
+
+		for(u32 Y = 0;
+		    Y < Output.Height;
+		    ++Y)
+		{
+			for(u32 X = 0;
+			    X < Output.Width;
+			    ++X)
+			{
+				umm WindowOffset = (umm)Y*Output.KernelSize*InputRowStep + (umm)X*Output.KernelSize*Channels;
+				for(u32 Channel = 0;
+				    Channel < Channels;
+				    ++Channel)
+				{
+					// NOTE: The same scan as MaxPoolInto, so the first maximum wins.
+					umm Best = WindowOffset + Channel;
+					for(u32 KY = 0;
+					    KY < Output.KernelSize;
+					    ++KY)
+					{
+						for(u32 KX = 0;
+						    KX < Output.KernelSize;
+						    ++KX)
+						{
+							umm Offset = WindowOffset + KY*InputRowStep + (umm)KX*Channels + Channel;
+							if(Image[Offset] > Image[Best])
+							{
+								Best = Offset;
+							}
+						}
+					}
+					ImageError[Best] += Source[Channel];
+				}
+				Source += Channels;
+			}
+		}
+	}
+}
@@ -0,0 +1,127 @@
+
+/*
+	NOTE: Knowledge distillation. -teacher loads a trained network and the
+		network being trained, built from the usual options, learns from it
+		as a student. Before the first epoch the teacher runs over the
+		training set in batches, and each trial's softened target
+		softmax(z/T), with z the teacher's output weighted inputs and T
+		-temperature, goes in the rows below its label. The test set keeps
+		its labels alone.
+
+	While the epochs run, OutputErrorBatch softens the student's outputs by
+		the same T and its error at the output layer becomes
+
+			(1 - w)*(a - y) + w*T*(softmax(z/T) - p)
+
+		with w -distillweight, a - y the cost's usual gradient against the
+		label and p the teacher's target: the soft cross entropy's gradient,
+		(softmax(z/T) - p)/T, scaled by T^2 as in Hinton et al. The paths
+		with their own output error, -static and -graph, don't distill.
+
+	A higher temperature spreads the teacher's answer over the classes it
+		finds similar, which is what the student learns from it that the
+		labels can't teach.
+
+	After training, the two are compared on the test set: size, success
+		rate, and inference time through FeedForwardBatch.
+*/
+
+#define DISTILL_DEFAULT_TEMPERATURE 4.0f
+#define DISTILL_DEFAULT_WEIGHT 0.5f
+#define DISTILL_TEACHER_BATCH 1000
+
+internal b32
+DistillationSupports(neural_network Teacher, neural_network Student)
+{
+	b32 Result = ((Teacher.Layers[0] == Student.Layers[0]) &&
+	              (Teacher.Layers[Teacher.LayerCount - 1] == Student.Layers[Student.LayerCount - 1]));
+	return Result;
+}
+
+// NOTE: A copy of the training set whose outputs hold each trial's label
+//	above the teacher's softened outputs. The inputs are shared with the
+//	original.
+internal data_set
+DistillTrainingSet(memory_pool *Pool, parallel_context *Parallel, neural_network Teacher, data_set TrainingSet,
+                   r32 Temperature)
+{
+	TRACE_BLOCK("Distill targets");
+	TIMED_BLOCK("DistillTrainingSet", 0, 0);
+
+	u32 OutputCount = TrainingSet.Outputs.RowCount;
+	data_set Result = TrainingSet;
+	Result.Outputs = MatrixRaw_(Pool, 2*OutputCount, TrainingSet.DataCount);
+	EvaluateInto(SubMatrix(Result.Outputs, 0, 0, OutputCount, TrainingSet.DataCount), Lazy(TrainingSet.Outputs));
+
+	u32 OutputLayer = Teacher.LayerCount - 1;
+	for(u32 FirstTrial = 0;
+	    FirstTrial < TrainingSet.DataCount;
+	    FirstTrial += DISTILL_TEACHER_BATCH)
+	{
+		u32 TrialCount = Minimum(DISTILL_TEACHER_BATCH, TrainingSet.DataCount - FirstTrial);
+		temp_memory TempMem = PoolBeginTempMemory(Pool);
+
+		feed_forward_batch_result FeedForward =
+			FeedForwardBatch(Pool, Parallel, Teacher, MatrixColumns(TrainingSet.Inputs, FirstTrial, TrialCount));
+
+		SoftenOutputsInto(SubMatrix(Result.Outputs, OutputCount, FirstTrial, OutputCount, TrialCount),
+		                  FeedForward.WeightedInputs[OutputLayer], Temperature);
+
+		PoolEndTempMemory(TempMem);
+	}
+
+	return Result;
+}
+
+internal u64
+NetworkParameterCount(neural_network Network)
+{
+	u64 Result = 0;
+	for(u32 LayerIndex = 1;
+	    LayerIndex < Network.LayerCount;
+	    ++LayerIndex)
+	{
+		matrix Weights = Network.WeightMatrices[LayerIndex];
+		Result += (u64)Weights.RowCount*Weights.ColumnCount + Network.BiasVectors[LayerIndex].Dimension;
+	}
+	return Result;
+}
+
+internal void
+PrintDistillationRow(char *Name, neural_network Network, r32 SuccessRatePercent, r32 Seconds, r32 TeacherSeconds)
+{
+	char Layers[64] = "";
+	umm Used = 0;
+	for(u32 LayerIndex = 0;
+	    (LayerIndex < Network.LayerCount) && (Used < sizeof(Layers));
+	    ++LayerIndex)
+	{
+		Used += snprintf(Layers + Used, sizeof(Layers) - Used, LayerIndex ? ", %u" : "[%u", Network.Layers[LayerIndex]);
+	}
+	if(Used < sizeof(Layers))
+	{
+		snprintf(Layers + Used, sizeof(Layers) - Used, "]");
+	}
+
+	printf("  %-8s %-22s %10llu %7.2f%% %9.2fms %7.2fx\n", Name, Layers,
+	       (unsigned long long)NetworkParameterCount(Network), SuccessRatePercent, 1000.0f*Seconds,
+	       TeacherSeconds/Seconds);
+}
+
+internal void
+ReportDistillation(memory_pool *Pool, parallel_context *Parallel, neural_network Teacher, neural_network Student,
+                   data_set TestSet, r32 Temperature, r32 Weight)
+{
+	TRACE_BLOCK("Distillation report");
+
+	r32 TeacherSeconds = TimeInference(Pool, Parallel, Teacher, TestSet);
+	r32 StudentSeconds = TimeInference(Pool, Parallel, Student, TestSet);
+
+	printf("Distillation at temperature %.2f, %.0f%% teacher, %u test trials, %u thread(s):\n",
+	       Temperature, 100.0f*Weight, TestSet.DataCount, Parallel->Queue->ThreadCount);
+	printf("  %-8s %-22s %10s %8s %11s %8s\n", "", "layers", "parameters", "success", "inference", "speedup");
+	PrintDistillationRow("teacher", Teacher, EvaluateNetwork(Pool, Parallel, Teacher, TestSet),
+	                     TeacherSeconds, TeacherSeconds);
+	PrintDistillationRow("student", Student, EvaluateNetwork(Pool, Parallel, Student, TestSet),
+	                     StudentSeconds, TeacherSeconds);
+}
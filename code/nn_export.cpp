@@ -0,0 +1,197 @@
+
+/*
+	NOTE: Ahead-of-time export. -exportc writes the network as one standalone
+		C header for services that embed inference: the weights and biases
+		as aligned static const arrays, and an inference function with every
+		layer size a constant. It allocates nothing, keeps its layers on the
+		stack and needs nothing past <math.h>.
+
+	The generated code does the scalar kernels' arithmetic in their order.
+		Each weighted input starts at zero and sums weight*input over the
+		inputs in order, then adds the bias and goes through the same double
+		exp as Exp. Built with the same compiler and flags, it matches
+		FeedForward at CpuLevel_Scalar bit for bit, which
+		nn_export_harness.cpp checks. The first layer skips zero inputs:
+		those sums never become -0, so a zero product never changes them.
+
+	Weights are printed with 9 significant digits, which round-trips every
+		finite r32. Pruned and factored networks are exported as their dense
+		weights.
+*/
+
+#define EXPORT_DEFAULT_NAME "nn_exported"
+#define EXPORT_VALUES_PER_LINE 8
+
+internal void
+ExportValue(FILE *File, r32 Value, u32 Index, u32 Count)
+{
+	Assert((Value == Value) && (AbsoluteValue(Value) <= 3.402823466e+38f));
+
+	b32 LineStart = ((Index % EXPORT_VALUES_PER_LINE) == 0);
+	b32 LineEnd = ((((Index + 1) % EXPORT_VALUES_PER_LINE) == 0) || ((Index + 1) == Count));
+	fprintf(File, "%s%.8ef,%s", LineStart ? "\t" : " ", Value, LineEnd ? "\n" : "");
+}
+
+internal void
+ExportLayerCode(FILE *File, char *Name, u32 LayerIndex, u32 RowCount, u32 ColumnCount,
+                char *Input, char *Output, b32 SkipZeros)
+{
+	fprintf(File, "\t/* Layer %u: %u -> %u */\n", LayerIndex, ColumnCount, RowCount);
+	fprintf(File, "\tfor(Row = 0; Row < %u; ++Row)\n\t{\n\t\t%s[Row] = 0.0f;\n\t}\n", RowCount, Output);
+	fprintf(File, "\tfor(Column = 0; Column < %u; ++Column)\n\t{\n", ColumnCount);
+	fprintf(File, "\t\tScale = %s[Column];\n", Input);
+	if(SkipZeros)
+	{
+		fprintf(File, "\t\tif(Scale == 0.0f)\n\t\t{\n\t\t\tcontinue;\n\t\t}\n");
+	}
+	fprintf(File, "\t\tWeights = %s_layer%u_weights + Column*%u;\n", Name, LayerIndex, RowCount);
+	fprintf(File, "\t\tfor(Row = 0; Row < %u; ++Row)\n\t\t{\n\t\t\t%s[Row] += Weights[Row]*Scale;\n\t\t}\n\t}\n",
+	        RowCount, Output);
+	fprintf(File, "\tfor(Row = 0; Row < %u; ++Row)\n\t{\n", RowCount);
+	fprintf(File, "\t\t%s[Row] = %s_sigmoid(%s[Row] + %s_layer%u_biases[Row]);\n\t}\n",
+	        Output, Name, Output, Name, LayerIndex);
+}
+
+internal b32
+ExportNetworkHeader(neural_network Network, char *Filename, char *Name)
+{
+	TRACE_BLOCK("Export");
+
+	if(!NetworkIsDense(Network) || !NetworkIsAllSigmoid(Network))
+	{
+		fprintf(stderr, "Only dense sigmoid networks can be exported\n");
+		return false;
+	}
+
+	char UpperName[128];
+	umm NameLength = strlen(Name);
+	if(NameLength >= sizeof(UpperName))
+	{
+		fprintf(stderr, "Export name %s is too long\n", Name);
+		return false;
+	}
+	for(umm Index = 0;
+	    Index <= NameLength;
+	    ++Index)
+	{
+		char Character = Name[Index];
+		UpperName[Index] = ((Character >= 'a') && (Character <= 'z')) ? (char)(Character - 'a' + 'A') : Character;
+	}
+
+	FILE *File = 0;
+	if(fopen_s(&File, Filename, "wb") != 0)
+	{
+		fprintf(stderr, "Could not write %s\n", Filename);
+		return false;
+	}
+
+	u32 InputCount = Network.Layers[0];
+	u32 OutputCount = Network.Layers[Network.LayerCount - 1];
+
+	fprintf(File, "/*\n\tGenerated by nn -exportc: a %s [",
+	        (Network.CostFn == CostFn_Quadratic) ? "quadratic" : "cross-entropy");
+	for(u32 LayerIndex = 0;
+	    LayerIndex < Network.LayerCount;
+	    ++LayerIndex)
+	{
+		fprintf(File, LayerIndex ? ", %u" : "%u", Network.Layers[LayerIndex]);
+	}
+	fprintf(File, "] sigmoid network.\n\n"
+	              "\t%s_infer(Input, Output) reads %u floats and writes %u, in the same\n"
+	              "\tlayout and scale nn trains on. It allocates nothing and keeps no state.\n"
+	              "*/\n\n", Name, InputCount, OutputCount);
+
+	fprintf(File, "#ifndef %s_H\n#define %s_H\n\n#include <math.h>\n\n", UpperName, UpperName);
+	fprintf(File, "#ifndef NN_EXPORT_ALIGN\n"
+	              "#if defined(_MSC_VER)\n"
+	              "#define NN_EXPORT_ALIGN __declspec(align(64))\n"
+	              "#else\n"
+	              "#define NN_EXPORT_ALIGN __attribute__((aligned(64)))\n"
+	              "#endif\n"
+	              "#endif\n\n");
+
+	fprintf(File, "#define %s_LAYER_COUNT %u\n", UpperName, Network.LayerCount);
+	fprintf(File, "#define %s_INPUT_COUNT %u\n", UpperName, InputCount);
+	fprintf(File, "#define %s_OUTPUT_COUNT %u\n\n", UpperName, OutputCount);
+
+	fprintf(File, "static const unsigned int %s_layers[%u] = {", Name, Network.LayerCount);
+	for(u32 LayerIndex = 0;
+	    LayerIndex < Network.LayerCount;
+	    ++LayerIndex)
+	{
+		fprintf(File, LayerIndex ? ", %u" : "%u", Network.Layers[LayerIndex]);
+	}
+	fprintf(File, "};\n\n");
+
+	// NOTE: Column by column, so each input's weights are contiguous.
+	for(u32 LayerIndex = 1;
+	    LayerIndex < Network.LayerCount;
+	    ++LayerIndex)
+	{
+		matrix Weights = Network.WeightMatrices[LayerIndex];
+		u32 WeightCount = Weights.RowCount*Weights.ColumnCount;
+		fprintf(File, "static NN_EXPORT_ALIGN const float %s_layer%u_weights[%u] =\n{\n", Name, LayerIndex, WeightCount);
+		for(u32 ColumnIndex = 0;
+		    ColumnIndex < Weights.ColumnCount;
+		    ++ColumnIndex)
+		{
+			r32 *Source = MatrixColumnData(Weights, ColumnIndex);
+			for(u32 RowIndex = 0;
+			    RowIndex < Weights.RowCount;
+			    ++RowIndex)
+			{
+				ExportValue(File, Source[RowIndex], ColumnIndex*Weights.RowCount + RowIndex, WeightCount);
+			}
+		}
+		fprintf(File, "};\n\n");
+
+		vec Biases = Network.BiasVectors[LayerIndex];
+		fprintf(File, "static NN_EXPORT_ALIGN const float %s_layer%u_biases[%u] =\n{\n", Name, LayerIndex, Biases.Dimension);
+		for(u32 RowIndex = 0;
+		    RowIndex < Biases.Dimension;
+		    ++RowIndex)
+		{
+			ExportValue(File, Biases.Data[RowIndex], RowIndex, Biases.Dimension);
+		}
+		fprintf(File, "};\n\n");
+	}
+
+	fprintf(File, "static float\n%s_sigmoid(float Value)\n{\n"
+	              "\tfloat Result = 1.0f / (1.0f + (float)exp(-Value));\n"
+	              "\treturn Result;\n}\n\n", Name);
+
+	fprintf(File, "static void\n%s_infer(const float *Input, float *Output)\n{\n", Name);
+	for(u32 LayerIndex = 1;
+	    LayerIndex < (Network.LayerCount - 1);
+	    ++LayerIndex)
+	{
+		fprintf(File, "\tfloat Layer%u[%u];\n", LayerIndex, Network.Layers[LayerIndex]);
+	}
+	fprintf(File, "\tconst float *Weights;\n\tfloat Scale;\n\tunsigned int Row, Column;\n");
+
+	for(u32 LayerIndex = 1;
+	    LayerIndex < Network.LayerCount;
+	    ++LayerIndex)
+	{
+		char Input[16] = "Input";
+		char Output[16] = "Output";
+		if(LayerIndex > 1)
+		{
+			snprintf(Input, sizeof(Input), "Layer%u", LayerIndex - 1);
+		}
+		if(LayerIndex < (Network.LayerCount - 1))
+		{
+			snprintf(Output, sizeof(Output), "Layer%u", LayerIndex);
+		}
+
+		fprintf(File, "\n");
+		ExportLayerCode(File, Name, LayerIndex, Network.Layers[LayerIndex], Network.Layers[LayerIndex - 1],
+		                Input, Output, (LayerIndex == 1));
+	}
+	fprintf(File, "}\n\n#endif\n");
+
+	fclose(File);
+
+	printf("Exported the network to %s as %s_infer\n", Filename, Name);
+	return true;
+}
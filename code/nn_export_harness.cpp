@@ -0,0 +1,173 @@
+
+/*
+	NOTE: Checks a header written by nn -exportc against FeedForward on the
+		network file it came from, one test image at a time, then times both.
+		It exits non-zero if any output differs in any bit.
+
+		nn -l trained.nn -exportc nn_exported.h
+		nn_export_harness trained.nn
+
+	NN_EXPORT_HEADER and NN_EXPORT_NAME pick the header and its -exportname,
+		nn_exported.h and nn_exported by default. Build it with the same
+		compiler and flags as nn (see build.bat), since the match is only
+		exact when both sides compile the arithmetic the same way.
+*/
+
+#define NN_NO_MAIN 1
+#include "nn.cpp"
+
+#ifndef NN_EXPORT_HEADER
+#define NN_EXPORT_HEADER "nn_exported.h"
+#endif
+#ifndef NN_EXPORT_NAME
+#define NN_EXPORT_NAME nn_exported
+#endif
+
+#include NN_EXPORT_HEADER
+
+#define EXPORT_NAME_PASTE_(Name, Suffix) Name##Suffix
+#define EXPORT_NAME_PASTE(Name, Suffix) EXPORT_NAME_PASTE_(Name, Suffix)
+#define ExportedLayers EXPORT_NAME_PASTE(NN_EXPORT_NAME, _layers)
+#define ExportedInfer EXPORT_NAME_PASTE(NN_EXPORT_NAME, _infer)
+
+#define EXPORT_HARNESS_REPEATS 5
+
+internal r32
+TimeFeedForward(memory_pool *Pool, neural_network Network, data_set TestSet)
+{
+	r32 Best = 1e30f;
+	for(u32 Repeat = 0;
+	    Repeat < EXPORT_HARNESS_REPEATS;
+	    ++Repeat)
+	{
+		u64 Start = PlatformGetWallClock();
+		for(u32 TrialIndex = 0;
+		    TrialIndex < TestSet.DataCount;
+		    ++TrialIndex)
+		{
+			temp_memory TempMem = PoolBeginTempMemory(Pool);
+			vec Input = {MatrixColumnData(TestSet.Inputs, TrialIndex), TestSet.Inputs.RowCount};
+			FeedForward(Pool, Network, Input);
+			PoolEndTempMemory(TempMem);
+		}
+		r32 Seconds = PlatformGetSecondsElapsed(Start, PlatformGetWallClock());
+
+		if(Seconds < Best)
+		{
+			Best = Seconds;
+		}
+	}
+
+	return Best;
+}
+
+internal r32
+TimeExported(r32 *Output, data_set TestSet)
+{
+	r32 Best = 1e30f;
+	for(u32 Repeat = 0;
+	    Repeat < EXPORT_HARNESS_REPEATS;
+	    ++Repeat)
+	{
+		u64 Start = PlatformGetWallClock();
+		for(u32 TrialIndex = 0;
+		    TrialIndex < TestSet.DataCount;
+		    ++TrialIndex)
+		{
+			ExportedInfer(MatrixColumnData(TestSet.Inputs, TrialIndex), Output);
+		}
+		r32 Seconds = PlatformGetSecondsElapsed(Start, PlatformGetWallClock());
+
+		if(Seconds < Best)
+		{
+			Best = Seconds;
+		}
+	}
+
+	return Best;
+}
+
+s32 main(s32 ArgC, char **ArgV)
+{
+	if(ArgC != 2)
+	{
+		fprintf(stderr, "Usage: nn_export_harness <network file>\n");
+		return 1;
+	}
+
+	InitializeMathKernels();
+	cpu_level BestLevel = GlobalMathKernels.Level;
+
+	memory_pool MainPool = {};
+	memory_pool TempPool = {};
+	if(!PoolReserve(&MainPool, Gigabytes(16), 0) ||
+	   !PoolReserve(&TempPool, Gigabytes(16), 0))
+	{
+		fprintf(stderr, "Could not reserve memory pools\n");
+		return 1;
+	}
+
+	data_set TestSet = LoadMNISTData(&MainPool, &TempPool, "t10k-images.idx3-ubyte", "t10k-labels.idx1-ubyte");
+	neural_network Network = LoadNetwork(&MainPool, ArgV[1]);
+
+	b32 Matches = (Network.LayerCount == ArrayCount(ExportedLayers));
+	for(u32 LayerIndex = 0;
+	    Matches && (LayerIndex < Network.LayerCount);
+	    ++LayerIndex)
+	{
+		Matches = (Network.Layers[LayerIndex] == ExportedLayers[LayerIndex]);
+	}
+	if(!Matches || (TestSet.Inputs.RowCount != Network.Layers[0]))
+	{
+		fprintf(stderr, "%s does not have the exported header's layers\n", ArgV[1]);
+		return 1;
+	}
+
+	// NOTE: FeedForward only runs the dense weights.
+	Network.BlockSparseWeights = 0;
+	Network.Ranks = 0;
+
+	u32 OutputCount = Network.Layers[Network.LayerCount - 1];
+	r32 *Output = PoolPushArray(&MainPool, r32, OutputCount);
+
+	// NOTE: The header is the scalar kernels' arithmetic, so that's the level
+	//	it has to match; the wide levels round differently.
+	SetMathKernels(&GlobalMathKernels, CpuLevel_Scalar);
+
+	u32 DifferentCount = 0;
+	for(u32 TrialIndex = 0;
+	    TrialIndex < TestSet.DataCount;
+	    ++TrialIndex)
+	{
+		temp_memory TempMem = PoolBeginTempMemory(&MainPool);
+
+		vec Input = {MatrixColumnData(TestSet.Inputs, TrialIndex), TestSet.Inputs.RowCount};
+		feed_forward_result FeedForwardResult = FeedForward(&MainPool, Network, Input);
+		ExportedInfer(Input.Data, Output);
+		if(memcmp(FeedForwardResult.Activations[Network.LayerCount - 1].Data, Output, OutputCount*sizeof(r32)) != 0)
+		{
+			++DifferentCount;
+		}
+
+		PoolEndTempMemory(TempMem);
+	}
+
+	r32 ScalarSeconds = TimeFeedForward(&MainPool, Network, TestSet);
+	SetMathKernels(&GlobalMathKernels, BestLevel);
+	r32 BestSeconds = TimeFeedForward(&MainPool, Network, TestSet);
+	r32 ExportedSeconds = TimeExported(Output, TestSet);
+
+	printf("Exported network check, %u test images one at a time:\n", TestSet.DataCount);
+	printf("  %u outputs differ from FeedForward at the scalar level\n", DifferentCount);
+	printf("  %-22s %10s %8s\n", "", "us/image", "speedup");
+	printf("  %-22s %10.2f %7.2fx\n", "FeedForward scalar",
+	       1e6f*ScalarSeconds/TestSet.DataCount, 1.0f);
+	char BestName[32];
+	snprintf(BestName, sizeof(BestName), "FeedForward %s", CpuLevelNames[BestLevel]);
+	printf("  %-22s %10.2f %7.2fx\n", BestName,
+	       1e6f*BestSeconds/TestSet.DataCount, ScalarSeconds/BestSeconds);
+	printf("  %-22s %10.2f %7.2fx\n", "exported",
+	       1e6f*ExportedSeconds/TestSet.DataCount, ScalarSeconds/ExportedSeconds);
+
+	return DifferentCount ? 1 : 0;
+}
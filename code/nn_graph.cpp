@@ -0,0 +1,896 @@
+
+/*
+	NOTE: Computation graph. -graph trains through a small static graph built
+		once at startup instead of the hand-written FeedForwardBatch,
+		BackPropagateBatch and ComputeGradientsBatch.
+
+	BuildTrainingGraph records the forward pass as nodes over the nn_math.h
+		ops, with the weights, biases, inputs and targets as leaves and the
+		cost as the last node. DifferentiateGraph then walks the nodes
+		backwards and appends their gradients (reverse-mode autodiff). A node
+		is only made once for the same op over the same operands, so the
+		cross-entropy gradient's sigmoid(z) - y reuses the forward activation.
+
+	Then the passes:
+		Dead gradients: only what the parameter gradients depend on is run.
+			This drops the gradient for the inputs and the cost itself.
+		Fusion: sigmoid'(z) into the product it feeds, that into the
+			quadratic cost's a - y, and the bias into the product before it,
+			so each runs as one expression over its operands.
+		Memory planning: every node gets a buffer when it's run and gives it
+			back after its last use. Elementwise nodes take an operand's
+			buffer over when this is its last use, everything else takes the
+			smallest free buffer that fits. The parameter gradients are kept
+			to the end, since ApplyGradients reads them.
+
+	The executor runs the schedule with the kernels the hand-written path
+		uses, in the same order, so the two train bit for bit the same. The
+		graph has no micro-batches and only sigmoids; networks with factored
+		or block-sparse weights, or other activations, train the hand-written
+		way.
+*/
+
+#define GRAPH_MAX_NODES 256
+#define GRAPH_MAX_OPERANDS 3
+#define GRAPH_BENCHMARK_BATCHES 1000
+
+enum graph_op
+{
+	GraphOp_None,
+
+	// NOTE: Leaves, bound to the network and the batch before each run.
+	GraphOp_Input,
+	GraphOp_Target,
+	GraphOp_Weight,
+	GraphOp_Bias,
+
+	GraphOp_Mult,
+	GraphOp_TransposeMult,
+	GraphOp_MultTranspose,
+	GraphOp_SumColumns,
+	GraphOp_AddColumn,
+	GraphOp_Plus,
+	GraphOp_Minus,
+	GraphOp_Hadamard,
+	GraphOp_Sigmoid,
+	GraphOp_SigmoidPrime,
+
+	// NOTE: Costs are only differentiated, never run.
+	GraphOp_QuadraticCost,
+	GraphOp_CrossEntropyCost,
+
+	// NOTE: Made by FuseGraph.
+	GraphOp_MultAddColumn,
+	GraphOp_SigmoidBackward,
+	GraphOp_QuadraticError,
+
+	GraphOp_Count,
+};
+
+global_variable char *GraphOpNames[GraphOp_Count] =
+{
+	"none",
+	"input",
+	"target",
+	"weight",
+	"bias",
+	"mult",
+	"transpose mult",
+	"mult transpose",
+	"sum columns",
+	"add column",
+	"plus",
+	"minus",
+	"hadamard",
+	"sigmoid",
+	"sigmoid prime",
+	"quadratic cost",
+	"cross-entropy cost",
+	"mult add column",
+	"sigmoid backward",
+	"quadratic error",
+};
+
+struct graph_node
+{
+	graph_op Op;
+	u32 OperandCount;
+	u32 Operands[GRAPH_MAX_OPERANDS];
+	u32 RowCount;
+	u32 ColumnCount;
+	u32 LayerIndex;
+
+	// NOTE: Filled in by the passes.
+	b32 Live;
+	b32 Output;
+	u32 UseCount;
+	u32 LastUse;
+	s32 Slot;
+	matrix Value;
+};
+
+struct compute_graph
+{
+	// NOTE: Node 0 is never used, so an operand of 0 is no operand.
+	u32 NodeCount;
+	graph_node Nodes[GRAPH_MAX_NODES];
+
+	u32 LayerCount;
+	cost_function CostFn;
+	u32 BatchSize;
+	u32 InputNode;
+	u32 TargetNode;
+	u32 CostNode;
+	u32 *WeightNodes;
+	u32 *BiasNodes;
+	u32 *WeightGradientNodes;
+	u32 *BiasGradientNodes;
+
+	u32 ScheduleCount;
+	u32 Schedule[GRAPH_MAX_NODES];
+
+	u32 SlotCount;
+	r32 *Arena;
+	umm ArenaFloats;
+	umm UnplannedFloats;
+	network_gradients Gradients;
+
+	u32 ForwardCount;
+	u32 DifferentiatedCount;
+	u32 DeadCount;
+	u32 FusedCount;
+};
+
+//
+// NOTE: Building
+//
+
+internal u32
+GraphNode(compute_graph *Graph, graph_op Op, u32 RowCount, u32 ColumnCount,
+          u32 A = 0, u32 B = 0, u32 C = 0)
+{
+	u32 Operands[GRAPH_MAX_OPERANDS] = {A, B, C};
+	u32 OperandCount = C ? 3 : (B ? 2 : (A ? 1 : 0));
+
+	// NOTE: Leaves are distinct values even when they look alike; anything
+	//	else is the same value as an earlier node with its op and operands.
+	if(OperandCount)
+	{
+		for(u32 NodeIndex = 1;
+		    NodeIndex < Graph->NodeCount;
+		    ++NodeIndex)
+		{
+			graph_node *Node = Graph->Nodes + NodeIndex;
+			if((Node->Op == Op) &&
+			   (Node->Operands[0] == A) &&
+			   (Node->Operands[1] == B) &&
+			   (Node->Operands[2] == C))
+			{
+				return NodeIndex;
+			}
+		}
+	}
+
+	Assert(Graph->NodeCount < GRAPH_MAX_NODES);
+	u32 Result = Graph->NodeCount++;
+
+	graph_node *Node = Graph->Nodes + Result;
+	*Node = {};
+	Node->Op = Op;
+	Node->OperandCount = OperandCount;
+	for(u32 OperandIndex = 0;
+	    OperandIndex < GRAPH_MAX_OPERANDS;
+	    ++OperandIndex)
+	{
+		Node->Operands[OperandIndex] = Operands[OperandIndex];
+	}
+	Node->RowCount = RowCount;
+	Node->ColumnCount = ColumnCount;
+	Node->Slot = -1;
+
+	return Result;
+}
+
+internal u32
+GraphLeaf(compute_graph *Graph, graph_op Op, u32 RowCount, u32 ColumnCount, u32 LayerIndex = 0)
+{
+	u32 Result = GraphNode(Graph, Op, RowCount, ColumnCount);
+	Graph->Nodes[Result].LayerIndex = LayerIndex;
+	return Result;
+}
+
+internal u32
+GraphElementwise(compute_graph *Graph, graph_op Op, u32 A, u32 B = 0)
+{
+	graph_node *Node = Graph->Nodes + A;
+	Assert(!B || (Op == GraphOp_AddColumn) ||
+	       ((Graph->Nodes[B].RowCount == Node->RowCount) &&
+	        (Graph->Nodes[B].ColumnCount == Node->ColumnCount)));
+
+	u32 Result = GraphNode(Graph, Op, Node->RowCount, Node->ColumnCount, A, B);
+	return Result;
+}
+
+internal u32
+GraphMult(compute_graph *Graph, u32 A, u32 B)
+{
+	Assert(Graph->Nodes[A].ColumnCount == Graph->Nodes[B].RowCount);
+	u32 Result = GraphNode(Graph, GraphOp_Mult, Graph->Nodes[A].RowCount, Graph->Nodes[B].ColumnCount, A, B);
+	return Result;
+}
+
+internal u32
+GraphTransposeMult(compute_graph *Graph, u32 A, u32 B)
+{
+	Assert(Graph->Nodes[A].RowCount == Graph->Nodes[B].RowCount);
+	u32 Result = GraphNode(Graph, GraphOp_TransposeMult, Graph->Nodes[A].ColumnCount, Graph->Nodes[B].ColumnCount, A, B);
+	return Result;
+}
+
+internal u32
+GraphMultTranspose(compute_graph *Graph, u32 A, u32 B)
+{
+	Assert(Graph->Nodes[A].ColumnCount == Graph->Nodes[B].ColumnCount);
+	u32 Result = GraphNode(Graph, GraphOp_MultTranspose, Graph->Nodes[A].RowCount, Graph->Nodes[B].RowCount, A, B);
+	return Result;
+}
+
+internal u32
+GraphSumColumns(compute_graph *Graph, u32 A)
+{
+	u32 Result = GraphNode(Graph, GraphOp_SumColumns, Graph->Nodes[A].RowCount, 1, A);
+	return Result;
+}
+
+internal void
+BuildTrainingGraph(memory_pool *Pool, compute_graph *Graph, neural_network Network, u32 BatchSize)
+{
+	Graph->NodeCount = 1;
+	Graph->LayerCount = Network.LayerCount;
+	Graph->CostFn = Network.CostFn;
+	Graph->BatchSize = BatchSize;
+	Graph->WeightNodes = PoolPushArray(Pool, u32, Network.LayerCount);
+	Graph->BiasNodes = PoolPushArray(Pool, u32, Network.LayerCount);
+	Graph->WeightGradientNodes = PoolPushArray(Pool, u32, Network.LayerCount);
+	Graph->BiasGradientNodes = PoolPushArray(Pool, u32, Network.LayerCount);
+
+	Graph->InputNode = GraphLeaf(Graph, GraphOp_Input, Network.Layers[0], BatchSize);
+	Graph->TargetNode = GraphLeaf(Graph, GraphOp_Target, Network.Layers[Network.LayerCount - 1], BatchSize);
+
+	u32 Activation = Graph->InputNode;
+	u32 WeightedInput = 0;
+	for(u32 LayerIndex = 1;
+	    LayerIndex < Network.LayerCount;
+	    ++LayerIndex)
+	{
+		u32 Weight = GraphLeaf(Graph, GraphOp_Weight, Network.Layers[LayerIndex], Network.Layers[LayerIndex - 1], LayerIndex);
+		u32 Bias = GraphLeaf(Graph, GraphOp_Bias, Network.Layers[LayerIndex], 1, LayerIndex);
+		Graph->WeightNodes[LayerIndex] = Weight;
+		Graph->BiasNodes[LayerIndex] = Bias;
+
+		WeightedInput = GraphElementwise(Graph, GraphOp_AddColumn, GraphMult(Graph, Weight, Activation), Bias);
+		Activation = GraphElementwise(Graph, GraphOp_Sigmoid, WeightedInput);
+	}
+
+	switch(Network.CostFn)
+	{
+		case CostFn_Quadratic:
+		{
+			Graph->CostNode = GraphNode(Graph, GraphOp_QuadraticCost, 1, 1, Activation, Graph->TargetNode);
+		} break;
+
+		case CostFn_CrossEntropy:
+		{
+			// NOTE: Over the weighted inputs, whose gradient doesn't go through
+			//	sigmoid'.
+			Graph->CostNode = GraphNode(Graph, GraphOp_CrossEntropyCost, 1, 1, WeightedInput, Graph->TargetNode);
+		} break;
+
+		InvalidDefaultCase;
+	}
+
+	Graph->ForwardCount = Graph->NodeCount - 1;
+}
+
+internal void
+AddGradient(compute_graph *Graph, u32 *Gradients, u32 NodeIndex, u32 Gradient)
+{
+	// NOTE: A value used more than once sums the gradients from each use.
+	if(Gradients[NodeIndex])
+	{
+		Gradients[NodeIndex] = GraphElementwise(Graph, GraphOp_Plus, Gradients[NodeIndex], Gradient);
+	}
+	else
+	{
+		Gradients[NodeIndex] = Gradient;
+	}
+}
+
+internal void
+DifferentiateGraph(memory_pool *Pool, compute_graph *Graph)
+{
+	temp_memory TempMem = PoolBeginTempMemory(Pool);
+
+	// NOTE: Operands come before the nodes that use them, so going backwards
+	//	every gradient is complete before it's passed on.
+	u32 *Gradients = PoolPushArray(Pool, u32, Graph->CostNode + 1);
+	memset(Gradients, 0, (Graph->CostNode + 1)*sizeof(u32));
+
+	for(u32 NodeIndex = Graph->CostNode;
+	    NodeIndex > 0;
+	    --NodeIndex)
+	{
+		graph_node Node = Graph->Nodes[NodeIndex];
+		u32 Gradient = Gradients[NodeIndex];
+		if(!Gradient && (NodeIndex != Graph->CostNode))
+		{
+			continue;
+		}
+
+		u32 A = Node.Operands[0];
+		u32 B = Node.Operands[1];
+		switch(Node.Op)
+		{
+			case GraphOp_QuadraticCost:
+			{
+				// NOTE: C = |a - y|^2/2
+				AddGradient(Graph, Gradients, A, GraphElementwise(Graph, GraphOp_Minus, A, B));
+			} break;
+
+			case GraphOp_CrossEntropyCost:
+			{
+				// NOTE: C = -y ln sigmoid(z) - (1 - y) ln(1 - sigmoid(z))
+				u32 Activation = GraphElementwise(Graph, GraphOp_Sigmoid, A);
+				AddGradient(Graph, Gradients, A, GraphElementwise(Graph, GraphOp_Minus, Activation, B));
+			} break;
+
+			case GraphOp_Mult:
+			{
+				AddGradient(Graph, Gradients, A, GraphMultTranspose(Graph, Gradient, B));
+				AddGradient(Graph, Gradients, B, GraphTransposeMult(Graph, A, Gradient));
+			} break;
+
+			case GraphOp_AddColumn:
+			{
+				AddGradient(Graph, Gradients, A, Gradient);
+				AddGradient(Graph, Gradients, B, GraphSumColumns(Graph, Gradient));
+			} break;
+
+			case GraphOp_Sigmoid:
+			{
+				u32 Prime = GraphElementwise(Graph, GraphOp_SigmoidPrime, A);
+				AddGradient(Graph, Gradients, A, GraphElementwise(Graph, GraphOp_Hadamard, Gradient, Prime));
+			} break;
+
+			case GraphOp_Plus:
+			{
+				AddGradient(Graph, Gradients, A, Gradient);
+				AddGradient(Graph, Gradients, B, Gradient);
+			} break;
+
+			case GraphOp_Input:
+			case GraphOp_Target:
+			case GraphOp_Weight:
+			case GraphOp_Bias:
+			{
+			} break;
+
+			InvalidDefaultCase;
+		}
+	}
+
+	for(u32 LayerIndex = 1;
+	    LayerIndex < Graph->LayerCount;
+	    ++LayerIndex)
+	{
+		Graph->WeightGradientNodes[LayerIndex] = Gradients[Graph->WeightNodes[LayerIndex]];
+		Graph->BiasGradientNodes[LayerIndex] = Gradients[Graph->BiasNodes[LayerIndex]];
+		Assert(Graph->WeightGradientNodes[LayerIndex] && Graph->BiasGradientNodes[LayerIndex]);
+
+		Graph->Nodes[Graph->WeightGradientNodes[LayerIndex]].Output = true;
+		Graph->Nodes[Graph->BiasGradientNodes[LayerIndex]].Output = true;
+	}
+
+	Graph->DifferentiatedCount = Graph->NodeCount - 1;
+
+	PoolEndTempMemory(TempMem);
+}
+
+//
+// NOTE: Passes
+//
+
+internal u32
+MarkLiveNodes(compute_graph *Graph)
+{
+	// NOTE: Live is everything the parameter gradients are computed from;
+	//	UseCount only counts live users.
+	for(u32 NodeIndex = 1;
+	    NodeIndex < Graph->NodeCount;
+	    ++NodeIndex)
+	{
+		graph_node *Node = Graph->Nodes + NodeIndex;
+		Node->Live = Node->Output;
+		Node->UseCount = 0;
+	}
+
+	u32 Result = 0;
+	for(u32 NodeIndex = Graph->NodeCount - 1;
+	    NodeIndex > 0;
+	    --NodeIndex)
+	{
+		graph_node *Node = Graph->Nodes + NodeIndex;
+		if(!Node->Live)
+		{
+			continue;
+		}
+
+		++Result;
+		for(u32 OperandIndex = 0;
+		    OperandIndex < Node->OperandCount;
+		    ++OperandIndex)
+		{
+			graph_node *Operand = Graph->Nodes + Node->Operands[OperandIndex];
+			Operand->Live = true;
+			++Operand->UseCount;
+		}
+	}
+
+	return Result;
+}
+
+internal void
+FuseGraph(compute_graph *Graph)
+{
+	// NOTE: Nodes are rewritten where they are, so the operands still come
+	//	first. An absorbed node has to have no other users; it's dead after.
+	for(u32 NodeIndex = 1;
+	    NodeIndex < Graph->NodeCount;
+	    ++NodeIndex)
+	{
+		graph_node *Node = Graph->Nodes + NodeIndex;
+		if(!Node->Live)
+		{
+			continue;
+		}
+
+		graph_node *A = Graph->Nodes + Node->Operands[0];
+		graph_node *B = Graph->Nodes + Node->Operands[1];
+		b32 Fused = false;
+
+		if((Node->Op == GraphOp_Hadamard) && (B->Op == GraphOp_SigmoidPrime) && (B->UseCount == 1))
+		{
+			// NOTE: g * sigmoid'(z)
+			Node->Op = GraphOp_SigmoidBackward;
+			Node->Operands[1] = B->Operands[0];
+			Fused = true;
+		}
+		else if((Node->Op == GraphOp_AddColumn) && (A->Op == GraphOp_Mult) && (A->UseCount == 1))
+		{
+			// NOTE: W*a + b
+			Node->Op = GraphOp_MultAddColumn;
+			Node->OperandCount = 3;
+			Node->Operands[2] = Node->Operands[1];
+			Node->Operands[0] = A->Operands[0];
+			Node->Operands[1] = A->Operands[1];
+			Fused = true;
+		}
+
+		if((Node->Op == GraphOp_SigmoidBackward) && (A->Op == GraphOp_Minus) && (A->UseCount == 1))
+		{
+			// NOTE: (a - y) * sigmoid'(z)
+			Node->Op = GraphOp_QuadraticError;
+			Node->OperandCount = 3;
+			Node->Operands[2] = Node->Operands[1];
+			Node->Operands[0] = A->Operands[0];
+			Node->Operands[1] = A->Operands[1];
+			Fused = true;
+		}
+
+		if(Fused)
+		{
+			++Graph->FusedCount;
+			MarkLiveNodes(Graph);
+		}
+	}
+}
+
+internal void
+PlanGraphMemory(memory_pool *Pool, compute_graph *Graph)
+{
+	Graph->ScheduleCount = 0;
+	for(u32 NodeIndex = 1;
+	    NodeIndex < Graph->NodeCount;
+	    ++NodeIndex)
+	{
+		graph_node *Node = Graph->Nodes + NodeIndex;
+		if(Node->Live && Node->OperandCount)
+		{
+			Graph->Schedule[Graph->ScheduleCount++] = NodeIndex;
+		}
+	}
+
+	for(u32 ScheduleIndex = 0;
+	    ScheduleIndex < Graph->ScheduleCount;
+	    ++ScheduleIndex)
+	{
+		graph_node *Node = Graph->Nodes + Graph->Schedule[ScheduleIndex];
+		for(u32 OperandIndex = 0;
+		    OperandIndex < Node->OperandCount;
+		    ++OperandIndex)
+		{
+			Graph->Nodes[Node->Operands[OperandIndex]].LastUse = ScheduleIndex;
+		}
+		if(Node->Output)
+		{
+			Node->LastUse = Graph->ScheduleCount;
+		}
+	}
+
+	umm SlotFloats[GRAPH_MAX_NODES];
+	b32 SlotFree[GRAPH_MAX_NODES];
+	Graph->SlotCount = 0;
+	Graph->UnplannedFloats = 0;
+
+	for(u32 ScheduleIndex = 0;
+	    ScheduleIndex < Graph->ScheduleCount;
+	    ++ScheduleIndex)
+	{
+		graph_node *Node = Graph->Nodes + Graph->Schedule[ScheduleIndex];
+		umm Floats = (umm)MatrixStrideFor(Node->RowCount)*Node->ColumnCount;
+		Graph->UnplannedFloats += Floats;
+
+		b32 Elementwise = ((Node->Op == GraphOp_AddColumn) ||
+		                   (Node->Op == GraphOp_Plus) ||
+		                   (Node->Op == GraphOp_Minus) ||
+		                   (Node->Op == GraphOp_Hadamard) ||
+		                   (Node->Op == GraphOp_Sigmoid) ||
+		                   (Node->Op == GraphOp_SigmoidPrime) ||
+		                   (Node->Op == GraphOp_SigmoidBackward) ||
+		                   (Node->Op == GraphOp_QuadraticError));
+
+		s32 Slot = -1;
+		if(Elementwise)
+		{
+			// NOTE: Each element is read before it's written, so an operand
+			//	that's done after this can be overwritten.
+			for(u32 OperandIndex = 0;
+			    (Slot < 0) && (OperandIndex < Node->OperandCount);
+			    ++OperandIndex)
+			{
+				graph_node *Operand = Graph->Nodes + Node->Operands[OperandIndex];
+				if((Operand->Slot >= 0) &&
+				   (Operand->LastUse == ScheduleIndex) &&
+				   (Operand->RowCount == Node->RowCount) &&
+				   (Operand->ColumnCount == Node->ColumnCount))
+				{
+					Slot = Operand->Slot;
+				}
+			}
+		}
+
+		if(Slot < 0)
+		{
+			for(u32 SlotIndex = 0;
+			    SlotIndex < Graph->SlotCount;
+			    ++SlotIndex)
+			{
+				if(SlotFree[SlotIndex] &&
+				   (SlotFloats[SlotIndex] >= Floats) &&
+				   ((Slot < 0) || (SlotFloats[SlotIndex] < SlotFloats[Slot])))
+				{
+					Slot = (s32)SlotIndex;
+				}
+			}
+		}
+
+		if(Slot < 0)
+		{
+			Slot = (s32)Graph->SlotCount++;
+			SlotFloats[Slot] = Floats;
+		}
+		SlotFree[Slot] = false;
+		Node->Slot = Slot;
+
+		for(u32 OperandIndex = 0;
+		    OperandIndex < Node->OperandCount;
+		    ++OperandIndex)
+		{
+			graph_node *Operand = Graph->Nodes + Node->Operands[OperandIndex];
+			if((Operand->Slot >= 0) && (Operand->Slot != Slot) && (Operand->LastUse == ScheduleIndex))
+			{
+				SlotFree[Operand->Slot] = true;
+			}
+		}
+	}
+
+	// NOTE: Every size is a whole number of strides, so each slot stays aligned.
+	umm SlotOffsets[GRAPH_MAX_NODES];
+	Graph->ArenaFloats = 0;
+	for(u32 SlotIndex = 0;
+	    SlotIndex < Graph->SlotCount;
+	    ++SlotIndex)
+	{
+		SlotOffsets[SlotIndex] = Graph->ArenaFloats;
+		Graph->ArenaFloats += SlotFloats[SlotIndex];
+	}
+	Graph->Arena = PoolPushArrayAligned(Pool, r32, Graph->ArenaFloats);
+
+	for(u32 ScheduleIndex = 0;
+	    ScheduleIndex < Graph->ScheduleCount;
+	    ++ScheduleIndex)
+	{
+		graph_node *Node = Graph->Nodes + Graph->Schedule[ScheduleIndex];
+		Node->Value.RowCount = Node->RowCount;
+		Node->Value.ColumnCount = Node->ColumnCount;
+		Node->Value.Stride = MatrixStrideFor(Node->RowCount);
+		Node->Value.Data = Graph->Arena + SlotOffsets[Node->Slot];
+	}
+
+	Graph->Gradients.WeightGradients = PoolPushArray(Pool, matrix, Graph->LayerCount);
+	Graph->Gradients.BiasGradients = PoolPushArray(Pool, vec, Graph->LayerCount);
+	for(u32 LayerIndex = 1;
+	    LayerIndex < Graph->LayerCount;
+	    ++LayerIndex)
+	{
+		matrix BiasGradient = Graph->Nodes[Graph->BiasGradientNodes[LayerIndex]].Value;
+		Graph->Gradients.WeightGradients[LayerIndex] = Graph->Nodes[Graph->WeightGradientNodes[LayerIndex]].Value;
+		Graph->Gradients.BiasGradients[LayerIndex] = {BiasGradient.Data, BiasGradient.RowCount};
+	}
+}
+
+internal b32
+GraphSupportsNetwork(neural_network Network)
+{
+	b32 Result = (!Network.Ranks && !Network.BlockSparseWeights && NetworkIsDense(Network) &&
+	              NetworkIsAllSigmoid(Network));
+	return Result;
+}
+
+internal compute_graph *
+CompileTrainingGraph(memory_pool *Pool, neural_network Network, u32 BatchSize)
+{
+	TRACE_BLOCK("Graph compile");
+
+	compute_graph *Graph = PoolPushStruct(Pool, compute_graph);
+	*Graph = {};
+
+	BuildTrainingGraph(Pool, Graph, Network, BatchSize);
+	DifferentiateGraph(Pool, Graph);
+	u32 LiveCount = MarkLiveNodes(Graph);
+	Graph->DeadCount = Graph->DifferentiatedCount - LiveCount;
+	FuseGraph(Graph);
+	PlanGraphMemory(Pool, Graph);
+
+	printf("Graph: %u forward nodes, %u after autodiff, %u dead, %u fused; %u ops run\n",
+	       Graph->ForwardCount, Graph->DifferentiatedCount, Graph->DeadCount, Graph->FusedCount,
+	       Graph->ScheduleCount);
+	printf("Graph memory: %.2fMB in %u buffers, %.2fMB with one per op\n",
+	       (r32)(Graph->ArenaFloats*sizeof(r32))/(r32)(Megabytes(1)), Graph->SlotCount,
+	       (r32)(Graph->UnplannedFloats*sizeof(r32))/(r32)(Megabytes(1)));
+
+	return Graph;
+}
+
+internal void
+PrintGraphSchedule(compute_graph *Graph)
+{
+	for(u32 ScheduleIndex = 0;
+	    ScheduleIndex < Graph->ScheduleCount;
+	    ++ScheduleIndex)
+	{
+		u32 NodeIndex = Graph->Schedule[ScheduleIndex];
+		graph_node *Node = Graph->Nodes + NodeIndex;
+		printf("  %3u: %%%-3u = %-16s", ScheduleIndex, NodeIndex, GraphOpNames[Node->Op]);
+		for(u32 OperandIndex = 0;
+		    OperandIndex < Node->OperandCount;
+		    ++OperandIndex)
+		{
+			graph_node *Operand = Graph->Nodes + Node->Operands[OperandIndex];
+			if(Operand->OperandCount)
+			{
+				printf(" %%%u", Node->Operands[OperandIndex]);
+			}
+			else if(Operand->LayerIndex)
+			{
+				printf(" %s%u", GraphOpNames[Operand->Op], Operand->LayerIndex);
+			}
+			else
+			{
+				printf(" %s", GraphOpNames[Operand->Op]);
+			}
+		}
+		printf("   [%ux%u in buffer %d%s]\n", Node->RowCount, Node->ColumnCount, Node->Slot,
+		       Node->Output ? ", gradient" : "");
+	}
+}
+
+//
+// NOTE: Executor
+//
+
+internal void
+RunGraph(memory_pool *Pool, parallel_context *Parallel, compute_graph *Graph, neural_network Network,
+         matrix Inputs, matrix Targets)
+{
+	TIMED_BLOCK("RunGraph", 0, 0);
+
+	Assert((Inputs.ColumnCount == Graph->BatchSize) && (Targets.ColumnCount == Graph->BatchSize));
+	Assert(Network.LayerCount == Graph->LayerCount);
+
+	Graph->Nodes[Graph->InputNode].Value = Inputs;
+	Graph->Nodes[Graph->TargetNode].Value = Targets;
+	for(u32 LayerIndex = 1;
+	    LayerIndex < Network.LayerCount;
+	    ++LayerIndex)
+	{
+		vec Bias = Network.BiasVectors[LayerIndex];
+		Graph->Nodes[Graph->WeightNodes[LayerIndex]].Value = Network.WeightMatrices[LayerIndex];
+		Graph->Nodes[Graph->BiasNodes[LayerIndex]].Value = Matrix(Bias.Data, Bias.Dimension, 1);
+	}
+
+	sparse_matrix SparseInputs = {};
+	b32 HasSparseInputs = false;
+	if(Parallel->SparseInputDensity > 0.0f)
+	{
+		HasSparseInputs = MakeSparseMatrix(Pool, Inputs, Parallel->SparseInputDensity, &SparseInputs);
+	}
+
+	for(u32 ScheduleIndex = 0;
+	    ScheduleIndex < Graph->ScheduleCount;
+	    ++ScheduleIndex)
+	{
+		graph_node *Node = Graph->Nodes + Graph->Schedule[ScheduleIndex];
+		TRACE_BLOCK_ARG("Graph op", Node->Op);
+
+		matrix Result = Node->Value;
+		matrix A = Graph->Nodes[Node->Operands[0]].Value;
+		matrix B = Graph->Nodes[Node->Operands[1]].Value;
+		matrix C = Graph->Nodes[Node->Operands[2]].Value;
+		b32 SparseB = (HasSparseInputs && (Node->Operands[1] == Graph->InputNode));
+
+		switch(Node->Op)
+		{
+			case GraphOp_Mult:
+			case GraphOp_MultAddColumn:
+			{
+				if(SparseB)
+				{
+					ParallelSparseMultInto(Pool, Parallel, Result, A, SparseInputs);
+				}
+				else
+				{
+					ParallelMultInto(Pool, Parallel, Result, A, B);
+				}
+				if(Node->Op == GraphOp_MultAddColumn)
+				{
+					vec Bias = {C.Data, C.RowCount};
+					EvaluateInto(Result, LazyMVPlus(Lazy(Result), Bias));
+				}
+			} break;
+
+			case GraphOp_TransposeMult:
+			{
+				ParallelTransposeMultInto(Pool, Parallel, Result, A, B);
+			} break;
+
+			case GraphOp_MultTranspose:
+			{
+				if(SparseB)
+				{
+					ParallelSparseMultTransposeInto(Pool, Parallel, Result, A, SparseInputs);
+				}
+				else
+				{
+					ParallelMultTransposeInto(Pool, Parallel, Result, A, B);
+				}
+			} break;
+
+			case GraphOp_SumColumns:
+			{
+				vec Sum = {Result.Data, Result.RowCount};
+				ParallelMatrixSumColumnsInto(Pool, Parallel, Sum, A);
+			} break;
+
+			case GraphOp_AddColumn:
+			{
+				vec Bias = {B.Data, B.RowCount};
+				EvaluateInto(Result, LazyMVPlus(Lazy(A), Bias));
+			} break;
+
+			case GraphOp_Plus:
+			{
+				EvaluateInto(Result, LazyPlus(Lazy(A), Lazy(B)));
+			} break;
+
+			case GraphOp_Minus:
+			{
+				EvaluateInto(Result, LazyMinus(Lazy(A), Lazy(B)));
+			} break;
+
+			case GraphOp_Hadamard:
+			{
+				EvaluateInto(Result, LazyHadamard(Lazy(A), Lazy(B)));
+			} break;
+
+			case GraphOp_Sigmoid:
+			{
+				SigmoidInto(Result, A);
+			} break;
+
+			case GraphOp_SigmoidPrime:
+			{
+				EvaluateInto(Result, LazySigmoidPrime(Lazy(A)));
+			} break;
+
+			case GraphOp_SigmoidBackward:
+			{
+				EvaluateInto(Result, LazyHadamard(Lazy(A), LazySigmoidPrime(Lazy(B))));
+			} break;
+
+			case GraphOp_QuadraticError:
+			{
+				EvaluateInto(Result, LazyHadamard(LazyMinus(Lazy(A), Lazy(B)), LazySigmoidPrime(Lazy(C))));
+			} break;
+
+			InvalidDefaultCase;
+		}
+	}
+}
+
+internal void
+GraphGradientDescentBatch(memory_pool *Pool, parallel_context *Parallel, compute_graph *Graph,
+                          neural_network Network, matrix Inputs, matrix Outputs,
+                          r32 LearningRate, r32 Regularization, u32 TotalTrials)
+{
+	TIMED_BLOCK("GraphGradientDescentBatch", 0, 0);
+
+	temp_memory TempMem = PoolBeginTempMemory(Pool);
+
+	RunGraph(Pool, Parallel, Graph, Network, Inputs, Outputs);
+	ApplyGradients(Network, Graph->Gradients, Inputs.ColumnCount, LearningRate, Regularization, TotalTrials);
+
+	PoolEndTempMemory(TempMem);
+}
+
+//
+// NOTE: Benchmark
+//
+
+internal BENCHMARK_TRAIN_BATCH(GraphBenchmarkBatch)
+{
+	GraphGradientDescentBatch(Pool, Parallel, (compute_graph *)Data, Network, Inputs, Outputs,
+	                          LearningRate, Regularization, TotalTrials);
+}
+
+internal void
+BenchmarkComputeGraph(memory_pool *Pool, parallel_context *Parallel, neural_network Network,
+                      data_set TrainingSet, u32 BatchSize, r32 LearningRate, r32 Regularization)
+{
+	TRACE_BLOCK("Graph benchmark");
+
+	if(!GraphSupportsNetwork(Network))
+	{
+		printf("The graph only trains dense, unfactored sigmoid networks; skipping the graph benchmark\n");
+		return;
+	}
+
+	temp_memory TempMem = PoolBeginTempMemory(Pool);
+
+	compute_graph *Graph = CompileTrainingGraph(Pool, Network, BatchSize);
+	PrintGraphSchedule(Graph);
+
+	training_benchmark Training = BenchmarkTraining(Pool, Parallel, Network, TrainingSet, BatchSize,
+	                                                GRAPH_BENCHMARK_BATCHES, LearningRate, Regularization,
+	                                                GraphBenchmarkBatch, 0, Graph);
+
+	printf("Graph benchmark, %u batches of %u, %u thread(s):\n",
+	       Training.BatchCount, BatchSize, Parallel->Queue->ThreadCount);
+	printf("  %-6s %14s\n", "", "train us/batch");
+	printf("  %-6s %14.2f\n", "hand", 1e6f*Training.GenericSeconds/Training.BatchCount);
+	printf("  %-6s %14.2f\n", "graph", 1e6f*Training.CandidateSeconds/Training.BatchCount);
+	printf("  speedup: %.2fx; %u weights and biases differ, by at most %g\n",
+	       Training.GenericSeconds/Training.CandidateSeconds, Training.DifferentCount, Training.MaxDifference);
+
+	PoolEndTempMemory(TempMem);
+}
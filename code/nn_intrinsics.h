@@ -1,54 +1,367 @@
-#pragma once
-
-// TODO: Remove this.
-#include <math.h>
-
-inline r32
-U8ToR32(u8 Value)
-{
-	r32 Result = (r32)Value / 255.0f;
-	return Result;
-}
-
-inline r32
-Exp(r32 Value)
-{
-	r32 Result = (r32)exp(Value);
-	return Result;
-}
-
-inline r32
-Sigmoid(r32 Value)
-{
-	r32 Result = 1.0f / (1.0f + Exp(-Value));
-	return Result;
-}
-
-inline r32
-Square(r32 Value)
-{
-	r32 Result = Value*Value;
-	return Result;
-}
-
-inline r32
-SigmoidPrime(r32 Value)
-{
-	r32 SigmoidValue = Sigmoid(Value);
-	r32 Result = SigmoidValue * (1.0f - SigmoidValue);
-	return Result;
-}
-
-inline r32
-Ln(r32 Value)
-{
-	r32 Result = logf(Value);
-	return Result;
-}
-
-inline r32
-SquareRoot(r32 Value)
-{
-	r32 Result = sqrtf(Value);
-	return Result;
-}
\ No newline at end of file
+#pragma once
+
+// TODO: Remove this.
+#include <math.h>
+
+inline r32
+U8ToR32(u8 Value)
+{
+	r32 Result = (r32)Value / 255.0f;
+	return Result;
+}
+
+inline r32
+Exp(r32 Value)
+{
+	r32 Result = (r32)exp(Value);
+	return Result;
+}
+
+inline r32
+Sigmoid(r32 Value)
+{
+	r32 Result = 1.0f / (1.0f + Exp(-Value));
+	return Result;
+}
+
+inline r32
+Square(r32 Value)
+{
+	r32 Result = Value*Value;
+	return Result;
+}
+
+inline r32
+SigmoidPrime(r32 Value)
+{
+	r32 SigmoidValue = Sigmoid(Value);
+	r32 Result = SigmoidValue * (1.0f - SigmoidValue);
+	return Result;
+}
+
+// NOTE: The negative side's slope. Small enough to act like ReLU, but the
+//	units below zero still get a gradient.
+#define LEAKY_RELU_SLOPE 0.01f
+
+inline r32
+ReLU(r32 Value)
+{
+	r32 Result = (Value > 0.0f) ? Value : 0.0f;
+	return Result;
+}
+
+inline r32
+ReLUPrime(r32 Value)
+{
+	r32 Result = (Value > 0.0f) ? 1.0f : 0.0f;
+	return Result;
+}
+
+inline r32
+LeakyReLU(r32 Value)
+{
+	r32 Result = (Value > 0.0f) ? Value : Value*LEAKY_RELU_SLOPE;
+	return Result;
+}
+
+inline r32
+LeakyReLUPrime(r32 Value)
+{
+	r32 Result = (Value > 0.0f) ? 1.0f : LEAKY_RELU_SLOPE;
+	return Result;
+}
+
+inline r32
+Tanh(r32 Value)
+{
+	// NOTE: Through the same exp as Sigmoid; it saturates to +-1.
+	r32 Result = 1.0f - 2.0f / (Exp(2.0f*Value) + 1.0f);
+	return Result;
+}
+
+inline r32
+TanhPrime(r32 Value)
+{
+	r32 TanhValue = Tanh(Value);
+	r32 Result = 1.0f - TanhValue*TanhValue;
+	return Result;
+}
+
+inline r32
+Sign(r32 Value)
+{
+	r32 Result = (Value > 0.0f) ? 1.0f : -1.0f;
+	return Result;
+}
+
+// NOTE: The straight-through estimator: Sign's derivative is taken to be
+//	the clipped identity's, one inside (-1, 1) and zero outside, so units
+//	far past the threshold stop getting pushed.
+inline r32
+SignPrime(r32 Value)
+{
+	r32 Result = ((Value > -1.0f) && (Value < 1.0f)) ? 1.0f : 0.0f;
+	return Result;
+}
+
+inline r32
+Ln(r32 Value)
+{
+	r32 Result = logf(Value);
+	return Result;
+}
+
+inline r32
+SquareRoot(r32 Value)
+{
+	r32 Result = sqrtf(Value);
+	return Result;
+}
+
+inline r32
+AbsoluteValue(r32 Value)
+{
+	r32 Result = fabsf(Value);
+	return Result;
+}
+
+// NOTE: Rounds to nearest even. NaNs stay NaNs, made quiet so the
+//	rounding can't carry them into an infinity.
+inline bf16
+R32ToBF16(r32 Value)
+{
+	u32 Bits;
+	memcpy(&Bits, &Value, sizeof(Bits));
+
+	bf16 Result;
+	if(Value != Value)
+	{
+		Result = (bf16)((Bits >> 16) | 0x40);
+	}
+	else
+	{
+		Result = (bf16)((Bits + 0x7FFF + ((Bits >> 16) & 1)) >> 16);
+	}
+	return Result;
+}
+
+inline r32
+BF16ToR32(bf16 Value)
+{
+	u32 Bits = (u32)Value << 16;
+	r32 Result;
+	memcpy(&Result, &Bits, sizeof(Result));
+	return Result;
+}
+
+inline u32
+FindLeastSignificantSetBit(u32 Value)
+{
+	Assert(Value != 0);
+#if _WIN32
+	unsigned long Index;
+	_BitScanForward(&Index, Value);
+	u32 Result = (u32)Index;
+#else
+	u32 Result = (u32)__builtin_ctz(Value);
+#endif
+	return Result;
+}
+
+inline u32
+CountSetBits(u32 Value)
+{
+#if _WIN32
+	u32 Result = (u32)__popcnt(Value);
+#else
+	u32 Result = (u32)__builtin_popcount(Value);
+#endif
+	return Result;
+}
+
+inline u32
+CountSetBits64(u64 Value)
+{
+#if _WIN32
+	u32 Result = (u32)__popcnt64(Value);
+#else
+	u32 Result = (u32)__builtin_popcountll(Value);
+#endif
+	return Result;
+}
+
+//
+// NOTE: CPU features
+//
+
+#if !_WIN32
+	#include <cpuid.h>
+#endif
+
+enum cpu_level
+{
+	CpuLevel_Scalar,
+	CpuLevel_SSE42,
+	CpuLevel_AVX2,
+	CpuLevel_AVX512,
+
+	CpuLevel_Count,
+};
+
+global_variable char *CpuLevelNames[CpuLevel_Count] =
+{
+	"scalar",
+	"sse4.2",
+	"avx2",
+	"avx512",
+};
+
+inline void
+CpuId(u32 Leaf, u32 SubLeaf, u32 *Registers)
+{
+#if _WIN32
+	__cpuidex((int *)Registers, (int)Leaf, (int)SubLeaf);
+#else
+	__cpuid_count(Leaf, SubLeaf, Registers[0], Registers[1], Registers[2], Registers[3]);
+#endif
+}
+
+inline u64
+ReadExtendedControlRegister0()
+{
+#if _WIN32
+	u64 Result = _xgetbv(0);
+#else
+	u32 Low;
+	u32 High;
+	__asm__ volatile("xgetbv" : "=a"(Low), "=d"(High) : "c"(0));
+	u64 Result = ((u64)High << 32) | Low;
+#endif
+	return Result;
+}
+
+// NOTE: 48 characters from extended leaves 0x80000002-4, plus the terminator.
+#define CPU_BRAND_STRING_SIZE 49
+
+internal void
+GetCpuBrandString(char *Dest)
+{
+	char Brand[CPU_BRAND_STRING_SIZE] = {};
+
+	u32 Registers[4];
+	CpuId(0x80000000, 0, Registers);
+	if(Registers[0] >= 0x80000004)
+	{
+		for(u32 LeafIndex = 0;
+		    LeafIndex < 3;
+		    ++LeafIndex)
+		{
+			CpuId(0x80000002 + LeafIndex, 0, (u32 *)(Brand + 16*LeafIndex));
+		}
+	}
+
+	char *Source = Brand;
+	while(*Source == ' ')
+	{
+		++Source;
+	}
+
+	if(*Source)
+	{
+		strcpy(Dest, Source);
+	}
+	else
+	{
+		strcpy(Dest, "unknown");
+	}
+}
+
+internal cpu_level
+GetSupportedCpuLevel()
+{
+	// NOTE: AVX and AVX-512 also need the OS to save the wider registers on a
+	//	context switch, which is what XCR0 says.
+	cpu_level Result = CpuLevel_Scalar;
+
+	u32 Registers[4];
+	CpuId(0, 0, Registers);
+	u32 MaxLeaf = Registers[0];
+
+	if(MaxLeaf >= 1)
+	{
+		CpuId(1, 0, Registers);
+		b32 SSE42 = (Registers[2] >> 20) & 1;
+		b32 POPCNT = (Registers[2] >> 23) & 1;
+		b32 FMA = (Registers[2] >> 12) & 1;
+		b32 OSXSave = (Registers[2] >> 27) & 1;
+		b32 AVX = (Registers[2] >> 28) & 1;
+
+		if(SSE42 && POPCNT)
+		{
+			Result = CpuLevel_SSE42;
+		}
+
+		if(OSXSave && AVX && FMA && (MaxLeaf >= 7))
+		{
+			u64 XCR0 = ReadExtendedControlRegister0();
+			b32 OSSavesYMM = ((XCR0 & 0x6) == 0x6);
+			b32 OSSavesZMM = ((XCR0 & 0xE6) == 0xE6);
+
+			CpuId(7, 0, Registers);
+			b32 AVX2 = (Registers[1] >> 5) & 1;
+			b32 AVX512F = (Registers[1] >> 16) & 1;
+
+			if(OSSavesYMM && AVX2)
+			{
+				Result = CpuLevel_AVX2;
+				if(OSSavesZMM && AVX512F)
+				{
+					Result = CpuLevel_AVX512;
+				}
+			}
+		}
+	}
+
+	return Result;
+}
+
+// NOTE: AVX512-BF16's dot product, on top of CpuLevel_AVX512, which has
+//	already checked that the OS saves the registers.
+internal b32
+GetSupportedBF16()
+{
+	b32 Result = false;
+
+	u32 Registers[4];
+	CpuId(0, 0, Registers);
+	if(Registers[0] >= 7)
+	{
+		CpuId(7, 0, Registers);
+		u32 MaxSubLeaf = Registers[0];
+		b32 AVX512BW = (Registers[1] >> 30) & 1;
+		if(AVX512BW && (MaxSubLeaf >= 1))
+		{
+			CpuId(7, 1, Registers);
+			Result = (Registers[0] >> 5) & 1;
+		}
+	}
+
+	return Result;
+}
+
+// NOTE: AVX512-VPOPCNTDQ's per-lane popcount, on top of CpuLevel_AVX512.
+internal b32
+GetSupportedVPOPCNTDQ()
+{
+	b32 Result = false;
+
+	u32 Registers[4];
+	CpuId(0, 0, Registers);
+	if(Registers[0] >= 7)
+	{
+		CpuId(7, 0, Registers);
+		Result = (Registers[2] >> 14) & 1;
+	}
+
+	return Result;
+}
@@ -1,277 +1,1075 @@
-
-internal u32
-GetFileSize(FILE *File)
-{
-	u32 CurrentPosition = ftell(File);
-	fseek(File, 0, SEEK_SET);
-	u32 BeginningPosition = ftell(File);
-	fseek(File, 0, SEEK_END);
-	u32 EndPosition = ftell(File);
-
-	u32 Result = EndPosition - BeginningPosition;
-	fseek(File, (u32)CurrentPosition, SEEK_SET);
-	return Result;
-}
-
-internal void
-ConvertToLittleEndian(u32 *Value)
-{
-	*Value = (((*Value & 0xFF) << 24) |
-	          ((*Value & 0xFF00) << 8) |
-	          ((*Value & 0xFF0000) >> 8) |
-	          ((*Value & 0xFF000000) >> 24));
-}
-
-internal u8 *
-LoadEntireFile(memory_pool *Pool, char *Filename)
-{
-	u8 *Result = 0;
-
-	FILE *File = 0;
-	errno_t Error = fopen_s(&File, Filename, "rb");
-	Assert(Error == 0);
-
-	u32 FileSize = GetFileSize(File);
-	Result = PoolPushSize(Pool, FileSize);
-
-	umm SizeRead = fread(Result, 1, FileSize, File);
-	Assert(SizeRead == FileSize);
-
-	fclose(File);
-	return Result;
-}
-
-internal mnist_image_set_file_header *
-LoadMNISTImageSet(memory_pool *Pool, char *Filename)
-{
-	u8 *FileData = LoadEntireFile(Pool, Filename);
-
-	ConvertToLittleEndian((u32 *)FileData);
-	Assert(*(u32 *)FileData == 2051);
-
-	ConvertToLittleEndian((u32 *)FileData + 1);
-	ConvertToLittleEndian((u32 *)FileData + 2);
-	ConvertToLittleEndian((u32 *)FileData + 3);
-
-	mnist_image_set_file_header *Result = (mnist_image_set_file_header *)FileData;
-	return Result;
-}
-
-internal mnist_label_set_file_header *
-LoadMNISTLabelSet(memory_pool *Pool, char *Filename)
-{
-	u8 *FileData = LoadEntireFile(Pool, Filename);
-
-	ConvertToLittleEndian((u32 *)FileData);
-	Assert(*(u32 *)FileData == 2049);
-
-	ConvertToLittleEndian((u32 *)FileData + 1);
-
-	mnist_label_set_file_header *Result = (mnist_label_set_file_header *)FileData;
-	return Result;
-}
-
-internal data_set
-LoadMNISTData(memory_pool *Pool, memory_pool *TempPool, char *ImagesFile, char *LabelsFile)
-{
-	data_set Result = {};
-
-	temp_memory TempMem = PoolBeginTempMemory(TempPool);
-	mnist_image_set_file_header *ImagesHeader = LoadMNISTImageSet(TempPool, ImagesFile);
-	mnist_label_set_file_header *LabelsHeader = LoadMNISTLabelSet(TempPool, LabelsFile);
-
-	Assert(ImagesHeader->ImageCount == LabelsHeader->ItemCount);
-	Result.DataCount = ImagesHeader->ImageCount;
-
-	Result.InputData = PoolPushArray(Pool, vec, Result.DataCount);
-	Result.OutputData = PoolPushArray(Pool, vec, Result.DataCount);
-
-	u8 *ImageData = (u8 *)(ImagesHeader + 1);
-	u8 *LabelData = (u8 *)(LabelsHeader + 1);
-
-	u32 ImageSize = ImagesHeader->RowCount * ImagesHeader->ColumnCount;
-	vec *ImageVec = Result.InputData;
-	for(u32 ImageIndex = 0 ;
-	    ImageIndex < Result.DataCount;
-	    ++ImageIndex)
-	{
-		*ImageVec = VecRaw_(Pool, ImageSize);
-		r32 *Value = ImageVec->Data;
-		for(u32 PixelIndex = 0;
-		    PixelIndex < ImageSize;
-		  	++PixelIndex)
-		{
-			*Value++ = U8ToR32(*ImageData++);
-		}
-		++ImageVec;
-	}
-
-	vec *LabelVec = Result.OutputData;
-	for(u32 LabelIndex = 0 ;
-	    LabelIndex < Result.DataCount;
-	    ++LabelIndex)
-	{
-		*LabelVec = VecZero(Pool, MNIST_OUTPUT_SIZE);
-		LabelVec->Data[*LabelData++] = 1.0f;
-		++LabelVec;
-	}
-
-	PoolEndTempMemory(TempMem);
-
-	return Result;
-}
-
-internal u32
-NetworkGetTotalFileSize(neural_network Network)
-{
-	u32 Result = 0;
-	Result += sizeof(neural_network_file_header);
-	Result += Network.LayerCount * sizeof(u32);
-	Result += (Network.LayerCount - 1) * sizeof(matrix_serialized);
-	Result += (Network.LayerCount - 1) * sizeof(vec_serialized);
-
-	for(u32 LayerIndex = 1;
-		LayerIndex < Network.LayerCount;
-		++LayerIndex)
-	{
-		u32 LastLayerSize = Network.Layers[LayerIndex - 1];
-		u32 LayerSize = Network.Layers[LayerIndex];
-
-		Result += LastLayerSize * LayerSize * sizeof(r32);
-		Result += LayerSize * sizeof(r32);
-	}
-
-	return Result;
-}
-
-inline u32
-OffsetFrom(void *From, void *To)
-{
-	u32 Result = (u32)((u64)To - (u64)From);
-	return Result;
-}
-
-internal void
-SerializeNetworkToDisk(memory_pool *Pool, neural_network Network, char *Filename)
-{
-	temp_memory TempMem = PoolBeginTempMemory(Pool);
-
-	FILE *NetworkFile;
-	errno_t	Error = fopen_s(&NetworkFile, Filename, "wb");
-	Assert(Error == 0);
-
-	u32 TotalFileSize = NetworkGetTotalFileSize(Network);
-	neural_network_file_header *Header = (neural_network_file_header *)PoolPushSize(Pool, TotalFileSize);
-
-	Header->MagicNumber = NEURAL_NETWORK_MAGIC_NUMBER;
-	Header->CostFn = Network.CostFn;
-	Header->LayerCount = Network.LayerCount;
-
-	Header->LayersOffset = sizeof(neural_network_file_header);
-	u32 *LayerData = (u32 *)(((u8 *)Header) + Header->LayersOffset);
-	for(u32 LayerIndex = 0;
-		LayerIndex < Header->LayerCount;
-		++LayerIndex)
-	{
-		*LayerData++ = Network.Layers[LayerIndex];
-	}
-
-	Header->WeightMatricesOffset = OffsetFrom(Header, LayerData);
-	matrix_serialized *DestMatrix = (matrix_serialized *)(((u8 *)Header) + Header->WeightMatricesOffset);
-	r32 *MatrixData = (r32 *)(((u8 *)DestMatrix) + sizeof(matrix_serialized)*(Header->LayerCount - 1));
-	for(u32 LayerIndex = 1;
-		LayerIndex < Header->LayerCount;
-		++LayerIndex)
-	{
-		matrix *SourceMatrix = Network.WeightMatrices + LayerIndex;
-		DestMatrix->RowCount = SourceMatrix->RowCount;
-		DestMatrix->ColumnCount = SourceMatrix->ColumnCount;
-		DestMatrix->DataOffset = OffsetFrom(Header, MatrixData);
-		++DestMatrix;
-
-		r32 *SourceData = SourceMatrix->Data;
-		u32 MatrixDataCount = SourceMatrix->RowCount * SourceMatrix->ColumnCount;
-		for(u32 MatrixDataIndex = 0;
-			MatrixDataIndex < MatrixDataCount;
-			++MatrixDataIndex)
-		{
-			*MatrixData++ = *SourceData++;
-		}
-	}
-
-	Header->BiasVectorsOffset = OffsetFrom(Header, MatrixData);
-	vec_serialized *DestVec = (vec_serialized *)(((u8 *)Header) + Header->BiasVectorsOffset);
-	r32 *VecData = (r32 *)(((u8 *)DestVec) + sizeof(vec_serialized)*(Header->LayerCount - 1));
-	for(u32 LayerIndex = 1;
-		LayerIndex < Header->LayerCount;
-		++LayerIndex)
-	{
-		vec *SourceVec = Network.BiasVectors + LayerIndex;
-		DestVec->Dimension = SourceVec->Dimension;
-		DestVec->DataOffset = OffsetFrom(Header, VecData);
-		++DestVec;
-
-		r32 *SourceData = SourceVec->Data;
-		u32 VecDataCount = SourceVec->Dimension;
-		for(u32 VecDataIndex = 0;
-			VecDataIndex < VecDataCount;
-			++VecDataIndex)
-		{
-			*VecData++ = *SourceData++;
-		}
-	}
-
-	fwrite(Header, TotalFileSize, 1, NetworkFile);
-
-	fclose(NetworkFile);
-	PoolEndTempMemory(TempMem);
-}
-
-inline void *
-AddOffsetToPointer(void *Pointer, u32 Offset)
-{
-	void *Result = (u8 *)Pointer + Offset;
-	return Result;
-}
-
-internal neural_network
-LoadNetwork(memory_pool *Pool, char *Filename)
-{
-	neural_network Result = {};
-	neural_network_file_header *Header = (neural_network_file_header *)LoadEntireFile(Pool, Filename);
-	Assert(Header->MagicNumber == NEURAL_NETWORK_MAGIC_NUMBER);
-
-	Result.CostFn = Header->CostFn;
-	Result.LayerCount = Header->LayerCount;
-	
-	Result.Layers = (u32 *)AddOffsetToPointer(Header, Header->LayersOffset);	
-	Result.WeightMatrices = PoolPushArray(Pool, matrix, Result.LayerCount);
-	Result.BiasVectors = PoolPushArray(Pool, vec, Result.LayerCount);
-
-	matrix_serialized *LoadedMatrices = (matrix_serialized *)AddOffsetToPointer(Header, Header->WeightMatricesOffset);
-	for(u32 MatrixIndex = 1;
-		MatrixIndex < Result.LayerCount;
-		++MatrixIndex)
-	{
-		matrix *Matrix = Result.WeightMatrices + MatrixIndex;
-		matrix_serialized *LoadedMatrix = LoadedMatrices + (MatrixIndex - 1);
-
-		Matrix->RowCount = LoadedMatrix->RowCount;
-		Matrix->ColumnCount = LoadedMatrix->ColumnCount;
-		Matrix->Data = (r32 *)AddOffsetToPointer(Header, LoadedMatrix->DataOffset);
-	}
-
-	vec_serialized *LoadedVectors = (vec_serialized *)AddOffsetToPointer(Header, Header->BiasVectorsOffset);
-	for(u32 VecIndex = 1;
-		VecIndex < Result.LayerCount;
-		++VecIndex)
-	{
-		vec *Vec = Result.BiasVectors + VecIndex;
-		vec_serialized *LoadedVec = LoadedVectors + (VecIndex - 1);
-		
-		Vec->Dimension = LoadedVec->Dimension;
-		Vec->Data = (r32 *)AddOffsetToPointer(Header, LoadedVec->DataOffset);
-	}
-
-	return Result;
-}
\ No newline at end of file
+
+internal u32
+GetFileSize(FILE *File)
+{
+	u32 CurrentPosition = ftell(File);
+	fseek(File, 0, SEEK_SET);
+	u32 BeginningPosition = ftell(File);
+	fseek(File, 0, SEEK_END);
+	u32 EndPosition = ftell(File);
+
+	u32 Result = EndPosition - BeginningPosition;
+	fseek(File, (u32)CurrentPosition, SEEK_SET);
+	return Result;
+}
+
+internal void
+ConvertToLittleEndian(u32 *Value)
+{
+	*Value = (((*Value & 0xFF) << 24) |
+	          ((*Value & 0xFF00) << 8) |
+	          ((*Value & 0xFF0000) >> 8) |
+	          ((*Value & 0xFF000000) >> 24));
+}
+
+internal u8 *
+LoadEntireFile(memory_pool *Pool, char *Filename)
+{
+	u8 *Result = 0;
+
+	FILE *File = 0;
+	errno_t Error = fopen_s(&File, Filename, "rb");
+	Assert(Error == 0);
+
+	u32 FileSize = GetFileSize(File);
+	// NOTE: Aligned so the 8 byte aligned offsets in packed network files
+	//	are 8 byte aligned in memory too.
+	Result = (u8 *)PoolPushSizeAligned(Pool, FileSize);
+
+	umm SizeRead = fread(Result, 1, FileSize, File);
+	Assert(SizeRead == FileSize);
+
+	fclose(File);
+	return Result;
+}
+
+internal mnist_image_set_file_header *
+LoadMNISTImageSet(memory_pool *Pool, char *Filename)
+{
+	u8 *FileData = LoadEntireFile(Pool, Filename);
+
+	ConvertToLittleEndian((u32 *)FileData);
+	Assert(*(u32 *)FileData == 2051);
+
+	ConvertToLittleEndian((u32 *)FileData + 1);
+	ConvertToLittleEndian((u32 *)FileData + 2);
+	ConvertToLittleEndian((u32 *)FileData + 3);
+
+	mnist_image_set_file_header *Result = (mnist_image_set_file_header *)FileData;
+	return Result;
+}
+
+internal mnist_label_set_file_header *
+LoadMNISTLabelSet(memory_pool *Pool, char *Filename)
+{
+	u8 *FileData = LoadEntireFile(Pool, Filename);
+
+	ConvertToLittleEndian((u32 *)FileData);
+	Assert(*(u32 *)FileData == 2049);
+
+	ConvertToLittleEndian((u32 *)FileData + 1);
+
+	mnist_label_set_file_header *Result = (mnist_label_set_file_header *)FileData;
+	return Result;
+}
+
+internal data_set
+LoadMNISTData(memory_pool *Pool, memory_pool *TempPool, char *ImagesFile, char *LabelsFile)
+{
+	TRACE_BLOCK("Load MNIST data");
+
+	data_set Result = {};
+
+	temp_memory TempMem = PoolBeginTempMemory(TempPool);
+	mnist_image_set_file_header *ImagesHeader = LoadMNISTImageSet(TempPool, ImagesFile);
+	mnist_label_set_file_header *LabelsHeader = LoadMNISTLabelSet(TempPool, LabelsFile);
+
+	Assert(ImagesHeader->ImageCount == LabelsHeader->ItemCount);
+	Result.DataCount = ImagesHeader->ImageCount;
+	Result.ImageWidth = ImagesHeader->ColumnCount;
+	Result.ImageHeight = ImagesHeader->RowCount;
+
+	u8 *ImageData = (u8 *)(ImagesHeader + 1);
+	u8 *LabelData = (u8 *)(LabelsHeader + 1);
+
+	u32 ImageSize = ImagesHeader->RowCount * ImagesHeader->ColumnCount;
+	Result.Inputs = MatrixRaw_(Pool, ImageSize, Result.DataCount);
+	for(u32 ImageIndex = 0 ;
+	    ImageIndex < Result.DataCount;
+	    ++ImageIndex)
+	{
+		r32 *Value = MatrixColumnData(Result.Inputs, ImageIndex);
+		for(u32 PixelIndex = 0;
+		    PixelIndex < ImageSize;
+		  	++PixelIndex)
+		{
+			*Value++ = U8ToR32(*ImageData++);
+		}
+	}
+
+	Result.Outputs = MatrixRaw_(Pool, MNIST_OUTPUT_SIZE, Result.DataCount);
+	for(u32 LabelIndex = 0 ;
+	    LabelIndex < Result.DataCount;
+	    ++LabelIndex)
+	{
+		r32 *Value = MatrixColumnData(Result.Outputs, LabelIndex);
+		for(u32 OutputIndex = 0;
+		    OutputIndex < MNIST_OUTPUT_SIZE;
+		    ++OutputIndex)
+		{
+			Value[OutputIndex] = 0.0f;
+		}
+		Value[*LabelData++] = 1.0f;
+	}
+
+	PoolEndTempMemory(TempMem);
+
+	return Result;
+}
+
+inline u32
+PackedDataAlign(u32 Offset)
+{
+	u32 Result = (Offset + 7) & ~7;
+	return Result;
+}
+
+inline u64
+DataSetCacheAlign(u64 Offset)
+{
+	u64 Result = (Offset + DATA_SET_CACHE_ALIGNMENT - 1) & ~(u64)(DATA_SET_CACHE_ALIGNMENT - 1);
+	return Result;
+}
+
+inline matrix
+CachedMatrix(data_set_cache_header *Header, u64 Offset, u32 Rows, u32 Stride)
+{
+	matrix Result = {};
+	Result.RowCount = Rows;
+	Result.ColumnCount = Header->DataCount;
+	Result.Stride = Stride;
+	Result.Data = (r32 *)((u8 *)Header + Offset);
+	return Result;
+}
+
+internal b32
+MapDataSetCache(char *CacheFilename, platform_file_stamp ImagesFile, platform_file_stamp LabelsFile,
+                data_set *Result)
+{
+	platform_mapped_file Mapped;
+	if(!PlatformMapFileReadOnly(CacheFilename, &Mapped))
+	{
+		return false;
+	}
+
+	data_set_cache_header *Header = (data_set_cache_header *)Mapped.Data;
+	b32 Valid = ((Mapped.Size >= sizeof(data_set_cache_header)) &&
+	             (Header->MagicNumber == DATA_SET_CACHE_MAGIC_NUMBER) &&
+	             (Header->Version == DATA_SET_CACHE_VERSION) &&
+	             (Header->TotalSize == Mapped.Size) &&
+	             (Header->ImagesFile.Size == ImagesFile.Size) &&
+	             (Header->ImagesFile.WriteTime == ImagesFile.WriteTime) &&
+	             (Header->LabelsFile.Size == LabelsFile.Size) &&
+	             (Header->LabelsFile.WriteTime == LabelsFile.WriteTime));
+	if(Valid)
+	{
+		u64 InputsSize = (u64)Header->InputStride*Header->DataCount*sizeof(r32);
+		u64 OutputsSize = (u64)Header->OutputStride*Header->DataCount*sizeof(r32);
+		Valid = ((Header->InputStride == MatrixStrideFor(Header->InputRowCount)) &&
+		         (Header->OutputStride == MatrixStrideFor(Header->OutputRowCount)) &&
+		         (Header->InputsOffset == DataSetCacheAlign(Header->InputsOffset)) &&
+		         (Header->OutputsOffset == DataSetCacheAlign(Header->OutputsOffset)) &&
+		         (Header->InputsOffset >= sizeof(data_set_cache_header)) &&
+		         ((Header->InputsOffset + InputsSize) <= Header->OutputsOffset) &&
+		         ((Header->OutputsOffset + OutputsSize) <= Header->TotalSize));
+	}
+
+	if(Valid)
+	{
+		*Result = {};
+		Result->DataCount = Header->DataCount;
+		Result->ImageWidth = Header->ImageWidth;
+		Result->ImageHeight = Header->ImageHeight;
+		Result->Inputs = CachedMatrix(Header, Header->InputsOffset, Header->InputRowCount, Header->InputStride);
+		Result->Outputs = CachedMatrix(Header, Header->OutputsOffset, Header->OutputRowCount, Header->OutputStride);
+	}
+	else
+	{
+		PlatformUnmapFile(&Mapped);
+	}
+
+	return Valid;
+}
+
+// NOTE: Written to a temporary file and renamed into place, so jobs that
+//	start while it is being built never map half of one. Jobs that all find
+//	it missing each build it, and the last rename wins; they're the same.
+internal b32
+WriteDataSetCache(char *CacheFilename, data_set DataSet, platform_file_stamp ImagesFile,
+                  platform_file_stamp LabelsFile)
+{
+	TRACE_BLOCK("Write data set cache");
+
+	char TempFilename[512];
+	if(snprintf(TempFilename, sizeof(TempFilename), "%s.%llx.tmp", CacheFilename,
+	            (unsigned long long)PlatformGetWallClock()) >= (int)sizeof(TempFilename))
+	{
+		return false;
+	}
+
+	data_set_cache_header Header = {};
+	Header.MagicNumber = DATA_SET_CACHE_MAGIC_NUMBER;
+	Header.Version = DATA_SET_CACHE_VERSION;
+	Header.ImagesFile = ImagesFile;
+	Header.LabelsFile = LabelsFile;
+	Header.DataCount = DataSet.DataCount;
+	Header.ImageWidth = DataSet.ImageWidth;
+	Header.ImageHeight = DataSet.ImageHeight;
+	Header.InputRowCount = DataSet.Inputs.RowCount;
+	Header.InputStride = DataSet.Inputs.Stride;
+	Header.OutputRowCount = DataSet.Outputs.RowCount;
+	Header.OutputStride = DataSet.Outputs.Stride;
+
+	u64 InputsSize = (u64)Header.InputStride*Header.DataCount*sizeof(r32);
+	u64 OutputsSize = (u64)Header.OutputStride*Header.DataCount*sizeof(r32);
+	Header.InputsOffset = DataSetCacheAlign(sizeof(data_set_cache_header));
+	Header.OutputsOffset = DataSetCacheAlign(Header.InputsOffset + InputsSize);
+	Header.TotalSize = Header.OutputsOffset + OutputsSize;
+
+	u8 Padding[DATA_SET_CACHE_ALIGNMENT] = {};
+	platform_file_buffer Buffers[] =
+	{
+		{&Header, sizeof(Header)},
+		{Padding, (umm)(Header.InputsOffset - sizeof(Header))},
+		{DataSet.Inputs.Data, (umm)InputsSize},
+		{Padding, (umm)(Header.OutputsOffset - (Header.InputsOffset + InputsSize))},
+		{DataSet.Outputs.Data, (umm)OutputsSize},
+	};
+
+	b32 Result = (PlatformWriteBuffersToFile(TempFilename, Buffers, ArrayCount(Buffers)) &&
+	              PlatformReplaceFile(TempFilename, CacheFilename));
+	if(!Result)
+	{
+		remove(TempFilename);
+	}
+	return Result;
+}
+
+// NOTE: LoadMNISTData through the cache: mapped when it is there and up to
+//	date, built and then mapped when it isn't. The conversion's own copy
+//	only lives until the cache is mapped.
+internal data_set
+LoadCachedMNISTData(memory_pool *Pool, memory_pool *TempPool, char *ImagesFile, char *LabelsFile)
+{
+	TRACE_BLOCK("Load cached MNIST data");
+
+	data_set Result = {};
+
+	char CacheFilename[512];
+	if(snprintf(CacheFilename, sizeof(CacheFilename), "%s" DATA_SET_CACHE_EXTENSION, ImagesFile) >=
+	   (int)sizeof(CacheFilename))
+	{
+		fprintf(stderr, "%s is too long to cache; loading it uncached\n", ImagesFile);
+		return LoadMNISTData(Pool, TempPool, ImagesFile, LabelsFile);
+	}
+
+	platform_file_stamp ImagesStamp = PlatformGetFileStamp(ImagesFile);
+	platform_file_stamp LabelsStamp = PlatformGetFileStamp(LabelsFile);
+	if(!MapDataSetCache(CacheFilename, ImagesStamp, LabelsStamp, &Result))
+	{
+		temp_memory TempMem = PoolBeginTempMemory(Pool);
+		data_set Loaded = LoadMNISTData(Pool, TempPool, ImagesFile, LabelsFile);
+		b32 Cached = (WriteDataSetCache(CacheFilename, Loaded, ImagesStamp, LabelsStamp) &&
+		              MapDataSetCache(CacheFilename, ImagesStamp, LabelsStamp, &Result));
+		PoolEndTempMemory(TempMem);
+
+		if(Cached)
+		{
+			printf("Cached %s and %s in %s\n", ImagesFile, LabelsFile, CacheFilename);
+		}
+		else
+		{
+			fprintf(stderr, "Could not write %s; loading the data uncached\n", CacheFilename);
+			Result = LoadMNISTData(Pool, TempPool, ImagesFile, LabelsFile);
+		}
+	}
+
+	return Result;
+}
+
+internal u32
+NetworkFileFlags(neural_network Network, network_file_format Format)
+{
+	u32 Result = 0;
+	if(Network.Activations)
+	{
+		Result |= NetworkFileFlag_Activations;
+	}
+	if(Network.Shapes)
+	{
+		Result |= NetworkFileFlag_Shapes;
+	}
+	if(Network.WeightMasks && (Format == NetworkFormat_Dense))
+	{
+		Result |= NetworkFileFlag_Pruned;
+	}
+	return Result;
+}
+
+internal u32
+NetworkGetTotalFileSize(neural_network Network, network_file_format Format = NetworkFormat_Dense,
+                        block_sparse_matrix *PackedWeights = 0)
+{
+	u32 Result = 0;
+	Result += sizeof(neural_network_file_header);
+	if(NetworkFileFlags(Network, Format))
+	{
+		Result += sizeof(neural_network_file_flags);
+	}
+	Result += Network.LayerCount * sizeof(u32);
+	if(Network.Activations)
+	{
+		Result += Network.LayerCount * sizeof(activation_function);
+	}
+	if(Network.Shapes)
+	{
+		Result += Network.LayerCount * sizeof(layer_shape);
+	}
+	Result += (Network.LayerCount - 1) * sizeof(vec_serialized);
+	switch(Format)
+	{
+		case NetworkFormat_Dense: {Result += (Network.LayerCount - 1) * sizeof(matrix_serialized);} break;
+		case NetworkFormat_BlockSparse: {Result += (Network.LayerCount - 1) * sizeof(block_sparse_matrix_serialized);} break;
+		case NetworkFormat_LowRank: {Result += (Network.LayerCount - 1) * sizeof(low_rank_matrix_serialized);} break;
+		case NetworkFormat_Packed: {Result += (Network.LayerCount - 1) * sizeof(packed_matrix_serialized);} break;
+
+		InvalidDefaultCase;
+	}
+
+	for(u32 LayerIndex = 1;
+		LayerIndex < Network.LayerCount;
+		++LayerIndex)
+	{
+		// NOTE: Convolutions' weights and biases are per channel, and pools
+		//	have none.
+		u32 LastLayerSize = Network.WeightMatrices[LayerIndex].ColumnCount;
+		u32 LayerSize = Network.WeightMatrices[LayerIndex].RowCount;
+
+		u32 WeightCount = LastLayerSize * LayerSize;
+		if(Format == NetworkFormat_BlockSparse)
+		{
+			block_sparse_matrix *Packed = PackedWeights + LayerIndex;
+			Result += (BlockSparseRowCount(LayerSize) + 1) * sizeof(u32);
+			Result += Packed->BlockCount * sizeof(u32);
+			WeightCount = Packed->BlockCount * BLOCK_SPARSE_ROWS;
+		}
+		else if((Format == NetworkFormat_LowRank) && Network.Ranks[LayerIndex])
+		{
+			WeightCount = Network.Ranks[LayerIndex] * (LayerSize + LastLayerSize);
+		}
+		else if(Format == NetworkFormat_Packed)
+		{
+			packed_matrix *Packed = Network.PackedWeights + LayerIndex;
+			Result = PackedDataAlign(Result);
+			Result += Packed->RowCount*Packed->WordCount*(Packed->Ternary ? 2 : 1) * sizeof(u64);
+			WeightCount = Packed->RowCount;
+		}
+		Result += WeightCount * sizeof(r32);
+		Result += Network.BiasVectors[LayerIndex].Dimension * sizeof(r32);
+	}
+
+	return Result;
+}
+
+inline u32
+OffsetFrom(void *From, void *To)
+{
+	u32 Result = (u32)((u64)To - (u64)From);
+	return Result;
+}
+
+internal r32 *
+WriteMatrixData(r32 *Dest, matrix Source)
+{
+	// NOTE: Saved densely, without the stride padding.
+	for(u32 ColumnIndex = 0;
+		ColumnIndex < Source.ColumnCount;
+		++ColumnIndex)
+	{
+		r32 *SourceData = MatrixColumnData(Source, ColumnIndex);
+		for(u32 RowIndex = 0;
+			RowIndex < Source.RowCount;
+			++RowIndex)
+		{
+			*Dest++ = *SourceData++;
+		}
+	}
+
+	return Dest;
+}
+
+internal u32 *
+WriteActivations(activation_function *Dest, neural_network Network)
+{
+	if(Network.Activations)
+	{
+		for(u32 LayerIndex = 0;
+		    LayerIndex < Network.LayerCount;
+		    ++LayerIndex)
+		{
+			*Dest++ = Network.Activations[LayerIndex];
+		}
+	}
+
+	return (u32 *)Dest;
+}
+
+internal u32 *
+WriteShapes(layer_shape *Dest, neural_network Network)
+{
+	if(Network.Shapes)
+	{
+		for(u32 LayerIndex = 0;
+		    LayerIndex < Network.LayerCount;
+		    ++LayerIndex)
+		{
+			*Dest++ = Network.Shapes[LayerIndex];
+		}
+	}
+
+	return (u32 *)Dest;
+}
+
+// NOTE: Fills in the header, and the flags after it for networks that need
+//	them, up to where the layer array goes.
+internal void
+WriteNetworkFileHeader(neural_network_file_header *Header, neural_network Network, network_file_format Format)
+{
+	u32 Flags = NetworkFileFlags(Network, Format);
+	Header->LayersOffset = sizeof(neural_network_file_header);
+	if(Flags)
+	{
+		Header->MagicNumber = NEURAL_NETWORK_FLAGGED_MAGIC_NUMBER;
+		neural_network_file_flags *FileFlags = (neural_network_file_flags *)(Header + 1);
+		FileFlags->Format = Format;
+		FileFlags->Flags = Flags;
+		Header->LayersOffset += sizeof(neural_network_file_flags);
+	}
+	else
+	{
+		switch(Format)
+		{
+			case NetworkFormat_Dense: {Header->MagicNumber = NEURAL_NETWORK_MAGIC_NUMBER;} break;
+			case NetworkFormat_BlockSparse: {Header->MagicNumber = NEURAL_NETWORK_BLOCK_SPARSE_MAGIC_NUMBER;} break;
+			case NetworkFormat_LowRank: {Header->MagicNumber = NEURAL_NETWORK_LOW_RANK_MAGIC_NUMBER;} break;
+			case NetworkFormat_Packed: {Header->MagicNumber = NEURAL_NETWORK_PACKED_MAGIC_NUMBER;} break;
+
+			InvalidDefaultCase;
+		}
+	}
+	Header->CostFn = Network.CostFn;
+	Header->LayerCount = Network.LayerCount;
+}
+
+internal void
+SerializeNetworkToDisk(memory_pool *Pool, neural_network Network, char *Filename)
+{
+	TRACE_BLOCK("Save network");
+
+	temp_memory TempMem = PoolBeginTempMemory(Pool);
+
+	FILE *NetworkFile;
+	errno_t	Error = fopen_s(&NetworkFile, Filename, "wb");
+	Assert(Error == 0);
+
+	// NOTE: Factored networks save their factors and pruned networks their
+	//	blocks, packed by the masks the same as the copies inference uses.
+	//	Binary and ternary networks save their bits.
+	network_file_format Format = NetworkFormat_Dense;
+	block_sparse_matrix *PackedWeights = 0;
+	if(Network.PackedWeights)
+	{
+		Format = NetworkFormat_Packed;
+	}
+	else if(Network.Ranks)
+	{
+		Format = NetworkFormat_LowRank;
+	}
+	else if(Network.WeightMasks)
+	{
+		Format = NetworkFormat_BlockSparse;
+		PackedWeights = PoolPushArray(Pool, block_sparse_matrix, Network.LayerCount);
+		for(u32 LayerIndex = 1;
+			LayerIndex < Network.LayerCount;
+			++LayerIndex)
+		{
+			PackedWeights[LayerIndex] = PackBlockSparse(Pool, Network.WeightMatrices[LayerIndex],
+			                                            Network.WeightMasks[LayerIndex]);
+		}
+	}
+
+	u32 TotalFileSize = NetworkGetTotalFileSize(Network, Format, PackedWeights);
+	neural_network_file_header *Header = (neural_network_file_header *)PoolPushSize(Pool, TotalFileSize);
+	WriteNetworkFileHeader(Header, Network, Format);
+
+	u32 *LayerData = (u32 *)(((u8 *)Header) + Header->LayersOffset);
+	for(u32 LayerIndex = 0;
+		LayerIndex < Header->LayerCount;
+		++LayerIndex)
+	{
+		*LayerData++ = Network.Layers[LayerIndex];
+	}
+	LayerData = WriteActivations((activation_function *)LayerData, Network);
+	LayerData = WriteShapes((layer_shape *)LayerData, Network);
+
+	Header->WeightMatricesOffset = OffsetFrom(Header, LayerData);
+	void *MatricesEnd = 0;
+	if(Format == NetworkFormat_BlockSparse)
+	{
+		block_sparse_matrix_serialized *DestPacked =
+			(block_sparse_matrix_serialized *)(((u8 *)Header) + Header->WeightMatricesOffset);
+		u32 *PackedData = (u32 *)(((u8 *)DestPacked) + sizeof(block_sparse_matrix_serialized)*(Header->LayerCount - 1));
+		for(u32 LayerIndex = 1;
+			LayerIndex < Header->LayerCount;
+			++LayerIndex)
+		{
+			block_sparse_matrix *Source = PackedWeights + LayerIndex;
+			u32 BlockRowCount = BlockSparseRowCount(Source->RowCount);
+			u32 ValueCount = Source->BlockCount*BLOCK_SPARSE_ROWS;
+
+			DestPacked->RowCount = Source->RowCount;
+			DestPacked->ColumnCount = Source->ColumnCount;
+			DestPacked->BlockCount = Source->BlockCount;
+
+			DestPacked->BlockRowStartsOffset = OffsetFrom(Header, PackedData);
+			memcpy(PackedData, Source->BlockRowStarts, (BlockRowCount + 1)*sizeof(u32));
+			PackedData += BlockRowCount + 1;
+
+			DestPacked->BlockColumnsOffset = OffsetFrom(Header, PackedData);
+			memcpy(PackedData, Source->BlockColumns, Source->BlockCount*sizeof(u32));
+			PackedData += Source->BlockCount;
+
+			DestPacked->BlockValuesOffset = OffsetFrom(Header, PackedData);
+			memcpy(PackedData, Source->BlockValues, ValueCount*sizeof(r32));
+			PackedData += ValueCount;
+
+			++DestPacked;
+		}
+		MatricesEnd = PackedData;
+	}
+	else if(Format == NetworkFormat_LowRank)
+	{
+		low_rank_matrix_serialized *DestFactored =
+			(low_rank_matrix_serialized *)(((u8 *)Header) + Header->WeightMatricesOffset);
+		r32 *MatrixData = (r32 *)(((u8 *)DestFactored) + sizeof(low_rank_matrix_serialized)*(Header->LayerCount - 1));
+		for(u32 LayerIndex = 1;
+			LayerIndex < Header->LayerCount;
+			++LayerIndex)
+		{
+			matrix *SourceMatrix = Network.WeightMatrices + LayerIndex;
+			DestFactored->RowCount = SourceMatrix->RowCount;
+			DestFactored->ColumnCount = SourceMatrix->ColumnCount;
+			DestFactored->Rank = Network.Ranks[LayerIndex];
+			DestFactored->LeftOffset = OffsetFrom(Header, MatrixData);
+			if(DestFactored->Rank)
+			{
+				MatrixData = WriteMatrixData(MatrixData, Network.LeftFactors[LayerIndex]);
+				DestFactored->RightOffset = OffsetFrom(Header, MatrixData);
+				MatrixData = WriteMatrixData(MatrixData, Network.RightFactors[LayerIndex]);
+			}
+			else
+			{
+				DestFactored->RightOffset = 0;
+				MatrixData = WriteMatrixData(MatrixData, *SourceMatrix);
+			}
+			++DestFactored;
+		}
+		MatricesEnd = MatrixData;
+	}
+	else if(Format == NetworkFormat_Packed)
+	{
+		packed_matrix_serialized *DestPacked =
+			(packed_matrix_serialized *)(((u8 *)Header) + Header->WeightMatricesOffset);
+		u32 *PackedData = (u32 *)(((u8 *)DestPacked) + sizeof(packed_matrix_serialized)*(Header->LayerCount - 1));
+		for(u32 LayerIndex = 1;
+			LayerIndex < Header->LayerCount;
+			++LayerIndex)
+		{
+			packed_matrix *Source = Network.PackedWeights + LayerIndex;
+			u32 WordTotal = Source->RowCount*Source->WordCount;
+
+			DestPacked->RowCount = Source->RowCount;
+			DestPacked->ColumnCount = Source->ColumnCount;
+			DestPacked->Ternary = Source->Ternary;
+
+			if(OffsetFrom(Header, PackedData) != PackedDataAlign(OffsetFrom(Header, PackedData)))
+			{
+				*PackedData++ = 0;
+			}
+			DestPacked->SignsOffset = OffsetFrom(Header, PackedData);
+			memcpy(PackedData, Source->Signs, WordTotal*sizeof(u64));
+			PackedData += 2*WordTotal;
+
+			DestPacked->MasksOffset = 0;
+			if(Source->Ternary)
+			{
+				DestPacked->MasksOffset = OffsetFrom(Header, PackedData);
+				memcpy(PackedData, Source->Masks, WordTotal*sizeof(u64));
+				PackedData += 2*WordTotal;
+			}
+
+			DestPacked->ScalesOffset = OffsetFrom(Header, PackedData);
+			memcpy(PackedData, Source->Scales, Source->RowCount*sizeof(r32));
+			PackedData += Source->RowCount;
+
+			++DestPacked;
+		}
+		MatricesEnd = PackedData;
+	}
+	else
+	{
+		matrix_serialized *DestMatrix = (matrix_serialized *)(((u8 *)Header) + Header->WeightMatricesOffset);
+		r32 *MatrixData = (r32 *)(((u8 *)DestMatrix) + sizeof(matrix_serialized)*(Header->LayerCount - 1));
+		for(u32 LayerIndex = 1;
+			LayerIndex < Header->LayerCount;
+			++LayerIndex)
+		{
+			matrix *SourceMatrix = Network.WeightMatrices + LayerIndex;
+			DestMatrix->RowCount = SourceMatrix->RowCount;
+			DestMatrix->ColumnCount = SourceMatrix->ColumnCount;
+			DestMatrix->DataOffset = OffsetFrom(Header, MatrixData);
+			++DestMatrix;
+
+			MatrixData = WriteMatrixData(MatrixData, *SourceMatrix);
+		}
+		MatricesEnd = MatrixData;
+	}
+
+	Header->BiasVectorsOffset = OffsetFrom(Header, MatricesEnd);
+	vec_serialized *DestVec = (vec_serialized *)(((u8 *)Header) + Header->BiasVectorsOffset);
+	r32 *VecData = (r32 *)(((u8 *)DestVec) + sizeof(vec_serialized)*(Header->LayerCount - 1));
+	for(u32 LayerIndex = 1;
+		LayerIndex < Header->LayerCount;
+		++LayerIndex)
+	{
+		vec *SourceVec = Network.BiasVectors + LayerIndex;
+		DestVec->Dimension = SourceVec->Dimension;
+		DestVec->DataOffset = OffsetFrom(Header, VecData);
+		++DestVec;
+
+		r32 *SourceData = SourceVec->Data;
+		u32 VecDataCount = SourceVec->Dimension;
+		for(u32 VecDataIndex = 0;
+			VecDataIndex < VecDataCount;
+			++VecDataIndex)
+		{
+			*VecData++ = *SourceData++;
+		}
+	}
+
+	fwrite(Header, TotalFileSize, 1, NetworkFile);
+
+	fclose(NetworkFile);
+	PoolEndTempMemory(TempMem);
+}
+
+inline void *
+AddOffsetToPointer(void *Pointer, u32 Offset)
+{
+	void *Result = (u8 *)Pointer + Offset;
+	return Result;
+}
+
+internal neural_network
+LoadNetwork(memory_pool *Pool, char *Filename)
+{
+	TRACE_BLOCK("Load network");
+
+	neural_network Result = {};
+	neural_network_file_header *Header = (neural_network_file_header *)LoadEntireFile(Pool, Filename);
+
+	network_file_format Format = NetworkFormat_Count;
+	u32 Flags = 0;
+	switch(Header->MagicNumber)
+	{
+		case NEURAL_NETWORK_MAGIC_NUMBER: {Format = NetworkFormat_Dense;} break;
+		case NEURAL_NETWORK_BLOCK_SPARSE_MAGIC_NUMBER: {Format = NetworkFormat_BlockSparse;} break;
+		case NEURAL_NETWORK_LOW_RANK_MAGIC_NUMBER: {Format = NetworkFormat_LowRank;} break;
+		case NEURAL_NETWORK_PACKED_MAGIC_NUMBER: {Format = NetworkFormat_Packed;} break;
+
+		case NEURAL_NETWORK_FLAGGED_MAGIC_NUMBER:
+		{
+			neural_network_file_flags *FileFlags = (neural_network_file_flags *)(Header + 1);
+			Format = (network_file_format)FileFlags->Format;
+			Flags = FileFlags->Flags;
+		} break;
+	}
+	// NOTE: Anything this build didn't write is refused rather than guessed
+	//	at: an unknown format or flag, or arrays that don't end where the
+	//	matrices start.
+	u32 KnownFlags = NetworkFileFlag_Activations | NetworkFileFlag_Shapes | NetworkFileFlag_Pruned;
+	u32 LayersOffset = sizeof(neural_network_file_header);
+	if(Header->MagicNumber == NEURAL_NETWORK_FLAGGED_MAGIC_NUMBER)
+	{
+		LayersOffset += sizeof(neural_network_file_flags);
+	}
+	u32 WeightMatricesOffset = LayersOffset + Header->LayerCount*sizeof(u32);
+	if(Flags & NetworkFileFlag_Activations)
+	{
+		WeightMatricesOffset += Header->LayerCount*sizeof(activation_function);
+	}
+	if(Flags & NetworkFileFlag_Shapes)
+	{
+		WeightMatricesOffset += Header->LayerCount*sizeof(layer_shape);
+	}
+
+	if((Format < NetworkFormat_Count) &&
+	   !(Flags & ~KnownFlags) &&
+	   (!(Flags & NetworkFileFlag_Pruned) || (Format == NetworkFormat_Dense)) &&
+	   (Header->LayerCount >= 2) &&
+	   (Header->LayersOffset == LayersOffset) &&
+	   (Header->WeightMatricesOffset == WeightMatricesOffset))
+	{
+		Result.CostFn = Header->CostFn;
+		Result.LayerCount = Header->LayerCount;
+	
+		Result.Layers = (u32 *)AddOffsetToPointer(Header, Header->LayersOffset);	
+
+		u32 *ExtraData = Result.Layers + Result.LayerCount;
+		if(Flags & NetworkFileFlag_Activations)
+		{
+			Result.Activations = (activation_function *)ExtraData;
+			ExtraData += Result.LayerCount;
+		}
+		if(Flags & NetworkFileFlag_Shapes)
+		{
+			Result.Shapes = (layer_shape *)ExtraData;
+		}
+		Result.WeightMatrices = PoolPushArray(Pool, matrix, Result.LayerCount);
+		Result.BiasVectors = PoolPushArray(Pool, vec, Result.LayerCount);
+
+		if(Format == NetworkFormat_BlockSparse)
+		{
+			// NOTE: The blocks are used in place for inference. Training needs
+			//	the dense weights back, and masks that keep the pruned ones at zero.
+			Result.WeightMasks = PoolPushArray(Pool, matrix, Result.LayerCount);
+			Result.BlockSparseWeights = PoolPushArray(Pool, block_sparse_matrix, Result.LayerCount);
+
+			block_sparse_matrix_serialized *LoadedMatrices =
+				(block_sparse_matrix_serialized *)AddOffsetToPointer(Header, Header->WeightMatricesOffset);
+			for(u32 MatrixIndex = 1;
+				MatrixIndex < Result.LayerCount;
+				++MatrixIndex)
+			{
+				block_sparse_matrix_serialized *LoadedMatrix = LoadedMatrices + (MatrixIndex - 1);
+				block_sparse_matrix *Packed = Result.BlockSparseWeights + MatrixIndex;
+				Packed->RowCount = LoadedMatrix->RowCount;
+				Packed->ColumnCount = LoadedMatrix->ColumnCount;
+				Packed->BlockCount = LoadedMatrix->BlockCount;
+				Packed->BlockRowStarts = (u32 *)AddOffsetToPointer(Header, LoadedMatrix->BlockRowStartsOffset);
+				Packed->BlockColumns = (u32 *)AddOffsetToPointer(Header, LoadedMatrix->BlockColumnsOffset);
+				Packed->BlockValues = (r32 *)AddOffsetToPointer(Header, LoadedMatrix->BlockValuesOffset);
+
+				Result.WeightMatrices[MatrixIndex] = UnpackBlockSparse(Pool, *Packed);
+				Result.WeightMasks[MatrixIndex] = MatrixNonZeroPattern(Pool, Result.WeightMatrices[MatrixIndex]);
+			}
+		}
+		else if(Format == NetworkFormat_LowRank)
+		{
+			// NOTE: The factors are used in place. Their product stands in for
+			//	the weights everywhere but inference.
+			Result.Ranks = PoolPushArray(Pool, u32, Result.LayerCount);
+			Result.LeftFactors = PoolPushArray(Pool, matrix, Result.LayerCount);
+			Result.RightFactors = PoolPushArray(Pool, matrix, Result.LayerCount);
+
+			low_rank_matrix_serialized *LoadedMatrices =
+				(low_rank_matrix_serialized *)AddOffsetToPointer(Header, Header->WeightMatricesOffset);
+			for(u32 MatrixIndex = 1;
+				MatrixIndex < Result.LayerCount;
+				++MatrixIndex)
+			{
+				low_rank_matrix_serialized *LoadedMatrix = LoadedMatrices + (MatrixIndex - 1);
+				u32 Rank = LoadedMatrix->Rank;
+				Result.Ranks[MatrixIndex] = Rank;
+				if(Rank)
+				{
+					Result.LeftFactors[MatrixIndex] = Matrix((r32 *)AddOffsetToPointer(Header, LoadedMatrix->LeftOffset),
+					                                         LoadedMatrix->RowCount, Rank);
+					Result.RightFactors[MatrixIndex] = Matrix((r32 *)AddOffsetToPointer(Header, LoadedMatrix->RightOffset),
+					                                          Rank, LoadedMatrix->ColumnCount);
+					Result.WeightMatrices[MatrixIndex] = Mult(Pool, Result.LeftFactors[MatrixIndex],
+					                                          Result.RightFactors[MatrixIndex]);
+				}
+				else
+				{
+					Result.WeightMatrices[MatrixIndex] = Matrix((r32 *)AddOffsetToPointer(Header, LoadedMatrix->LeftOffset),
+					                                            LoadedMatrix->RowCount, LoadedMatrix->ColumnCount);
+				}
+			}
+		}
+		else if(Format == NetworkFormat_Packed)
+		{
+			// NOTE: The bits are used in place for inference. The weights they
+			//	stand for, unpacked, are what everything else runs on, and what
+			//	more binary training starts its latent weights from.
+			Result.PackedWeights = PoolPushArray(Pool, packed_matrix, Result.LayerCount);
+
+			packed_matrix_serialized *LoadedMatrices =
+				(packed_matrix_serialized *)AddOffsetToPointer(Header, Header->WeightMatricesOffset);
+			for(u32 MatrixIndex = 1;
+				MatrixIndex < Result.LayerCount;
+				++MatrixIndex)
+			{
+				packed_matrix_serialized *LoadedMatrix = LoadedMatrices + (MatrixIndex - 1);
+				packed_matrix *Packed = Result.PackedWeights + MatrixIndex;
+				Packed->RowCount = LoadedMatrix->RowCount;
+				Packed->ColumnCount = LoadedMatrix->ColumnCount;
+				Packed->WordCount = PackedWordCount(LoadedMatrix->ColumnCount);
+				Packed->Ternary = LoadedMatrix->Ternary;
+				Packed->Scales = (r32 *)AddOffsetToPointer(Header, LoadedMatrix->ScalesOffset);
+				Packed->Signs = (u64 *)AddOffsetToPointer(Header, LoadedMatrix->SignsOffset);
+				if(Packed->Ternary)
+				{
+					Packed->Masks = (u64 *)AddOffsetToPointer(Header, LoadedMatrix->MasksOffset);
+					Packed->NonZeroCounts = PoolPushArray(Pool, u32, Packed->RowCount);
+					CountPackedNonZeros(*Packed);
+				}
+
+				Result.WeightMatrices[MatrixIndex] = UnpackWeights(Pool, *Packed);
+			}
+		}
+		else
+		{
+			matrix_serialized *LoadedMatrices = (matrix_serialized *)AddOffsetToPointer(Header, Header->WeightMatricesOffset);
+			for(u32 MatrixIndex = 1;
+				MatrixIndex < Result.LayerCount;
+				++MatrixIndex)
+			{
+				matrix_serialized *LoadedMatrix = LoadedMatrices + (MatrixIndex - 1);
+				Result.WeightMatrices[MatrixIndex] = Matrix((r32 *)AddOffsetToPointer(Header, LoadedMatrix->DataOffset),
+				                                            LoadedMatrix->RowCount, LoadedMatrix->ColumnCount);
+			}
+
+			if(Flags & NetworkFileFlag_Pruned)
+			{
+				// NOTE: Checkpoints of pruned networks stay dense. The masks
+				//	and blocks come back from the zeros, as for block sparse files.
+				Result.WeightMasks = PoolPushArray(Pool, matrix, Result.LayerCount);
+				Result.BlockSparseWeights = PoolPushArray(Pool, block_sparse_matrix, Result.LayerCount);
+				for(u32 MatrixIndex = 1;
+					MatrixIndex < Result.LayerCount;
+					++MatrixIndex)
+				{
+					matrix Weights = Result.WeightMatrices[MatrixIndex];
+					Result.WeightMasks[MatrixIndex] = MatrixNonZeroPattern(Pool, Weights);
+					Result.BlockSparseWeights[MatrixIndex] = PackBlockSparse(Pool, Weights, Result.WeightMasks[MatrixIndex]);
+				}
+			}
+		}
+
+		vec_serialized *LoadedVectors = (vec_serialized *)AddOffsetToPointer(Header, Header->BiasVectorsOffset);
+		for(u32 VecIndex = 1;
+			VecIndex < Result.LayerCount;
+			++VecIndex)
+		{
+			vec *Vec = Result.BiasVectors + VecIndex;
+			vec_serialized *LoadedVec = LoadedVectors + (VecIndex - 1);
+		
+			Vec->Dimension = LoadedVec->Dimension;
+			Vec->Data = (r32 *)AddOffsetToPointer(Header, LoadedVec->DataOffset);
+		}
+	}
+	else
+	{
+		fprintf(stderr, "%s isn't a network file this build can load\n", Filename);
+	}
+
+	return Result;
+}
+
+internal network_checkpoint *
+CreateCheckpoint(memory_pool *Pool, platform_work_queue *Queue, neural_network Network, char *Filename)
+{
+	network_checkpoint *Result = PoolPushStructAligned(Pool, network_checkpoint);
+	*Result = {};
+	Result->Filename = Filename;
+	Result->Queue = Queue;
+	Result->LayerCount = Network.LayerCount;
+
+	u32 FilenameLength = 0;
+	while(Filename[FilenameLength])
+	{
+		++FilenameLength;
+	}
+	char Suffix[] = ".tmp";
+	Result->TempFilename = PoolPushArray(Pool, char, FilenameLength + sizeof(Suffix));
+	for(u32 Index = 0;
+	    Index < FilenameLength;
+	    ++Index)
+	{
+		Result->TempFilename[Index] = Filename[Index];
+	}
+	for(u32 Index = 0;
+	    Index < sizeof(Suffix);
+	    ++Index)
+	{
+		Result->TempFilename[FilenameLength + Index] = Suffix[Index];
+	}
+
+	// NOTE: TempFilename can leave the pool at any byte, so everything after it
+	//	is pushed aligned.
+	u32 MatrixCount = Network.LayerCount - 1;
+	Result->WeightSnapshots = PoolPushArrayAligned(Pool, r32 *, Network.LayerCount);
+	Result->BiasSnapshots = PoolPushArrayAligned(Pool, r32 *, Network.LayerCount);
+
+	// NOTE: Metadata before the matrix data, each matrix's data, the vector
+	//	array, then each vector's data.
+	Result->BufferCount = 2 + 2*MatrixCount;
+	Result->Buffers = PoolPushArrayAligned(Pool, platform_file_buffer, Result->BufferCount);
+
+	u32 ActivationsSize = Network.Activations ? Network.LayerCount*sizeof(activation_function) : 0;
+	u32 ShapesSize = Network.Shapes ? Network.LayerCount*sizeof(layer_shape) : 0;
+	u32 FlagsSize = NetworkFileFlags(Network, NetworkFormat_Dense) ? sizeof(neural_network_file_flags) : 0;
+	u32 PrefixSize = sizeof(neural_network_file_header) + FlagsSize +
+		Network.LayerCount*sizeof(u32) + ActivationsSize + ShapesSize +
+		MatrixCount*sizeof(matrix_serialized);
+	neural_network_file_header *Header = (neural_network_file_header *)PoolPushSizeAligned(Pool, PrefixSize);
+	WriteNetworkFileHeader(Header, Network, NetworkFormat_Dense);
+	Header->WeightMatricesOffset = Header->LayersOffset + Network.LayerCount*sizeof(u32) + ActivationsSize + ShapesSize;
+
+	u32 *LayerData = (u32 *)AddOffsetToPointer(Header, Header->LayersOffset);
+	for(u32 LayerIndex = 0;
+	    LayerIndex < Network.LayerCount;
+	    ++LayerIndex)
+	{
+		*LayerData++ = Network.Layers[LayerIndex];
+	}
+	WriteShapes((layer_shape *)WriteActivations((activation_function *)LayerData, Network), Network);
+
+	platform_file_buffer *Buffer = Result->Buffers;
+	Buffer->Data = Header;
+	Buffer->Size = PrefixSize;
+	++Buffer;
+
+	u32 FileOffset = PrefixSize;
+	matrix_serialized *DestMatrix = (matrix_serialized *)AddOffsetToPointer(Header, Header->WeightMatricesOffset);
+	for(u32 LayerIndex = 1;
+	    LayerIndex < Network.LayerCount;
+	    ++LayerIndex)
+	{
+		matrix *SourceMatrix = Network.WeightMatrices + LayerIndex;
+		u32 DataSize = SourceMatrix->RowCount*SourceMatrix->ColumnCount*sizeof(r32);
+
+		DestMatrix->RowCount = SourceMatrix->RowCount;
+		DestMatrix->ColumnCount = SourceMatrix->ColumnCount;
+		DestMatrix->DataOffset = FileOffset;
+		++DestMatrix;
+
+		Result->WeightSnapshots[LayerIndex] = (r32 *)PoolPushSizeAligned(Pool, DataSize);
+		Buffer->Data = Result->WeightSnapshots[LayerIndex];
+		Buffer->Size = DataSize;
+		++Buffer;
+
+		FileOffset += DataSize;
+	}
+
+	Header->BiasVectorsOffset = FileOffset;
+	u32 VectorArraySize = MatrixCount*sizeof(vec_serialized);
+	vec_serialized *DestVec = (vec_serialized *)PoolPushSizeAligned(Pool, VectorArraySize);
+	Buffer->Data = DestVec;
+	Buffer->Size = VectorArraySize;
+	++Buffer;
+
+	FileOffset += VectorArraySize;
+	for(u32 LayerIndex = 1;
+	    LayerIndex < Network.LayerCount;
+	    ++LayerIndex)
+	{
+		vec *SourceVec = Network.BiasVectors + LayerIndex;
+		u32 DataSize = SourceVec->Dimension*sizeof(r32);
+
+		DestVec->Dimension = SourceVec->Dimension;
+		DestVec->DataOffset = FileOffset;
+		++DestVec;
+
+		Result->BiasSnapshots[LayerIndex] = (r32 *)PoolPushSizeAligned(Pool, DataSize);
+		Buffer->Data = Result->BiasSnapshots[LayerIndex];
+		Buffer->Size = DataSize;
+		++Buffer;
+
+		FileOffset += DataSize;
+	}
+
+	Assert(Buffer == (Result->Buffers + Result->BufferCount));
+	Assert(FileOffset == NetworkGetTotalFileSize(Network));
+
+	return Result;
+}
+
+internal PLATFORM_WORK_QUEUE_CALLBACK(DoCheckpointWork)
+{
+	TRACE_BLOCK("Checkpoint write");
+
+	network_checkpoint *Checkpoint = (network_checkpoint *)Data;
+
+	if(PlatformWriteBuffersToFile(Checkpoint->TempFilename, Checkpoint->Buffers, Checkpoint->BufferCount) &&
+	   PlatformReplaceFile(Checkpoint->TempFilename, Checkpoint->Filename))
+	{
+		AtomicAddU32(&Checkpoint->WrittenCount, 1);
+	}
+	else
+	{
+		AtomicAddU32(&Checkpoint->FailedCount, 1);
+	}
+
+	CompletePreviousWritesBeforeFutureWrites;
+	Checkpoint->Busy = false;
+}
+
+internal b32
+BeginCheckpoint(network_checkpoint *Checkpoint, neural_network Network)
+{
+	// NOTE: Called between batches. If the last checkpoint is still being written
+	//	this one is dropped rather than making training wait on the disk.
+	b32 Result = false;
+	if(Checkpoint->Busy)
+	{
+		++Checkpoint->SkippedCount;
+	}
+	else
+	{
+		TRACE_BLOCK("Checkpoint snapshot");
+
+		Assert(Checkpoint->LayerCount == Network.LayerCount);
+		for(u32 LayerIndex = 1;
+		    LayerIndex < Network.LayerCount;
+		    ++LayerIndex)
+		{
+			matrix *Weight = Network.WeightMatrices + LayerIndex;
+			vec *Bias = Network.BiasVectors + LayerIndex;
+			r32 *WeightSnapshot = Checkpoint->WeightSnapshots[LayerIndex];
+			for(u32 ColumnIndex = 0;
+			    ColumnIndex < Weight->ColumnCount;
+			    ++ColumnIndex)
+			{
+				memcpy(WeightSnapshot, MatrixColumnData(*Weight, ColumnIndex), Weight->RowCount*sizeof(r32));
+				WeightSnapshot += Weight->RowCount;
+			}
+			memcpy(Checkpoint->BiasSnapshots[LayerIndex], Bias->Data, Bias->Dimension*sizeof(r32));
+		}
+
+		Checkpoint->Busy = true;
+		PlatformAddEntry(Checkpoint->Queue, DoCheckpointWork, Checkpoint);
+		Result = true;
+	}
+
+	return Result;
+}
+
+internal void
+EndCheckpoints(network_checkpoint *Checkpoint)
+{
+	PlatformCompleteAllWork(Checkpoint->Queue);
+	printf("Checkpoints: %u written, %u skipped, %u failed\n",
+	       Checkpoint->WrittenCount, Checkpoint->SkippedCount, Checkpoint->FailedCount);
+}
@@ -1,56 +1,215 @@
-#pragma once
-
-#define MNIST_OUTPUT_SIZE 10
-
-#pragma pack(push, 1)
-struct mnist_image_set_file_header
-{
-	u32 MagicNumber;
-	u32	ImageCount;
-	u32 RowCount;
-	u32 ColumnCount;
-};
-
-struct mnist_label_set_file_header
-{
-	u32 MagicNumber;
-	u32	ItemCount;
-};
-#pragma pack(pop)
-
-/*
-	NOTE: This is the file format for the saved networks. The weight matrices
-		and bias vectors have no data for the input layer of neurons.
-		
-	neural_network_file_header
-	layer array
-	matrix array
-	matrix data
-	vector array
-	vector data
-*/
-#define NEURAL_NETWORK_MAGIC_NUMBER 1337
-struct neural_network_file_header
-{
-	u32 MagicNumber;
-	
-	cost_function CostFn;
-	u32 LayerCount;
-
-	u32 LayersOffset;
-	u32 WeightMatricesOffset;
-	u32 BiasVectorsOffset;
-};
-
-struct matrix_serialized
-{
-	u32 RowCount;
-	u32 ColumnCount;
-	u32 DataOffset;
-};
-
-struct vec_serialized
-{
-	u32 Dimension;
-	u32 DataOffset;
-};
\ No newline at end of file
+#pragma once
+
+#define MNIST_OUTPUT_SIZE 10
+
+#pragma pack(push, 1)
+struct mnist_image_set_file_header
+{
+	u32 MagicNumber;
+	u32	ImageCount;
+	u32 RowCount;
+	u32 ColumnCount;
+};
+
+struct mnist_label_set_file_header
+{
+	u32 MagicNumber;
+	u32	ItemCount;
+};
+#pragma pack(pop)
+
+/*
+	NOTE: Data set caches, written by -datacache next to the images file.
+		They hold LoadMNISTData's matrices exactly as it builds them, padded
+		strides and all, so a job maps the file and trains on the pages as
+		they are:
+
+	data_set_cache_header
+	inputs, InputStride*DataCount r32s
+	outputs, OutputStride*DataCount r32s
+
+	Both start on a DATA_SET_CACHE_ALIGNMENT boundary of the file, and so
+		of the mapping. The header keeps the sizes and last write times of
+		the IDX files it was built from, and the strides; a cache that
+		doesn't match either the files or this build's MatrixStrideFor is
+		built again. The files are stamped before they are read, so one
+		replaced while the cache is being built leaves a stale stamp, and
+		the next job builds it again.
+*/
+#define DATA_SET_CACHE_MAGIC_NUMBER 1437
+#define DATA_SET_CACHE_VERSION 2
+#define DATA_SET_CACHE_ALIGNMENT 64
+#define DATA_SET_CACHE_EXTENSION ".cache"
+
+struct data_set_cache_header
+{
+	u32 MagicNumber;
+	u32 Version;
+
+	u64 TotalSize;
+	u64 InputsOffset;
+	u64 OutputsOffset;
+
+	platform_file_stamp ImagesFile;
+	platform_file_stamp LabelsFile;
+
+	u32 DataCount;
+	u32 ImageWidth;
+	u32 ImageHeight;
+
+	u32 InputRowCount;
+	u32 InputStride;
+	u32 OutputRowCount;
+	u32 OutputStride;
+};
+
+/*
+	NOTE: This is the file format for the saved networks. The weight matrices
+		and bias vectors have no data for the input layer of neurons.
+		
+	neural_network_file_header
+	layer array
+	matrix array
+	matrix data
+	vector array
+	vector data
+
+	Pruned networks are saved with NEURAL_NETWORK_BLOCK_SPARSE_MAGIC_NUMBER
+		instead. The layout is the same, except the matrix array holds
+		block_sparse_matrix_serialized and every matrix's data is its block row
+		starts, block columns and block values, one after the other.
+
+	Networks with activations other than sigmoid, or with convolution or
+		pooling layers, use NEURAL_NETWORK_FLAGGED_MAGIC_NUMBER. A
+		neural_network_file_flags follows the header; its Format says which
+		of the layouts here the rest of the file has, and its Flags which
+		arrays sit between the layer array and the matrix array, in this
+		order:
+
+	activation_function per layer, if NetworkFileFlag_Activations
+	layer_shape per layer, if NetworkFileFlag_Shapes
+
+	Checkpoints are always dense. A pruned network's are flagged
+		NetworkFileFlag_Pruned, and its zero weights are the pruned ones.
+
+	Files without NetworkFileFlag_Activations are all sigmoid. Pooling
+		layers have empty weight matrices and bias vectors. Builds from before
+		the flags reject the magic number instead of reading these networks
+		as plain sigmoid layers.
+
+	Factored networks use NEURAL_NETWORK_LOW_RANK_MAGIC_NUMBER, with
+		low_rank_matrix_serialized in the matrix array. A layer of rank zero
+		was left dense and its data is the usual matrix data; otherwise it is
+		the left factor followed by the right one.
+
+	Binary and ternary networks use NEURAL_NETWORK_PACKED_MAGIC_NUMBER, with
+		packed_matrix_serialized in the matrix array. Each matrix's data is
+		its sign words, then its mask words if it is ternary, then one r32
+		scale per row; the words start 8 byte aligned, after 4 bytes of zero
+		padding where needed.
+*/
+#define NEURAL_NETWORK_MAGIC_NUMBER 1337
+#define NEURAL_NETWORK_BLOCK_SPARSE_MAGIC_NUMBER 1338
+#define NEURAL_NETWORK_LOW_RANK_MAGIC_NUMBER 1339
+#define NEURAL_NETWORK_PACKED_MAGIC_NUMBER 1340
+#define NEURAL_NETWORK_FLAGGED_MAGIC_NUMBER 1341
+
+enum network_file_format
+{
+	NetworkFormat_Dense,
+	NetworkFormat_BlockSparse,
+	NetworkFormat_LowRank,
+	NetworkFormat_Packed,
+
+	NetworkFormat_Count,
+};
+struct neural_network_file_header
+{
+	u32 MagicNumber;
+	
+	cost_function CostFn;
+	u32 LayerCount;
+
+	u32 LayersOffset;
+	u32 WeightMatricesOffset;
+	u32 BiasVectorsOffset;
+};
+
+enum network_file_flag
+{
+	NetworkFileFlag_Activations = 0x1,
+	NetworkFileFlag_Shapes = 0x2,
+	NetworkFileFlag_Pruned = 0x4,
+};
+struct neural_network_file_flags
+{
+	u32 Format;
+	u32 Flags;
+};
+
+struct matrix_serialized
+{
+	u32 RowCount;
+	u32 ColumnCount;
+	u32 DataOffset;
+};
+
+struct block_sparse_matrix_serialized
+{
+	u32 RowCount;
+	u32 ColumnCount;
+	u32 BlockCount;
+	u32 BlockRowStartsOffset;
+	u32 BlockColumnsOffset;
+	u32 BlockValuesOffset;
+};
+
+struct low_rank_matrix_serialized
+{
+	u32 RowCount;
+	u32 ColumnCount;
+	u32 Rank;
+	u32 LeftOffset;
+	u32 RightOffset;
+};
+
+struct packed_matrix_serialized
+{
+	u32 RowCount;
+	u32 ColumnCount;
+	b32 Ternary;
+	u32 SignsOffset;
+	u32 MasksOffset;
+	u32 ScalesOffset;
+};
+
+struct vec_serialized
+{
+	u32 Dimension;
+	u32 DataOffset;
+};
+/*
+	NOTE: A checkpoint keeps its own copy of the weights, taken between batches,
+		and a background thread writes that copy out while training carries on.
+		The file metadata never changes so it is built once; the snapshot buffers
+		slot in between it to give exactly the layout above.
+*/
+struct network_checkpoint
+{
+	char *Filename;
+	char *TempFilename;
+
+	u32 LayerCount;
+	r32 **WeightSnapshots;
+	r32 **BiasSnapshots;
+
+	u32 BufferCount;
+	platform_file_buffer *Buffers;
+
+	platform_work_queue *Queue;
+	u32 volatile Busy;
+
+	u32 volatile WrittenCount;
+	u32 volatile FailedCount;
+	u32 SkippedCount;
+};
@@ -0,0 +1,147 @@
+
+/*
+	NOTE: Startup side of the layer JIT in nn_jit.h. -jit generates a kernel
+		for every dense layer at the training batch size before training
+		starts; FeedForwardBatch picks them up by shape, so anything else
+		(the test set's batches, sparse or factored layers) runs the compiled
+		kernels as before. The first layer normally takes the sparse input
+		path, so only the later layers are JIT'd unless -sparseinput is 0.
+
+	-jitbench times each layer's generated kernel against what it replaces,
+		ParallelMult, MVPlus and Sigmoid, on one real batch.
+*/
+
+#define JIT_BENCHMARK_REPEATS 5
+#define JIT_BENCHMARK_ITERATIONS 20
+
+internal b32
+CompileJitKernels(neural_network Network, u32 BatchSize)
+{
+	if(GlobalJit.Executable)
+	{
+		return true;
+	}
+
+	TRACE_BLOCK("JIT compile");
+
+	if(!NetworkIsDense(Network))
+	{
+		printf("Not JIT compiling the layers, the network has image layers; using the compiled kernels\n");
+		return false;
+	}
+
+	u64 Start = PlatformGetWallClock();
+	char *Failure = CompileJitLayerKernels(Network.Layers, Network.LayerCount, BatchSize);
+	if(Failure)
+	{
+		printf("Not JIT compiling the layers, %s; using the compiled kernels\n", Failure);
+		return false;
+	}
+
+	u32 CodeSize = 0;
+	for(u32 KernelIndex = 0;
+	    KernelIndex < GlobalJit.KernelCount;
+	    ++KernelIndex)
+	{
+		CodeSize += GlobalJit.Kernels[KernelIndex].CodeSize;
+	}
+	printf("JIT compiled %u layer kernels for batches of %u, %u bytes of code in %.2fms\n",
+	       GlobalJit.KernelCount, BatchSize, CodeSize,
+	       1000.0f*PlatformGetSecondsElapsed(Start, PlatformGetWallClock()));
+
+	return true;
+}
+
+internal void
+BenchmarkJitKernels(memory_pool *Pool, parallel_context *Parallel, neural_network Network,
+                    data_set TrainingSet, u32 BatchSize)
+{
+	TRACE_BLOCK("JIT benchmark");
+
+	if(!CompileJitKernels(Network, BatchSize))
+	{
+		return;
+	}
+
+	temp_memory TempMem = PoolBeginTempMemory(Pool);
+
+	// NOTE: The first batch of training images, then each layer's compiled
+	//	activations feed the next.
+	matrix Inputs = TrainingSet.Inputs;
+	Inputs.ColumnCount = BatchSize;
+
+	printf("JIT layer benchmark, batches of %u, %u thread(s) compiled:\n",
+	       BatchSize, Parallel->Queue->ThreadCount);
+	printf("  %-12s %14s %14s %8s %10s %10s\n", "", "compiled us", "jit us", "speedup", "differ z/a", "max diff");
+
+	for(u32 LayerIndex = 1;
+	    LayerIndex < Network.LayerCount;
+	    ++LayerIndex)
+	{
+		matrix Weights = Network.WeightMatrices[LayerIndex];
+		vec Biases = Network.BiasVectors[LayerIndex];
+		jit_layer_kernel *Kernel = FindJitLayerKernel(Weights, Inputs);
+		Assert(Kernel);
+
+		r32 CompiledSeconds = 1e30f;
+		r32 JitSeconds = 1e30f;
+		for(u32 Repeat = 0;
+		    Repeat < JIT_BENCHMARK_REPEATS;
+		    ++Repeat)
+		{
+			u64 Start = PlatformGetWallClock();
+			for(u32 Iteration = 0;
+			    Iteration < JIT_BENCHMARK_ITERATIONS;
+			    ++Iteration)
+			{
+				temp_memory IterationMem = PoolBeginTempMemory(Pool);
+				Sigmoid(Pool, MVPlus(Pool, ParallelMult(Pool, Parallel, Weights, Inputs), Biases));
+				PoolEndTempMemory(IterationMem);
+			}
+			r32 Seconds = PlatformGetSecondsElapsed(Start, PlatformGetWallClock());
+			if(Seconds < CompiledSeconds)
+			{
+				CompiledSeconds = Seconds;
+			}
+
+			Start = PlatformGetWallClock();
+			for(u32 Iteration = 0;
+			    Iteration < JIT_BENCHMARK_ITERATIONS;
+			    ++Iteration)
+			{
+				temp_memory IterationMem = PoolBeginTempMemory(Pool);
+				matrix WeightedInputs, Activations;
+				RunJitLayerKernel(Pool, Kernel, Weights, Biases, Inputs, &WeightedInputs, &Activations);
+				PoolEndTempMemory(IterationMem);
+			}
+			Seconds = PlatformGetSecondsElapsed(Start, PlatformGetWallClock());
+			if(Seconds < JitSeconds)
+			{
+				JitSeconds = Seconds;
+			}
+		}
+
+		matrix CompiledWeightedInputs = MVPlus(Pool, ParallelMult(Pool, Parallel, Weights, Inputs), Biases);
+		matrix CompiledActivations = Sigmoid(Pool, CompiledWeightedInputs);
+		matrix JitWeightedInputs, JitActivations;
+		RunJitLayerKernel(Pool, Kernel, Weights, Biases, Inputs, &JitWeightedInputs, &JitActivations);
+
+		u32 WeightedInputDifferences = 0;
+		u32 ActivationDifferences = 0;
+		r32 MaxDifference = 0.0f;
+		CompareMatrices(CompiledWeightedInputs, JitWeightedInputs, &WeightedInputDifferences, &MaxDifference);
+		CompareMatrices(CompiledActivations, JitActivations, &ActivationDifferences, &MaxDifference);
+
+		char Name[32];
+		snprintf(Name, sizeof(Name), "%u: %u->%u", LayerIndex, Weights.ColumnCount, Weights.RowCount);
+		char Differences[32];
+		snprintf(Differences, sizeof(Differences), "%u/%u", WeightedInputDifferences, ActivationDifferences);
+		printf("  %-12s %14.2f %14.2f %7.2fx %10s %10.3g\n", Name,
+		       1e6f*CompiledSeconds/JIT_BENCHMARK_ITERATIONS, 1e6f*JitSeconds/JIT_BENCHMARK_ITERATIONS,
+		       CompiledSeconds/JitSeconds, Differences, MaxDifference);
+
+		Inputs = CompiledActivations;
+	}
+
+	PoolEndTempMemory(TempMem);
+}
@@ -0,0 +1,809 @@
+#pragma once
+
+/*
+	NOTE: Runtime code generation for the dense forward layers. Layer shapes
+		and the batch size are only known once the network is loaded and the
+		command line parsed, so with -jit the kernels are generated then: an
+		x86-64 AVX2/FMA GEMM with every row, column, stride and inner count a
+		constant, fused with the bias add and the sigmoid, one kernel per
+		layer at the training batch size.
+
+		The products tile three vectors of rows by four columns: twelve
+		accumulators, with the tile's weights held in registers and the
+		tiles for one set of rows run across all the columns before the
+		next, so that panel of weights stays in cache. The last partial
+		vector of rows goes through vmaskmovps so no row past RowCount is
+		touched.
+
+		Every weighted input sums over the inner index in order with FMA like
+		the wide kernels, and the bias and the sigmoid are the same operations
+		as WideSigmoid. The only difference is where a compiler fuses the
+		sigmoid's separate multiplies and adds into FMAs; MSVC doesn't, GCC
+		does, so there the activations can differ in the last bit.
+
+		Code pages are W^X (see nn_platform.h). Everything is emitted into
+		one writable allocation that's then made executable once; if either
+		step is refused, or the CPU is below AVX2, nothing is generated and
+		the compiled kernels run as before.
+*/
+
+#define JIT_CODE_SIZE Megabytes(1)
+#define JIT_MAX_LAYER_KERNELS 16
+
+// NOTE: Tile shape, in vectors of rows and columns.
+#define JIT_TILE_VECTORS 3
+#define JIT_TILE_COLUMNS 4
+
+struct jit_layer_arguments
+{
+	r32 *WeightedInputs;
+	r32 *Activations;
+	r32 *Weights;
+	r32 *Inputs;
+	r32 *Biases;
+};
+
+typedef void jit_layer_function(jit_layer_arguments *Arguments);
+
+struct jit_layer_kernel
+{
+	u32 RowCount;
+	u32 InnerCount;
+	u32 ColumnCount;
+	u32 WeightStride;
+	u32 InputStride;
+
+	u32 CodeSize;
+	jit_layer_function *Function;
+};
+
+struct jit_state
+{
+	u8 *Code;
+	umm CodeSize;
+	b32 Executable;
+
+	u32 KernelCount;
+	jit_layer_kernel Kernels[JIT_MAX_LAYER_KERNELS];
+};
+
+global_variable jit_state GlobalJit;
+
+//
+// NOTE: x86-64 encoding
+//
+
+enum jit_register
+{
+	JitRegister_RAX = 0,
+	JitRegister_RCX = 1,
+	JitRegister_RDX = 2,
+	JitRegister_RSP = 4,
+	JitRegister_RSI = 6,
+	JitRegister_RDI = 7,
+	JitRegister_R8 = 8,
+	JitRegister_R9 = 9,
+	JitRegister_R10 = 10,
+	JitRegister_R11 = 11,
+};
+
+#define JIT_MAP_0F 1
+#define JIT_MAP_0F38 2
+#define JIT_MAP_0F3A 3
+
+#define JIT_PREFIX_NONE 0
+#define JIT_PREFIX_66 1
+
+struct jit_emitter
+{
+	u8 *Base;
+	u32 Size;
+	u32 At;
+	b32 Overflowed;
+};
+
+// NOTE: A register, [Register + Displacement], or a RIP-relative reference to
+//	Displacement bytes into the code buffer.
+struct jit_operand
+{
+	b32 Memory;
+	b32 RipRelative;
+	u32 Register;
+	s32 Displacement;
+};
+
+inline jit_operand
+JitRegister(u32 Register)
+{
+	jit_operand Result = {};
+	Result.Register = Register;
+	return Result;
+}
+
+inline jit_operand
+JitMemory(u32 Base, s32 Displacement)
+{
+	jit_operand Result = {};
+	Result.Memory = true;
+	Result.Register = Base;
+	Result.Displacement = Displacement;
+	return Result;
+}
+
+inline jit_operand
+JitBufferAddress(u32 Offset)
+{
+	jit_operand Result = {};
+	Result.Memory = true;
+	Result.RipRelative = true;
+	Result.Displacement = (s32)Offset;
+	return Result;
+}
+
+inline void
+JitByte(jit_emitter *Emitter, u32 Value)
+{
+	if(Emitter->At < Emitter->Size)
+	{
+		Emitter->Base[Emitter->At++] = (u8)Value;
+	}
+	else
+	{
+		Emitter->Overflowed = true;
+	}
+}
+
+inline void
+JitU32(jit_emitter *Emitter, u32 Value)
+{
+	JitByte(Emitter, Value & 0xFF);
+	JitByte(Emitter, (Value >> 8) & 0xFF);
+	JitByte(Emitter, (Value >> 16) & 0xFF);
+	JitByte(Emitter, (Value >> 24) & 0xFF);
+}
+
+internal void
+JitModRM(jit_emitter *Emitter, u32 Reg, jit_operand Rm, u32 ImmediateSize)
+{
+	// NOTE: Memory operands always take a 32-bit displacement, which also
+	//	keeps RBP and R13 bases out of the special cases. RSP and R12 bases
+	//	need a SIB byte.
+	if(!Rm.Memory)
+	{
+		JitByte(Emitter, 0xC0 | ((Reg & 7) << 3) | (Rm.Register & 7));
+	}
+	else if(Rm.RipRelative)
+	{
+		JitByte(Emitter, 0x05 | ((Reg & 7) << 3));
+		s32 Displacement = Rm.Displacement - (s32)(Emitter->At + 4 + ImmediateSize);
+		JitU32(Emitter, (u32)Displacement);
+	}
+	else
+	{
+		JitByte(Emitter, 0x80 | ((Reg & 7) << 3) | (Rm.Register & 7));
+		if((Rm.Register & 7) == 4)
+		{
+			JitByte(Emitter, 0x24);
+		}
+		JitU32(Emitter, (u32)Rm.Displacement);
+	}
+}
+
+inline u32
+JitRmHighBit(jit_operand Rm)
+{
+	u32 Result = Rm.RipRelative ? 0 : ((Rm.Register >> 3) & 1);
+	return Result;
+}
+
+internal void
+JitVex(jit_emitter *Emitter, u32 Map, u32 Prefix, b32 Wide, u32 Opcode,
+       u32 Reg, u32 Source, jit_operand Rm, s32 Immediate = -1)
+{
+	// NOTE: Always the three byte form. Source is VEX.vvvv, the extra source
+	//	register of the three operand forms; pass 0 where it's unused.
+	JitByte(Emitter, 0xC4);
+	JitByte(Emitter, ((~Reg >> 3) & 1) << 7 | (1 << 6) | ((~JitRmHighBit(Rm) & 1) << 5) | Map);
+	JitByte(Emitter, ((~Source & 15) << 3) | ((Wide ? 1 : 0) << 2) | Prefix);
+	JitByte(Emitter, Opcode);
+	JitModRM(Emitter, Reg, Rm, (Immediate >= 0) ? 1 : 0);
+	if(Immediate >= 0)
+	{
+		JitByte(Emitter, (u32)Immediate);
+	}
+}
+
+internal void
+JitRex(jit_emitter *Emitter, b32 Wide64, u32 Reg, jit_operand Rm)
+{
+	u32 Rex = 0x40 | ((Wide64 ? 1 : 0) << 3) | (((Reg >> 3) & 1) << 2) | JitRmHighBit(Rm);
+	if(Rex != 0x40)
+	{
+		JitByte(Emitter, Rex);
+	}
+}
+
+// NOTE: General purpose instructions
+
+inline void
+JitLoad64(jit_emitter *Emitter, u32 Dest, u32 Base, s32 Displacement)
+{
+	jit_operand Rm = JitMemory(Base, Displacement);
+	JitRex(Emitter, true, Dest, Rm);
+	JitByte(Emitter, 0x8B);
+	JitModRM(Emitter, Dest, Rm, 0);
+}
+
+inline void
+JitLoadAddress64(jit_emitter *Emitter, u32 Dest, u32 Base, s32 Displacement)
+{
+	jit_operand Rm = JitMemory(Base, Displacement);
+	JitRex(Emitter, true, Dest, Rm);
+	JitByte(Emitter, 0x8D);
+	JitModRM(Emitter, Dest, Rm, 0);
+}
+
+inline void
+JitMove64(jit_emitter *Emitter, u32 Dest, u32 Source)
+{
+	jit_operand Rm = JitRegister(Dest);
+	JitRex(Emitter, true, Source, Rm);
+	JitByte(Emitter, 0x89);
+	JitModRM(Emitter, Source, Rm, 0);
+}
+
+inline void
+JitMoveImmediate32(jit_emitter *Emitter, u32 Dest, u32 Value)
+{
+	JitRex(Emitter, false, 0, JitRegister(Dest));
+	JitByte(Emitter, 0xB8 + (Dest & 7));
+	JitU32(Emitter, Value);
+}
+
+inline void
+JitAddImmediate64(jit_emitter *Emitter, u32 Dest, s32 Value)
+{
+	jit_operand Rm = JitRegister(Dest);
+	JitRex(Emitter, true, 0, Rm);
+	JitByte(Emitter, 0x81);
+	JitModRM(Emitter, 0, Rm, 4);
+	JitU32(Emitter, (u32)Value);
+}
+
+inline void
+JitDecrement32(jit_emitter *Emitter, u32 Register)
+{
+	jit_operand Rm = JitRegister(Register);
+	JitRex(Emitter, false, 0, Rm);
+	JitByte(Emitter, 0xFF);
+	JitModRM(Emitter, 1, Rm, 0);
+}
+
+inline void
+JitJumpIfNotZero(jit_emitter *Emitter, u32 Target)
+{
+	JitByte(Emitter, 0x0F);
+	JitByte(Emitter, 0x85);
+	JitU32(Emitter, (u32)((s32)Target - (s32)(Emitter->At + 4)));
+}
+
+// NOTE: AVX instructions, on ymm registers unless they say otherwise
+
+inline void
+JitLoadPs(jit_emitter *Emitter, u32 Dest, jit_operand Source)
+{
+	JitVex(Emitter, JIT_MAP_0F, JIT_PREFIX_NONE, true, 0x10, Dest, 0, Source);
+}
+
+inline void
+JitStorePs(jit_emitter *Emitter, jit_operand Dest, u32 Source)
+{
+	JitVex(Emitter, JIT_MAP_0F, JIT_PREFIX_NONE, true, 0x11, Source, 0, Dest);
+}
+
+inline void
+JitLoadXmm(jit_emitter *Emitter, u32 Dest, jit_operand Source)
+{
+	JitVex(Emitter, JIT_MAP_0F, JIT_PREFIX_NONE, false, 0x10, Dest, 0, Source);
+}
+
+inline void
+JitStoreXmm(jit_emitter *Emitter, jit_operand Dest, u32 Source)
+{
+	JitVex(Emitter, JIT_MAP_0F, JIT_PREFIX_NONE, false, 0x11, Source, 0, Dest);
+}
+
+inline void
+JitMaskLoadPs(jit_emitter *Emitter, u32 Dest, u32 Mask, jit_operand Source)
+{
+	JitVex(Emitter, JIT_MAP_0F38, JIT_PREFIX_66, true, 0x2C, Dest, Mask, Source);
+}
+
+inline void
+JitMaskStorePs(jit_emitter *Emitter, jit_operand Dest, u32 Mask, u32 Source)
+{
+	JitVex(Emitter, JIT_MAP_0F38, JIT_PREFIX_66, true, 0x2E, Source, Mask, Dest);
+}
+
+inline void
+JitBroadcastSs(jit_emitter *Emitter, u32 Dest, jit_operand Source)
+{
+	JitVex(Emitter, JIT_MAP_0F38, JIT_PREFIX_66, true, 0x18, Dest, 0, Source);
+}
+
+// NOTE: Dest = A op B
+inline void JitXorPs(jit_emitter *Emitter, u32 Dest, u32 A, jit_operand B) {JitVex(Emitter, JIT_MAP_0F, JIT_PREFIX_NONE, true, 0x57, Dest, A, B);}
+inline void JitAddPs(jit_emitter *Emitter, u32 Dest, u32 A, jit_operand B) {JitVex(Emitter, JIT_MAP_0F, JIT_PREFIX_NONE, true, 0x58, Dest, A, B);}
+inline void JitMulPs(jit_emitter *Emitter, u32 Dest, u32 A, jit_operand B) {JitVex(Emitter, JIT_MAP_0F, JIT_PREFIX_NONE, true, 0x59, Dest, A, B);}
+inline void JitSubPs(jit_emitter *Emitter, u32 Dest, u32 A, jit_operand B) {JitVex(Emitter, JIT_MAP_0F, JIT_PREFIX_NONE, true, 0x5C, Dest, A, B);}
+inline void JitMinPs(jit_emitter *Emitter, u32 Dest, u32 A, jit_operand B) {JitVex(Emitter, JIT_MAP_0F, JIT_PREFIX_NONE, true, 0x5D, Dest, A, B);}
+inline void JitDivPs(jit_emitter *Emitter, u32 Dest, u32 A, jit_operand B) {JitVex(Emitter, JIT_MAP_0F, JIT_PREFIX_NONE, true, 0x5E, Dest, A, B);}
+inline void JitMaxPs(jit_emitter *Emitter, u32 Dest, u32 A, jit_operand B) {JitVex(Emitter, JIT_MAP_0F, JIT_PREFIX_NONE, true, 0x5F, Dest, A, B);}
+inline void JitAddS32(jit_emitter *Emitter, u32 Dest, u32 A, jit_operand B) {JitVex(Emitter, JIT_MAP_0F, JIT_PREFIX_66, true, 0xFE, Dest, A, B);}
+
+// NOTE: Dest += A*B, and Dest = Dest*A + B
+inline void JitMulAddPs(jit_emitter *Emitter, u32 Dest, u32 A, jit_operand B) {JitVex(Emitter, JIT_MAP_0F38, JIT_PREFIX_66, true, 0xB8, Dest, A, B);}
+inline void JitScaleAddPs(jit_emitter *Emitter, u32 Dest, u32 A, jit_operand B) {JitVex(Emitter, JIT_MAP_0F38, JIT_PREFIX_66, true, 0xA8, Dest, A, B);}
+
+inline void
+JitRoundNearestPs(jit_emitter *Emitter, u32 Dest, u32 Source)
+{
+	JitVex(Emitter, JIT_MAP_0F3A, JIT_PREFIX_66, true, 0x08, Dest, 0, JitRegister(Source), 0x8);
+}
+
+inline void
+JitConvertToS32(jit_emitter *Emitter, u32 Dest, u32 Source)
+{
+	JitVex(Emitter, JIT_MAP_0F, JIT_PREFIX_66, true, 0x5B, Dest, 0, JitRegister(Source));
+}
+
+inline void
+JitShiftLeftS32(jit_emitter *Emitter, u32 Dest, u32 Source, u32 Count)
+{
+	JitVex(Emitter, JIT_MAP_0F, JIT_PREFIX_66, true, 0x72, 6, Dest, JitRegister(Source), (s32)Count);
+}
+
+//
+// NOTE: Layer kernels
+//
+
+// NOTE: The constants sit at the start of the code buffer, a vector each,
+//	where the kernels reach them RIP-relative.
+enum jit_constant
+{
+	JitConstant_ExpMax,
+	JitConstant_ExpMin,
+	JitConstant_Log2E,
+	JitConstant_Ln2High,
+	JitConstant_Ln2Low,
+	JitConstant_Poly0,
+	JitConstant_Poly1,
+	JitConstant_Poly2,
+	JitConstant_Poly3,
+	JitConstant_Poly4,
+	JitConstant_Poly5,
+	JitConstant_One,
+	JitConstant_ExponentBias,
+
+	// NOTE: Lane masks for 0-7 rows.
+	JitConstant_RowMasks,
+
+	JitConstant_Count = JitConstant_RowMasks + 8,
+};
+
+#define JIT_VECTOR_BYTES 32
+#define JIT_VECTOR_WIDTH 8
+
+inline jit_operand
+JitConstant(u32 Constant)
+{
+	jit_operand Result = JitBufferAddress(Constant*JIT_VECTOR_BYTES);
+	return Result;
+}
+
+internal void
+JitWriteConstants(u8 *Code)
+{
+	r32 Values[JitConstant_ExponentBias] =
+	{
+		88.3762626647949f, -87.3365478515625f, 1.44269504088896341f, 0.693359375f, -2.12194440e-4f,
+		1.9875691500e-4f, 1.3981999507e-3f, 8.3334519073e-3f, 4.1665795894e-2f, 1.6666665459e-1f,
+		5.0000001201e-1f, 1.0f,
+	};
+
+	for(u32 Lane = 0;
+	    Lane < JIT_VECTOR_WIDTH;
+	    ++Lane)
+	{
+		for(u32 Constant = 0;
+		    Constant < JitConstant_ExponentBias;
+		    ++Constant)
+		{
+			((r32 *)(Code + Constant*JIT_VECTOR_BYTES))[Lane] = Values[Constant];
+		}
+		((s32 *)(Code + JitConstant_ExponentBias*JIT_VECTOR_BYTES))[Lane] = 127;
+
+		for(u32 RowCount = 0;
+		    RowCount < JIT_VECTOR_WIDTH;
+		    ++RowCount)
+		{
+			((s32 *)(Code + (JitConstant_RowMasks + RowCount)*JIT_VECTOR_BYTES))[Lane] = (Lane < RowCount) ? -1 : 0;
+		}
+	}
+}
+
+// NOTE: Registers the kernels use. The general purpose ones are all volatile
+//	on both ABIs except RSI and RDI on Win64, which the prologue saves.
+#define JIT_WEIGHTS JitRegister_R8
+#define JIT_INPUTS JitRegister_R9
+#define JIT_WEIGHTED_INPUTS JitRegister_R10
+#define JIT_ACTIVATIONS JitRegister_R11
+#define JIT_BIASES JitRegister_RDX
+#define JIT_WEIGHT_WALK JitRegister_RAX
+#define JIT_INPUT_WALK JitRegister_RDI
+#define JIT_INNER_COUNTER JitRegister_RCX
+#define JIT_COLUMN_COUNTER JitRegister_RSI
+
+// NOTE: ymm0-11 accumulate. In the inner loop ymm12-14 hold the tile's
+//	weights and ymm15 the broadcast input; the epilogue reuses them.
+#define JIT_WEIGHT_VECTORS 12
+#define JIT_BROADCAST 15
+#define JIT_SCRATCH 12
+#define JIT_EXPONENT 13
+#define JIT_MASK 14
+#define JIT_POLY 15
+
+#if _WIN32
+	#define JIT_ARGUMENTS JitRegister_RCX
+	#define JIT_SAVED_XMM_BYTES (10*16 + 8)
+#else
+	#define JIT_ARGUMENTS JitRegister_RDI
+#endif
+
+internal void
+JitEmitSigmoid(jit_emitter *Emitter, u32 Value, u32 Exponent, u32 Scratch)
+{
+	// NOTE: WideSigmoid and WideExp, an operation at a time. Value comes in
+	//	as the weighted input and leaves as the activation; Exponent, Scratch
+	//	and JIT_POLY are clobbered.
+	u32 Poly = JIT_POLY;
+
+	JitXorPs(Emitter, Scratch, Scratch, JitRegister(Scratch));
+	JitSubPs(Emitter, Scratch, Scratch, JitRegister(Value));
+	JitMinPs(Emitter, Scratch, Scratch, JitConstant(JitConstant_ExpMax));
+	JitMaxPs(Emitter, Scratch, Scratch, JitConstant(JitConstant_ExpMin));
+
+	JitMulPs(Emitter, Exponent, Scratch, JitConstant(JitConstant_Log2E));
+	JitRoundNearestPs(Emitter, Exponent, Exponent);
+	JitMulPs(Emitter, Value, Exponent, JitConstant(JitConstant_Ln2High));
+	JitSubPs(Emitter, Scratch, Scratch, JitRegister(Value));
+	JitMulPs(Emitter, Value, Exponent, JitConstant(JitConstant_Ln2Low));
+	JitSubPs(Emitter, Scratch, Scratch, JitRegister(Value));
+
+	JitLoadPs(Emitter, Poly, JitConstant(JitConstant_Poly0));
+	for(u32 Constant = JitConstant_Poly1;
+	    Constant <= JitConstant_Poly5;
+	    ++Constant)
+	{
+		JitScaleAddPs(Emitter, Poly, Scratch, JitConstant(Constant));
+	}
+	JitMulPs(Emitter, Value, Scratch, JitRegister(Scratch));
+	JitAddPs(Emitter, Scratch, Scratch, JitConstant(JitConstant_One));
+	JitScaleAddPs(Emitter, Poly, Value, JitRegister(Scratch));
+
+	JitConvertToS32(Emitter, Exponent, Exponent);
+	JitAddS32(Emitter, Exponent, Exponent, JitConstant(JitConstant_ExponentBias));
+	JitShiftLeftS32(Emitter, Exponent, Exponent, 23);
+	JitMulPs(Emitter, Poly, Poly, JitRegister(Exponent));
+
+	JitAddPs(Emitter, Poly, Poly, JitConstant(JitConstant_One));
+	JitLoadPs(Emitter, Value, JitConstant(JitConstant_One));
+	JitDivPs(Emitter, Value, Value, JitRegister(Poly));
+}
+
+internal void
+JitEmitTile(jit_emitter *Emitter, jit_layer_kernel *Kernel, u32 FirstVector, u32 VectorCount,
+            u32 PartialRowCount, u32 ColumnCount)
+{
+	// NOTE: VectorCount vectors of rows from FirstVector by ColumnCount
+	//	columns, the last vector partial when PartialRowCount is set. The
+	//	column pointers are the tile's first column.
+	u32 OutputStride = MatrixStrideFor(Kernel->RowCount);
+
+	for(u32 Accumulator = 0;
+	    Accumulator < VectorCount*ColumnCount;
+	    ++Accumulator)
+	{
+		JitXorPs(Emitter, Accumulator, Accumulator, JitRegister(Accumulator));
+	}
+	JitLoadAddress64(Emitter, JIT_WEIGHT_WALK, JIT_WEIGHTS, FirstVector*JIT_VECTOR_BYTES);
+	JitMove64(Emitter, JIT_INPUT_WALK, JIT_INPUTS);
+	JitMoveImmediate32(Emitter, JIT_INNER_COUNTER, Kernel->InnerCount);
+
+	// NOTE: Each weight vector is loaded once and used for every column.
+	//	The partial one borrows the broadcast register for its mask.
+	u32 InnerLoop = Emitter->At;
+	for(u32 Vector = 0;
+	    Vector < VectorCount;
+	    ++Vector)
+	{
+		jit_operand Weights = JitMemory(JIT_WEIGHT_WALK, Vector*JIT_VECTOR_BYTES);
+		if(PartialRowCount && (Vector == (VectorCount - 1)))
+		{
+			JitLoadPs(Emitter, JIT_BROADCAST, JitConstant(JitConstant_RowMasks + PartialRowCount));
+			JitMaskLoadPs(Emitter, JIT_WEIGHT_VECTORS + Vector, JIT_BROADCAST, Weights);
+		}
+		else
+		{
+			JitLoadPs(Emitter, JIT_WEIGHT_VECTORS + Vector, Weights);
+		}
+	}
+	for(u32 Column = 0;
+	    Column < ColumnCount;
+	    ++Column)
+	{
+		JitBroadcastSs(Emitter, JIT_BROADCAST, JitMemory(JIT_INPUT_WALK, Column*Kernel->InputStride*sizeof(r32)));
+		for(u32 Vector = 0;
+		    Vector < VectorCount;
+		    ++Vector)
+		{
+			JitMulAddPs(Emitter, Vector*ColumnCount + Column, JIT_BROADCAST, JitRegister(JIT_WEIGHT_VECTORS + Vector));
+		}
+	}
+	JitAddImmediate64(Emitter, JIT_WEIGHT_WALK, Kernel->WeightStride*sizeof(r32));
+	JitAddImmediate64(Emitter, JIT_INPUT_WALK, sizeof(r32));
+	JitDecrement32(Emitter, JIT_INNER_COUNTER);
+	JitJumpIfNotZero(Emitter, InnerLoop);
+
+	if(PartialRowCount)
+	{
+		JitLoadPs(Emitter, JIT_MASK, JitConstant(JitConstant_RowMasks + PartialRowCount));
+	}
+	for(u32 Column = 0;
+	    Column < ColumnCount;
+	    ++Column)
+	{
+		for(u32 Vector = 0;
+		    Vector < VectorCount;
+		    ++Vector)
+		{
+			u32 Accumulator = Vector*ColumnCount + Column;
+			b32 Partial = (PartialRowCount && (Vector == (VectorCount - 1)));
+			s32 RowOffset = (FirstVector + Vector)*JIT_VECTOR_BYTES;
+			s32 OutputOffset = Column*OutputStride*sizeof(r32) + RowOffset;
+
+			if(Partial)
+			{
+				JitMaskLoadPs(Emitter, JIT_SCRATCH, JIT_MASK, JitMemory(JIT_BIASES, RowOffset));
+				JitAddPs(Emitter, Accumulator, Accumulator, JitRegister(JIT_SCRATCH));
+				JitMaskStorePs(Emitter, JitMemory(JIT_WEIGHTED_INPUTS, OutputOffset), JIT_MASK, Accumulator);
+			}
+			else
+			{
+				JitAddPs(Emitter, Accumulator, Accumulator, JitMemory(JIT_BIASES, RowOffset));
+				JitStorePs(Emitter, JitMemory(JIT_WEIGHTED_INPUTS, OutputOffset), Accumulator);
+			}
+
+			JitEmitSigmoid(Emitter, Accumulator, JIT_EXPONENT, JIT_SCRATCH);
+
+			if(Partial)
+			{
+				JitMaskStorePs(Emitter, JitMemory(JIT_ACTIVATIONS, OutputOffset), JIT_MASK, Accumulator);
+			}
+			else
+			{
+				JitStorePs(Emitter, JitMemory(JIT_ACTIVATIONS, OutputOffset), Accumulator);
+			}
+		}
+	}
+}
+
+internal void
+JitEmitRowPanel(jit_emitter *Emitter, jit_layer_kernel *Kernel, u32 FirstVector, u32 VectorCount,
+                u32 PartialRowCount)
+{
+	// NOTE: One tile's rows across every column. The panel's weights stay in
+	//	cache while the inputs stream past, then the column pointers go back
+	//	to the first column for the next panel.
+	u32 OutputStride = MatrixStrideFor(Kernel->RowCount);
+	u32 FullBlockCount = Kernel->ColumnCount / JIT_TILE_COLUMNS;
+	u32 LeftoverColumns = Kernel->ColumnCount % JIT_TILE_COLUMNS;
+	s32 InputStep = JIT_TILE_COLUMNS*Kernel->InputStride*sizeof(r32);
+	s32 OutputStep = JIT_TILE_COLUMNS*OutputStride*sizeof(r32);
+
+	if(FullBlockCount)
+	{
+		JitMoveImmediate32(Emitter, JIT_COLUMN_COUNTER, FullBlockCount);
+		u32 ColumnLoop = Emitter->At;
+
+		JitEmitTile(Emitter, Kernel, FirstVector, VectorCount, PartialRowCount, JIT_TILE_COLUMNS);
+
+		JitAddImmediate64(Emitter, JIT_INPUTS, InputStep);
+		JitAddImmediate64(Emitter, JIT_WEIGHTED_INPUTS, OutputStep);
+		JitAddImmediate64(Emitter, JIT_ACTIVATIONS, OutputStep);
+		JitDecrement32(Emitter, JIT_COLUMN_COUNTER);
+		JitJumpIfNotZero(Emitter, ColumnLoop);
+	}
+	if(LeftoverColumns)
+	{
+		JitEmitTile(Emitter, Kernel, FirstVector, VectorCount, PartialRowCount, LeftoverColumns);
+	}
+	if(FullBlockCount)
+	{
+		JitAddImmediate64(Emitter, JIT_INPUTS, -(s32)FullBlockCount*InputStep);
+		JitAddImmediate64(Emitter, JIT_WEIGHTED_INPUTS, -(s32)FullBlockCount*OutputStep);
+		JitAddImmediate64(Emitter, JIT_ACTIVATIONS, -(s32)FullBlockCount*OutputStep);
+	}
+}
+
+internal void
+JitEmitLayerKernel(jit_emitter *Emitter, jit_layer_kernel *Kernel)
+{
+	// NOTE: Entry points start on a cache line, padded with int3.
+	while(Emitter->At % 64)
+	{
+		JitByte(Emitter, 0xCC);
+	}
+	u32 Start = Emitter->At;
+
+#if _WIN32
+	// NOTE: Win64 wants RSI, RDI and xmm6-15 back as they were.
+	JitByte(Emitter, 0x56);
+	JitByte(Emitter, 0x57);
+	JitAddImmediate64(Emitter, JitRegister_RSP, -JIT_SAVED_XMM_BYTES);
+	for(u32 Register = 6;
+	    Register < 16;
+	    ++Register)
+	{
+		JitStoreXmm(Emitter, JitMemory(JitRegister_RSP, (Register - 6)*16), Register);
+	}
+#endif
+
+	JitLoad64(Emitter, JIT_WEIGHTS, JIT_ARGUMENTS, offsetof(jit_layer_arguments, Weights));
+	JitLoad64(Emitter, JIT_INPUTS, JIT_ARGUMENTS, offsetof(jit_layer_arguments, Inputs));
+	JitLoad64(Emitter, JIT_WEIGHTED_INPUTS, JIT_ARGUMENTS, offsetof(jit_layer_arguments, WeightedInputs));
+	JitLoad64(Emitter, JIT_ACTIVATIONS, JIT_ARGUMENTS, offsetof(jit_layer_arguments, Activations));
+	JitLoad64(Emitter, JIT_BIASES, JIT_ARGUMENTS, offsetof(jit_layer_arguments, Biases));
+
+	u32 VectorCount = (Kernel->RowCount + JIT_VECTOR_WIDTH - 1) / JIT_VECTOR_WIDTH;
+	for(u32 FirstVector = 0;
+	    FirstVector < VectorCount;
+	    FirstVector += JIT_TILE_VECTORS)
+	{
+		u32 TileVectors = Minimum(JIT_TILE_VECTORS, VectorCount - FirstVector);
+		u32 PartialRowCount = 0;
+		if((FirstVector + TileVectors) == VectorCount)
+		{
+			PartialRowCount = Kernel->RowCount % JIT_VECTOR_WIDTH;
+		}
+		JitEmitRowPanel(Emitter, Kernel, FirstVector, TileVectors, PartialRowCount);
+	}
+
+#if _WIN32
+	for(u32 Register = 6;
+	    Register < 16;
+	    ++Register)
+	{
+		JitLoadXmm(Emitter, Register, JitMemory(JitRegister_RSP, (Register - 6)*16));
+	}
+	JitAddImmediate64(Emitter, JitRegister_RSP, JIT_SAVED_XMM_BYTES);
+	JitByte(Emitter, 0x5F);
+	JitByte(Emitter, 0x5E);
+#endif
+
+	// NOTE: vzeroupper, ret
+	JitByte(Emitter, 0xC5);
+	JitByte(Emitter, 0xF8);
+	JitByte(Emitter, 0x77);
+	JitByte(Emitter, 0xC3);
+
+	Kernel->CodeSize = Emitter->At - Start;
+	Kernel->Function = (jit_layer_function *)(Emitter->Base + Start);
+}
+
+internal char *
+CompileJitLayerKernels(u32 *Layers, u32 LayerCount, u32 ColumnCount)
+{
+	// NOTE: Returns why nothing was compiled, or 0 when it all worked.
+	if(GlobalMathKernels.Level < CpuLevel_AVX2)
+	{
+		return "the CPU level is below avx2";
+	}
+	if((LayerCount - 1) > JIT_MAX_LAYER_KERNELS)
+	{
+		return "the network has too many layers";
+	}
+
+	jit_state *Jit = &GlobalJit;
+	Jit->CodeSize = JIT_CODE_SIZE;
+	Jit->Code = PlatformAllocateCodePages(Jit->CodeSize);
+	if(!Jit->Code)
+	{
+		return "code pages could not be allocated";
+	}
+
+	JitWriteConstants(Jit->Code);
+	jit_emitter Emitter = {};
+	Emitter.Base = Jit->Code;
+	Emitter.Size = (u32)Jit->CodeSize;
+	Emitter.At = JitConstant_Count*JIT_VECTOR_BYTES;
+
+	for(u32 LayerIndex = 1;
+	    LayerIndex < LayerCount;
+	    ++LayerIndex)
+	{
+		jit_layer_kernel *Kernel = Jit->Kernels + Jit->KernelCount++;
+		Kernel->RowCount = Layers[LayerIndex];
+		Kernel->InnerCount = Layers[LayerIndex - 1];
+		Kernel->ColumnCount = ColumnCount;
+		Kernel->WeightStride = MatrixStrideFor(Kernel->RowCount);
+		Kernel->InputStride = MatrixStrideFor(Kernel->InnerCount);
+		JitEmitLayerKernel(&Emitter, Kernel);
+	}
+
+	char *Failure = 0;
+	if(Emitter.Overflowed)
+	{
+		Failure = "the kernels don't fit in the code buffer";
+	}
+	else if(!PlatformMakeCodeExecutable(Jit->Code, Jit->CodeSize))
+	{
+		Failure = "the OS refused to make the code executable";
+	}
+
+	if(Failure)
+	{
+		PlatformFreeCodePages(Jit->Code, Jit->CodeSize);
+		Jit->Code = 0;
+		Jit->KernelCount = 0;
+	}
+	else
+	{
+		Jit->Executable = true;
+	}
+
+	return Failure;
+}
+
+internal jit_layer_kernel *
+FindJitLayerKernel(matrix Weights, matrix Inputs)
+{
+	jit_layer_kernel *Result = 0;
+	for(u32 KernelIndex = 0;
+	    KernelIndex < GlobalJit.KernelCount;
+	    ++KernelIndex)
+	{
+		jit_layer_kernel *Kernel = GlobalJit.Kernels + KernelIndex;
+		if((Kernel->RowCount == Weights.RowCount) &&
+		   (Kernel->InnerCount == Weights.ColumnCount) &&
+		   (Kernel->ColumnCount == Inputs.ColumnCount) &&
+		   (Kernel->WeightStride == Weights.Stride) &&
+		   (Kernel->InputStride == Inputs.Stride))
+		{
+			Result = Kernel;
+			break;
+		}
+	}
+	return Result;
+}
+
+internal void
+RunJitLayerKernel(memory_pool *Pool, jit_layer_kernel *Kernel, matrix Weights, vec Biases, matrix Inputs,
+                  matrix *WeightedInputs, matrix *Activations)
+{
+	TIMED_BLOCK("RunJitLayerKernel",
+	            ((u64)Weights.RowCount*Weights.ColumnCount + (u64)Weights.ColumnCount*Inputs.ColumnCount +
+	             2*(u64)Weights.RowCount*Inputs.ColumnCount)*sizeof(r32),
+	            2*(u64)Weights.RowCount*Weights.ColumnCount*Inputs.ColumnCount);
+
+	*WeightedInputs = MatrixRaw_(Pool, Weights.RowCount, Inputs.ColumnCount);
+	*Activations = MatrixRaw_(Pool, Weights.RowCount, Inputs.ColumnCount);
+
+	jit_layer_arguments Arguments = {};
+	Arguments.WeightedInputs = WeightedInputs->Data;
+	Arguments.Activations = Activations->Data;
+	Arguments.Weights = Weights.Data;
+	Arguments.Inputs = Inputs.Data;
+	Arguments.Biases = Biases.Data;
+	Kernel->Function(&Arguments);
+}
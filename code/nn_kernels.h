@@ -0,0 +1,1665 @@
+#pragma once
+
+/*
+	NOTE: The inner loops of nn_math.h, once per instruction set. One binary
+		runs on every host: InitializeMathKernels picks the widest set the CPU
+		and OS support at startup and nn_math.h calls through GlobalMathKernels
+		from then on. Set NN_CPU_LEVEL to scalar, sse4.2, avx2 or avx512 to
+		force a lower level for testing or benchmarking, NN_BF16=software to
+		keep AVX512-BF16's dot product out of the mixed precision kernels, and
+		NN_POPCNT=64 to keep AVX512-VPOPCNTDQ out of the binary ones.
+
+		The scalar kernels add up in exactly the order the original loops did.
+		The wide ones sum dot products in several lanes and use FMA where the
+		set has it, so results differ in the last bits between levels. A given
+		level is still deterministic, so -deterministic runs only reproduce
+		on hosts that pick the same level.
+
+		The wide kernels are compiled with per-function target options instead
+		of build flags, so nothing outside this file needs -mavx2 and the like.
+*/
+
+/*
+	NOTE: GEMM cache blocking. The inner dimension is cut into InnerBlock
+		slices and the columns into ColumnBlock groups, so a slice of A stays
+		in cache while a whole column group runs through it. Every result still
+		sums over the inner index in order, so the blocking never changes a
+		single bit of the result. Zero means no blocking in that dimension.
+		The scalar kernel ignores it.
+
+		The autotuner records the best config per shape in GlobalGemmTuning;
+		shapes it hasn't seen run unblocked.
+*/
+struct gemm_config
+{
+	u32 InnerBlock;
+	u32 ColumnBlock;
+};
+
+#define GEMM_TUNING_MAX_SHAPES 32
+
+struct gemm_shape_config
+{
+	u32 RowCount;
+	u32 InnerCount;
+	b32 TransposeB;
+	gemm_config Config;
+};
+
+struct gemm_tuning
+{
+	u32 ShapeCount;
+	gemm_shape_config Shapes[GEMM_TUNING_MAX_SHAPES];
+};
+
+global_variable gemm_tuning GlobalGemmTuning;
+
+internal gemm_config
+GetGemmConfig(u32 RowCount, u32 InnerCount, b32 TransposeB)
+{
+	gemm_config Result = {};
+	for(u32 ShapeIndex = 0;
+	    ShapeIndex < GlobalGemmTuning.ShapeCount;
+	    ++ShapeIndex)
+	{
+		gemm_shape_config *Shape = GlobalGemmTuning.Shapes + ShapeIndex;
+		if((Shape->RowCount == RowCount) &&
+		   (Shape->InnerCount == InnerCount) &&
+		   (Shape->TransposeB == TransposeB))
+		{
+			Result = Shape->Config;
+			break;
+		}
+	}
+	return Result;
+}
+
+internal void
+SetGemmConfig(u32 RowCount, u32 InnerCount, b32 TransposeB, gemm_config Config)
+{
+	gemm_shape_config *Shape = 0;
+	for(u32 ShapeIndex = 0;
+	    ShapeIndex < GlobalGemmTuning.ShapeCount;
+	    ++ShapeIndex)
+	{
+		gemm_shape_config *Test = GlobalGemmTuning.Shapes + ShapeIndex;
+		if((Test->RowCount == RowCount) &&
+		   (Test->InnerCount == InnerCount) &&
+		   (Test->TransposeB == TransposeB))
+		{
+			Shape = Test;
+			break;
+		}
+	}
+
+	if(!Shape && (GlobalGemmTuning.ShapeCount < GEMM_TUNING_MAX_SHAPES))
+	{
+		Shape = GlobalGemmTuning.Shapes + GlobalGemmTuning.ShapeCount++;
+		Shape->RowCount = RowCount;
+		Shape->InnerCount = InnerCount;
+		Shape->TransposeB = TransposeB;
+	}
+
+	if(Shape)
+	{
+		Shape->Config = Config;
+	}
+}
+
+// NOTE: Result = A*B for column-major A and Result. B(Inner, Column) lives at
+//	B[Inner*BInnerStep + Column*BColumnStep], so swapping the steps multiplies
+//	by B transposed instead.
+#define MATH_GEMM_KERNEL(name) void name(r32 *Result, u32 ResultStride, r32 *A, u32 AStride, \
+                                         r32 *B, u32 BInnerStep, u32 BColumnStep, \
+                                         u32 RowCount, u32 ColumnCount, u32 InnerCount, \
+                                         gemm_config Config)
+typedef MATH_GEMM_KERNEL(math_gemm_kernel);
+
+#define MATH_DOT_KERNEL(name) r32 name(r32 *A, r32 *B, u32 Count)
+typedef MATH_DOT_KERNEL(math_dot_kernel);
+
+#define MATH_BINARY_KERNEL(name) void name(r32 *Dest, r32 *A, r32 *B, u32 Count)
+typedef MATH_BINARY_KERNEL(math_binary_kernel);
+
+#define MATH_UNARY_KERNEL(name) void name(r32 *Dest, r32 *Source, u32 Count)
+typedef MATH_UNARY_KERNEL(math_unary_kernel);
+
+#define MATH_SCALE_KERNEL(name) void name(r32 *Dest, r32 Scale, u32 Count)
+typedef MATH_SCALE_KERNEL(math_scale_kernel);
+
+// NOTE: Result = A*B for a sparse B in compressed columns (see sparse_matrix).
+//	Each result sums the non-zero inner indices in order with the same
+//	multiply-add as the GEMM, so skipping the zeros doesn't change its bits.
+#define MATH_SPARSE_GEMM_KERNEL(name) void name(r32 *Result, u32 ResultStride, r32 *A, u32 AStride, \
+                                                u32 *ColumnStarts, u32 *RowIndices, r32 *Values, \
+                                                u32 RowCount, u32 ColumnCount)
+typedef MATH_SPARSE_GEMM_KERNEL(math_sparse_gemm_kernel);
+
+// NOTE: One bit per value, set for non-zeros, 32 values to a mask; the last
+//	mask's unused high bits are clear. Returns the number of non-zeros.
+#define MATH_NON_ZERO_MASK_KERNEL(name) u32 name(u32 *Masks, r32 *Source, u32 Count)
+typedef MATH_NON_ZERO_MASK_KERNEL(math_non_zero_mask_kernel);
+
+// NOTE: Result = A*B for A in block sparse rows (see block_sparse_matrix),
+//	sixteen rows to a block. Like the sparse GEMM, the kept blocks are summed
+//	in column order with the GEMM's multiply-add, so the bits match a dense
+//	product with the pruned weights left as zeros.
+#define BLOCK_SPARSE_ROWS 16
+#define MATH_BLOCK_SPARSE_GEMM_KERNEL(name) void name(r32 *Result, u32 ResultStride, \
+                                                      u32 *BlockRowStarts, u32 *BlockColumns, r32 *BlockValues, \
+                                                      r32 *B, u32 BStride, u32 RowCount, u32 ColumnCount)
+typedef MATH_BLOCK_SPARSE_GEMM_KERNEL(math_block_sparse_gemm_kernel);
+
+// NOTE: One image through a valid, stride one convolution, channels last (see
+//	nn_conv.h). Each output sums Weights(OutputChannel, Tap)*Window(Tap) over
+//	the window's taps in (KY, KX, InputChannel) order, the im2col matrix's row
+//	order, with the GEMM's multiply-add, so it matches the im2col product bit
+//	for bit without building it.
+#define MATH_CONVOLVE_KERNEL(name) void name(r32 *Result, r32 *Weights, u32 WeightStride, r32 *Input, \
+                                             u32 InputWidth, u32 InputChannels, \
+                                             u32 OutputWidth, u32 OutputHeight, u32 OutputChannels, \
+                                             u32 KernelSize)
+typedef MATH_CONVOLVE_KERNEL(math_convolve_kernel);
+
+// NOTE: bf16 kernels for mixed precision (see nn_bf16.h). The GEMM widens
+//	A and B to r32 as it loads them and sums in r32 exactly like Gemm, so
+//	it gives Gemm's bits for the widened matrices. The dot likewise, except
+//	where the CPU does it in hardware, which rounds in its own way.
+//	Converting to bf16 rounds to nearest even, the same at every level.
+#define MATH_GEMM_BF16_KERNEL(name) void name(r32 *Result, u32 ResultStride, bf16 *A, u32 AStride, \
+                                              bf16 *B, u32 BInnerStep, u32 BColumnStep, \
+                                              u32 RowCount, u32 ColumnCount, u32 InnerCount)
+typedef MATH_GEMM_BF16_KERNEL(math_gemm_bf16_kernel);
+
+#define MATH_DOT_BF16_KERNEL(name) r32 name(bf16 *A, bf16 *B, u32 Count)
+typedef MATH_DOT_BF16_KERNEL(math_dot_bf16_kernel);
+
+#define MATH_TO_BF16_KERNEL(name) void name(bf16 *Dest, r32 *Source, u32 Count)
+typedef MATH_TO_BF16_KERNEL(math_to_bf16_kernel);
+
+#define MATH_FROM_BF16_KERNEL(name) void name(r32 *Dest, bf16 *Source, u32 Count)
+typedef MATH_FROM_BF16_KERNEL(math_from_bf16_kernel);
+
+// NOTE: The XNOR-popcount kernel for binary and ternary layers (see
+//	nn_binary.h): how many of WordCount*64 bits differ between A and B,
+//	only counting where Mask is set if there is one. The count is exact, so
+//	every version gives the same answer.
+#define MATH_COUNT_DIFFERENT_BITS_KERNEL(name) u32 name(u64 *A, u64 *B, u64 *Mask, u32 WordCount)
+typedef MATH_COUNT_DIFFERENT_BITS_KERNEL(math_count_different_bits_kernel);
+
+// NOTE: QuantizeWeightsInto's passes over one column of a binary or ternary
+//	layer's latent weights (see nn_binary.h), with a row per lane. ClipAbsSum
+//	clips the weights to +-Limit in place and adds their magnitudes to Sums.
+//	KeptAbsSum adds the magnitudes above Thresholds to Sums and counts them
+//	in Counts, which are r32 so they sum in lanes too. Quantize writes
+//	+-Scales, or zero where a magnitude isn't above its threshold; a
+//	negative threshold keeps every weight. Each row sums in column order,
+//	so every version gives the same bits.
+#define MATH_CLIP_ABS_SUM_KERNEL(name) void name(r32 *Values, r32 *Sums, r32 Limit, u32 Count)
+typedef MATH_CLIP_ABS_SUM_KERNEL(math_clip_abs_sum_kernel);
+
+#define MATH_KEPT_ABS_SUM_KERNEL(name) void name(r32 *Sums, r32 *Counts, r32 *Source, r32 *Thresholds, u32 Count)
+typedef MATH_KEPT_ABS_SUM_KERNEL(math_kept_abs_sum_kernel);
+
+#define MATH_QUANTIZE_KERNEL(name) void name(r32 *Dest, r32 *Source, r32 *Scales, r32 *Thresholds, u32 Count)
+typedef MATH_QUANTIZE_KERNEL(math_quantize_kernel);
+
+/*
+	NOTE: Static kernels. The layer loops again, as templates on the layer
+		sizes, for networks whose topology is fixed at compile time (see
+		nn_static.cpp). Every buffer is column-major with its rows padded to
+		STATIC_ROW_STRIDE, the padding matrices get, so strides are constants
+		too. The padding rows of the weights and errors are kept at zero, which
+		lets the wide versions run whole vectors with no tails to handle.
+
+		Rows sum in the same order, with the same multiply-adds, as the generic
+		path's GEMM, dot and elementwise kernels at the same level.
+*/
+#define STATIC_ROW_STRIDE(Rows) (((Rows) + 15) & ~15u)
+
+// NOTE: Trials per pass through the layers. The gradient kernels mark the
+//	gradient columns that any trial touched in UsedColumns, and the first
+//	touch in a batch starts the column from zero. The rest hold a stale
+//	batch's gradients, which the update doesn't read.
+#define STATIC_TILE_COLUMNS 64
+
+/*
+	NOTE: Expression templates. A chain of elementwise operations is a tree
+		of these nodes, built by the Lazy* functions in nn_math.h, and
+		EvaluateExpression runs the whole tree in one pass over the result
+		with no intermediates. Each element goes through the same operations
+		in the same order as the one-kernel-per-operation calls would, so the
+		result is the same, bit for bit. (GCC would fuse a multiply and the
+		add after it into an FMA; nn_kernels_wide.h turns that off.)
+*/
+enum expr_op
+{
+	ExprOp_Plus,
+	ExprOp_Minus,
+	ExprOp_Hadamard,
+
+	ExprOp_Sigmoid,
+	ExprOp_SigmoidPrime,
+	ExprOp_ReLU,
+	ExprOp_ReLUPrime,
+	ExprOp_LeakyReLU,
+	ExprOp_LeakyReLUPrime,
+	ExprOp_Tanh,
+	ExprOp_TanhPrime,
+	ExprOp_Sign,
+	ExprOp_SignPrime,
+};
+
+// NOTE: A matrix read where it is. Element (Row, Column) is at
+//	Data[Column*Stride + Row], so a Stride of 0 repeats one column across
+//	every column, the way MVPlus adds its vector.
+struct expr_operand
+{
+	r32 *Data;
+	u32 Stride;
+};
+
+struct expr_scalar
+{
+	r32 Value;
+};
+
+template<u32 Op, typename a, typename b>
+struct expr_binary
+{
+	a A;
+	b B;
+};
+
+template<u32 Op, typename a>
+struct expr_unary
+{
+	a A;
+};
+
+inline u32 ExprOperationCount(expr_operand E) {return 0;}
+inline u32 ExprOperationCount(expr_scalar E) {return 0;}
+template<u32 Op, typename a, typename b>
+inline u32 ExprOperationCount(expr_binary<Op, a, b> E) {return 1 + ExprOperationCount(E.A) + ExprOperationCount(E.B);}
+template<u32 Op, typename a>
+inline u32 ExprOperationCount(expr_unary<Op, a> E) {return 1 + ExprOperationCount(E.A);}
+
+inline u32 ExprOperandCount(expr_operand E) {return 1;}
+inline u32 ExprOperandCount(expr_scalar E) {return 0;}
+template<u32 Op, typename a, typename b>
+inline u32 ExprOperandCount(expr_binary<Op, a, b> E) {return ExprOperandCount(E.A) + ExprOperandCount(E.B);}
+template<u32 Op, typename a>
+inline u32 ExprOperandCount(expr_unary<Op, a> E) {return ExprOperandCount(E.A);}
+
+struct math_kernels
+{
+	cpu_level Level;
+
+	math_gemm_kernel *Gemm;
+	math_sparse_gemm_kernel *SparseGemm;
+	math_block_sparse_gemm_kernel *BlockSparseGemm;
+	math_convolve_kernel *Convolve;
+	math_non_zero_mask_kernel *NonZeroMask;
+	math_dot_kernel *Dot;
+
+	// NOTE: HardwareBF16 is set when DotBF16 is AVX512-BF16's.
+	b32 HardwareBF16;
+	math_gemm_bf16_kernel *GemmBF16;
+	math_dot_bf16_kernel *DotBF16;
+	math_to_bf16_kernel *ToBF16;
+	math_from_bf16_kernel *FromBF16;
+
+	// NOTE: HardwareVPOPCNT is set when CountDifferentBits is
+	//	AVX512-VPOPCNTDQ's.
+	b32 HardwareVPOPCNT;
+	math_count_different_bits_kernel *CountDifferentBits;
+
+	math_binary_kernel *Add;
+	math_binary_kernel *Subtract;
+	math_binary_kernel *Multiply;
+	math_unary_kernel *AddEquals;
+	math_scale_kernel *ScaleEquals;
+
+	math_unary_kernel *Sigmoid;
+	math_unary_kernel *SigmoidPrime;
+
+	math_clip_abs_sum_kernel *ClipAbsSum;
+	math_kept_abs_sum_kernel *KeptAbsSum;
+	math_quantize_kernel *Quantize;
+};
+
+global_variable math_kernels GlobalMathKernels;
+
+//
+// NOTE: Scalar
+//
+
+internal MATH_GEMM_KERNEL(Gemm_Scalar)
+{
+	for(u32 ColumnIndex = 0;
+	    ColumnIndex < ColumnCount;
+	    ++ColumnIndex)
+	{
+		r32 *Dest = Result + (umm)ColumnIndex*ResultStride;
+		for(u32 RowIndex = 0;
+		    RowIndex < RowCount;
+		    ++RowIndex)
+		{
+			Dest[RowIndex] = 0.0f;
+		}
+
+		r32 *AColumn = A;
+		r32 *BValue = B + (umm)ColumnIndex*BColumnStep;
+		for(u32 InnerIndex = 0;
+		    InnerIndex < InnerCount;
+		    ++InnerIndex)
+		{
+			r32 Scale = *BValue;
+			for(u32 RowIndex = 0;
+			    RowIndex < RowCount;
+			    ++RowIndex)
+			{
+				Dest[RowIndex] += AColumn[RowIndex]*Scale;
+			}
+
+			AColumn += AStride;
+			BValue += BInnerStep;
+		}
+	}
+}
+
+internal MATH_SPARSE_GEMM_KERNEL(SparseGemm_Scalar)
+{
+	for(u32 ColumnIndex = 0;
+	    ColumnIndex < ColumnCount;
+	    ++ColumnIndex)
+	{
+		r32 *Dest = Result + (umm)ColumnIndex*ResultStride;
+		for(u32 RowIndex = 0;
+		    RowIndex < RowCount;
+		    ++RowIndex)
+		{
+			Dest[RowIndex] = 0.0f;
+		}
+
+		for(u32 EntryIndex = ColumnStarts[ColumnIndex];
+		    EntryIndex < ColumnStarts[ColumnIndex + 1];
+		    ++EntryIndex)
+		{
+			r32 *AColumn = A + (umm)RowIndices[EntryIndex]*AStride;
+			r32 Scale = Values[EntryIndex];
+			for(u32 RowIndex = 0;
+			    RowIndex < RowCount;
+			    ++RowIndex)
+			{
+				Dest[RowIndex] += AColumn[RowIndex]*Scale;
+			}
+		}
+	}
+}
+
+internal MATH_BLOCK_SPARSE_GEMM_KERNEL(BlockSparseGemm_Scalar)
+{
+	u32 BlockRowCount = (RowCount + BLOCK_SPARSE_ROWS - 1) / BLOCK_SPARSE_ROWS;
+	for(u32 ColumnIndex = 0;
+	    ColumnIndex < ColumnCount;
+	    ++ColumnIndex)
+	{
+		r32 *Dest = Result + (umm)ColumnIndex*ResultStride;
+		r32 *BColumn = B + (umm)ColumnIndex*BStride;
+		for(u32 BlockRow = 0;
+		    BlockRow < BlockRowCount;
+		    ++BlockRow)
+		{
+			u32 FirstRow = BlockRow*BLOCK_SPARSE_ROWS;
+			u32 BlockRows = Minimum(BLOCK_SPARSE_ROWS, RowCount - FirstRow);
+
+			r32 Sums[BLOCK_SPARSE_ROWS] = {};
+			for(u32 BlockIndex = BlockRowStarts[BlockRow];
+			    BlockIndex < BlockRowStarts[BlockRow + 1];
+			    ++BlockIndex)
+			{
+				r32 *AValue = BlockValues + (umm)BlockIndex*BLOCK_SPARSE_ROWS;
+				r32 Scale = BColumn[BlockColumns[BlockIndex]];
+				for(u32 RowIndex = 0;
+				    RowIndex < BlockRows;
+				    ++RowIndex)
+				{
+					Sums[RowIndex] += AValue[RowIndex]*Scale;
+				}
+			}
+
+			for(u32 RowIndex = 0;
+			    RowIndex < BlockRows;
+			    ++RowIndex)
+			{
+				Dest[FirstRow + RowIndex] = Sums[RowIndex];
+			}
+		}
+	}
+}
+
+internal MATH_NON_ZERO_MASK_KERNEL(NonZeroMask_Scalar)
+{
+	u32 Result = 0;
+	for(u32 FirstIndex = 0;
+	    FirstIndex < Count;
+	    FirstIndex += 32)
+	{
+		u32 MaskCount = Minimum(32, Count - FirstIndex);
+		u32 Bits = 0;
+		for(u32 Index = 0;
+		    Index < MaskCount;
+		    ++Index)
+		{
+			Bits |= (u32)(Source[FirstIndex + Index] != 0.0f) << Index;
+		}
+		*Masks++ = Bits;
+		Result += CountSetBits(Bits);
+	}
+	return Result;
+}
+
+internal MATH_CONVOLVE_KERNEL(Convolve_Scalar)
+{
+	u32 RowTapCount = KernelSize*InputChannels;
+	umm InputRowStep = (umm)InputWidth*InputChannels;
+	for(u32 Y = 0;
+	    Y < OutputHeight;
+	    ++Y)
+	{
+		for(u32 X = 0;
+		    X < OutputWidth;
+		    ++X)
+		{
+			r32 *Dest = Result + ((umm)Y*OutputWidth + X)*OutputChannels;
+			for(u32 Channel = 0;
+			    Channel < OutputChannels;
+			    ++Channel)
+			{
+				Dest[Channel] = 0.0f;
+			}
+
+			r32 *Window = Input + (umm)Y*InputRowStep + (umm)X*InputChannels;
+			r32 *WeightColumn = Weights;
+			for(u32 KY = 0;
+			    KY < KernelSize;
+			    ++KY)
+			{
+				r32 *InputRow = Window + KY*InputRowStep;
+				for(u32 Tap = 0;
+				    Tap < RowTapCount;
+				    ++Tap)
+				{
+					r32 Scale = InputRow[Tap];
+					for(u32 Channel = 0;
+					    Channel < OutputChannels;
+					    ++Channel)
+					{
+						Dest[Channel] += WeightColumn[Channel]*Scale;
+					}
+					WeightColumn += WeightStride;
+				}
+			}
+		}
+	}
+}
+
+internal MATH_GEMM_BF16_KERNEL(GemmBF16_Scalar)
+{
+	for(u32 ColumnIndex = 0;
+	    ColumnIndex < ColumnCount;
+	    ++ColumnIndex)
+	{
+		r32 *Dest = Result + (umm)ColumnIndex*ResultStride;
+		for(u32 RowIndex = 0;
+		    RowIndex < RowCount;
+		    ++RowIndex)
+		{
+			Dest[RowIndex] = 0.0f;
+		}
+
+		bf16 *AColumn = A;
+		bf16 *BValue = B + (umm)ColumnIndex*BColumnStep;
+		for(u32 InnerIndex = 0;
+		    InnerIndex < InnerCount;
+		    ++InnerIndex)
+		{
+			r32 Scale = BF16ToR32(*BValue);
+			for(u32 RowIndex = 0;
+			    RowIndex < RowCount;
+			    ++RowIndex)
+			{
+				Dest[RowIndex] += BF16ToR32(AColumn[RowIndex])*Scale;
+			}
+
+			AColumn += AStride;
+			BValue += BInnerStep;
+		}
+	}
+}
+
+internal MATH_DOT_BF16_KERNEL(DotBF16_Scalar)
+{
+	r32 Result = 0.0f;
+	for(u32 Index = 0;
+	    Index < Count;
+	    ++Index)
+	{
+		Result += BF16ToR32(A[Index])*BF16ToR32(B[Index]);
+	}
+	return Result;
+}
+
+internal MATH_TO_BF16_KERNEL(ToBF16_Scalar)
+{
+	for(u32 Index = 0;
+	    Index < Count;
+	    ++Index)
+	{
+		Dest[Index] = R32ToBF16(Source[Index]);
+	}
+}
+
+internal MATH_FROM_BF16_KERNEL(FromBF16_Scalar)
+{
+	for(u32 Index = 0;
+	    Index < Count;
+	    ++Index)
+	{
+		Dest[Index] = BF16ToR32(Source[Index]);
+	}
+}
+
+internal MATH_COUNT_DIFFERENT_BITS_KERNEL(CountDifferentBits_Scalar)
+{
+	u32 Result = 0;
+	for(u32 WordIndex = 0;
+	    WordIndex < WordCount;
+	    ++WordIndex)
+	{
+		u64 Different = A[WordIndex] ^ B[WordIndex];
+		if(Mask)
+		{
+			Different &= Mask[WordIndex];
+		}
+		Result += CountSetBits64(Different);
+	}
+	return Result;
+}
+
+internal MATH_DOT_KERNEL(Dot_Scalar)
+{
+	r32 Result = 0.0f;
+	for(u32 Index = 0;
+	    Index < Count;
+	    ++Index)
+	{
+		Result += A[Index]*B[Index];
+	}
+	return Result;
+}
+
+internal MATH_BINARY_KERNEL(Add_Scalar)
+{
+	for(u32 Index = 0;
+	    Index < Count;
+	    ++Index)
+	{
+		Dest[Index] = A[Index] + B[Index];
+	}
+}
+
+internal MATH_BINARY_KERNEL(Subtract_Scalar)
+{
+	for(u32 Index = 0;
+	    Index < Count;
+	    ++Index)
+	{
+		Dest[Index] = A[Index] - B[Index];
+	}
+}
+
+internal MATH_BINARY_KERNEL(Multiply_Scalar)
+{
+	for(u32 Index = 0;
+	    Index < Count;
+	    ++Index)
+	{
+		Dest[Index] = A[Index] * B[Index];
+	}
+}
+
+internal MATH_UNARY_KERNEL(AddEquals_Scalar)
+{
+	for(u32 Index = 0;
+	    Index < Count;
+	    ++Index)
+	{
+		Dest[Index] += Source[Index];
+	}
+}
+
+internal MATH_SCALE_KERNEL(ScaleEquals_Scalar)
+{
+	for(u32 Index = 0;
+	    Index < Count;
+	    ++Index)
+	{
+		Dest[Index] *= Scale;
+	}
+}
+
+internal MATH_UNARY_KERNEL(Sigmoid_Scalar)
+{
+	for(u32 Index = 0;
+	    Index < Count;
+	    ++Index)
+	{
+		Dest[Index] = Sigmoid(Source[Index]);
+	}
+}
+
+internal MATH_UNARY_KERNEL(SigmoidPrime_Scalar)
+{
+	for(u32 Index = 0;
+	    Index < Count;
+	    ++Index)
+	{
+		Dest[Index] = SigmoidPrime(Source[Index]);
+	}
+}
+
+internal MATH_CLIP_ABS_SUM_KERNEL(ClipAbsSum_Scalar)
+{
+	for(u32 Index = 0;
+	    Index < Count;
+	    ++Index)
+	{
+		r32 Value = Values[Index];
+		if(Value > Limit)
+		{
+			Value = Limit;
+		}
+		else if(Value < -Limit)
+		{
+			Value = -Limit;
+		}
+		Values[Index] = Value;
+		Sums[Index] += AbsoluteValue(Value);
+	}
+}
+
+internal MATH_KEPT_ABS_SUM_KERNEL(KeptAbsSum_Scalar)
+{
+	for(u32 Index = 0;
+	    Index < Count;
+	    ++Index)
+	{
+		r32 Magnitude = AbsoluteValue(Source[Index]);
+		if(Magnitude > Thresholds[Index])
+		{
+			Sums[Index] += Magnitude;
+			Counts[Index] += 1.0f;
+		}
+	}
+}
+
+internal MATH_QUANTIZE_KERNEL(Quantize_Scalar)
+{
+	for(u32 Index = 0;
+	    Index < Count;
+	    ++Index)
+	{
+		r32 Value = Source[Index];
+		r32 Scale = Scales[Index];
+		if(AbsoluteValue(Value) > Thresholds[Index])
+		{
+			// NOTE: 0 - Scale, like the wide versions, so a zero scale
+			//	doesn't come out as -0.
+			Dest[Index] = (Value > 0.0f) ? Scale : (0.0f - Scale);
+		}
+		else
+		{
+			Dest[Index] = 0.0f;
+		}
+	}
+}
+
+inline r32
+ExprElement_Scalar(expr_operand E, u32 Column, u32 Row)
+{
+	r32 Result = E.Data[(umm)Column*E.Stride + Row];
+	return Result;
+}
+
+inline r32
+ExprElement_Scalar(expr_scalar E, u32 Column, u32 Row)
+{
+	return E.Value;
+}
+
+template<u32 Op, typename a, typename b>
+inline r32
+ExprElement_Scalar(expr_binary<Op, a, b> E, u32 Column, u32 Row)
+{
+	r32 A = ExprElement_Scalar(E.A, Column, Row);
+	r32 B = ExprElement_Scalar(E.B, Column, Row);
+	r32 Result = ((Op == ExprOp_Plus) ? (A + B) :
+	              (Op == ExprOp_Minus) ? (A - B) :
+	              (A * B));
+	return Result;
+}
+
+template<u32 Op, typename a>
+inline r32
+ExprElement_Scalar(expr_unary<Op, a> E, u32 Column, u32 Row)
+{
+	r32 A = ExprElement_Scalar(E.A, Column, Row);
+	r32 Result = ((Op == ExprOp_Sigmoid) ? Sigmoid(A) :
+	              (Op == ExprOp_SigmoidPrime) ? SigmoidPrime(A) :
+	              (Op == ExprOp_ReLU) ? ReLU(A) :
+	              (Op == ExprOp_ReLUPrime) ? ReLUPrime(A) :
+	              (Op == ExprOp_LeakyReLU) ? LeakyReLU(A) :
+	              (Op == ExprOp_LeakyReLUPrime) ? LeakyReLUPrime(A) :
+	              (Op == ExprOp_Tanh) ? Tanh(A) :
+	              (Op == ExprOp_TanhPrime) ? TanhPrime(A) :
+	              (Op == ExprOp_Sign) ? Sign(A) :
+	              SignPrime(A));
+	return Result;
+}
+
+template<typename expr>
+internal void
+EvaluateExpression_Scalar(r32 *Dest, u32 DestStride, expr E, u32 RowCount, u32 ColumnCount)
+{
+	for(u32 ColumnIndex = 0;
+	    ColumnIndex < ColumnCount;
+	    ++ColumnIndex)
+	{
+		r32 *DestColumn = Dest + (umm)ColumnIndex*DestStride;
+		for(u32 RowIndex = 0;
+		    RowIndex < RowCount;
+		    ++RowIndex)
+		{
+			DestColumn[RowIndex] = ExprElement_Scalar(E, ColumnIndex, RowIndex);
+		}
+	}
+}
+
+template<u32 RowCount, u32 InnerCount, b32 SkipZeros>
+internal void
+StaticForward_Scalar(r32 *WeightedInputs, r32 *Activations, r32 *Weights, r32 *Biases,
+                     r32 *Inputs, u32 ColumnCount)
+{
+	u32 const Stride = STATIC_ROW_STRIDE(RowCount);
+	u32 const InputStride = STATIC_ROW_STRIDE(InnerCount);
+	for(u32 ColumnIndex = 0;
+	    ColumnIndex < ColumnCount;
+	    ++ColumnIndex)
+	{
+		r32 *Dest = WeightedInputs + ColumnIndex*Stride;
+		r32 *Input = Inputs + ColumnIndex*InputStride;
+		for(u32 RowIndex = 0;
+		    RowIndex < RowCount;
+		    ++RowIndex)
+		{
+			Dest[RowIndex] = 0.0f;
+		}
+
+		for(u32 InnerIndex = 0;
+		    InnerIndex < InnerCount;
+		    ++InnerIndex)
+		{
+			r32 Scale = Input[InnerIndex];
+			if(SkipZeros && (Scale == 0.0f))
+			{
+				continue;
+			}
+
+			r32 *WeightColumn = Weights + InnerIndex*Stride;
+			for(u32 RowIndex = 0;
+			    RowIndex < RowCount;
+			    ++RowIndex)
+			{
+				Dest[RowIndex] += WeightColumn[RowIndex]*Scale;
+			}
+		}
+
+		r32 *Activation = Activations + ColumnIndex*Stride;
+		for(u32 RowIndex = 0;
+		    RowIndex < RowCount;
+		    ++RowIndex)
+		{
+			Dest[RowIndex] = Dest[RowIndex] + Biases[RowIndex];
+			Activation[RowIndex] = Sigmoid(Dest[RowIndex]);
+		}
+	}
+}
+
+template<u32 RowCount, b32 QuadraticCost>
+internal void
+StaticOutputError_Scalar(r32 *Errors, r32 *Activations, r32 *WeightedInputs, r32 *DesiredOutputs, u32 ColumnCount)
+{
+	u32 const Stride = STATIC_ROW_STRIDE(RowCount);
+	for(u32 ColumnIndex = 0;
+	    ColumnIndex < ColumnCount;
+	    ++ColumnIndex)
+	{
+		u32 Offset = ColumnIndex*Stride;
+		for(u32 RowIndex = 0;
+		    RowIndex < RowCount;
+		    ++RowIndex)
+		{
+			r32 Error = Activations[Offset + RowIndex] - DesiredOutputs[Offset + RowIndex];
+			if(QuadraticCost)
+			{
+				Error = Error * SigmoidPrime(WeightedInputs[Offset + RowIndex]);
+			}
+			Errors[Offset + RowIndex] = Error;
+		}
+	}
+}
+
+template<u32 RowCount, u32 InnerCount>
+internal void
+StaticHiddenError_Scalar(r32 *Errors, r32 *Weights, r32 *NextErrors, r32 *WeightedInputs, u32 ColumnCount)
+{
+	u32 const Stride = STATIC_ROW_STRIDE(RowCount);
+	u32 const ErrorStride = STATIC_ROW_STRIDE(InnerCount);
+	for(u32 ColumnIndex = 0;
+	    ColumnIndex < ColumnCount;
+	    ++ColumnIndex)
+	{
+		r32 *NextError = NextErrors + ColumnIndex*Stride;
+		r32 *Error = Errors + ColumnIndex*ErrorStride;
+		r32 *WeightedInput = WeightedInputs + ColumnIndex*ErrorStride;
+		for(u32 InnerIndex = 0;
+		    InnerIndex < InnerCount;
+		    ++InnerIndex)
+		{
+			r32 *WeightColumn = Weights + InnerIndex*Stride;
+			r32 Sum = 0.0f;
+			for(u32 RowIndex = 0;
+			    RowIndex < RowCount;
+			    ++RowIndex)
+			{
+				Sum += WeightColumn[RowIndex]*NextError[RowIndex];
+			}
+			Error[InnerIndex] = Sum * SigmoidPrime(WeightedInput[InnerIndex]);
+		}
+	}
+}
+
+template<u32 RowCount, u32 InnerCount, b32 SkipZeros>
+internal void
+StaticAccumulateGradients_Scalar(r32 *WeightGradients, r32 *BiasGradients, r32 *Errors,
+                                 r32 *Activations, u32 ColumnCount, b32 *UsedColumns)
+{
+	u32 const Stride = STATIC_ROW_STRIDE(RowCount);
+	u32 const ActivationStride = STATIC_ROW_STRIDE(InnerCount);
+	for(u32 ColumnIndex = 0;
+	    ColumnIndex < ColumnCount;
+	    ++ColumnIndex)
+	{
+		r32 *Error = Errors + ColumnIndex*Stride;
+		r32 *Activation = Activations + ColumnIndex*ActivationStride;
+		for(u32 InnerIndex = 0;
+		    InnerIndex < InnerCount;
+		    ++InnerIndex)
+		{
+			r32 Scale = Activation[InnerIndex];
+			if(SkipZeros && (Scale == 0.0f))
+			{
+				continue;
+			}
+
+			r32 *Dest = WeightGradients + InnerIndex*Stride;
+			if(!UsedColumns[InnerIndex])
+			{
+				memset(Dest, 0, Stride*sizeof(r32));
+				UsedColumns[InnerIndex] = true;
+			}
+			for(u32 RowIndex = 0;
+			    RowIndex < RowCount;
+			    ++RowIndex)
+			{
+				Dest[RowIndex] += Error[RowIndex]*Scale;
+			}
+		}
+
+		for(u32 RowIndex = 0;
+		    RowIndex < RowCount;
+		    ++RowIndex)
+		{
+			BiasGradients[RowIndex] += Error[RowIndex];
+		}
+	}
+}
+
+template<u32 RowCount, u32 InnerCount>
+internal void
+StaticUpdate_Scalar(r32 *Weights, r32 *Biases, r32 *WeightGradients, r32 *BiasGradients,
+                    r32 GradientScale, r32 WeightScale, b32 *UsedColumns)
+{
+	u32 const Stride = STATIC_ROW_STRIDE(RowCount);
+	for(u32 ColumnIndex = 0;
+	    ColumnIndex < InnerCount;
+	    ++ColumnIndex)
+	{
+		r32 *Weight = Weights + ColumnIndex*Stride;
+		r32 *WeightGradient = WeightGradients + ColumnIndex*Stride;
+		b32 Used = UsedColumns[ColumnIndex];
+		for(u32 RowIndex = 0;
+		    RowIndex < Stride;
+		    ++RowIndex)
+		{
+			r32 Decayed = Weight[RowIndex]*WeightScale;
+			if(Used)
+			{
+				r32 Step = WeightGradient[RowIndex]*GradientScale;
+				Decayed += Step;
+			}
+			Weight[RowIndex] = Decayed;
+		}
+		UsedColumns[ColumnIndex] = false;
+	}
+
+	for(u32 RowIndex = 0;
+	    RowIndex < Stride;
+	    ++RowIndex)
+	{
+		r32 Step = BiasGradients[RowIndex]*GradientScale;
+		Biases[RowIndex] += Step;
+		BiasGradients[RowIndex] = 0.0f;
+	}
+}
+
+//
+// NOTE: SSE4.2
+//
+
+#if defined(__clang__)
+	#pragma clang attribute push(__attribute__((target("sse4.2"))), apply_to = function)
+#elif defined(__GNUC__)
+	#pragma GCC push_options
+	#pragma GCC target("sse4.2")
+#endif
+
+#define WIDE_NAME(Name) Name##_SSE42
+#define WIDE_WIDTH 4
+#define wide_r32 __m128
+#define wide_s32 __m128i
+#define WideZero() _mm_setzero_ps()
+#define WideSet1(Value) _mm_set1_ps(Value)
+#define WideLoad(Source) _mm_loadu_ps(Source)
+#define WideStore(Dest, Value) _mm_storeu_ps(Dest, Value)
+#define WideAdd(A, B) _mm_add_ps(A, B)
+#define WideSub(A, B) _mm_sub_ps(A, B)
+#define WideMul(A, B) _mm_mul_ps(A, B)
+#define WideDiv(A, B) _mm_div_ps(A, B)
+#define WideMin(A, B) _mm_min_ps(A, B)
+#define WideMax(A, B) _mm_max_ps(A, B)
+#define WideMulAdd(A, B, C) _mm_add_ps(_mm_mul_ps(A, B), C)
+#define WideRoundNearest(A) _mm_round_ps(A, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC)
+#define WideConvertToS32(A) _mm_cvtps_epi32(A)
+#define WideCastToR32(A) _mm_castsi128_ps(A)
+#define WideS32Set1(Value) _mm_set1_epi32(Value)
+#define WideS32Add(A, B) _mm_add_epi32(A, B)
+#define WideS32ShiftLeft(A, Shift) _mm_slli_epi32(A, Shift)
+#define WideNonZeroBits(A) (u32)_mm_movemask_ps(_mm_cmpneq_ps(A, _mm_setzero_ps()))
+#define WideSelectPositive(Value, IfPositive, Otherwise) \
+	_mm_blendv_ps(Otherwise, IfPositive, _mm_cmpgt_ps(Value, _mm_setzero_ps()))
+
+inline r32
+WideHorizontalAdd_SSE42(__m128 Value)
+{
+	__m128 Sum = _mm_add_ps(Value, _mm_movehl_ps(Value, Value));
+	Sum = _mm_add_ss(Sum, _mm_shuffle_ps(Sum, Sum, 1));
+	r32 Result = _mm_cvtss_f32(Sum);
+	return Result;
+}
+#define WideHorizontalAdd(Value) WideHorizontalAdd_SSE42(Value)
+
+inline __m128
+WideLoadPartial_SSE42(r32 *Source, u32 Count)
+{
+	r32 Lanes[4] = {};
+	for(u32 Index = 0;
+	    Index < Count;
+	    ++Index)
+	{
+		Lanes[Index] = Source[Index];
+	}
+	__m128 Result = _mm_loadu_ps(Lanes);
+	return Result;
+}
+
+inline void
+WideStorePartial_SSE42(r32 *Dest, __m128 Value, u32 Count)
+{
+	r32 Lanes[4];
+	_mm_storeu_ps(Lanes, Value);
+	for(u32 Index = 0;
+	    Index < Count;
+	    ++Index)
+	{
+		Dest[Index] = Lanes[Index];
+	}
+}
+
+inline __m128
+WideLoadBF16_SSE42(bf16 *Source)
+{
+	__m128i Halves = _mm_cvtepu16_epi32(_mm_loadl_epi64((__m128i *)Source));
+	__m128 Result = _mm_castsi128_ps(_mm_slli_epi32(Halves, 16));
+	return Result;
+}
+
+inline void
+WideStoreBF16_SSE42(bf16 *Dest, __m128 Value)
+{
+	// NOTE: R32ToBF16, a lane at a time.
+	__m128i Bits = _mm_castps_si128(Value);
+	__m128i High = _mm_srli_epi32(Bits, 16);
+	__m128i Bias = _mm_add_epi32(_mm_and_si128(High, _mm_set1_epi32(1)), _mm_set1_epi32(0x7FFF));
+	__m128i Rounded = _mm_srli_epi32(_mm_add_epi32(Bits, Bias), 16);
+	__m128i Quiet = _mm_or_si128(High, _mm_set1_epi32(0x40));
+	__m128i Halves = _mm_blendv_epi8(Rounded, Quiet, _mm_castps_si128(_mm_cmpunord_ps(Value, Value)));
+	_mm_storel_epi64((__m128i *)Dest, _mm_packus_epi32(Halves, Halves));
+}
+
+#include "nn_kernels_wide.h"
+
+#if defined(__clang__)
+	#pragma clang attribute pop
+#elif defined(__GNUC__)
+	#pragma GCC pop_options
+#endif
+
+//
+// NOTE: AVX2 + FMA
+//
+
+#if defined(__clang__)
+	#pragma clang attribute push(__attribute__((target("avx2,fma"))), apply_to = function)
+#elif defined(__GNUC__)
+	#pragma GCC push_options
+	#pragma GCC target("avx2,fma")
+#endif
+
+#define WIDE_NAME(Name) Name##_AVX2
+#define WIDE_WIDTH 8
+#define wide_r32 __m256
+#define wide_s32 __m256i
+#define WideZero() _mm256_setzero_ps()
+#define WideSet1(Value) _mm256_set1_ps(Value)
+#define WideLoad(Source) _mm256_loadu_ps(Source)
+#define WideStore(Dest, Value) _mm256_storeu_ps(Dest, Value)
+#define WideAdd(A, B) _mm256_add_ps(A, B)
+#define WideSub(A, B) _mm256_sub_ps(A, B)
+#define WideMul(A, B) _mm256_mul_ps(A, B)
+#define WideDiv(A, B) _mm256_div_ps(A, B)
+#define WideMin(A, B) _mm256_min_ps(A, B)
+#define WideMax(A, B) _mm256_max_ps(A, B)
+#define WideMulAdd(A, B, C) _mm256_fmadd_ps(A, B, C)
+#define WideRoundNearest(A) _mm256_round_ps(A, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC)
+#define WideConvertToS32(A) _mm256_cvtps_epi32(A)
+#define WideCastToR32(A) _mm256_castsi256_ps(A)
+#define WideS32Set1(Value) _mm256_set1_epi32(Value)
+#define WideS32Add(A, B) _mm256_add_epi32(A, B)
+#define WideS32ShiftLeft(A, Shift) _mm256_slli_epi32(A, Shift)
+#define WideNonZeroBits(A) (u32)_mm256_movemask_ps(_mm256_cmp_ps(A, _mm256_setzero_ps(), _CMP_NEQ_UQ))
+#define WideSelectPositive(Value, IfPositive, Otherwise) \
+	_mm256_blendv_ps(Otherwise, IfPositive, _mm256_cmp_ps(Value, _mm256_setzero_ps(), _CMP_GT_OQ))
+
+inline r32
+WideHorizontalAdd_AVX2(__m256 Value)
+{
+	__m128 Sum = _mm_add_ps(_mm256_castps256_ps128(Value), _mm256_extractf128_ps(Value, 1));
+	Sum = _mm_add_ps(Sum, _mm_movehl_ps(Sum, Sum));
+	Sum = _mm_add_ss(Sum, _mm_shuffle_ps(Sum, Sum, 1));
+	r32 Result = _mm_cvtss_f32(Sum);
+	return Result;
+}
+#define WideHorizontalAdd(Value) WideHorizontalAdd_AVX2(Value)
+
+inline __m256i
+WidePartialMask_AVX2(u32 Count)
+{
+	// NOTE: Lanes below Count get all ones, the rest zero.
+	__m256i Result = _mm256_cmpgt_epi32(_mm256_set1_epi32((s32)Count),
+	                                    _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+	return Result;
+}
+
+inline __m256
+WideLoadPartial_AVX2(r32 *Source, u32 Count)
+{
+	__m256 Result = _mm256_maskload_ps(Source, WidePartialMask_AVX2(Count));
+	return Result;
+}
+
+inline void
+WideStorePartial_AVX2(r32 *Dest, __m256 Value, u32 Count)
+{
+	_mm256_maskstore_ps(Dest, WidePartialMask_AVX2(Count), Value);
+}
+
+inline __m256
+WideLoadBF16_AVX2(bf16 *Source)
+{
+	__m256i Halves = _mm256_cvtepu16_epi32(_mm_loadu_si128((__m128i *)Source));
+	__m256 Result = _mm256_castsi256_ps(_mm256_slli_epi32(Halves, 16));
+	return Result;
+}
+
+inline void
+WideStoreBF16_AVX2(bf16 *Dest, __m256 Value)
+{
+	__m256i Bits = _mm256_castps_si256(Value);
+	__m256i High = _mm256_srli_epi32(Bits, 16);
+	__m256i Bias = _mm256_add_epi32(_mm256_and_si256(High, _mm256_set1_epi32(1)), _mm256_set1_epi32(0x7FFF));
+	__m256i Rounded = _mm256_srli_epi32(_mm256_add_epi32(Bits, Bias), 16);
+	__m256i Quiet = _mm256_or_si256(High, _mm256_set1_epi32(0x40));
+	__m256i Halves = _mm256_blendv_epi8(Rounded, Quiet,
+	                                    _mm256_castps_si256(_mm256_cmp_ps(Value, Value, _CMP_UNORD_Q)));
+	// NOTE: The pack works within 128-bit lanes, so the two halves' low
+	//	quarters are gathered after.
+	__m256i Packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(Halves, Halves), 0x08);
+	_mm_storeu_si128((__m128i *)Dest, _mm256_castsi256_si128(Packed));
+}
+
+#include "nn_kernels_wide.h"
+
+#if defined(__clang__)
+	#pragma clang attribute pop
+#elif defined(__GNUC__)
+	#pragma GCC pop_options
+#endif
+
+//
+// NOTE: AVX-512
+//
+
+#if defined(__clang__)
+	#pragma clang attribute push(__attribute__((target("avx512f,avx2,fma"))), apply_to = function)
+#elif defined(__GNUC__)
+	#pragma GCC push_options
+	#pragma GCC target("avx512f,avx2,fma")
+	// NOTE: GCC's own _mm512_undefined_* trips its uninitialized warnings.
+	#pragma GCC diagnostic push
+	#pragma GCC diagnostic ignored "-Wuninitialized"
+	#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+#define WIDE_NAME(Name) Name##_AVX512
+#define WIDE_WIDTH 16
+#define wide_r32 __m512
+#define wide_s32 __m512i
+#define WideZero() _mm512_setzero_ps()
+#define WideSet1(Value) _mm512_set1_ps(Value)
+#define WideLoad(Source) _mm512_loadu_ps(Source)
+#define WideStore(Dest, Value) _mm512_storeu_ps(Dest, Value)
+#define WideAdd(A, B) _mm512_add_ps(A, B)
+#define WideSub(A, B) _mm512_sub_ps(A, B)
+#define WideMul(A, B) _mm512_mul_ps(A, B)
+#define WideDiv(A, B) _mm512_div_ps(A, B)
+#define WideMin(A, B) _mm512_min_ps(A, B)
+#define WideMax(A, B) _mm512_max_ps(A, B)
+#define WideMulAdd(A, B, C) _mm512_fmadd_ps(A, B, C)
+#define WideRoundNearest(A) _mm512_roundscale_ps(A, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC)
+#define WideConvertToS32(A) _mm512_cvtps_epi32(A)
+#define WideCastToR32(A) _mm512_castsi512_ps(A)
+#define WideS32Set1(Value) _mm512_set1_epi32(Value)
+#define WideS32Add(A, B) _mm512_add_epi32(A, B)
+#define WideS32ShiftLeft(A, Shift) _mm512_slli_epi32(A, Shift)
+#define WideNonZeroBits(A) (u32)_mm512_cmp_ps_mask(A, _mm512_setzero_ps(), _CMP_NEQ_UQ)
+#define WideSelectPositive(Value, IfPositive, Otherwise) \
+	_mm512_mask_blend_ps(_mm512_cmp_ps_mask(Value, _mm512_setzero_ps(), _CMP_GT_OQ), Otherwise, IfPositive)
+#define WideHorizontalAdd(Value) _mm512_reduce_add_ps(Value)
+
+inline __m512
+WideLoadPartial_AVX512(r32 *Source, u32 Count)
+{
+	__m512 Result = _mm512_maskz_loadu_ps((__mmask16)((1u << Count) - 1), Source);
+	return Result;
+}
+
+inline void
+WideStorePartial_AVX512(r32 *Dest, __m512 Value, u32 Count)
+{
+	_mm512_mask_storeu_ps(Dest, (__mmask16)((1u << Count) - 1), Value);
+}
+
+inline __m512
+WideLoadBF16_AVX512(bf16 *Source)
+{
+	__m512i Halves = _mm512_cvtepu16_epi32(_mm256_loadu_si256((__m256i *)Source));
+	__m512 Result = _mm512_castsi512_ps(_mm512_slli_epi32(Halves, 16));
+	return Result;
+}
+
+inline void
+WideStoreBF16_AVX512(bf16 *Dest, __m512 Value)
+{
+	__m512i Bits = _mm512_castps_si512(Value);
+	__m512i High = _mm512_srli_epi32(Bits, 16);
+	__m512i Bias = _mm512_add_epi32(_mm512_and_si512(High, _mm512_set1_epi32(1)), _mm512_set1_epi32(0x7FFF));
+	__m512i Rounded = _mm512_srli_epi32(_mm512_add_epi32(Bits, Bias), 16);
+	__m512i Quiet = _mm512_or_si512(High, _mm512_set1_epi32(0x40));
+	__m512i Halves = _mm512_mask_blend_epi32(_mm512_cmp_ps_mask(Value, Value, _CMP_UNORD_Q), Rounded, Quiet);
+	_mm256_storeu_si256((__m256i *)Dest, _mm512_cvtepi32_epi16(Halves));
+}
+
+#include "nn_kernels_wide.h"
+
+#if defined(__clang__)
+	#pragma clang attribute pop
+#elif defined(__GNUC__)
+	#pragma GCC diagnostic pop
+	#pragma GCC pop_options
+#endif
+
+//
+// NOTE: AVX512-BF16
+//
+
+#if defined(__clang__)
+	#pragma clang attribute push(__attribute__((target("avx512f,avx512bw,avx512bf16"))), apply_to = function)
+#elif defined(__GNUC__)
+	#pragma GCC push_options
+	#pragma GCC target("avx512f,avx512bw,avx512bf16")
+	#pragma GCC diagnostic push
+	#pragma GCC diagnostic ignored "-Wuninitialized"
+	#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+internal MATH_DOT_BF16_KERNEL(DotBF16_AVX512BF16)
+{
+	// NOTE: Each dpbf16 multiplies 32 pairs and adds the two products of a
+	//	pair into one of 16 r32 lanes. It flushes denormals and rounds the
+	//	pair sum its own way, so it doesn't match the widening DotBF16s.
+	__m512 Sum0 = _mm512_setzero_ps();
+	__m512 Sum1 = _mm512_setzero_ps();
+
+	u32 Index = 0;
+	for(;
+	    (Index + 64) <= Count;
+	    Index += 64)
+	{
+		Sum0 = _mm512_dpbf16_ps(Sum0, (__m512bh)_mm512_loadu_si512(A + Index), (__m512bh)_mm512_loadu_si512(B + Index));
+		Sum1 = _mm512_dpbf16_ps(Sum1, (__m512bh)_mm512_loadu_si512(A + Index + 32),
+		                        (__m512bh)_mm512_loadu_si512(B + Index + 32));
+	}
+	for(;
+	    Index < Count;
+	    Index += 32)
+	{
+		u32 Remaining = Count - Index;
+		__mmask32 Mask = (Remaining >= 32) ? (__mmask32)0xFFFFFFFF : (__mmask32)((1u << Remaining) - 1);
+		Sum0 = _mm512_dpbf16_ps(Sum0, (__m512bh)_mm512_maskz_loadu_epi16(Mask, A + Index),
+		                        (__m512bh)_mm512_maskz_loadu_epi16(Mask, B + Index));
+	}
+
+	r32 Result = _mm512_reduce_add_ps(_mm512_add_ps(Sum0, Sum1));
+	return Result;
+}
+
+#if defined(__clang__)
+	#pragma clang attribute pop
+#elif defined(__GNUC__)
+	#pragma GCC diagnostic pop
+	#pragma GCC pop_options
+#endif
+
+//
+// NOTE: POPCNT, for CountDifferentBits from CpuLevel_SSE42 up
+//
+
+#if defined(__clang__)
+	#pragma clang attribute push(__attribute__((target("popcnt"))), apply_to = function)
+#elif defined(__GNUC__)
+	#pragma GCC push_options
+	#pragma GCC target("popcnt")
+#endif
+
+internal MATH_COUNT_DIFFERENT_BITS_KERNEL(CountDifferentBits_POPCNT)
+{
+	// NOTE: Four counts in flight, so the popcounts don't wait on each
+	//	other's adds.
+	u64 Count0 = 0;
+	u64 Count1 = 0;
+	u64 Count2 = 0;
+	u64 Count3 = 0;
+	u32 WordIndex = 0;
+	if(Mask)
+	{
+		for(;
+		    (WordIndex + 4) <= WordCount;
+		    WordIndex += 4)
+		{
+			Count0 += _mm_popcnt_u64((A[WordIndex + 0] ^ B[WordIndex + 0]) & Mask[WordIndex + 0]);
+			Count1 += _mm_popcnt_u64((A[WordIndex + 1] ^ B[WordIndex + 1]) & Mask[WordIndex + 1]);
+			Count2 += _mm_popcnt_u64((A[WordIndex + 2] ^ B[WordIndex + 2]) & Mask[WordIndex + 2]);
+			Count3 += _mm_popcnt_u64((A[WordIndex + 3] ^ B[WordIndex + 3]) & Mask[WordIndex + 3]);
+		}
+		for(;
+		    WordIndex < WordCount;
+		    ++WordIndex)
+		{
+			Count0 += _mm_popcnt_u64((A[WordIndex] ^ B[WordIndex]) & Mask[WordIndex]);
+		}
+	}
+	else
+	{
+		for(;
+		    (WordIndex + 4) <= WordCount;
+		    WordIndex += 4)
+		{
+			Count0 += _mm_popcnt_u64(A[WordIndex + 0] ^ B[WordIndex + 0]);
+			Count1 += _mm_popcnt_u64(A[WordIndex + 1] ^ B[WordIndex + 1]);
+			Count2 += _mm_popcnt_u64(A[WordIndex + 2] ^ B[WordIndex + 2]);
+			Count3 += _mm_popcnt_u64(A[WordIndex + 3] ^ B[WordIndex + 3]);
+		}
+		for(;
+		    WordIndex < WordCount;
+		    ++WordIndex)
+		{
+			Count0 += _mm_popcnt_u64(A[WordIndex] ^ B[WordIndex]);
+		}
+	}
+
+	u32 Result = (u32)(Count0 + Count1 + Count2 + Count3);
+	return Result;
+}
+
+#if defined(__clang__)
+	#pragma clang attribute pop
+#elif defined(__GNUC__)
+	#pragma GCC pop_options
+#endif
+
+//
+// NOTE: AVX512-VPOPCNTDQ
+//
+
+#if defined(__clang__)
+	#pragma clang attribute push(__attribute__((target("avx512f,avx512vpopcntdq"))), apply_to = function)
+#elif defined(__GNUC__)
+	#pragma GCC push_options
+	#pragma GCC target("avx512f,avx512vpopcntdq")
+	#pragma GCC diagnostic push
+	#pragma GCC diagnostic ignored "-Wuninitialized"
+	#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+internal MATH_COUNT_DIFFERENT_BITS_KERNEL(CountDifferentBits_AVX512VPOPCNT)
+{
+	// NOTE: Eight words a step, counted in their own lanes and summed once
+	//	at the end. The tail is a masked load, zeros past the end.
+	__m512i Counts = _mm512_setzero_si512();
+	for(u32 WordIndex = 0;
+	    WordIndex < WordCount;
+	    WordIndex += 8)
+	{
+		u32 Remaining = WordCount - WordIndex;
+		__mmask8 Lanes = (Remaining >= 8) ? (__mmask8)0xFF : (__mmask8)((1u << Remaining) - 1);
+		__m512i Different = _mm512_xor_si512(_mm512_maskz_loadu_epi64(Lanes, A + WordIndex),
+		                                     _mm512_maskz_loadu_epi64(Lanes, B + WordIndex));
+		if(Mask)
+		{
+			Different = _mm512_and_si512(Different, _mm512_maskz_loadu_epi64(Lanes, Mask + WordIndex));
+		}
+		Counts = _mm512_add_epi64(Counts, _mm512_popcnt_epi64(Different));
+	}
+
+	u32 Result = (u32)_mm512_reduce_add_epi64(Counts);
+	return Result;
+}
+
+#if defined(__clang__)
+	#pragma clang attribute pop
+#elif defined(__GNUC__)
+	#pragma GCC diagnostic pop
+	#pragma GCC pop_options
+#endif
+
+//
+// NOTE: Dispatch
+//
+
+#define MATH_KERNELS_FOR_LEVEL(Kernels, Suffix) \
+	(Kernels)->Gemm = Gemm_##Suffix; \
+	(Kernels)->SparseGemm = SparseGemm_##Suffix; \
+	(Kernels)->BlockSparseGemm = BlockSparseGemm_##Suffix; \
+	(Kernels)->Convolve = Convolve_##Suffix; \
+	(Kernels)->NonZeroMask = NonZeroMask_##Suffix; \
+	(Kernels)->Dot = Dot_##Suffix; \
+	(Kernels)->HardwareBF16 = false; \
+	(Kernels)->GemmBF16 = GemmBF16_##Suffix; \
+	(Kernels)->DotBF16 = DotBF16_##Suffix; \
+	(Kernels)->ToBF16 = ToBF16_##Suffix; \
+	(Kernels)->FromBF16 = FromBF16_##Suffix; \
+	(Kernels)->Add = Add_##Suffix; \
+	(Kernels)->Subtract = Subtract_##Suffix; \
+	(Kernels)->Multiply = Multiply_##Suffix; \
+	(Kernels)->AddEquals = AddEquals_##Suffix; \
+	(Kernels)->ScaleEquals = ScaleEquals_##Suffix; \
+	(Kernels)->Sigmoid = Sigmoid_##Suffix; \
+	(Kernels)->SigmoidPrime = SigmoidPrime_##Suffix; \
+	(Kernels)->ClipAbsSum = ClipAbsSum_##Suffix; \
+	(Kernels)->KeptAbsSum = KeptAbsSum_##Suffix; \
+	(Kernels)->Quantize = Quantize_##Suffix
+
+internal void
+SetMathKernels(math_kernels *Kernels, cpu_level Level, b32 HardwareBF16 = false, b32 HardwareVPOPCNT = false)
+{
+	Kernels->Level = Level;
+	switch(Level)
+	{
+		case CpuLevel_Scalar: {MATH_KERNELS_FOR_LEVEL(Kernels, Scalar);} break;
+		case CpuLevel_SSE42: {MATH_KERNELS_FOR_LEVEL(Kernels, SSE42);} break;
+		case CpuLevel_AVX2: {MATH_KERNELS_FOR_LEVEL(Kernels, AVX2);} break;
+		case CpuLevel_AVX512: {MATH_KERNELS_FOR_LEVEL(Kernels, AVX512);} break;
+
+		InvalidDefaultCase;
+	}
+
+	if(HardwareBF16)
+	{
+		Assert(Level == CpuLevel_AVX512);
+		Kernels->HardwareBF16 = true;
+		Kernels->DotBF16 = DotBF16_AVX512BF16;
+	}
+
+	// NOTE: CpuLevel_SSE42 needs POPCNT too (see GetSupportedCpuLevel).
+	Kernels->HardwareVPOPCNT = false;
+	Kernels->CountDifferentBits = (Level == CpuLevel_Scalar) ? CountDifferentBits_Scalar : CountDifferentBits_POPCNT;
+	if(HardwareVPOPCNT)
+	{
+		Assert(Level == CpuLevel_AVX512);
+		Kernels->HardwareVPOPCNT = true;
+		Kernels->CountDifferentBits = CountDifferentBits_AVX512VPOPCNT;
+	}
+}
+
+internal void
+InitializeMathKernels()
+{
+	cpu_level Supported = GetSupportedCpuLevel();
+	cpu_level Level = Supported;
+
+	char *Override = getenv("NN_CPU_LEVEL");
+	if(Override)
+	{
+		b32 Found = false;
+		for(u32 LevelIndex = 0;
+		    LevelIndex < CpuLevel_Count;
+		    ++LevelIndex)
+		{
+			if(strcmp(Override, CpuLevelNames[LevelIndex]) == 0)
+			{
+				Level = (cpu_level)LevelIndex;
+				Found = true;
+			}
+		}
+
+		if(!Found)
+		{
+			printf("NN_CPU_LEVEL=%s is not one of scalar, sse4.2, avx2, avx512; ignoring it\n", Override);
+		}
+		else if(Level > Supported)
+		{
+			printf("NN_CPU_LEVEL=%s is not supported here, using %s\n", Override, CpuLevelNames[Supported]);
+			Level = Supported;
+		}
+	}
+
+	// NOTE: NN_BF16=software keeps the widening bf16 dot on hosts that have
+	//	it in hardware, for comparing the two.
+	b32 HardwareBF16 = ((Level == CpuLevel_AVX512) && GetSupportedBF16());
+	char *BF16Override = getenv("NN_BF16");
+	if(BF16Override && (strcmp(BF16Override, "software") == 0))
+	{
+		HardwareBF16 = false;
+	}
+
+	// NOTE: NN_POPCNT=64 likewise keeps the 64-bit popcount.
+	b32 HardwareVPOPCNT = ((Level == CpuLevel_AVX512) && GetSupportedVPOPCNTDQ());
+	char *PopCountOverride = getenv("NN_POPCNT");
+	if(PopCountOverride && (strcmp(PopCountOverride, "64") == 0))
+	{
+		HardwareVPOPCNT = false;
+	}
+
+	SetMathKernels(&GlobalMathKernels, Level, HardwareBF16, HardwareVPOPCNT);
+}
+
+//
+// NOTE: Static kernel dispatch. Templates can't go in math_kernels, so these
+//	switch on the level instead, one predictable branch per layer. The scalar
+//	kernels skip zero inputs in the input layer themselves.
+//
+
+#define STATIC_WIDE_KERNEL_DISPATCH(Name, Arguments, ...) \
+	switch(GlobalMathKernels.Level) \
+	{ \
+		case CpuLevel_SSE42: {Name##_SSE42<__VA_ARGS__> Arguments;} break; \
+		case CpuLevel_AVX2: {Name##_AVX2<__VA_ARGS__> Arguments;} break; \
+		case CpuLevel_AVX512: {Name##_AVX512<__VA_ARGS__> Arguments;} break; \
+		InvalidDefaultCase; \
+	}
+
+template<typename expr>
+inline void
+EvaluateExpression(r32 *Dest, u32 DestStride, expr E, u32 RowCount, u32 ColumnCount)
+{
+	switch(GlobalMathKernels.Level)
+	{
+		case CpuLevel_Scalar: {EvaluateExpression_Scalar(Dest, DestStride, E, RowCount, ColumnCount);} break;
+		case CpuLevel_SSE42: {EvaluateExpression_SSE42(Dest, DestStride, E, RowCount, ColumnCount);} break;
+		case CpuLevel_AVX2: {EvaluateExpression_AVX2(Dest, DestStride, E, RowCount, ColumnCount);} break;
+		case CpuLevel_AVX512: {EvaluateExpression_AVX512(Dest, DestStride, E, RowCount, ColumnCount);} break;
+		InvalidDefaultCase;
+	}
+}
+
+template<u32 RowCount, u32 InnerCount, b32 InputLayer>
+inline void
+StaticForward(r32 *WeightedInputs, r32 *Activations, r32 *Weights, r32 *Biases, r32 *Inputs, u32 ColumnCount)
+{
+	if(GlobalMathKernels.Level == CpuLevel_Scalar)
+	{
+		StaticForward_Scalar<RowCount, InnerCount, InputLayer>(WeightedInputs, Activations, Weights, Biases,
+		                                                       Inputs, ColumnCount);
+	}
+	else if(InputLayer)
+	{
+		STATIC_WIDE_KERNEL_DISPATCH(StaticForwardSparse,
+		                            (WeightedInputs, Activations, Weights, Biases, Inputs, ColumnCount),
+		                            RowCount, InnerCount);
+	}
+	else
+	{
+		STATIC_WIDE_KERNEL_DISPATCH(StaticForward,
+		                            (WeightedInputs, Activations, Weights, Biases, Inputs, ColumnCount),
+		                            RowCount, InnerCount);
+	}
+}
+
+template<u32 RowCount, b32 QuadraticCost>
+inline void
+StaticOutputError(r32 *Errors, r32 *Activations, r32 *WeightedInputs, r32 *DesiredOutputs, u32 ColumnCount)
+{
+	if(GlobalMathKernels.Level == CpuLevel_Scalar)
+	{
+		StaticOutputError_Scalar<RowCount, QuadraticCost>(Errors, Activations, WeightedInputs,
+		                                                  DesiredOutputs, ColumnCount);
+	}
+	else
+	{
+		STATIC_WIDE_KERNEL_DISPATCH(StaticOutputError,
+		                            (Errors, Activations, WeightedInputs, DesiredOutputs, ColumnCount),
+		                            RowCount, QuadraticCost);
+	}
+}
+
+template<u32 RowCount, u32 InnerCount>
+inline void
+StaticHiddenError(r32 *Errors, r32 *Weights, r32 *NextErrors, r32 *WeightedInputs, u32 ColumnCount)
+{
+	if(GlobalMathKernels.Level == CpuLevel_Scalar)
+	{
+		StaticHiddenError_Scalar<RowCount, InnerCount>(Errors, Weights, NextErrors, WeightedInputs, ColumnCount);
+	}
+	else
+	{
+		STATIC_WIDE_KERNEL_DISPATCH(StaticHiddenError,
+		                            (Errors, Weights, NextErrors, WeightedInputs, ColumnCount),
+		                            RowCount, InnerCount);
+	}
+}
+
+template<u32 RowCount, u32 InnerCount, b32 InputLayer>
+inline void
+StaticAccumulateGradients(r32 *WeightGradients, r32 *BiasGradients, r32 *Errors, r32 *Activations,
+                          u32 ColumnCount, b32 *UsedColumns)
+{
+	if(GlobalMathKernels.Level == CpuLevel_Scalar)
+	{
+		StaticAccumulateGradients_Scalar<RowCount, InnerCount, InputLayer>(WeightGradients, BiasGradients, Errors,
+		                                                                   Activations, ColumnCount, UsedColumns);
+	}
+	else if(InputLayer)
+	{
+		STATIC_WIDE_KERNEL_DISPATCH(StaticAccumulateGradientsSparse,
+		                            (WeightGradients, BiasGradients, Errors, Activations, ColumnCount, UsedColumns),
+		                            RowCount, InnerCount);
+	}
+	else
+	{
+		STATIC_WIDE_KERNEL_DISPATCH(StaticAccumulateGradients,
+		                            (WeightGradients, BiasGradients, Errors, Activations, ColumnCount, UsedColumns),
+		                            RowCount, InnerCount);
+	}
+}
+
+template<u32 RowCount, u32 InnerCount>
+inline void
+StaticUpdate(r32 *Weights, r32 *Biases, r32 *WeightGradients, r32 *BiasGradients,
+             r32 GradientScale, r32 WeightScale, b32 *UsedColumns)
+{
+	if(GlobalMathKernels.Level == CpuLevel_Scalar)
+	{
+		StaticUpdate_Scalar<RowCount, InnerCount>(Weights, Biases, WeightGradients, BiasGradients,
+		                                          GradientScale, WeightScale, UsedColumns);
+	}
+	else
+	{
+		STATIC_WIDE_KERNEL_DISPATCH(StaticUpdate,
+		                            (Weights, Biases, WeightGradients, BiasGradients,
+		                             GradientScale, WeightScale, UsedColumns),
+		                            RowCount, InnerCount);
+	}
+}
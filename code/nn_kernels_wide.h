@@ -0,0 +1,1714 @@
+/*
+	NOTE: No #pragma once; nn_kernels.h includes this once per instruction
+		set, with WIDE_NAME, WIDE_WIDTH and the Wide* lane operations defined
+		for that set. Everything defined here is undefined again at the end.
+
+		Rows are processed a full vector at a time, and the last partial
+		vector of a column goes through WideLoadPartial/WideStorePartial, so
+		short columns (the 10-row output layer) are still vectorized.
+*/
+
+inline wide_r32
+WIDE_NAME(WideExp)(wide_r32 Value)
+{
+	// NOTE: Cephes expf: split into 2^N * e^R with |R| <= ln(2)/2, then a
+	//	degree 5 polynomial for e^R. Good to about 1 ulp over the clamped range.
+	Value = WideMin(Value, WideSet1(88.3762626647949f));
+	Value = WideMax(Value, WideSet1(-87.3365478515625f));
+
+	wide_r32 N = WideRoundNearest(WideMul(Value, WideSet1(1.44269504088896341f)));
+	wide_r32 R = WideSub(Value, WideMul(N, WideSet1(0.693359375f)));
+	R = WideSub(R, WideMul(N, WideSet1(-2.12194440e-4f)));
+
+	wide_r32 Poly = WideSet1(1.9875691500e-4f);
+	Poly = WideMulAdd(Poly, R, WideSet1(1.3981999507e-3f));
+	Poly = WideMulAdd(Poly, R, WideSet1(8.3334519073e-3f));
+	Poly = WideMulAdd(Poly, R, WideSet1(4.1665795894e-2f));
+	Poly = WideMulAdd(Poly, R, WideSet1(1.6666665459e-1f));
+	Poly = WideMulAdd(Poly, R, WideSet1(5.0000001201e-1f));
+	Poly = WideMulAdd(Poly, WideMul(R, R), WideAdd(R, WideSet1(1.0f)));
+
+	wide_s32 Exponent = WideS32ShiftLeft(WideS32Add(WideConvertToS32(N), WideS32Set1(127)), 23);
+	wide_r32 Result = WideMul(Poly, WideCastToR32(Exponent));
+	return Result;
+}
+
+inline wide_r32
+WIDE_NAME(WideSigmoid)(wide_r32 Value)
+{
+	wide_r32 One = WideSet1(1.0f);
+	wide_r32 Result = WideDiv(One, WideAdd(One, WIDE_NAME(WideExp)(WideSub(WideZero(), Value))));
+	return Result;
+}
+
+inline wide_r32
+WIDE_NAME(WideSigmoidPrime)(wide_r32 Value)
+{
+	wide_r32 SigmoidValue = WIDE_NAME(WideSigmoid)(Value);
+	wide_r32 Result = WideMul(SigmoidValue, WideSub(WideSet1(1.0f), SigmoidValue));
+	return Result;
+}
+
+inline wide_r32
+WIDE_NAME(WideReLU)(wide_r32 Value)
+{
+	wide_r32 Result = WideSelectPositive(Value, Value, WideZero());
+	return Result;
+}
+
+inline wide_r32
+WIDE_NAME(WideReLUPrime)(wide_r32 Value)
+{
+	wide_r32 Result = WideSelectPositive(Value, WideSet1(1.0f), WideZero());
+	return Result;
+}
+
+inline wide_r32
+WIDE_NAME(WideLeakyReLU)(wide_r32 Value)
+{
+	wide_r32 Result = WideSelectPositive(Value, Value, WideMul(Value, WideSet1(LEAKY_RELU_SLOPE)));
+	return Result;
+}
+
+inline wide_r32
+WIDE_NAME(WideLeakyReLUPrime)(wide_r32 Value)
+{
+	wide_r32 Result = WideSelectPositive(Value, WideSet1(1.0f), WideSet1(LEAKY_RELU_SLOPE));
+	return Result;
+}
+
+inline wide_r32
+WIDE_NAME(WideTanh)(wide_r32 Value)
+{
+	wide_r32 One = WideSet1(1.0f);
+	wide_r32 Exponential = WIDE_NAME(WideExp)(WideAdd(Value, Value));
+	wide_r32 Result = WideSub(One, WideDiv(WideSet1(2.0f), WideAdd(Exponential, One)));
+	return Result;
+}
+
+inline wide_r32
+WIDE_NAME(WideTanhPrime)(wide_r32 Value)
+{
+	wide_r32 TanhValue = WIDE_NAME(WideTanh)(Value);
+	wide_r32 Result = WideSub(WideSet1(1.0f), WideMul(TanhValue, TanhValue));
+	return Result;
+}
+
+inline wide_r32
+WIDE_NAME(WideSign)(wide_r32 Value)
+{
+	wide_r32 Result = WideSelectPositive(Value, WideSet1(1.0f), WideSet1(-1.0f));
+	return Result;
+}
+
+inline wide_r32
+WIDE_NAME(WideSignPrime)(wide_r32 Value)
+{
+	// NOTE: 1 - |Value| is positive exactly inside (-1, 1).
+	wide_r32 One = WideSet1(1.0f);
+	wide_r32 Inside = WideSub(One, WideMax(Value, WideSub(WideZero(), Value)));
+	wide_r32 Result = WideSelectPositive(Inside, One, WideZero());
+	return Result;
+}
+
+internal void
+WIDE_NAME(GemmBlock)(r32 *Result, u32 ResultStride, r32 *A, u32 AStride,
+                     r32 *B, u32 BInnerStep, u32 BColumnStep,
+                     u32 RowCount, u32 ColumnCount, u32 InnerCount, b32 Accumulate)
+{
+	// NOTE: Tiles of two vectors of rows by four columns, which keeps eight
+	//	accumulators in registers and reuses every A load four times. With
+	//	Accumulate the tiles pick up the sums left by the previous inner block.
+	u32 FullRowCount = (RowCount / WIDE_WIDTH)*WIDE_WIDTH;
+	u32 PairRowCount = (RowCount / (2*WIDE_WIDTH))*(2*WIDE_WIDTH);
+
+	u32 ColumnIndex = 0;
+	for(;
+	    (ColumnIndex + 4) <= ColumnCount;
+	    ColumnIndex += 4)
+	{
+		r32 *Dest0 = Result + (umm)ColumnIndex*ResultStride;
+		r32 *Dest1 = Dest0 + ResultStride;
+		r32 *Dest2 = Dest1 + ResultStride;
+		r32 *Dest3 = Dest2 + ResultStride;
+		r32 *BColumn = B + (umm)ColumnIndex*BColumnStep;
+
+		u32 RowIndex = 0;
+		for(;
+		    RowIndex < PairRowCount;
+		    RowIndex += 2*WIDE_WIDTH)
+		{
+			wide_r32 Sum00 = Accumulate ? WideLoad(Dest0 + RowIndex) : WideZero();
+			wide_r32 Sum01 = Accumulate ? WideLoad(Dest1 + RowIndex) : WideZero();
+			wide_r32 Sum02 = Accumulate ? WideLoad(Dest2 + RowIndex) : WideZero();
+			wide_r32 Sum03 = Accumulate ? WideLoad(Dest3 + RowIndex) : WideZero();
+			wide_r32 Sum10 = Accumulate ? WideLoad(Dest0 + RowIndex + WIDE_WIDTH) : WideZero();
+			wide_r32 Sum11 = Accumulate ? WideLoad(Dest1 + RowIndex + WIDE_WIDTH) : WideZero();
+			wide_r32 Sum12 = Accumulate ? WideLoad(Dest2 + RowIndex + WIDE_WIDTH) : WideZero();
+			wide_r32 Sum13 = Accumulate ? WideLoad(Dest3 + RowIndex + WIDE_WIDTH) : WideZero();
+
+			r32 *AValue = A + RowIndex;
+			r32 *BValue = BColumn;
+			for(u32 InnerIndex = 0;
+			    InnerIndex < InnerCount;
+			    ++InnerIndex)
+			{
+				wide_r32 A0 = WideLoad(AValue);
+				wide_r32 A1 = WideLoad(AValue + WIDE_WIDTH);
+				wide_r32 B0 = WideSet1(BValue[0]);
+				wide_r32 B1 = WideSet1(BValue[BColumnStep]);
+				wide_r32 B2 = WideSet1(BValue[2*BColumnStep]);
+				wide_r32 B3 = WideSet1(BValue[3*BColumnStep]);
+
+				Sum00 = WideMulAdd(A0, B0, Sum00);
+				Sum01 = WideMulAdd(A0, B1, Sum01);
+				Sum02 = WideMulAdd(A0, B2, Sum02);
+				Sum03 = WideMulAdd(A0, B3, Sum03);
+				Sum10 = WideMulAdd(A1, B0, Sum10);
+				Sum11 = WideMulAdd(A1, B1, Sum11);
+				Sum12 = WideMulAdd(A1, B2, Sum12);
+				Sum13 = WideMulAdd(A1, B3, Sum13);
+
+				AValue += AStride;
+				BValue += BInnerStep;
+			}
+
+			WideStore(Dest0 + RowIndex, Sum00);
+			WideStore(Dest1 + RowIndex, Sum01);
+			WideStore(Dest2 + RowIndex, Sum02);
+			WideStore(Dest3 + RowIndex, Sum03);
+			WideStore(Dest0 + RowIndex + WIDE_WIDTH, Sum10);
+			WideStore(Dest1 + RowIndex + WIDE_WIDTH, Sum11);
+			WideStore(Dest2 + RowIndex + WIDE_WIDTH, Sum12);
+			WideStore(Dest3 + RowIndex + WIDE_WIDTH, Sum13);
+		}
+
+		for(;
+		    RowIndex < RowCount;
+		    RowIndex += WIDE_WIDTH)
+		{
+			u32 Count = (RowIndex < FullRowCount) ? WIDE_WIDTH : (RowCount - RowIndex);
+
+			wide_r32 Sum0 = Accumulate ? WIDE_NAME(WideLoadPartial)(Dest0 + RowIndex, Count) : WideZero();
+			wide_r32 Sum1 = Accumulate ? WIDE_NAME(WideLoadPartial)(Dest1 + RowIndex, Count) : WideZero();
+			wide_r32 Sum2 = Accumulate ? WIDE_NAME(WideLoadPartial)(Dest2 + RowIndex, Count) : WideZero();
+			wide_r32 Sum3 = Accumulate ? WIDE_NAME(WideLoadPartial)(Dest3 + RowIndex, Count) : WideZero();
+
+			r32 *AValue = A + RowIndex;
+			r32 *BValue = BColumn;
+			for(u32 InnerIndex = 0;
+			    InnerIndex < InnerCount;
+			    ++InnerIndex)
+			{
+				wide_r32 A0 = WIDE_NAME(WideLoadPartial)(AValue, Count);
+				Sum0 = WideMulAdd(A0, WideSet1(BValue[0]), Sum0);
+				Sum1 = WideMulAdd(A0, WideSet1(BValue[BColumnStep]), Sum1);
+				Sum2 = WideMulAdd(A0, WideSet1(BValue[2*BColumnStep]), Sum2);
+				Sum3 = WideMulAdd(A0, WideSet1(BValue[3*BColumnStep]), Sum3);
+
+				AValue += AStride;
+				BValue += BInnerStep;
+			}
+
+			WIDE_NAME(WideStorePartial)(Dest0 + RowIndex, Sum0, Count);
+			WIDE_NAME(WideStorePartial)(Dest1 + RowIndex, Sum1, Count);
+			WIDE_NAME(WideStorePartial)(Dest2 + RowIndex, Sum2, Count);
+			WIDE_NAME(WideStorePartial)(Dest3 + RowIndex, Sum3, Count);
+		}
+	}
+
+	for(;
+	    ColumnIndex < ColumnCount;
+	    ++ColumnIndex)
+	{
+		r32 *Dest = Result + (umm)ColumnIndex*ResultStride;
+		r32 *BColumn = B + (umm)ColumnIndex*BColumnStep;
+
+		for(u32 RowIndex = 0;
+		    RowIndex < RowCount;
+		    RowIndex += WIDE_WIDTH)
+		{
+			u32 Count = (RowIndex < FullRowCount) ? WIDE_WIDTH : (RowCount - RowIndex);
+
+			wide_r32 Sum = Accumulate ? WIDE_NAME(WideLoadPartial)(Dest + RowIndex, Count) : WideZero();
+			r32 *AValue = A + RowIndex;
+			r32 *BValue = BColumn;
+			for(u32 InnerIndex = 0;
+			    InnerIndex < InnerCount;
+			    ++InnerIndex)
+			{
+				Sum = WideMulAdd(WIDE_NAME(WideLoadPartial)(AValue, Count), WideSet1(*BValue), Sum);
+				AValue += AStride;
+				BValue += BInnerStep;
+			}
+
+			WIDE_NAME(WideStorePartial)(Dest + RowIndex, Sum, Count);
+		}
+	}
+}
+
+internal MATH_GEMM_KERNEL(WIDE_NAME(Gemm))
+{
+	u32 InnerBlock = Config.InnerBlock ? Config.InnerBlock : InnerCount;
+	u32 ColumnBlock = Config.ColumnBlock ? Config.ColumnBlock : ColumnCount;
+
+	for(u32 FirstColumn = 0;
+	    FirstColumn < ColumnCount;
+	    FirstColumn += ColumnBlock)
+	{
+		u32 BlockColumns = Minimum(ColumnBlock, ColumnCount - FirstColumn);
+		for(u32 FirstInner = 0;
+		    FirstInner < InnerCount;
+		    FirstInner += InnerBlock)
+		{
+			u32 BlockInner = Minimum(InnerBlock, InnerCount - FirstInner);
+			WIDE_NAME(GemmBlock)(Result + (umm)FirstColumn*ResultStride, ResultStride,
+			                     A + (umm)FirstInner*AStride, AStride,
+			                     B + (umm)FirstInner*BInnerStep + (umm)FirstColumn*BColumnStep,
+			                     BInnerStep, BColumnStep,
+			                     RowCount, BlockColumns, BlockInner, (FirstInner > 0));
+		}
+	}
+}
+
+internal MATH_SPARSE_GEMM_KERNEL(WIDE_NAME(SparseGemm))
+{
+	// NOTE: Four vectors of a result column stay in registers while the
+	//	column's non-zeros stream through. The rows left over take one more
+	//	pass of four partial vectors, some of which may be empty.
+	//	Each result column loads its own slices of A. Two MNIST images share
+	//	under a tenth of their non-zero pixels, so loading a column of A once
+	//	for several result columns costs more, in multiply-adds by zero or in
+	//	read-modify-writes of the result, than the loads it saves; so do
+	//	wider row bands and prefetching the next non-zero's slice.
+	for(u32 ColumnIndex = 0;
+	    ColumnIndex < ColumnCount;
+	    ++ColumnIndex)
+	{
+		r32 *Dest = Result + (umm)ColumnIndex*ResultStride;
+		u32 FirstEntry = ColumnStarts[ColumnIndex];
+		u32 OnePastLastEntry = ColumnStarts[ColumnIndex + 1];
+
+		u32 RowIndex = 0;
+		for(;
+		    (RowIndex + 4*WIDE_WIDTH) <= RowCount;
+		    RowIndex += 4*WIDE_WIDTH)
+		{
+			wide_r32 Sum0 = WideZero();
+			wide_r32 Sum1 = WideZero();
+			wide_r32 Sum2 = WideZero();
+			wide_r32 Sum3 = WideZero();
+			for(u32 EntryIndex = FirstEntry;
+			    EntryIndex < OnePastLastEntry;
+			    ++EntryIndex)
+			{
+				r32 *AValue = A + (umm)RowIndices[EntryIndex]*AStride + RowIndex;
+				wide_r32 Scale = WideSet1(Values[EntryIndex]);
+				Sum0 = WideMulAdd(WideLoad(AValue), Scale, Sum0);
+				Sum1 = WideMulAdd(WideLoad(AValue + WIDE_WIDTH), Scale, Sum1);
+				Sum2 = WideMulAdd(WideLoad(AValue + 2*WIDE_WIDTH), Scale, Sum2);
+				Sum3 = WideMulAdd(WideLoad(AValue + 3*WIDE_WIDTH), Scale, Sum3);
+			}
+			WideStore(Dest + RowIndex, Sum0);
+			WideStore(Dest + RowIndex + WIDE_WIDTH, Sum1);
+			WideStore(Dest + RowIndex + 2*WIDE_WIDTH, Sum2);
+			WideStore(Dest + RowIndex + 3*WIDE_WIDTH, Sum3);
+		}
+
+		if(RowIndex < RowCount)
+		{
+			u32 Counts[4];
+			for(u32 VectorIndex = 0;
+			    VectorIndex < 4;
+			    ++VectorIndex)
+			{
+				u32 FirstRow = RowIndex + VectorIndex*WIDE_WIDTH;
+				u32 Count = (FirstRow < RowCount) ? (RowCount - FirstRow) : 0;
+				Counts[VectorIndex] = (Count < WIDE_WIDTH) ? Count : WIDE_WIDTH;
+			}
+
+			wide_r32 Sum0 = WideZero();
+			wide_r32 Sum1 = WideZero();
+			wide_r32 Sum2 = WideZero();
+			wide_r32 Sum3 = WideZero();
+			for(u32 EntryIndex = FirstEntry;
+			    EntryIndex < OnePastLastEntry;
+			    ++EntryIndex)
+			{
+				r32 *AValue = A + (umm)RowIndices[EntryIndex]*AStride + RowIndex;
+				wide_r32 Scale = WideSet1(Values[EntryIndex]);
+				Sum0 = WideMulAdd(WIDE_NAME(WideLoadPartial)(AValue, Counts[0]), Scale, Sum0);
+				if(Counts[1])
+				{
+					Sum1 = WideMulAdd(WIDE_NAME(WideLoadPartial)(AValue + WIDE_WIDTH, Counts[1]), Scale, Sum1);
+				}
+				if(Counts[2])
+				{
+					Sum2 = WideMulAdd(WIDE_NAME(WideLoadPartial)(AValue + 2*WIDE_WIDTH, Counts[2]), Scale, Sum2);
+				}
+				if(Counts[3])
+				{
+					Sum3 = WideMulAdd(WIDE_NAME(WideLoadPartial)(AValue + 3*WIDE_WIDTH, Counts[3]), Scale, Sum3);
+				}
+			}
+			WIDE_NAME(WideStorePartial)(Dest + RowIndex, Sum0, Counts[0]);
+			WIDE_NAME(WideStorePartial)(Dest + RowIndex + WIDE_WIDTH, Sum1, Counts[1]);
+			WIDE_NAME(WideStorePartial)(Dest + RowIndex + 2*WIDE_WIDTH, Sum2, Counts[2]);
+			WIDE_NAME(WideStorePartial)(Dest + RowIndex + 3*WIDE_WIDTH, Sum3, Counts[3]);
+		}
+	}
+}
+
+internal MATH_BLOCK_SPARSE_GEMM_KERNEL(WIDE_NAME(BlockSparseGemm))
+{
+	// NOTE: Four columns of B at a time stay in cache while every block row
+	//	runs over them, with a vector of the block row by the four columns
+	//	in registers as its kept blocks stream through. The blocks are zero
+	//	padded, so only the stores of the last block row are partial.
+	u32 BlockRowCount = (RowCount + BLOCK_SPARSE_ROWS - 1) / BLOCK_SPARSE_ROWS;
+
+	u32 ColumnIndex = 0;
+	for(;
+	    (ColumnIndex + 4) <= ColumnCount;
+	    ColumnIndex += 4)
+	{
+		r32 *BColumn = B + (umm)ColumnIndex*BStride;
+		for(u32 BlockRow = 0;
+		    BlockRow < BlockRowCount;
+		    ++BlockRow)
+		{
+			u32 FirstBlock = BlockRowStarts[BlockRow];
+			u32 OnePastLastBlock = BlockRowStarts[BlockRow + 1];
+			for(u32 VectorRow = 0;
+			    VectorRow < BLOCK_SPARSE_ROWS;
+			    VectorRow += WIDE_WIDTH)
+			{
+				u32 RowIndex = BlockRow*BLOCK_SPARSE_ROWS + VectorRow;
+				if(RowIndex >= RowCount)
+				{
+					break;
+				}
+				r32 *AValues = BlockValues + VectorRow;
+
+				wide_r32 Sum0 = WideZero();
+				wide_r32 Sum1 = WideZero();
+				wide_r32 Sum2 = WideZero();
+				wide_r32 Sum3 = WideZero();
+				for(u32 BlockIndex = FirstBlock;
+				    BlockIndex < OnePastLastBlock;
+				    ++BlockIndex)
+				{
+					wide_r32 A0 = WideLoad(AValues + (umm)BlockIndex*BLOCK_SPARSE_ROWS);
+					r32 *BValue = BColumn + BlockColumns[BlockIndex];
+					Sum0 = WideMulAdd(A0, WideSet1(BValue[0]), Sum0);
+					Sum1 = WideMulAdd(A0, WideSet1(BValue[BStride]), Sum1);
+					Sum2 = WideMulAdd(A0, WideSet1(BValue[2*BStride]), Sum2);
+					Sum3 = WideMulAdd(A0, WideSet1(BValue[3*BStride]), Sum3);
+				}
+
+				r32 *Dest = Result + (umm)ColumnIndex*ResultStride + RowIndex;
+				u32 Count = RowCount - RowIndex;
+				if(Count >= WIDE_WIDTH)
+				{
+					WideStore(Dest, Sum0);
+					WideStore(Dest + ResultStride, Sum1);
+					WideStore(Dest + 2*ResultStride, Sum2);
+					WideStore(Dest + 3*ResultStride, Sum3);
+				}
+				else
+				{
+					WIDE_NAME(WideStorePartial)(Dest, Sum0, Count);
+					WIDE_NAME(WideStorePartial)(Dest + ResultStride, Sum1, Count);
+					WIDE_NAME(WideStorePartial)(Dest + 2*ResultStride, Sum2, Count);
+					WIDE_NAME(WideStorePartial)(Dest + 3*ResultStride, Sum3, Count);
+				}
+			}
+		}
+	}
+
+	for(;
+	    ColumnIndex < ColumnCount;
+	    ++ColumnIndex)
+	{
+		r32 *BColumn = B + (umm)ColumnIndex*BStride;
+		for(u32 BlockRow = 0;
+		    BlockRow < BlockRowCount;
+		    ++BlockRow)
+		{
+			for(u32 VectorRow = 0;
+			    VectorRow < BLOCK_SPARSE_ROWS;
+			    VectorRow += WIDE_WIDTH)
+			{
+				u32 RowIndex = BlockRow*BLOCK_SPARSE_ROWS + VectorRow;
+				if(RowIndex >= RowCount)
+				{
+					break;
+				}
+				r32 *AValues = BlockValues + VectorRow;
+
+				wide_r32 Sum = WideZero();
+				for(u32 BlockIndex = BlockRowStarts[BlockRow];
+				    BlockIndex < BlockRowStarts[BlockRow + 1];
+				    ++BlockIndex)
+				{
+					wide_r32 A0 = WideLoad(AValues + (umm)BlockIndex*BLOCK_SPARSE_ROWS);
+					Sum = WideMulAdd(A0, WideSet1(BColumn[BlockColumns[BlockIndex]]), Sum);
+				}
+
+				u32 Count = Minimum(WIDE_WIDTH, RowCount - RowIndex);
+				WIDE_NAME(WideStorePartial)(Result + (umm)ColumnIndex*ResultStride + RowIndex, Sum, Count);
+			}
+		}
+	}
+}
+
+internal MATH_NON_ZERO_MASK_KERNEL(WIDE_NAME(NonZeroMask))
+{
+	u32 Result = 0;
+	for(u32 FirstIndex = 0;
+	    FirstIndex < Count;
+	    FirstIndex += 32)
+	{
+		u32 Bits = 0;
+		for(u32 Lane = 0;
+		    (Lane < 32) && ((FirstIndex + Lane) < Count);
+		    Lane += WIDE_WIDTH)
+		{
+			r32 *Value = Source + FirstIndex + Lane;
+			u32 Remaining = Count - (FirstIndex + Lane);
+			wide_r32 Values = (Remaining >= WIDE_WIDTH) ? WideLoad(Value) : WIDE_NAME(WideLoadPartial)(Value, Remaining);
+			Bits |= WideNonZeroBits(Values) << Lane;
+		}
+		*Masks++ = Bits;
+		Result += CountSetBits(Bits);
+	}
+	return Result;
+}
+
+internal MATH_CONVOLVE_KERNEL(WIDE_NAME(Convolve))
+{
+	// NOTE: Output channels across the lanes, four pixels of a row at a
+	//	time so every weight load is used four times, like the GEMM's column
+	//	tiles. Each sum starts from zero and takes the taps in order, as the
+	//	GEMM's do, so the tiling doesn't show in the bits.
+	u32 RowTapCount = KernelSize*InputChannels;
+	umm InputRowStep = (umm)InputWidth*InputChannels;
+	u32 FullChannelCount = (OutputChannels / WIDE_WIDTH)*WIDE_WIDTH;
+	for(u32 Y = 0;
+	    Y < OutputHeight;
+	    ++Y)
+	{
+		u32 X = 0;
+		for(;
+		    (X + 4) <= OutputWidth;
+		    X += 4)
+		{
+			r32 *Dest = Result + ((umm)Y*OutputWidth + X)*OutputChannels;
+			r32 *Window = Input + (umm)Y*InputRowStep + (umm)X*InputChannels;
+			for(u32 Channel = 0;
+			    Channel < OutputChannels;
+			    Channel += WIDE_WIDTH)
+			{
+				u32 Count = (Channel < FullChannelCount) ? WIDE_WIDTH : (OutputChannels - Channel);
+
+				wide_r32 Sum0 = WideZero();
+				wide_r32 Sum1 = WideZero();
+				wide_r32 Sum2 = WideZero();
+				wide_r32 Sum3 = WideZero();
+
+				r32 *WeightColumn = Weights + Channel;
+				for(u32 KY = 0;
+				    KY < KernelSize;
+				    ++KY)
+				{
+					r32 *InputRow = Window + KY*InputRowStep;
+					for(u32 Tap = 0;
+					    Tap < RowTapCount;
+					    ++Tap)
+					{
+						wide_r32 Weight = (Count == WIDE_WIDTH) ? WideLoad(WeightColumn) :
+							WIDE_NAME(WideLoadPartial)(WeightColumn, Count);
+						Sum0 = WideMulAdd(Weight, WideSet1(InputRow[Tap]), Sum0);
+						Sum1 = WideMulAdd(Weight, WideSet1(InputRow[Tap + InputChannels]), Sum1);
+						Sum2 = WideMulAdd(Weight, WideSet1(InputRow[Tap + 2*InputChannels]), Sum2);
+						Sum3 = WideMulAdd(Weight, WideSet1(InputRow[Tap + 3*InputChannels]), Sum3);
+						WeightColumn += WeightStride;
+					}
+				}
+
+				WIDE_NAME(WideStorePartial)(Dest + Channel, Sum0, Count);
+				WIDE_NAME(WideStorePartial)(Dest + OutputChannels + Channel, Sum1, Count);
+				WIDE_NAME(WideStorePartial)(Dest + 2*OutputChannels + Channel, Sum2, Count);
+				WIDE_NAME(WideStorePartial)(Dest + 3*OutputChannels + Channel, Sum3, Count);
+			}
+		}
+
+		for(;
+		    X < OutputWidth;
+		    ++X)
+		{
+			r32 *Dest = Result + ((umm)Y*OutputWidth + X)*OutputChannels;
+			r32 *Window = Input + (umm)Y*InputRowStep + (umm)X*InputChannels;
+			for(u32 Channel = 0;
+			    Channel < OutputChannels;
+			    Channel += WIDE_WIDTH)
+			{
+				u32 Count = (Channel < FullChannelCount) ? WIDE_WIDTH : (OutputChannels - Channel);
+
+				wide_r32 Sum = WideZero();
+				r32 *WeightColumn = Weights + Channel;
+				for(u32 KY = 0;
+				    KY < KernelSize;
+				    ++KY)
+				{
+					r32 *InputRow = Window + KY*InputRowStep;
+					for(u32 Tap = 0;
+					    Tap < RowTapCount;
+					    ++Tap)
+					{
+						wide_r32 Weight = (Count == WIDE_WIDTH) ? WideLoad(WeightColumn) :
+							WIDE_NAME(WideLoadPartial)(WeightColumn, Count);
+						Sum = WideMulAdd(Weight, WideSet1(InputRow[Tap]), Sum);
+						WeightColumn += WeightStride;
+					}
+				}
+
+				WIDE_NAME(WideStorePartial)(Dest + Channel, Sum, Count);
+			}
+		}
+	}
+}
+
+internal MATH_DOT_KERNEL(WIDE_NAME(Dot))
+{
+	wide_r32 Sum0 = WideZero();
+	wide_r32 Sum1 = WideZero();
+
+	u32 Index = 0;
+	for(;
+	    (Index + 2*WIDE_WIDTH) <= Count;
+	    Index += 2*WIDE_WIDTH)
+	{
+		Sum0 = WideMulAdd(WideLoad(A + Index), WideLoad(B + Index), Sum0);
+		Sum1 = WideMulAdd(WideLoad(A + Index + WIDE_WIDTH), WideLoad(B + Index + WIDE_WIDTH), Sum1);
+	}
+	if(Index < Count)
+	{
+		u32 Remaining = Count - Index;
+		u32 First = Minimum(Remaining, WIDE_WIDTH);
+		Sum0 = WideMulAdd(WIDE_NAME(WideLoadPartial)(A + Index, First),
+		                  WIDE_NAME(WideLoadPartial)(B + Index, First), Sum0);
+		if(Remaining > WIDE_WIDTH)
+		{
+			Sum1 = WideMulAdd(WIDE_NAME(WideLoadPartial)(A + Index + WIDE_WIDTH, Remaining - WIDE_WIDTH),
+			                  WIDE_NAME(WideLoadPartial)(B + Index + WIDE_WIDTH, Remaining - WIDE_WIDTH), Sum1);
+		}
+	}
+
+	r32 Result = WideHorizontalAdd(WideAdd(Sum0, Sum1));
+	return Result;
+}
+
+inline wide_r32
+WIDE_NAME(WideLoadPartialBF16)(bf16 *Source, u32 Count)
+{
+	bf16 Lanes[WIDE_WIDTH] = {};
+	for(u32 Index = 0;
+	    Index < Count;
+	    ++Index)
+	{
+		Lanes[Index] = Source[Index];
+	}
+	wide_r32 Result = WIDE_NAME(WideLoadBF16)(Lanes);
+	return Result;
+}
+
+inline void
+WIDE_NAME(WideStorePartialBF16)(bf16 *Dest, wide_r32 Value, u32 Count)
+{
+	bf16 Lanes[WIDE_WIDTH];
+	WIDE_NAME(WideStoreBF16)(Lanes, Value);
+	for(u32 Index = 0;
+	    Index < Count;
+	    ++Index)
+	{
+		Dest[Index] = Lanes[Index];
+	}
+}
+
+internal MATH_GEMM_BF16_KERNEL(WIDE_NAME(GemmBF16))
+{
+	// NOTE: GemmBlock's tiles, unblocked, widening as it loads.
+	u32 FullRowCount = (RowCount / WIDE_WIDTH)*WIDE_WIDTH;
+	u32 PairRowCount = (RowCount / (2*WIDE_WIDTH))*(2*WIDE_WIDTH);
+
+	u32 ColumnIndex = 0;
+	for(;
+	    (ColumnIndex + 4) <= ColumnCount;
+	    ColumnIndex += 4)
+	{
+		r32 *Dest0 = Result + (umm)ColumnIndex*ResultStride;
+		r32 *Dest1 = Dest0 + ResultStride;
+		r32 *Dest2 = Dest1 + ResultStride;
+		r32 *Dest3 = Dest2 + ResultStride;
+		bf16 *BColumn = B + (umm)ColumnIndex*BColumnStep;
+
+		u32 RowIndex = 0;
+		for(;
+		    RowIndex < PairRowCount;
+		    RowIndex += 2*WIDE_WIDTH)
+		{
+			wide_r32 Sum00 = WideZero();
+			wide_r32 Sum01 = WideZero();
+			wide_r32 Sum02 = WideZero();
+			wide_r32 Sum03 = WideZero();
+			wide_r32 Sum10 = WideZero();
+			wide_r32 Sum11 = WideZero();
+			wide_r32 Sum12 = WideZero();
+			wide_r32 Sum13 = WideZero();
+
+			bf16 *AValue = A + RowIndex;
+			bf16 *BValue = BColumn;
+			for(u32 InnerIndex = 0;
+			    InnerIndex < InnerCount;
+			    ++InnerIndex)
+			{
+				wide_r32 A0 = WIDE_NAME(WideLoadBF16)(AValue);
+				wide_r32 A1 = WIDE_NAME(WideLoadBF16)(AValue + WIDE_WIDTH);
+				wide_r32 B0 = WideSet1(BF16ToR32(BValue[0]));
+				wide_r32 B1 = WideSet1(BF16ToR32(BValue[BColumnStep]));
+				wide_r32 B2 = WideSet1(BF16ToR32(BValue[2*BColumnStep]));
+				wide_r32 B3 = WideSet1(BF16ToR32(BValue[3*BColumnStep]));
+
+				Sum00 = WideMulAdd(A0, B0, Sum00);
+				Sum01 = WideMulAdd(A0, B1, Sum01);
+				Sum02 = WideMulAdd(A0, B2, Sum02);
+				Sum03 = WideMulAdd(A0, B3, Sum03);
+				Sum10 = WideMulAdd(A1, B0, Sum10);
+				Sum11 = WideMulAdd(A1, B1, Sum11);
+				Sum12 = WideMulAdd(A1, B2, Sum12);
+				Sum13 = WideMulAdd(A1, B3, Sum13);
+
+				AValue += AStride;
+				BValue += BInnerStep;
+			}
+
+			WideStore(Dest0 + RowIndex, Sum00);
+			WideStore(Dest1 + RowIndex, Sum01);
+			WideStore(Dest2 + RowIndex, Sum02);
+			WideStore(Dest3 + RowIndex, Sum03);
+			WideStore(Dest0 + RowIndex + WIDE_WIDTH, Sum10);
+			WideStore(Dest1 + RowIndex + WIDE_WIDTH, Sum11);
+			WideStore(Dest2 + RowIndex + WIDE_WIDTH, Sum12);
+			WideStore(Dest3 + RowIndex + WIDE_WIDTH, Sum13);
+		}
+
+		for(;
+		    RowIndex < RowCount;
+		    RowIndex += WIDE_WIDTH)
+		{
+			u32 Count = (RowIndex < FullRowCount) ? WIDE_WIDTH : (RowCount - RowIndex);
+
+			wide_r32 Sum0 = WideZero();
+			wide_r32 Sum1 = WideZero();
+			wide_r32 Sum2 = WideZero();
+			wide_r32 Sum3 = WideZero();
+
+			bf16 *AValue = A + RowIndex;
+			bf16 *BValue = BColumn;
+			for(u32 InnerIndex = 0;
+			    InnerIndex < InnerCount;
+			    ++InnerIndex)
+			{
+				wide_r32 A0 = WIDE_NAME(WideLoadPartialBF16)(AValue, Count);
+				Sum0 = WideMulAdd(A0, WideSet1(BF16ToR32(BValue[0])), Sum0);
+				Sum1 = WideMulAdd(A0, WideSet1(BF16ToR32(BValue[BColumnStep])), Sum1);
+				Sum2 = WideMulAdd(A0, WideSet1(BF16ToR32(BValue[2*BColumnStep])), Sum2);
+				Sum3 = WideMulAdd(A0, WideSet1(BF16ToR32(BValue[3*BColumnStep])), Sum3);
+
+				AValue += AStride;
+				BValue += BInnerStep;
+			}
+
+			WIDE_NAME(WideStorePartial)(Dest0 + RowIndex, Sum0, Count);
+			WIDE_NAME(WideStorePartial)(Dest1 + RowIndex, Sum1, Count);
+			WIDE_NAME(WideStorePartial)(Dest2 + RowIndex, Sum2, Count);
+			WIDE_NAME(WideStorePartial)(Dest3 + RowIndex, Sum3, Count);
+		}
+	}
+
+	for(;
+	    ColumnIndex < ColumnCount;
+	    ++ColumnIndex)
+	{
+		r32 *Dest = Result + (umm)ColumnIndex*ResultStride;
+		bf16 *BColumn = B + (umm)ColumnIndex*BColumnStep;
+
+		for(u32 RowIndex = 0;
+		    RowIndex < RowCount;
+		    RowIndex += WIDE_WIDTH)
+		{
+			u32 Count = (RowIndex < FullRowCount) ? WIDE_WIDTH : (RowCount - RowIndex);
+
+			wide_r32 Sum = WideZero();
+			bf16 *AValue = A + RowIndex;
+			bf16 *BValue = BColumn;
+			for(u32 InnerIndex = 0;
+			    InnerIndex < InnerCount;
+			    ++InnerIndex)
+			{
+				Sum = WideMulAdd(WIDE_NAME(WideLoadPartialBF16)(AValue, Count), WideSet1(BF16ToR32(*BValue)), Sum);
+				AValue += AStride;
+				BValue += BInnerStep;
+			}
+
+			WIDE_NAME(WideStorePartial)(Dest + RowIndex, Sum, Count);
+		}
+	}
+}
+
+internal MATH_DOT_BF16_KERNEL(WIDE_NAME(DotBF16))
+{
+	wide_r32 Sum0 = WideZero();
+	wide_r32 Sum1 = WideZero();
+
+	u32 Index = 0;
+	for(;
+	    (Index + 2*WIDE_WIDTH) <= Count;
+	    Index += 2*WIDE_WIDTH)
+	{
+		Sum0 = WideMulAdd(WIDE_NAME(WideLoadBF16)(A + Index), WIDE_NAME(WideLoadBF16)(B + Index), Sum0);
+		Sum1 = WideMulAdd(WIDE_NAME(WideLoadBF16)(A + Index + WIDE_WIDTH),
+		                  WIDE_NAME(WideLoadBF16)(B + Index + WIDE_WIDTH), Sum1);
+	}
+	if(Index < Count)
+	{
+		u32 Remaining = Count - Index;
+		u32 First = Minimum(Remaining, WIDE_WIDTH);
+		Sum0 = WideMulAdd(WIDE_NAME(WideLoadPartialBF16)(A + Index, First),
+		                  WIDE_NAME(WideLoadPartialBF16)(B + Index, First), Sum0);
+		if(Remaining > WIDE_WIDTH)
+		{
+			Sum1 = WideMulAdd(WIDE_NAME(WideLoadPartialBF16)(A + Index + WIDE_WIDTH, Remaining - WIDE_WIDTH),
+			                  WIDE_NAME(WideLoadPartialBF16)(B + Index + WIDE_WIDTH, Remaining - WIDE_WIDTH), Sum1);
+		}
+	}
+
+	r32 Result = WideHorizontalAdd(WideAdd(Sum0, Sum1));
+	return Result;
+}
+
+internal MATH_TO_BF16_KERNEL(WIDE_NAME(ToBF16))
+{
+	u32 Index = 0;
+	for(;
+	    (Index + WIDE_WIDTH) <= Count;
+	    Index += WIDE_WIDTH)
+	{
+		WIDE_NAME(WideStoreBF16)(Dest + Index, WideLoad(Source + Index));
+	}
+	if(Index < Count)
+	{
+		u32 Remaining = Count - Index;
+		WIDE_NAME(WideStorePartialBF16)(Dest + Index, WIDE_NAME(WideLoadPartial)(Source + Index, Remaining), Remaining);
+	}
+}
+
+internal MATH_FROM_BF16_KERNEL(WIDE_NAME(FromBF16))
+{
+	u32 Index = 0;
+	for(;
+	    (Index + WIDE_WIDTH) <= Count;
+	    Index += WIDE_WIDTH)
+	{
+		WideStore(Dest + Index, WIDE_NAME(WideLoadBF16)(Source + Index));
+	}
+	if(Index < Count)
+	{
+		u32 Remaining = Count - Index;
+		WIDE_NAME(WideStorePartial)(Dest + Index, WIDE_NAME(WideLoadPartialBF16)(Source + Index, Remaining), Remaining);
+	}
+}
+
+#define WIDE_ELEMENTWISE_LOOP(Expression) \
+	u32 Index = 0; \
+	for(; (Index + WIDE_WIDTH) <= Count; Index += WIDE_WIDTH) \
+	{ \
+		u32 LaneCount = WIDE_WIDTH; \
+		WideStore(Dest + Index, Expression); \
+	} \
+	if(Index < Count) \
+	{ \
+		u32 LaneCount = Count - Index; \
+		WIDE_NAME(WideStorePartial)(Dest + Index, Expression, LaneCount); \
+	}
+
+#define WIDE_OPERAND(Pointer) ((LaneCount == WIDE_WIDTH) ? WideLoad((Pointer) + Index) : \
+                                WIDE_NAME(WideLoadPartial)((Pointer) + Index, LaneCount))
+
+internal MATH_BINARY_KERNEL(WIDE_NAME(Add))
+{
+	WIDE_ELEMENTWISE_LOOP(WideAdd(WIDE_OPERAND(A), WIDE_OPERAND(B)));
+}
+
+internal MATH_BINARY_KERNEL(WIDE_NAME(Subtract))
+{
+	WIDE_ELEMENTWISE_LOOP(WideSub(WIDE_OPERAND(A), WIDE_OPERAND(B)));
+}
+
+internal MATH_BINARY_KERNEL(WIDE_NAME(Multiply))
+{
+	WIDE_ELEMENTWISE_LOOP(WideMul(WIDE_OPERAND(A), WIDE_OPERAND(B)));
+}
+
+internal MATH_UNARY_KERNEL(WIDE_NAME(AddEquals))
+{
+	WIDE_ELEMENTWISE_LOOP(WideAdd(WIDE_OPERAND(Dest), WIDE_OPERAND(Source)));
+}
+
+internal MATH_SCALE_KERNEL(WIDE_NAME(ScaleEquals))
+{
+	wide_r32 WideScale = WideSet1(Scale);
+	WIDE_ELEMENTWISE_LOOP(WideMul(WIDE_OPERAND(Dest), WideScale));
+}
+
+internal MATH_UNARY_KERNEL(WIDE_NAME(Sigmoid))
+{
+	WIDE_ELEMENTWISE_LOOP(WIDE_NAME(WideSigmoid)(WIDE_OPERAND(Source)));
+}
+
+internal MATH_UNARY_KERNEL(WIDE_NAME(SigmoidPrime))
+{
+	WIDE_ELEMENTWISE_LOOP(WIDE_NAME(WideSigmoidPrime)(WIDE_OPERAND(Source)));
+}
+
+#define WIDE_RESULT(Pointer, Value) \
+	if(LaneCount == WIDE_WIDTH) \
+	{ \
+		WideStore((Pointer) + Index, Value); \
+	} \
+	else \
+	{ \
+		WIDE_NAME(WideStorePartial)((Pointer) + Index, Value, LaneCount); \
+	}
+
+inline wide_r32
+WIDE_NAME(WideAbsoluteValue)(wide_r32 Value)
+{
+	wide_r32 Result = WideMax(Value, WideSub(WideZero(), Value));
+	return Result;
+}
+
+internal MATH_CLIP_ABS_SUM_KERNEL(WIDE_NAME(ClipAbsSum))
+{
+	wide_r32 Upper = WideSet1(Limit);
+	wide_r32 Lower = WideSet1(-Limit);
+	for(u32 Index = 0;
+	    Index < Count;
+	    Index += WIDE_WIDTH)
+	{
+		u32 LaneCount = Minimum(WIDE_WIDTH, Count - Index);
+		wide_r32 Value = WideMin(WideMax(WIDE_OPERAND(Values), Lower), Upper);
+		wide_r32 Sum = WideAdd(WIDE_OPERAND(Sums), WIDE_NAME(WideAbsoluteValue)(Value));
+		WIDE_RESULT(Values, Value);
+		WIDE_RESULT(Sums, Sum);
+	}
+}
+
+internal MATH_KEPT_ABS_SUM_KERNEL(WIDE_NAME(KeptAbsSum))
+{
+	// NOTE: Magnitude - Threshold is positive exactly when Magnitude is
+	//	above it, and the rows that aren't add zero.
+	wide_r32 One = WideSet1(1.0f);
+	for(u32 Index = 0;
+	    Index < Count;
+	    Index += WIDE_WIDTH)
+	{
+		u32 LaneCount = Minimum(WIDE_WIDTH, Count - Index);
+		wide_r32 Magnitude = WIDE_NAME(WideAbsoluteValue)(WIDE_OPERAND(Source));
+		wide_r32 Excess = WideSub(Magnitude, WIDE_OPERAND(Thresholds));
+		wide_r32 Sum = WideAdd(WIDE_OPERAND(Sums), WideSelectPositive(Excess, Magnitude, WideZero()));
+		wide_r32 Kept = WideAdd(WIDE_OPERAND(Counts), WideSelectPositive(Excess, One, WideZero()));
+		WIDE_RESULT(Sums, Sum);
+		WIDE_RESULT(Counts, Kept);
+	}
+}
+
+internal MATH_QUANTIZE_KERNEL(WIDE_NAME(Quantize))
+{
+	for(u32 Index = 0;
+	    Index < Count;
+	    Index += WIDE_WIDTH)
+	{
+		u32 LaneCount = Minimum(WIDE_WIDTH, Count - Index);
+		wide_r32 Value = WIDE_OPERAND(Source);
+		wide_r32 Scale = WIDE_OPERAND(Scales);
+		wide_r32 Signed = WideSelectPositive(Value, Scale, WideSub(WideZero(), Scale));
+		wide_r32 Excess = WideSub(WIDE_NAME(WideAbsoluteValue)(Value), WIDE_OPERAND(Thresholds));
+		WIDE_RESULT(Dest, WideSelectPositive(Excess, Signed, WideZero()));
+	}
+}
+
+//
+// NOTE: Expression templates (see nn_kernels.h). LaneCount is WIDE_WIDTH
+//	everywhere but the last partial vector of a column, and the loads fold
+//	to plain ones once inlined.
+//
+//	GCC would contract a multiply feeding an add from different nodes into
+//	an FMA, which the separate kernels never do, so it's off for these.
+//
+
+#if defined(__GNUC__) && !defined(__clang__)
+	#pragma GCC push_options
+	#pragma GCC optimize("fp-contract=off")
+#endif
+
+inline wide_r32
+WIDE_NAME(ExprElement)(expr_operand E, u32 Column, u32 Row, u32 LaneCount)
+{
+	r32 *Source = E.Data + (umm)Column*E.Stride + Row;
+	wide_r32 Result = ((LaneCount == WIDE_WIDTH) ? WideLoad(Source) :
+	                   WIDE_NAME(WideLoadPartial)(Source, LaneCount));
+	return Result;
+}
+
+inline wide_r32
+WIDE_NAME(ExprElement)(expr_scalar E, u32 Column, u32 Row, u32 LaneCount)
+{
+	wide_r32 Result = WideSet1(E.Value);
+	return Result;
+}
+
+template<u32 Op, typename a, typename b>
+inline wide_r32
+WIDE_NAME(ExprElement)(expr_binary<Op, a, b> E, u32 Column, u32 Row, u32 LaneCount)
+{
+	wide_r32 A = WIDE_NAME(ExprElement)(E.A, Column, Row, LaneCount);
+	wide_r32 B = WIDE_NAME(ExprElement)(E.B, Column, Row, LaneCount);
+	wide_r32 Result = ((Op == ExprOp_Plus) ? WideAdd(A, B) :
+	                   (Op == ExprOp_Minus) ? WideSub(A, B) :
+	                   WideMul(A, B));
+	return Result;
+}
+
+template<u32 Op, typename a>
+inline wide_r32
+WIDE_NAME(ExprElement)(expr_unary<Op, a> E, u32 Column, u32 Row, u32 LaneCount)
+{
+	wide_r32 A = WIDE_NAME(ExprElement)(E.A, Column, Row, LaneCount);
+	wide_r32 Result = ((Op == ExprOp_Sigmoid) ? WIDE_NAME(WideSigmoid)(A) :
+	                   (Op == ExprOp_SigmoidPrime) ? WIDE_NAME(WideSigmoidPrime)(A) :
+	                   (Op == ExprOp_ReLU) ? WIDE_NAME(WideReLU)(A) :
+	                   (Op == ExprOp_ReLUPrime) ? WIDE_NAME(WideReLUPrime)(A) :
+	                   (Op == ExprOp_LeakyReLU) ? WIDE_NAME(WideLeakyReLU)(A) :
+	                   (Op == ExprOp_LeakyReLUPrime) ? WIDE_NAME(WideLeakyReLUPrime)(A) :
+	                   (Op == ExprOp_Tanh) ? WIDE_NAME(WideTanh)(A) :
+	                   (Op == ExprOp_TanhPrime) ? WIDE_NAME(WideTanhPrime)(A) :
+	                   (Op == ExprOp_Sign) ? WIDE_NAME(WideSign)(A) :
+	                   WIDE_NAME(WideSignPrime)(A));
+	return Result;
+}
+
+template<typename expr>
+internal void
+WIDE_NAME(EvaluateExpression)(r32 *Dest, u32 DestStride, expr E, u32 RowCount, u32 ColumnCount)
+{
+	for(u32 ColumnIndex = 0;
+	    ColumnIndex < ColumnCount;
+	    ++ColumnIndex)
+	{
+		r32 *DestColumn = Dest + (umm)ColumnIndex*DestStride;
+		u32 RowIndex = 0;
+		for(;
+		    (RowIndex + WIDE_WIDTH) <= RowCount;
+		    RowIndex += WIDE_WIDTH)
+		{
+			WideStore(DestColumn + RowIndex, WIDE_NAME(ExprElement)(E, ColumnIndex, RowIndex, WIDE_WIDTH));
+		}
+		if(RowIndex < RowCount)
+		{
+			u32 LaneCount = RowCount - RowIndex;
+			WIDE_NAME(WideStorePartial)(DestColumn + RowIndex,
+			                            WIDE_NAME(ExprElement)(E, ColumnIndex, RowIndex, LaneCount), LaneCount);
+		}
+	}
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+	#pragma GCC pop_options
+#endif
+
+//
+// NOTE: Static kernels (see nn_kernels.h). Every row count here is a multiple
+//	of the vector width, so the loops over vectors have constant trip counts
+//	and no tails.
+//
+
+inline void
+WIDE_NAME(StaticStoreLayer)(r32 *WeightedInput, r32 *Activation, r32 *Bias, wide_r32 Sum)
+{
+	wide_r32 Value = WideAdd(Sum, WideLoad(Bias));
+	WideStore(WeightedInput, Value);
+	WideStore(Activation, WIDE_NAME(WideSigmoid)(Value));
+}
+
+template<u32 RowCount, u32 InnerCount>
+internal void
+WIDE_NAME(StaticForward)(r32 *WeightedInputs, r32 *Activations, r32 *Weights, r32 *Biases,
+                         r32 *Inputs, u32 ColumnCount)
+{
+	// NOTE: GemmBlock's tiles of two vectors by four columns, with the bias
+	//	and sigmoid applied on the way out.
+	u32 const Stride = STATIC_ROW_STRIDE(RowCount);
+	u32 const InputStride = STATIC_ROW_STRIDE(InnerCount);
+	u32 const PairRowCount = (Stride / (2*WIDE_WIDTH))*(2*WIDE_WIDTH);
+
+	u32 ColumnIndex = 0;
+	for(;
+	    (ColumnIndex + 4) <= ColumnCount;
+	    ColumnIndex += 4)
+	{
+		r32 *Input = Inputs + ColumnIndex*InputStride;
+		u32 Offset = ColumnIndex*Stride;
+
+		for(u32 RowIndex = 0;
+		    RowIndex < PairRowCount;
+		    RowIndex += 2*WIDE_WIDTH)
+		{
+			wide_r32 Sum00 = WideZero();
+			wide_r32 Sum01 = WideZero();
+			wide_r32 Sum02 = WideZero();
+			wide_r32 Sum03 = WideZero();
+			wide_r32 Sum10 = WideZero();
+			wide_r32 Sum11 = WideZero();
+			wide_r32 Sum12 = WideZero();
+			wide_r32 Sum13 = WideZero();
+
+			r32 *WeightValue = Weights + RowIndex;
+			for(u32 InnerIndex = 0;
+			    InnerIndex < InnerCount;
+			    ++InnerIndex)
+			{
+				wide_r32 A0 = WideLoad(WeightValue);
+				wide_r32 A1 = WideLoad(WeightValue + WIDE_WIDTH);
+				wide_r32 B0 = WideSet1(Input[InnerIndex]);
+				wide_r32 B1 = WideSet1(Input[InnerIndex + InputStride]);
+				wide_r32 B2 = WideSet1(Input[InnerIndex + 2*InputStride]);
+				wide_r32 B3 = WideSet1(Input[InnerIndex + 3*InputStride]);
+
+				Sum00 = WideMulAdd(A0, B0, Sum00);
+				Sum01 = WideMulAdd(A0, B1, Sum01);
+				Sum02 = WideMulAdd(A0, B2, Sum02);
+				Sum03 = WideMulAdd(A0, B3, Sum03);
+				Sum10 = WideMulAdd(A1, B0, Sum10);
+				Sum11 = WideMulAdd(A1, B1, Sum11);
+				Sum12 = WideMulAdd(A1, B2, Sum12);
+				Sum13 = WideMulAdd(A1, B3, Sum13);
+
+				WeightValue += Stride;
+			}
+
+			u32 Row0 = Offset + RowIndex;
+			u32 Row1 = Row0 + WIDE_WIDTH;
+			WIDE_NAME(StaticStoreLayer)(WeightedInputs + Row0, Activations + Row0, Biases + RowIndex, Sum00);
+			WIDE_NAME(StaticStoreLayer)(WeightedInputs + Row0 + Stride, Activations + Row0 + Stride, Biases + RowIndex, Sum01);
+			WIDE_NAME(StaticStoreLayer)(WeightedInputs + Row0 + 2*Stride, Activations + Row0 + 2*Stride, Biases + RowIndex, Sum02);
+			WIDE_NAME(StaticStoreLayer)(WeightedInputs + Row0 + 3*Stride, Activations + Row0 + 3*Stride, Biases + RowIndex, Sum03);
+			WIDE_NAME(StaticStoreLayer)(WeightedInputs + Row1, Activations + Row1, Biases + RowIndex + WIDE_WIDTH, Sum10);
+			WIDE_NAME(StaticStoreLayer)(WeightedInputs + Row1 + Stride, Activations + Row1 + Stride, Biases + RowIndex + WIDE_WIDTH, Sum11);
+			WIDE_NAME(StaticStoreLayer)(WeightedInputs + Row1 + 2*Stride, Activations + Row1 + 2*Stride, Biases + RowIndex + WIDE_WIDTH, Sum12);
+			WIDE_NAME(StaticStoreLayer)(WeightedInputs + Row1 + 3*Stride, Activations + Row1 + 3*Stride, Biases + RowIndex + WIDE_WIDTH, Sum13);
+		}
+
+		if(PairRowCount < Stride)
+		{
+			wide_r32 Sum0 = WideZero();
+			wide_r32 Sum1 = WideZero();
+			wide_r32 Sum2 = WideZero();
+			wide_r32 Sum3 = WideZero();
+
+			r32 *WeightValue = Weights + PairRowCount;
+			for(u32 InnerIndex = 0;
+			    InnerIndex < InnerCount;
+			    ++InnerIndex)
+			{
+				wide_r32 A0 = WideLoad(WeightValue);
+				Sum0 = WideMulAdd(A0, WideSet1(Input[InnerIndex]), Sum0);
+				Sum1 = WideMulAdd(A0, WideSet1(Input[InnerIndex + InputStride]), Sum1);
+				Sum2 = WideMulAdd(A0, WideSet1(Input[InnerIndex + 2*InputStride]), Sum2);
+				Sum3 = WideMulAdd(A0, WideSet1(Input[InnerIndex + 3*InputStride]), Sum3);
+
+				WeightValue += Stride;
+			}
+
+			u32 Row = Offset + PairRowCount;
+			WIDE_NAME(StaticStoreLayer)(WeightedInputs + Row, Activations + Row, Biases + PairRowCount, Sum0);
+			WIDE_NAME(StaticStoreLayer)(WeightedInputs + Row + Stride, Activations + Row + Stride, Biases + PairRowCount, Sum1);
+			WIDE_NAME(StaticStoreLayer)(WeightedInputs + Row + 2*Stride, Activations + Row + 2*Stride, Biases + PairRowCount, Sum2);
+			WIDE_NAME(StaticStoreLayer)(WeightedInputs + Row + 3*Stride, Activations + Row + 3*Stride, Biases + PairRowCount, Sum3);
+		}
+	}
+
+	for(;
+	    ColumnIndex < ColumnCount;
+	    ++ColumnIndex)
+	{
+		r32 *Input = Inputs + ColumnIndex*InputStride;
+		u32 Offset = ColumnIndex*Stride;
+		for(u32 RowIndex = 0;
+		    RowIndex < Stride;
+		    RowIndex += WIDE_WIDTH)
+		{
+			wide_r32 Sum = WideZero();
+			r32 *WeightValue = Weights + RowIndex;
+			for(u32 InnerIndex = 0;
+			    InnerIndex < InnerCount;
+			    ++InnerIndex)
+			{
+				Sum = WideMulAdd(WideLoad(WeightValue), WideSet1(Input[InnerIndex]), Sum);
+				WeightValue += Stride;
+			}
+
+			WIDE_NAME(StaticStoreLayer)(WeightedInputs + Offset + RowIndex, Activations + Offset + RowIndex,
+			                            Biases + RowIndex, Sum);
+		}
+	}
+}
+
+template<u32 InnerCount>
+inline u32
+WIDE_NAME(StaticGatherNonZeros)(u32 *Indices, r32 *Values, r32 *Source)
+{
+	// NOTE: Written unconditionally and kept only when non-zero, so there's
+	//	no branch on the data.
+	u32 Result = 0;
+	for(u32 Index = 0;
+	    Index < InnerCount;
+	    ++Index)
+	{
+		r32 Value = Source[Index];
+		Indices[Result] = Index;
+		Values[Result] = Value;
+		Result += (Value != 0.0f);
+	}
+	return Result;
+}
+
+template<u32 RowCount, u32 InnerCount>
+internal void
+WIDE_NAME(StaticForwardSparse)(r32 *WeightedInputs, r32 *Activations, r32 *Weights, r32 *Biases,
+                               r32 *Inputs, u32 ColumnCount)
+{
+	// NOTE: SparseGemm's loop for the input layer: a column's non-zero inputs
+	//	are gathered first, then stream past four vectors of its rows at a
+	//	time. The last group of vectors has a constant size, so it needs no
+	//	partial loads.
+	u32 const Stride = STATIC_ROW_STRIDE(RowCount);
+	u32 const InputStride = STATIC_ROW_STRIDE(InnerCount);
+	u32 const GroupRowCount = (Stride / (4*WIDE_WIDTH))*(4*WIDE_WIDTH);
+	u32 const LastVectorCount = (Stride - GroupRowCount) / WIDE_WIDTH;
+
+	u32 Indices[InnerCount];
+	r32 Values[InnerCount];
+	for(u32 ColumnIndex = 0;
+	    ColumnIndex < ColumnCount;
+	    ++ColumnIndex)
+	{
+		u32 EntryCount = WIDE_NAME(StaticGatherNonZeros)<InnerCount>(Indices, Values,
+		                                                             Inputs + ColumnIndex*InputStride);
+		r32 *WeightedInput = WeightedInputs + ColumnIndex*Stride;
+		r32 *Activation = Activations + ColumnIndex*Stride;
+
+		for(u32 RowIndex = 0;
+		    RowIndex < GroupRowCount;
+		    RowIndex += 4*WIDE_WIDTH)
+		{
+			wide_r32 Sum0 = WideZero();
+			wide_r32 Sum1 = WideZero();
+			wide_r32 Sum2 = WideZero();
+			wide_r32 Sum3 = WideZero();
+			for(u32 EntryIndex = 0;
+			    EntryIndex < EntryCount;
+			    ++EntryIndex)
+			{
+				r32 *WeightValue = Weights + Indices[EntryIndex]*Stride + RowIndex;
+				wide_r32 Scale = WideSet1(Values[EntryIndex]);
+				Sum0 = WideMulAdd(WideLoad(WeightValue), Scale, Sum0);
+				Sum1 = WideMulAdd(WideLoad(WeightValue + WIDE_WIDTH), Scale, Sum1);
+				Sum2 = WideMulAdd(WideLoad(WeightValue + 2*WIDE_WIDTH), Scale, Sum2);
+				Sum3 = WideMulAdd(WideLoad(WeightValue + 3*WIDE_WIDTH), Scale, Sum3);
+			}
+
+			WIDE_NAME(StaticStoreLayer)(WeightedInput + RowIndex, Activation + RowIndex, Biases + RowIndex, Sum0);
+			WIDE_NAME(StaticStoreLayer)(WeightedInput + RowIndex + WIDE_WIDTH, Activation + RowIndex + WIDE_WIDTH,
+			                            Biases + RowIndex + WIDE_WIDTH, Sum1);
+			WIDE_NAME(StaticStoreLayer)(WeightedInput + RowIndex + 2*WIDE_WIDTH, Activation + RowIndex + 2*WIDE_WIDTH,
+			                            Biases + RowIndex + 2*WIDE_WIDTH, Sum2);
+			WIDE_NAME(StaticStoreLayer)(WeightedInput + RowIndex + 3*WIDE_WIDTH, Activation + RowIndex + 3*WIDE_WIDTH,
+			                            Biases + RowIndex + 3*WIDE_WIDTH, Sum3);
+		}
+
+		if(LastVectorCount)
+		{
+			u32 const RowIndex = GroupRowCount;
+			wide_r32 Sum0 = WideZero();
+			wide_r32 Sum1 = WideZero();
+			wide_r32 Sum2 = WideZero();
+			for(u32 EntryIndex = 0;
+			    EntryIndex < EntryCount;
+			    ++EntryIndex)
+			{
+				r32 *WeightValue = Weights + Indices[EntryIndex]*Stride + RowIndex;
+				wide_r32 Scale = WideSet1(Values[EntryIndex]);
+				Sum0 = WideMulAdd(WideLoad(WeightValue), Scale, Sum0);
+				if(LastVectorCount > 1)
+				{
+					Sum1 = WideMulAdd(WideLoad(WeightValue + WIDE_WIDTH), Scale, Sum1);
+				}
+				if(LastVectorCount > 2)
+				{
+					Sum2 = WideMulAdd(WideLoad(WeightValue + 2*WIDE_WIDTH), Scale, Sum2);
+				}
+			}
+
+			WIDE_NAME(StaticStoreLayer)(WeightedInput + RowIndex, Activation + RowIndex, Biases + RowIndex, Sum0);
+			if(LastVectorCount > 1)
+			{
+				WIDE_NAME(StaticStoreLayer)(WeightedInput + RowIndex + WIDE_WIDTH, Activation + RowIndex + WIDE_WIDTH,
+				                            Biases + RowIndex + WIDE_WIDTH, Sum1);
+			}
+			if(LastVectorCount > 2)
+			{
+				WIDE_NAME(StaticStoreLayer)(WeightedInput + RowIndex + 2*WIDE_WIDTH, Activation + RowIndex + 2*WIDE_WIDTH,
+				                            Biases + RowIndex + 2*WIDE_WIDTH, Sum2);
+			}
+		}
+	}
+}
+
+template<u32 RowCount, b32 QuadraticCost>
+internal void
+WIDE_NAME(StaticOutputError)(r32 *Errors, r32 *Activations, r32 *WeightedInputs, r32 *DesiredOutputs, u32 ColumnCount)
+{
+	// NOTE: The desired outputs come from outside, so their padding rows
+	//	aren't known to be zero; the last vector stops at RowCount.
+	u32 const Stride = STATIC_ROW_STRIDE(RowCount);
+	u32 const FullRowCount = (RowCount / WIDE_WIDTH)*WIDE_WIDTH;
+	u32 const LastCount = RowCount - FullRowCount;
+	for(u32 ColumnIndex = 0;
+	    ColumnIndex < ColumnCount;
+	    ++ColumnIndex)
+	{
+		u32 Offset = ColumnIndex*Stride;
+		for(u32 RowIndex = 0;
+		    RowIndex < FullRowCount;
+		    RowIndex += WIDE_WIDTH)
+		{
+			u32 Row = Offset + RowIndex;
+			wide_r32 Error = WideSub(WideLoad(Activations + Row), WideLoad(DesiredOutputs + Row));
+			if(QuadraticCost)
+			{
+				Error = WideMul(Error, WIDE_NAME(WideSigmoidPrime)(WideLoad(WeightedInputs + Row)));
+			}
+			WideStore(Errors + Row, Error);
+		}
+
+		if(LastCount)
+		{
+			u32 Row = Offset + FullRowCount;
+			wide_r32 Error = WideSub(WIDE_NAME(WideLoadPartial)(Activations + Row, LastCount),
+			                         WIDE_NAME(WideLoadPartial)(DesiredOutputs + Row, LastCount));
+			if(QuadraticCost)
+			{
+				Error = WideMul(Error, WIDE_NAME(WideSigmoidPrime)(WIDE_NAME(WideLoadPartial)(WeightedInputs + Row, LastCount)));
+			}
+			WIDE_NAME(WideStorePartial)(Errors + Row, Error, LastCount);
+		}
+	}
+}
+
+template<u32 RowCount, u32 InnerCount>
+internal void
+WIDE_NAME(StaticHiddenError)(r32 *Errors, r32 *Weights, r32 *NextErrors, r32 *WeightedInputs, u32 ColumnCount)
+{
+	// NOTE: The dots split their lanes between two sums exactly like Dot, so
+	//	the zero padding adds nothing and the bits match TransposeMult.
+	u32 const Stride = STATIC_ROW_STRIDE(RowCount);
+	u32 const ErrorStride = STATIC_ROW_STRIDE(InnerCount);
+	u32 const PairRowCount = (Stride / (2*WIDE_WIDTH))*(2*WIDE_WIDTH);
+	for(u32 ColumnIndex = 0;
+	    ColumnIndex < ColumnCount;
+	    ++ColumnIndex)
+	{
+		r32 *NextError = NextErrors + ColumnIndex*Stride;
+		r32 *Error = Errors + ColumnIndex*ErrorStride;
+		for(u32 InnerIndex = 0;
+		    InnerIndex < InnerCount;
+		    ++InnerIndex)
+		{
+			r32 *WeightColumn = Weights + InnerIndex*Stride;
+			wide_r32 Sum0 = WideZero();
+			wide_r32 Sum1 = WideZero();
+			for(u32 RowIndex = 0;
+			    RowIndex < PairRowCount;
+			    RowIndex += 2*WIDE_WIDTH)
+			{
+				Sum0 = WideMulAdd(WideLoad(WeightColumn + RowIndex), WideLoad(NextError + RowIndex), Sum0);
+				Sum1 = WideMulAdd(WideLoad(WeightColumn + RowIndex + WIDE_WIDTH),
+				                  WideLoad(NextError + RowIndex + WIDE_WIDTH), Sum1);
+			}
+			if(PairRowCount < Stride)
+			{
+				Sum0 = WideMulAdd(WideLoad(WeightColumn + PairRowCount), WideLoad(NextError + PairRowCount), Sum0);
+			}
+			Error[InnerIndex] = WideHorizontalAdd(WideAdd(Sum0, Sum1));
+		}
+
+		r32 *WeightedInput = WeightedInputs + ColumnIndex*ErrorStride;
+		for(u32 RowIndex = 0;
+		    RowIndex < ErrorStride;
+		    RowIndex += WIDE_WIDTH)
+		{
+			WideStore(Error + RowIndex, WideMul(WideLoad(Error + RowIndex),
+			                                    WIDE_NAME(WideSigmoidPrime)(WideLoad(WeightedInput + RowIndex))));
+		}
+	}
+}
+
+template<u32 RowCount, u32 InnerCount>
+internal void
+WIDE_NAME(StaticAccumulateGradients)(r32 *WeightGradients, r32 *BiasGradients, r32 *Errors,
+                                     r32 *Activations, u32 ColumnCount, b32 *UsedColumns)
+{
+	// NOTE: GemmBlock with B transposed, four gradient columns by two vectors
+	//	summing over the trials, picking up where the last tile left off, or
+	//	from zero in the batch's first tile.
+	u32 const Stride = STATIC_ROW_STRIDE(RowCount);
+	u32 const ActivationStride = STATIC_ROW_STRIDE(InnerCount);
+	u32 const PairRowCount = (Stride / (2*WIDE_WIDTH))*(2*WIDE_WIDTH);
+
+	u32 InnerIndex = 0;
+	for(;
+	    (InnerIndex + 4) <= InnerCount;
+	    InnerIndex += 4)
+	{
+		r32 *Dest0 = WeightGradients + InnerIndex*Stride;
+		r32 *Dest1 = Dest0 + Stride;
+		r32 *Dest2 = Dest1 + Stride;
+		r32 *Dest3 = Dest2 + Stride;
+		b32 Fresh = !UsedColumns[InnerIndex];
+
+		for(u32 RowIndex = 0;
+		    RowIndex < PairRowCount;
+		    RowIndex += 2*WIDE_WIDTH)
+		{
+			wide_r32 Sum00 = Fresh ? WideZero() : WideLoad(Dest0 + RowIndex);
+			wide_r32 Sum01 = Fresh ? WideZero() : WideLoad(Dest1 + RowIndex);
+			wide_r32 Sum02 = Fresh ? WideZero() : WideLoad(Dest2 + RowIndex);
+			wide_r32 Sum03 = Fresh ? WideZero() : WideLoad(Dest3 + RowIndex);
+			wide_r32 Sum10 = Fresh ? WideZero() : WideLoad(Dest0 + RowIndex + WIDE_WIDTH);
+			wide_r32 Sum11 = Fresh ? WideZero() : WideLoad(Dest1 + RowIndex + WIDE_WIDTH);
+			wide_r32 Sum12 = Fresh ? WideZero() : WideLoad(Dest2 + RowIndex + WIDE_WIDTH);
+			wide_r32 Sum13 = Fresh ? WideZero() : WideLoad(Dest3 + RowIndex + WIDE_WIDTH);
+
+			for(u32 ColumnIndex = 0;
+			    ColumnIndex < ColumnCount;
+			    ++ColumnIndex)
+			{
+				r32 *Error = Errors + ColumnIndex*Stride + RowIndex;
+				r32 *Activation = Activations + ColumnIndex*ActivationStride + InnerIndex;
+				wide_r32 A0 = WideLoad(Error);
+				wide_r32 A1 = WideLoad(Error + WIDE_WIDTH);
+				wide_r32 B0 = WideSet1(Activation[0]);
+				wide_r32 B1 = WideSet1(Activation[1]);
+				wide_r32 B2 = WideSet1(Activation[2]);
+				wide_r32 B3 = WideSet1(Activation[3]);
+
+				Sum00 = WideMulAdd(A0, B0, Sum00);
+				Sum01 = WideMulAdd(A0, B1, Sum01);
+				Sum02 = WideMulAdd(A0, B2, Sum02);
+				Sum03 = WideMulAdd(A0, B3, Sum03);
+				Sum10 = WideMulAdd(A1, B0, Sum10);
+				Sum11 = WideMulAdd(A1, B1, Sum11);
+				Sum12 = WideMulAdd(A1, B2, Sum12);
+				Sum13 = WideMulAdd(A1, B3, Sum13);
+			}
+
+			WideStore(Dest0 + RowIndex, Sum00);
+			WideStore(Dest1 + RowIndex, Sum01);
+			WideStore(Dest2 + RowIndex, Sum02);
+			WideStore(Dest3 + RowIndex, Sum03);
+			WideStore(Dest0 + RowIndex + WIDE_WIDTH, Sum10);
+			WideStore(Dest1 + RowIndex + WIDE_WIDTH, Sum11);
+			WideStore(Dest2 + RowIndex + WIDE_WIDTH, Sum12);
+			WideStore(Dest3 + RowIndex + WIDE_WIDTH, Sum13);
+		}
+
+		if(PairRowCount < Stride)
+		{
+			u32 const RowIndex = PairRowCount;
+			wide_r32 Sum0 = Fresh ? WideZero() : WideLoad(Dest0 + RowIndex);
+			wide_r32 Sum1 = Fresh ? WideZero() : WideLoad(Dest1 + RowIndex);
+			wide_r32 Sum2 = Fresh ? WideZero() : WideLoad(Dest2 + RowIndex);
+			wide_r32 Sum3 = Fresh ? WideZero() : WideLoad(Dest3 + RowIndex);
+			for(u32 ColumnIndex = 0;
+			    ColumnIndex < ColumnCount;
+			    ++ColumnIndex)
+			{
+				r32 *Activation = Activations + ColumnIndex*ActivationStride + InnerIndex;
+				wide_r32 A0 = WideLoad(Errors + ColumnIndex*Stride + RowIndex);
+				Sum0 = WideMulAdd(A0, WideSet1(Activation[0]), Sum0);
+				Sum1 = WideMulAdd(A0, WideSet1(Activation[1]), Sum1);
+				Sum2 = WideMulAdd(A0, WideSet1(Activation[2]), Sum2);
+				Sum3 = WideMulAdd(A0, WideSet1(Activation[3]), Sum3);
+			}
+			WideStore(Dest0 + RowIndex, Sum0);
+			WideStore(Dest1 + RowIndex, Sum1);
+			WideStore(Dest2 + RowIndex, Sum2);
+			WideStore(Dest3 + RowIndex, Sum3);
+		}
+
+		UsedColumns[InnerIndex] = true;
+		UsedColumns[InnerIndex + 1] = true;
+		UsedColumns[InnerIndex + 2] = true;
+		UsedColumns[InnerIndex + 3] = true;
+	}
+
+	for(;
+	    InnerIndex < InnerCount;
+	    ++InnerIndex)
+	{
+		r32 *Dest = WeightGradients + InnerIndex*Stride;
+		b32 Fresh = !UsedColumns[InnerIndex];
+		for(u32 RowIndex = 0;
+		    RowIndex < Stride;
+		    RowIndex += WIDE_WIDTH)
+		{
+			wide_r32 Sum = Fresh ? WideZero() : WideLoad(Dest + RowIndex);
+			for(u32 ColumnIndex = 0;
+			    ColumnIndex < ColumnCount;
+			    ++ColumnIndex)
+			{
+				Sum = WideMulAdd(WideLoad(Errors + ColumnIndex*Stride + RowIndex),
+				                 WideSet1(Activations[ColumnIndex*ActivationStride + InnerIndex]), Sum);
+			}
+			WideStore(Dest + RowIndex, Sum);
+		}
+		UsedColumns[InnerIndex] = true;
+	}
+
+	for(u32 ColumnIndex = 0;
+	    ColumnIndex < ColumnCount;
+	    ++ColumnIndex)
+	{
+		r32 *Error = Errors + ColumnIndex*Stride;
+		for(u32 RowIndex = 0;
+		    RowIndex < Stride;
+		    RowIndex += WIDE_WIDTH)
+		{
+			WideStore(BiasGradients + RowIndex, WideAdd(WideLoad(BiasGradients + RowIndex), WideLoad(Error + RowIndex)));
+		}
+	}
+}
+
+template<u32 RowCount, u32 InnerCount>
+internal void
+WIDE_NAME(StaticAccumulateGradientsSparse)(r32 *WeightGradients, r32 *BiasGradients, r32 *Errors,
+                                           r32 *Activations, u32 ColumnCount, b32 *UsedColumns)
+{
+	// NOTE: For the input layer, SparseGemm's loop over the gradient columns.
+	//	Each one gathers the trials with a non-zero input there, then runs them
+	//	past four vectors of its rows at a time, from zero if it's the first
+	//	tile to touch the column. A column no trial touches is neither read
+	//	nor written, nor marked used.
+	u32 const Stride = STATIC_ROW_STRIDE(RowCount);
+	u32 const ActivationStride = STATIC_ROW_STRIDE(InnerCount);
+	u32 const GroupRowCount = (Stride / (4*WIDE_WIDTH))*(4*WIDE_WIDTH);
+	u32 const LastVectorCount = (Stride - GroupRowCount) / WIDE_WIDTH;
+
+	u32 Trials[STATIC_TILE_COLUMNS];
+	r32 Values[STATIC_TILE_COLUMNS];
+	for(u32 InnerIndex = 0;
+	    InnerIndex < InnerCount;
+	    ++InnerIndex)
+	{
+		u32 EntryCount = 0;
+		for(u32 ColumnIndex = 0;
+		    ColumnIndex < ColumnCount;
+		    ++ColumnIndex)
+		{
+			r32 Value = Activations[ColumnIndex*ActivationStride + InnerIndex];
+			Trials[EntryCount] = ColumnIndex;
+			Values[EntryCount] = Value;
+			EntryCount += (Value != 0.0f);
+		}
+		if(!EntryCount)
+		{
+			continue;
+		}
+		b32 Fresh = !UsedColumns[InnerIndex];
+		UsedColumns[InnerIndex] = true;
+
+		r32 *Dest = WeightGradients + InnerIndex*Stride;
+		for(u32 RowIndex = 0;
+		    RowIndex < GroupRowCount;
+		    RowIndex += 4*WIDE_WIDTH)
+		{
+			wide_r32 Sum0 = Fresh ? WideZero() : WideLoad(Dest + RowIndex);
+			wide_r32 Sum1 = Fresh ? WideZero() : WideLoad(Dest + RowIndex + WIDE_WIDTH);
+			wide_r32 Sum2 = Fresh ? WideZero() : WideLoad(Dest + RowIndex + 2*WIDE_WIDTH);
+			wide_r32 Sum3 = Fresh ? WideZero() : WideLoad(Dest + RowIndex + 3*WIDE_WIDTH);
+			for(u32 EntryIndex = 0;
+			    EntryIndex < EntryCount;
+			    ++EntryIndex)
+			{
+				r32 *Error = Errors + Trials[EntryIndex]*Stride + RowIndex;
+				wide_r32 Scale = WideSet1(Values[EntryIndex]);
+				Sum0 = WideMulAdd(WideLoad(Error), Scale, Sum0);
+				Sum1 = WideMulAdd(WideLoad(Error + WIDE_WIDTH), Scale, Sum1);
+				Sum2 = WideMulAdd(WideLoad(Error + 2*WIDE_WIDTH), Scale, Sum2);
+				Sum3 = WideMulAdd(WideLoad(Error + 3*WIDE_WIDTH), Scale, Sum3);
+			}
+			WideStore(Dest + RowIndex, Sum0);
+			WideStore(Dest + RowIndex + WIDE_WIDTH, Sum1);
+			WideStore(Dest + RowIndex + 2*WIDE_WIDTH, Sum2);
+			WideStore(Dest + RowIndex + 3*WIDE_WIDTH, Sum3);
+		}
+
+		if(LastVectorCount)
+		{
+			u32 const RowIndex = GroupRowCount;
+			wide_r32 Sum0 = Fresh ? WideZero() : WideLoad(Dest + RowIndex);
+			wide_r32 Sum1 = ((LastVectorCount > 1) && !Fresh) ? WideLoad(Dest + RowIndex + WIDE_WIDTH) : WideZero();
+			wide_r32 Sum2 = ((LastVectorCount > 2) && !Fresh) ? WideLoad(Dest + RowIndex + 2*WIDE_WIDTH) : WideZero();
+			for(u32 EntryIndex = 0;
+			    EntryIndex < EntryCount;
+			    ++EntryIndex)
+			{
+				r32 *Error = Errors + Trials[EntryIndex]*Stride + RowIndex;
+				wide_r32 Scale = WideSet1(Values[EntryIndex]);
+				Sum0 = WideMulAdd(WideLoad(Error), Scale, Sum0);
+				if(LastVectorCount > 1)
+				{
+					Sum1 = WideMulAdd(WideLoad(Error + WIDE_WIDTH), Scale, Sum1);
+				}
+				if(LastVectorCount > 2)
+				{
+					Sum2 = WideMulAdd(WideLoad(Error + 2*WIDE_WIDTH), Scale, Sum2);
+				}
+			}
+			WideStore(Dest + RowIndex, Sum0);
+			if(LastVectorCount > 1)
+			{
+				WideStore(Dest + RowIndex + WIDE_WIDTH, Sum1);
+			}
+			if(LastVectorCount > 2)
+			{
+				WideStore(Dest + RowIndex + 2*WIDE_WIDTH, Sum2);
+			}
+		}
+	}
+
+	for(u32 ColumnIndex = 0;
+	    ColumnIndex < ColumnCount;
+	    ++ColumnIndex)
+	{
+		r32 *Error = Errors + ColumnIndex*Stride;
+		for(u32 RowIndex = 0;
+		    RowIndex < Stride;
+		    RowIndex += WIDE_WIDTH)
+		{
+			WideStore(BiasGradients + RowIndex, WideAdd(WideLoad(BiasGradients + RowIndex), WideLoad(Error + RowIndex)));
+		}
+	}
+}
+
+// NOTE: Contraction is off here too, to stay bit for bit with the generic
+//	update's expression.
+#if defined(__GNUC__) && !defined(__clang__)
+	#pragma GCC push_options
+	#pragma GCC optimize("fp-contract=off")
+#endif
+
+template<u32 RowCount, u32 InnerCount>
+internal void
+WIDE_NAME(StaticUpdate)(r32 *Weights, r32 *Biases, r32 *WeightGradients, r32 *BiasGradients,
+                        r32 GradientScale, r32 WeightScale, b32 *UsedColumns)
+{
+	// NOTE: The generic update's expression, in one pass over each column.
+	//	Columns no trial touched only decay; their gradients are stale, and
+	//	the next batch's first touch starts them from zero again.
+	u32 const Stride = STATIC_ROW_STRIDE(RowCount);
+	wide_r32 WideGradientScale = WideSet1(GradientScale);
+	wide_r32 WideWeightScale = WideSet1(WeightScale);
+	for(u32 ColumnIndex = 0;
+	    ColumnIndex < InnerCount;
+	    ++ColumnIndex)
+	{
+		r32 *Weight = Weights + ColumnIndex*Stride;
+		if(UsedColumns[ColumnIndex])
+		{
+			r32 *WeightGradient = WeightGradients + ColumnIndex*Stride;
+			for(u32 RowIndex = 0;
+			    RowIndex < Stride;
+			    RowIndex += WIDE_WIDTH)
+			{
+				wide_r32 Decayed = WideMul(WideLoad(Weight + RowIndex), WideWeightScale);
+				wide_r32 Step = WideMul(WideLoad(WeightGradient + RowIndex), WideGradientScale);
+				WideStore(Weight + RowIndex, WideAdd(Decayed, Step));
+			}
+			UsedColumns[ColumnIndex] = false;
+		}
+		else
+		{
+			for(u32 RowIndex = 0;
+			    RowIndex < Stride;
+			    RowIndex += WIDE_WIDTH)
+			{
+				WideStore(Weight + RowIndex, WideMul(WideLoad(Weight + RowIndex), WideWeightScale));
+			}
+		}
+	}
+
+	for(u32 RowIndex = 0;
+	    RowIndex < Stride;
+	    RowIndex += WIDE_WIDTH)
+	{
+		wide_r32 Step = WideMul(WideLoad(BiasGradients + RowIndex), WideGradientScale);
+		WideStore(Biases + RowIndex, WideAdd(WideLoad(Biases + RowIndex), Step));
+		WideStore(BiasGradients + RowIndex, WideZero());
+	}
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+	#pragma GCC pop_options
+#endif
+
+#undef WIDE_OPERAND
+#undef WIDE_RESULT
+#undef WIDE_ELEMENTWISE_LOOP
+
+#undef WIDE_NAME
+#undef WIDE_WIDTH
+#undef wide_r32
+#undef wide_s32
+#undef WideZero
+#undef WideSet1
+#undef WideLoad
+#undef WideStore
+#undef WideAdd
+#undef WideSub
+#undef WideMul
+#undef WideDiv
+#undef WideMin
+#undef WideMax
+#undef WideMulAdd
+#undef WideRoundNearest
+#undef WideHorizontalAdd
+#undef WideConvertToS32
+#undef WideCastToR32
+#undef WideS32Set1
+#undef WideS32Add
+#undef WideS32ShiftLeft
+#undef WideNonZeroBits
+#undef WideSelectPositive
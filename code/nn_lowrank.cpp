@@ -0,0 +1,308 @@
+
+/*
+	NOTE: Low-rank factorization of trained weights. Each weight matrix W is
+		replaced by Left*Right through a rank r, so inference costs
+		2*r*(rows + columns) flops per input instead of 2*rows*columns.
+
+	The factors come from a randomized range finder: W times a Gaussian
+		sketch, sharpened by a couple of power iterations, spans W's dominant
+		column space Q. Q'*W is then only a few rows tall, and the eigenvectors
+		of its small Gram matrix give the truncated SVD in that space:
+
+		W ~= Q*U*U'*Q'*W, so Left = Q*U (orthonormal) and Right = U'*Q'*W.
+
+	-lowrank picks the rank and -lowrankenergy the smallest rank that keeps
+		that fraction of W's squared Frobenius norm. A layer whose factors
+		would be no smaller than W stays dense.
+*/
+
+#define LOW_RANK_OVERSAMPLING 10
+#define LOW_RANK_POWER_ITERATIONS 2
+
+global_variable u32 LowRankReportRanks[] = {0, 64, 32, 16, 8, 4};
+
+struct low_rank_factors
+{
+	u32 Rank;
+	r32 Energy;
+	matrix Left;
+	matrix Right;
+};
+
+internal low_rank_factors
+FactorWeights(memory_pool *Pool, matrix Weights, u32 Rank, r32 Energy, u32 Seed)
+{
+	TIMED_BLOCK("FactorWeights", 0, 0);
+
+	u32 RowCount = Weights.RowCount;
+	u32 ColumnCount = Weights.ColumnCount;
+	u32 MaxRank = Minimum(RowCount, ColumnCount);
+
+	// NOTE: Without a rank to aim for the sketch covers the whole range,
+	//	which makes it an exact SVD.
+	u32 SampleCount = MaxRank;
+	if(Rank && ((Rank + LOW_RANK_OVERSAMPLING) < MaxRank))
+	{
+		SampleCount = Rank + LOW_RANK_OVERSAMPLING;
+	}
+
+	// NOTE: The factors are pushed at full sample size before the temporaries
+	//	and trimmed to the chosen rank once it is known.
+	low_rank_factors Result = {};
+	Result.Left = MatrixRaw_(Pool, RowCount, SampleCount);
+	Result.Right = MatrixRaw_(Pool, SampleCount, ColumnCount);
+
+	temp_memory TempMem = PoolBeginTempMemory(Pool);
+
+	random_series Random = SeedRandom(Seed);
+	matrix Sketch = MatrixRaw_(Pool, ColumnCount, SampleCount);
+	for(u32 SampleIndex = 0;
+	    SampleIndex < SampleCount;
+	    ++SampleIndex)
+	{
+		r32 *Dest = MatrixColumnData(Sketch, SampleIndex);
+		for(u32 Index = 0;
+		    Index < ColumnCount;
+		    ++Index)
+		{
+			*Dest++ = RandomGaussian(0.0f, 1.0f, &Random);
+		}
+	}
+
+	matrix Range = Mult(Pool, Weights, Sketch);
+	matrix CoRange = MatrixRaw_(Pool, ColumnCount, SampleCount);
+	for(u32 Iteration = 0;
+	    Iteration < LOW_RANK_POWER_ITERATIONS;
+	    ++Iteration)
+	{
+		OrthonormalizeColumns(Range);
+		TransposeMultInto(CoRange, Weights, Range);
+		OrthonormalizeColumns(CoRange);
+		MultInto(Range, Weights, CoRange);
+	}
+	OrthonormalizeColumns(Range);
+
+	matrix Projected = TransposeMult(Pool, Range, Weights);
+	matrix Gram = MultTranspose(Pool, Projected, Projected);
+
+	r64 *GramValues = PoolPushArray(Pool, r64, (umm)SampleCount*SampleCount);
+	r64 *EigenVectors = PoolPushArray(Pool, r64, (umm)SampleCount*SampleCount);
+	r64 *EigenValues = PoolPushArray(Pool, r64, SampleCount);
+	for(u32 Column = 0;
+	    Column < SampleCount;
+	    ++Column)
+	{
+		for(u32 Row = 0;
+		    Row < SampleCount;
+		    ++Row)
+		{
+			GramValues[Column*SampleCount + Row] = MatrixColumnData(Gram, Column)[Row];
+		}
+	}
+	SymmetricEigen(GramValues, EigenVectors, EigenValues, SampleCount);
+
+	r64 TotalEnergy = 0.0;
+	for(u32 ColumnIndex = 0;
+	    ColumnIndex < ColumnCount;
+	    ++ColumnIndex)
+	{
+		r32 *Source = MatrixColumnData(Weights, ColumnIndex);
+		for(u32 RowIndex = 0;
+		    RowIndex < RowCount;
+		    ++RowIndex)
+		{
+			TotalEnergy += (r64)Source[RowIndex]*Source[RowIndex];
+		}
+	}
+
+	u32 KeptRank = 0;
+	r64 KeptEnergy = 0.0;
+	u32 TargetRank = Rank ? Minimum(Rank, SampleCount) : SampleCount;
+	while(KeptRank < TargetRank)
+	{
+		if(!Rank && (KeptEnergy >= Energy*TotalEnergy))
+		{
+			break;
+		}
+		KeptEnergy += Maximum(EigenValues[KeptRank], 0.0);
+		++KeptRank;
+	}
+
+	Result.Rank = KeptRank;
+	Result.Energy = (TotalEnergy > 0.0) ? (r32)(KeptEnergy / TotalEnergy) : 1.0f;
+
+	matrix Basis = MatrixRaw_(Pool, SampleCount, KeptRank);
+	for(u32 Column = 0;
+	    Column < KeptRank;
+	    ++Column)
+	{
+		r32 *Dest = MatrixColumnData(Basis, Column);
+		for(u32 Row = 0;
+		    Row < SampleCount;
+		    ++Row)
+		{
+			*Dest++ = (r32)EigenVectors[Column*SampleCount + Row];
+		}
+	}
+
+	Result.Left = MatrixColumns(Result.Left, 0, KeptRank);
+	Result.Right = SubMatrix(Result.Right, 0, 0, KeptRank, ColumnCount);
+	MultInto(Result.Left, Range, Basis);
+	TransposeMultInto(Result.Right, Basis, Projected);
+
+	PoolEndTempMemory(TempMem);
+	return Result;
+}
+
+internal void
+FactorNetwork(memory_pool *Pool, neural_network *Network, u32 Rank, r32 Energy, b32 Quiet = false)
+{
+	TRACE_BLOCK("Factor");
+
+	// NOTE: The product of the factors is dense, so any pruning is undone.
+	Network->WeightMasks = 0;
+	Network->BlockSparseWeights = 0;
+
+	Network->Ranks = PoolPushArray(Pool, u32, Network->LayerCount);
+	Network->LeftFactors = PoolPushArray(Pool, matrix, Network->LayerCount);
+	Network->RightFactors = PoolPushArray(Pool, matrix, Network->LayerCount);
+	Network->Ranks[0] = 0;
+
+	for(u32 LayerIndex = 1;
+	    LayerIndex < Network->LayerCount;
+	    ++LayerIndex)
+	{
+		matrix Weights = Network->WeightMatrices[LayerIndex];
+		low_rank_factors Factors = FactorWeights(Pool, Weights, Rank, Energy, DEFAULT_SEED + LayerIndex);
+
+		u32 DenseCount = Weights.RowCount*Weights.ColumnCount;
+		u32 FactoredCount = Factors.Rank*(Weights.RowCount + Weights.ColumnCount);
+		if(FactoredCount < DenseCount)
+		{
+			Network->Ranks[LayerIndex] = Factors.Rank;
+			Network->LeftFactors[LayerIndex] = Factors.Left;
+			Network->RightFactors[LayerIndex] = Factors.Right;
+			Network->WeightMatrices[LayerIndex] = Mult(Pool, Factors.Left, Factors.Right);
+		}
+		else
+		{
+			Network->Ranks[LayerIndex] = 0;
+		}
+
+		if(!Quiet)
+		{
+			if(Network->Ranks[LayerIndex])
+			{
+				printf("Layer %u: %ux%u factored at rank %u, keeping %.2f%% of the energy\n",
+				       LayerIndex, Weights.RowCount, Weights.ColumnCount, Factors.Rank, 100.0f*Factors.Energy);
+			}
+			else
+			{
+				printf("Layer %u: %ux%u left dense, rank %u would not shrink it\n",
+				       LayerIndex, Weights.RowCount, Weights.ColumnCount, Factors.Rank);
+			}
+		}
+	}
+}
+
+internal u64
+NetworkFlopsPerInput(neural_network Network)
+{
+	u64 Result = 0;
+	for(u32 LayerIndex = 1;
+	    LayerIndex < Network.LayerCount;
+	    ++LayerIndex)
+	{
+		u64 RowCount = Network.Layers[LayerIndex];
+		u64 ColumnCount = Network.Layers[LayerIndex - 1];
+		if(Network.Ranks && Network.Ranks[LayerIndex])
+		{
+			Result += 2*Network.Ranks[LayerIndex]*(RowCount + ColumnCount);
+		}
+		else
+		{
+			Result += 2*RowCount*ColumnCount;
+		}
+	}
+
+	return Result;
+}
+
+internal void
+ReportLowRank(memory_pool *Pool, parallel_context *Parallel, neural_network Network, data_set TestSet)
+{
+	TRACE_BLOCK("Low-rank report");
+
+	// NOTE: Every rank factors a fresh copy of the network as it is now. Rank
+	//	0 is the exact SVD, kept at full rank. Energy is the share of all the
+	//	weights' squared norm that the factors keep, and the flops are the
+	//	weight products' per input, ignoring sparse inputs.
+	printf("Low-rank report, %u test images:\n", TestSet.DataCount);
+	printf("  %5s %7s %9s %7s %6s %8s %9s %12s %8s\n",
+	       "rank", "energy", "flops", "flops", "size", "success", "dense ms", "factored ms", "speedup");
+
+	u64 DenseFlops = NetworkFlopsPerInput(Network);
+	u32 DenseSize = NetworkGetTotalFileSize(Network);
+	for(u32 RankIndex = 0;
+	    RankIndex < ArrayCount(LowRankReportRanks);
+	    ++RankIndex)
+	{
+		u32 Rank = LowRankReportRanks[RankIndex];
+		temp_memory TempMem = PoolBeginTempMemory(Pool);
+
+		neural_network Factored = CopyNetwork(Pool, Network);
+		FactorNetwork(Pool, &Factored, Rank, 1.0f, true);
+
+		r64 KeptEnergy = 0.0;
+		r64 TotalEnergy = 0.0;
+		for(u32 LayerIndex = 1;
+		    LayerIndex < Factored.LayerCount;
+		    ++LayerIndex)
+		{
+			matrix Original = Network.WeightMatrices[LayerIndex];
+			matrix Approximation = Factored.WeightMatrices[LayerIndex];
+			for(u32 ColumnIndex = 0;
+			    ColumnIndex < Original.ColumnCount;
+			    ++ColumnIndex)
+			{
+				r32 *OriginalValue = MatrixColumnData(Original, ColumnIndex);
+				r32 *ApproximationValue = MatrixColumnData(Approximation, ColumnIndex);
+				for(u32 RowIndex = 0;
+				    RowIndex < Original.RowCount;
+				    ++RowIndex)
+				{
+					r64 Difference = (r64)OriginalValue[RowIndex] - ApproximationValue[RowIndex];
+					TotalEnergy += (r64)OriginalValue[RowIndex]*OriginalValue[RowIndex];
+					KeptEnergy -= Difference*Difference;
+				}
+			}
+		}
+		KeptEnergy += TotalEnergy;
+
+		u64 Flops = NetworkFlopsPerInput(Factored);
+		r32 SizeRatio = (r32)NetworkGetTotalFileSize(Factored, NetworkFormat_LowRank) / (r32)DenseSize;
+		r32 SuccessRatePercent = EvaluateNetwork(Pool, Parallel, Factored, TestSet);
+		r32 FactoredSeconds = TimeInference(Pool, Parallel, Factored, TestSet);
+		u32 *Ranks = Factored.Ranks;
+		Factored.Ranks = 0;
+		r32 DenseSeconds = TimeInference(Pool, Parallel, Factored, TestSet);
+		Factored.Ranks = Ranks;
+
+		char RankName[16];
+		if(Rank)
+		{
+			snprintf(RankName, sizeof(RankName), "%u", Rank);
+		}
+		else
+		{
+			snprintf(RankName, sizeof(RankName), "full");
+		}
+
+		printf("  %5s %6.2f%% %9llu %6.2fx %5.2fx %7.2f%% %9.2f %12.2f %7.2fx\n",
+		       RankName, 100.0*KeptEnergy/TotalEnergy, (unsigned long long)Flops,
+		       (r32)DenseFlops/(r32)Flops, SizeRatio, SuccessRatePercent,
+		       1000.0f*DenseSeconds, 1000.0f*FactoredSeconds, DenseSeconds/FactoredSeconds);
+
+		PoolEndTempMemory(TempMem);
+	}
+}
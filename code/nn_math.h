@@ -1,637 +1,1643 @@
-
-#pragma once
-
-struct vec
-{
-	r32 *Data;
-	u32 Dimension;
-};
-
-inline vec
-VecRaw_(memory_pool *Pool, u32 Dimension)
-{
-	vec Result = {};
-	Result.Data = PoolPushArray(Pool, r32, Dimension);
-	Result.Dimension = Dimension;
-	return Result;
-}
-
-inline vec
-Vec(memory_pool *Pool, r32 *Data, u32 Dimension)
-{
-	vec Result = VecRaw_(Pool, Dimension);
-
-	for(u32 Index = 0;
-	    Index < Result.Dimension;
-	    ++Index)
-	{
-		r32 *Value = Result.Data + Index;
-		*Value = *(Data + Index);
-	}
-
-	return Result;
-}
-
-inline vec
-Vec(r32 *Data, u32 Dimension)
-{
-	vec Result = {};
-	Result.Data = Data;
-	Result.Dimension = Dimension;
-	return Result;
-}
-
-inline vec
-VecRand(memory_pool *Pool, u32 Dimension, r32 Mean, r32 StandardDeviation)
-{
-	vec Result = VecRaw_(Pool, Dimension);
-
-	for(u32 Index = 0;
-	    Index < Result.Dimension;
-	    ++Index)
-	{
-		r32 *Value = Result.Data + Index;
-		*Value = RandomGaussian(Mean, StandardDeviation);
-	}
-
-	return Result;	
-}
-
-inline vec
-VecZero(memory_pool *Pool, u32 Dimension)
-{
-	vec Result = VecRaw_(Pool, Dimension);
-
-	for(u32 Index = 0;
-	    Index < Result.Dimension;
-	    ++Index)
-	{
-		r32 *Value = Result.Data + Index;
-		*Value = 0.0f;
-	}
-
-	return Result;
-}
-
-inline vec
-Hadamard(memory_pool *Pool, vec A, vec B)
-{
-	Assert(A.Dimension == B.Dimension);
-
-	vec Result = VecRaw_(Pool, A.Dimension);
-
-	for(u32 Index = 0;
-	    Index < Result.Dimension;
-	    ++Index)
-	{
-		r32 *Value = Result.Data + Index;
-		*Value = *(A.Data + Index) * *(B.Data + Index);
-	}
-
-	return Result;
-}
-
-inline vec
-Plus(memory_pool *Pool, vec A, vec B)
-{
-	Assert(A.Dimension == B.Dimension);
-	
-	vec Result = VecRaw_(Pool, A.Dimension);
-	
-	for(u32 Index = 0;
-	    Index < Result.Dimension;
-	    ++Index)
-	{
-		r32 *Value = Result.Data + Index;
-		*Value = *(A.Data + Index) + *(B.Data + Index);
-	}
-
-	return Result;
-}
-
-inline vec
-Minus(memory_pool *Pool, vec A, vec B)
-{
-	Assert(A.Dimension == B.Dimension);
-	
-	vec Result = VecRaw_(Pool, A.Dimension);
-	
-	for(u32 Index = 0;
-	    Index < Result.Dimension;
-	    ++Index)
-	{
-		r32 *Value = Result.Data + Index;
-		*Value = *(A.Data + Index) - *(B.Data + Index);
-	}
-
-	return Result;
-}
-
-inline r32
-InnerProduct(vec A, vec B)
-{
-	Assert(A.Dimension == B.Dimension);
-
-	r32 Result = 0.0f;
-	for(u32 Index = 0;
-	    Index < A.Dimension;
-	    ++Index)
-	{
-		r32 *AValue = A.Data + Index;
-		r32 *BValue = B.Data + Index;
-		Result += *AValue * *BValue;
-	}
-
-	return Result;
-}
-
-inline vec
-Sigmoid(memory_pool *Pool, vec V)
-{
-	vec Result = VecRaw_(Pool, V.Dimension);
-
-	r32 *NewValue = Result.Data;
-	r32 *OldValue = V.Data;
-	for(u32 Index = 0;
-	    Index < Result.Dimension;
-	    ++Index)
-	{
-		*NewValue++ = Sigmoid(*OldValue++);
-	}
-
-	return Result;
-}
-
-inline vec
-SigmoidPrime(memory_pool *Pool, vec V)
-{
-	vec Result = VecRaw_(Pool, V.Dimension);
-
-	r32 *NewValue = Result.Data;
-	r32 *OldValue = V.Data;
-	for(u32 Index = 0;
-	    Index < Result.Dimension;
-	    ++Index)
-	{
-		*NewValue++ = SigmoidPrime(*OldValue++);
-	}
-
-	return Result;
-}
-
-inline void
-VectorScaleEquals(r32 Scale, vec V)
-{
-	for(u32 Index = 0;
-	    Index < V.Dimension;
-	    ++Index)
-	{
-		V.Data[Index] *= Scale;
-	}
-}
-
-inline void
-VectorPlusEquals(vec A, vec B)
-{
-	Assert(A.Dimension == B.Dimension);
-
-	for(u32 Index = 0;
-	    Index < A.Dimension;
-	    ++Index)
-	{
-		A.Data[Index] += B.Data[Index];
-	}
-}
-
-struct matrix
-{
-	u32 RowCount;
-	u32 ColumnCount;
-	r32 *Data;
-};
-
-inline matrix
-MatrixRaw_(memory_pool *Pool, u32 Rows, u32 Columns)
-{
-	matrix Result = {};
-	Result.Data = PoolPushArray(Pool, r32, Rows*Columns);
-	Result.ColumnCount = Columns;
-	Result.RowCount = Rows;
-	return Result;
-}
-
-inline matrix
-Matrix(memory_pool *Pool, r32 *Data, u32 Rows, u32 Columns)
-{
-	matrix Result = MatrixRaw_(Pool, Rows, Columns);;
-
-	r32 *ColData = Data;
-	r32 *ColDest = Result.Data;
-	for(u32 ColumnIndex = 0;
-	    ColumnIndex < Result.ColumnCount;
-	    ++ColumnIndex)
-	{
-		r32 *Source = ColData;
-		r32 *Dest = ColDest;
-		for(u32 RowIndex = 0;
-		    RowIndex < Result.RowCount;
-		    ++RowIndex)
-		{
-			*Dest++ = *Source++;
-		}
-
-		ColData += Rows;
-		ColDest += Result.RowCount;
-	}
-
-	return Result;
-}
-
-inline matrix
-Matrix(r32 *Data, u32 Rows, u32 Columns)
-{
-	matrix Result = {};
-	Result.Data = Data;
-	Result.ColumnCount = Columns;
-	Result.RowCount = Rows;
-	return Result;
-}
-
-inline matrix
-MatrixRand(memory_pool *Pool, u32 Rows, u32 Columns,
-           r32 Mean, r32 StandardDeviation)
-{
-	matrix Result = MatrixRaw_(Pool, Rows, Columns);
-
-	r32 *ColDest = Result.Data;
-	for(u32 ColumnIndex = 0;
-	    ColumnIndex < Result.ColumnCount;
-	    ++ColumnIndex)
-	{
-		r32 *Dest = ColDest;
-		for(u32 RowIndex = 0;
-		    RowIndex < Result.RowCount;
-		    ++RowIndex)
-		{
-			*Dest++ = RandomGaussian(Mean, StandardDeviation);
-		}
-
-		ColDest += Result.RowCount;
-	}
-
-	return Result;
-}
-
-inline vec
-Mult(memory_pool *Pool, matrix M, vec V)
-{
-	Assert(M.ColumnCount == V.Dimension);
-
-	vec Result = VecRaw_(Pool, M.RowCount);
-
-	r32 *Value = Result.Data;
-	for(u32 RowIndex = 0;
-	    RowIndex < M.RowCount;
-	    ++RowIndex)
-	{
-		r32 *MatValue = M.Data + RowIndex;
-		r32 *VValue = V.Data;
-	
-		*Value = 0.0f;
-		for(u32 ColumnIndex = 0;
-		    ColumnIndex < M.ColumnCount;
-		    ++ColumnIndex)
-		{
-			*Value += *MatValue * *VValue;
-			++VValue;
-			MatValue += M.RowCount;
-		}
-
-		++Value;
-	}
-
-	return Result;
-}
-
-inline vec
-TransposeMult(memory_pool *Pool, matrix M, vec V)
-{
-	Assert(M.RowCount == V.Dimension);
-
-	vec Result = VecRaw_(Pool, M.ColumnCount);
-
-	r32 *Value = Result.Data;
-	for(u32 ColumnIndex = 0;
-	    ColumnIndex < M.ColumnCount;
-	    ++ColumnIndex)
-	{
-		r32 *MatValue = M.Data + ColumnIndex*M.RowCount;
-		r32 *VValue = V.Data;
-
-		*Value = 0.0f;
-		for(u32 RowIndex = 0;
-		    RowIndex < M.RowCount;
-		    ++RowIndex)
-		{
-			*Value += *MatValue++ * *VValue++;
-		}
-
-		++Value;
-	}
-
-	return Result;	
-}
-
-inline matrix
-Transpose(memory_pool *Pool, matrix M)
-{
-	matrix Result = MatrixRaw_(Pool, M.ColumnCount, M.RowCount);
-
-	for(u32 ColumnIndex = 0;
-	    ColumnIndex < M.ColumnCount;
-	    ++ColumnIndex)
-	{
-		r32 *Source = M.Data + ColumnIndex*M.RowCount;
-		for(u32 RowIndex = 0;
-		    RowIndex < M.RowCount;
-		    ++RowIndex)
-		{
-			r32 *Dest = Result.Data + RowIndex*Result.RowCount + ColumnIndex;
-			*Dest = *Source++;
-		}
-	}
-
-	return Result;
-}
-
-inline matrix
-Mult(memory_pool *Pool, matrix A, matrix B)
-{
-	Assert(A.ColumnCount == B.RowCount);
-
-	matrix Result = MatrixRaw_(Pool, A.RowCount, B.ColumnCount);
-
-	r32 *Dest = Result.Data;
-	for(u32 ColumnIndex = 0;
-	    ColumnIndex < Result.ColumnCount;
-	    ++ColumnIndex)
-	{
-		for(u32 RowIndex = 0;
-		    RowIndex < Result.RowCount;
-		    ++RowIndex)
-		{
-			*Dest = 0.0f;
-			r32 *SourceA = A.Data + RowIndex;
-			r32 *SourceB = B.Data + ColumnIndex*B.RowCount;
-			for(u32 InnerIndex = 0;
-			    InnerIndex < A.ColumnCount;
-			    ++InnerIndex)
-			{
-				*Dest += *SourceA * *SourceB;
-				SourceA += A.RowCount;
-				++SourceB;
-			}
-			++Dest;
-		}
-	}
-
-	return Result;
-}
-
-inline matrix
-VectorTransposeMult(memory_pool *Pool, vec A, vec B)
-{
-	matrix Result = MatrixRaw_(Pool, A.Dimension, B.Dimension);
-
-	r32 *Dest = Result.Data;
-	for(u32 ColumnIndex = 0;
-	    ColumnIndex < Result.ColumnCount;
-	    ++ColumnIndex)
-	{
-		for(u32 RowIndex = 0;
-		    RowIndex < Result.RowCount;
-		    ++RowIndex)
-		{
-			*Dest++ = A.Data[RowIndex]*B.Data[ColumnIndex]; 
-		}
-	}
-
-	return Result;
-}
-
-inline void
-MatrixPlusEquals(matrix A, matrix B)
-{
-	Assert(A.RowCount == B.RowCount);
-	Assert(A.ColumnCount == B.ColumnCount);
-
-	r32 *AValue = A.Data;
-	r32 *BValue = B.Data;
-	for(u32 Index = 0;
-	    Index < (A.RowCount*A.ColumnCount);
-	    ++Index)
-	{
-		*AValue++ += *BValue++;
-	}	
-}
-
-inline void
-MatrixScaleEquals(r32 Scale, matrix A)
-{
-	r32 *Dest = A.Data;
-	for(u32 Index = 0;
-	    Index < (A.RowCount*A.ColumnCount);
-	    ++Index)
-	{
-		*Dest++ *= Scale;
-	}
-}
-
-inline matrix
-MVPlus(memory_pool *Pool, matrix A, vec V)
-{
-	Assert(V.Dimension == A.RowCount);
-
-	matrix Result = MatrixRaw_(Pool, A.RowCount, A.ColumnCount);
-
-	r32 *Value = Result.Data;
-	r32 *MValue = A.Data;
-	for(u32 ColumnIndex = 0;
-	    ColumnIndex < Result.ColumnCount;
-	    ++ColumnIndex)
-	{
-		r32 *VValue = V.Data;
-		for(u32 RowIndex = 0;
-		    RowIndex < Result.RowCount;
-		    ++RowIndex)
-		{
-			*Value++ = *MValue++ + *VValue++;
-		}
-	}
-
-	return Result;
-}
-
-inline matrix
-Sigmoid(memory_pool *Pool, matrix M)
-{
-	matrix Result = MatrixRaw_(Pool, M.RowCount, M.ColumnCount);
-
-	r32 *NewValue = Result.Data;
-	r32 *OldValue = M.Data;
-	for(u32 Index = 0;
-	    Index < (Result.RowCount * Result.ColumnCount);
-	    ++Index)
-	{
-		*NewValue++ = Sigmoid(*OldValue++);
-	}
-
-	return Result;
-}
-
-inline matrix
-SigmoidPrime(memory_pool *Pool, matrix M)
-{
-	matrix Result = MatrixRaw_(Pool, M.RowCount, M.ColumnCount);
-
-	r32 *NewValue = Result.Data;
-	r32 *OldValue = M.Data;
-	for(u32 Index = 0;
-	    Index < (Result.RowCount * Result.ColumnCount);
-	    ++Index)
-	{
-		*NewValue++ = SigmoidPrime(*OldValue++);
-	}
-
-	return Result;
-}
-
-inline matrix
-Minus(memory_pool *Pool, matrix A, matrix B)
-{
-	Assert((A.RowCount == B.RowCount) && (A.ColumnCount == B.ColumnCount));
-
-	matrix Result = MatrixRaw_(Pool, A.RowCount, A.ColumnCount);
-
-	r32 *AData = A.Data;
-	r32 *BData = B.Data;
-	r32 *ResultData = Result.Data;
-	for(u32 Index = 0;
-	    Index < (A.RowCount * A.ColumnCount);
-	    ++Index)
-	{
-		*ResultData++ = *AData++ - *BData++;
-	}
-
-	return Result;
-}
-
-inline matrix
-Hadamard(memory_pool *Pool, matrix A, matrix B)
-{
-	Assert((A.RowCount == B.RowCount) && (A.ColumnCount == B.ColumnCount));
-
-	matrix Result = MatrixRaw_(Pool, A.RowCount, A.ColumnCount);
-
-	r32 *AData = A.Data;
-	r32 *BData = B.Data;
-	r32 *ResultData = Result.Data;
-	for(u32 Index = 0;
-	    Index < (A.RowCount * A.ColumnCount);
-	    ++Index)
-	{
-		*ResultData++ = *AData++ * *BData++;
-	}
-
-	return Result;
-}
-
-inline matrix
-TransposeMult(memory_pool *Pool, matrix A, matrix B)
-{
-	Assert(A.RowCount == B.RowCount);
-
-	matrix Result = MatrixRaw_(Pool, A.ColumnCount, B.ColumnCount);
-	
-	r32 *Dest = Result.Data;
-	for(u32 ColumnIndex = 0;
-	    ColumnIndex < Result.ColumnCount;
-	    ++ColumnIndex)
-	{
-		for(u32 RowIndex = 0;
-		    RowIndex < Result.RowCount;
-		    ++RowIndex)
-		{
-			*Dest = 0.0f;
-			r32 *SourceA = A.Data + RowIndex*A.RowCount;
-			r32 *SourceB = B.Data + ColumnIndex*B.RowCount;
-			for(u32 InnerIndex = 0;
-			    InnerIndex < A.RowCount;
-			    ++InnerIndex)
-			{
-				*Dest += *SourceA * *SourceB;
-				++SourceA;
-				++SourceB;
-			}
-			++Dest;
-		}
-	}
-
-	return Result;
-}
-
-inline matrix
-MultTranspose(memory_pool *Pool, matrix A, matrix B)
-{
-	Assert(A.ColumnCount == B.ColumnCount);
-
-	matrix Result = MatrixRaw_(Pool, A.RowCount, B.RowCount);
-	
-	r32 *Dest = Result.Data;
-	for(u32 ColumnIndex = 0;
-	    ColumnIndex < Result.ColumnCount;
-	    ++ColumnIndex)
-	{
-		for(u32 RowIndex = 0;
-		    RowIndex < Result.RowCount;
-		    ++RowIndex)
-		{
-			*Dest = 0.0f;
-			r32 *SourceA = A.Data + RowIndex;
-			r32 *SourceB = B.Data + ColumnIndex;
-			for(u32 InnerIndex = 0;
-			    InnerIndex < A.ColumnCount;
-			    ++InnerIndex)
-			{
-				*Dest += *SourceA * *SourceB;
-				SourceA += A.RowCount;
-				SourceB += B.RowCount;
-			}
-			++Dest;
-		}
-	}
-
-	return Result;
-}
-
-inline vec
-MatrixSumColumns(memory_pool *Pool, matrix A)
-{
-	vec Result = VecZero(Pool, A.RowCount);
-
-	r32 *AData = A.Data;
-	for(u32 ColumnIndex = 0;
-	    ColumnIndex < A.ColumnCount;
-	    ++ColumnIndex)
-	{
-		r32 *VData = Result.Data;
-		for(u32 RowIndex = 0;
-		    RowIndex < A.RowCount;
-		    ++RowIndex)
-		{
-			*VData++ += *AData++;
-		}
-	}
-
-	return Result;
-}
\ No newline at end of file
+
+#pragma once
+
+struct vec
+{
+	r32 *Data;
+	u32 Dimension;
+};
+
+inline vec
+VecRawAt(char *Site, memory_pool *Pool, u32 Dimension)
+{
+	vec Result = {};
+	Result.Data = PoolPushArrayAlignedAt(Site, Pool, r32, Dimension);
+	Result.Dimension = Dimension;
+	return Result;
+}
+#define VecRaw_(...) VecRawAt(POOL_CALL_SITE, __VA_ARGS__)
+
+inline vec
+Vec(memory_pool *Pool, r32 *Data, u32 Dimension)
+{
+	vec Result = VecRaw_(Pool, Dimension);
+
+	for(u32 Index = 0;
+	    Index < Result.Dimension;
+	    ++Index)
+	{
+		r32 *Value = Result.Data + Index;
+		*Value = *(Data + Index);
+	}
+
+	return Result;
+}
+
+inline vec
+Vec(r32 *Data, u32 Dimension)
+{
+	vec Result = {};
+	Result.Data = Data;
+	Result.Dimension = Dimension;
+	return Result;
+}
+
+inline vec
+VecRandAt(char *Site, memory_pool *Pool, u32 Dimension, r32 Mean, r32 StandardDeviation)
+{
+	vec Result = VecRawAt(Site, Pool, Dimension);
+
+	for(u32 Index = 0;
+	    Index < Result.Dimension;
+	    ++Index)
+	{
+		r32 *Value = Result.Data + Index;
+		*Value = RandomGaussian(Mean, StandardDeviation);
+	}
+
+	return Result;	
+}
+#define VecRand(...) VecRandAt(POOL_CALL_SITE, __VA_ARGS__)
+
+inline vec
+VecZeroAt(char *Site, memory_pool *Pool, u32 Dimension)
+{
+	vec Result = VecRawAt(Site, Pool, Dimension);
+
+	for(u32 Index = 0;
+	    Index < Result.Dimension;
+	    ++Index)
+	{
+		r32 *Value = Result.Data + Index;
+		*Value = 0.0f;
+	}
+
+	return Result;
+}
+#define VecZero(...) VecZeroAt(POOL_CALL_SITE, __VA_ARGS__)
+
+inline vec
+HadamardAt(char *Site, memory_pool *Pool, vec A, vec B)
+{
+	TIMED_BLOCK("Hadamard(vec, vec)", 3*A.Dimension*sizeof(r32), A.Dimension);
+
+	Assert(A.Dimension == B.Dimension);
+
+	vec Result = VecRawAt(Site, Pool, A.Dimension);
+
+	GlobalMathKernels.Multiply(Result.Data, A.Data, B.Data, Result.Dimension);
+
+	return Result;
+}
+
+inline vec
+PlusAt(char *Site, memory_pool *Pool, vec A, vec B)
+{
+	TIMED_BLOCK("Plus(vec, vec)", 3*A.Dimension*sizeof(r32), A.Dimension);
+
+	Assert(A.Dimension == B.Dimension);
+	
+	vec Result = VecRawAt(Site, Pool, A.Dimension);
+	
+	GlobalMathKernels.Add(Result.Data, A.Data, B.Data, Result.Dimension);
+
+	return Result;
+}
+#define Plus(...) PlusAt(POOL_CALL_SITE, __VA_ARGS__)
+
+inline vec
+MinusAt(char *Site, memory_pool *Pool, vec A, vec B)
+{
+	TIMED_BLOCK("Minus(vec, vec)", 3*A.Dimension*sizeof(r32), A.Dimension);
+
+	Assert(A.Dimension == B.Dimension);
+	
+	vec Result = VecRawAt(Site, Pool, A.Dimension);
+	
+	GlobalMathKernels.Subtract(Result.Data, A.Data, B.Data, Result.Dimension);
+
+	return Result;
+}
+
+inline r32
+InnerProduct(vec A, vec B)
+{
+	TIMED_BLOCK("InnerProduct", 2*A.Dimension*sizeof(r32), 2*A.Dimension);
+
+	Assert(A.Dimension == B.Dimension);
+
+	r32 Result = GlobalMathKernels.Dot(A.Data, B.Data, A.Dimension);
+
+	return Result;
+}
+
+inline vec
+Sigmoid(memory_pool *Pool, vec V)
+{
+	TIMED_BLOCK("Sigmoid(vec)", 2*V.Dimension*sizeof(r32), 3*V.Dimension);
+
+	vec Result = VecRaw_(Pool, V.Dimension);
+	GlobalMathKernels.Sigmoid(Result.Data, V.Data, V.Dimension);
+
+	return Result;
+}
+
+inline vec
+SigmoidPrime(memory_pool *Pool, vec V)
+{
+	TIMED_BLOCK("SigmoidPrime(vec)", 2*V.Dimension*sizeof(r32), 5*V.Dimension);
+
+	vec Result = VecRaw_(Pool, V.Dimension);
+	GlobalMathKernels.SigmoidPrime(Result.Data, V.Data, V.Dimension);
+
+	return Result;
+}
+
+inline void
+VectorScaleEquals(r32 Scale, vec V)
+{
+	TIMED_BLOCK("VectorScaleEquals", 2*V.Dimension*sizeof(r32), V.Dimension);
+
+	GlobalMathKernels.ScaleEquals(V.Data, Scale, V.Dimension);
+}
+
+inline void
+VectorPlusEquals(vec A, vec B)
+{
+	TIMED_BLOCK("VectorPlusEquals", 3*A.Dimension*sizeof(r32), A.Dimension);
+
+	Assert(A.Dimension == B.Dimension);
+
+	GlobalMathKernels.AddEquals(A.Data, B.Data, A.Dimension);
+}
+
+/*
+	NOTE: Matrices are column-major, and Stride is the distance in floats from
+		the start of one column to the start of the next. Matrices we allocate
+		round Stride up to a multiple of MATRIX_STRIDE_MULTIPLE, so with the
+		pool's 64-byte alignment every column starts on its own cache line.
+		Views (SubMatrix, MatrixColumns) keep the stride of the matrix they
+		look into and copy nothing.
+
+		The padding rows past RowCount are never initialized; kernels only
+		ever touch rows below RowCount.
+*/
+#define MATRIX_STRIDE_MULTIPLE 16
+
+struct matrix
+{
+	u32 RowCount;
+	u32 ColumnCount;
+	u32 Stride;
+	r32 *Data;
+};
+
+inline u32
+MatrixStrideFor(u32 Rows)
+{
+	u32 Result = (Rows + MATRIX_STRIDE_MULTIPLE - 1) & ~(u32)(MATRIX_STRIDE_MULTIPLE - 1);
+	return Result;
+}
+
+inline r32 *
+MatrixColumnData(matrix A, u32 ColumnIndex)
+{
+	r32 *Result = A.Data + (umm)ColumnIndex*A.Stride;
+	return Result;
+}
+
+inline matrix
+MatrixRawAt(char *Site, memory_pool *Pool, u32 Rows, u32 Columns)
+{
+	matrix Result = {};
+	Result.Stride = MatrixStrideFor(Rows);
+	Result.Data = PoolPushArrayAlignedAt(Site, Pool, r32, (umm)Result.Stride*Columns);
+	Result.ColumnCount = Columns;
+	Result.RowCount = Rows;
+	return Result;
+}
+#define MatrixRaw_(...) MatrixRawAt(POOL_CALL_SITE, __VA_ARGS__)
+
+inline matrix
+Matrix(memory_pool *Pool, r32 *Data, u32 Rows, u32 Columns)
+{
+	matrix Result = MatrixRaw_(Pool, Rows, Columns);;
+
+	r32 *ColData = Data;
+	for(u32 ColumnIndex = 0;
+	    ColumnIndex < Result.ColumnCount;
+	    ++ColumnIndex)
+	{
+		r32 *Source = ColData;
+		r32 *Dest = MatrixColumnData(Result, ColumnIndex);
+		for(u32 RowIndex = 0;
+		    RowIndex < Result.RowCount;
+		    ++RowIndex)
+		{
+			*Dest++ = *Source++;
+		}
+
+		ColData += Rows;
+	}
+
+	return Result;
+}
+
+inline matrix
+Matrix(r32 *Data, u32 Rows, u32 Columns)
+{
+	// NOTE: Wraps densely packed data, e.g. a matrix loaded from a file.
+	matrix Result = {};
+	Result.Data = Data;
+	Result.ColumnCount = Columns;
+	Result.RowCount = Rows;
+	Result.Stride = Rows;
+	return Result;
+}
+
+inline matrix
+SubMatrix(matrix A, u32 FirstRow, u32 FirstColumn, u32 Rows, u32 Columns)
+{
+	Assert((FirstRow + Rows) <= A.RowCount);
+	Assert((FirstColumn + Columns) <= A.ColumnCount);
+
+	matrix Result = {};
+	Result.Data = MatrixColumnData(A, FirstColumn) + FirstRow;
+	Result.ColumnCount = Columns;
+	Result.RowCount = Rows;
+	Result.Stride = A.Stride;
+	return Result;
+}
+
+inline matrix
+MatrixColumns(matrix A, u32 FirstColumn, u32 ColumnCount)
+{
+	matrix Result = SubMatrix(A, 0, FirstColumn, A.RowCount, ColumnCount);
+	return Result;
+}
+
+inline vec
+MatrixColumn(matrix A, u32 ColumnIndex)
+{
+	Assert(ColumnIndex < A.ColumnCount);
+
+	vec Result = Vec(MatrixColumnData(A, ColumnIndex), A.RowCount);
+	return Result;
+}
+
+inline matrix
+MatrixRandAt(char *Site, memory_pool *Pool, u32 Rows, u32 Columns,
+           r32 Mean, r32 StandardDeviation)
+{
+	matrix Result = MatrixRawAt(Site, Pool, Rows, Columns);
+
+	for(u32 ColumnIndex = 0;
+	    ColumnIndex < Result.ColumnCount;
+	    ++ColumnIndex)
+	{
+		r32 *Dest = MatrixColumnData(Result, ColumnIndex);
+		for(u32 RowIndex = 0;
+		    RowIndex < Result.RowCount;
+		    ++RowIndex)
+		{
+			*Dest++ = RandomGaussian(Mean, StandardDeviation);
+		}
+	}
+
+	return Result;
+}
+#define MatrixRand(...) MatrixRandAt(POOL_CALL_SITE, __VA_ARGS__)
+
+inline vec
+MultAt(char *Site, memory_pool *Pool, matrix M, vec V)
+{
+	TIMED_BLOCK("Mult(matrix, vec)",
+	            ((u64)M.RowCount*M.ColumnCount + M.ColumnCount + M.RowCount)*sizeof(r32),
+	            2*(u64)M.RowCount*M.ColumnCount);
+
+	Assert(M.ColumnCount == V.Dimension);
+
+	vec Result = VecRawAt(Site, Pool, M.RowCount);
+	GlobalMathKernels.Gemm(Result.Data, Result.Dimension, M.Data, M.Stride,
+	                       V.Data, 1, V.Dimension, M.RowCount, 1, M.ColumnCount,
+	                       GetGemmConfig(M.RowCount, M.ColumnCount, false));
+
+	return Result;
+}
+
+inline vec
+TransposeMultAt(char *Site, memory_pool *Pool, matrix M, vec V)
+{
+	TIMED_BLOCK("TransposeMult(matrix, vec)",
+	            ((u64)M.RowCount*M.ColumnCount + M.ColumnCount + M.RowCount)*sizeof(r32),
+	            2*(u64)M.RowCount*M.ColumnCount);
+
+	Assert(M.RowCount == V.Dimension);
+
+	vec Result = VecRawAt(Site, Pool, M.ColumnCount);
+
+	for(u32 ColumnIndex = 0;
+	    ColumnIndex < M.ColumnCount;
+	    ++ColumnIndex)
+	{
+		Result.Data[ColumnIndex] = GlobalMathKernels.Dot(MatrixColumnData(M, ColumnIndex), V.Data, M.RowCount);
+	}
+
+	return Result;	
+}
+
+inline matrix
+TransposeAt(char *Site, memory_pool *Pool, matrix M)
+{
+	TIMED_BLOCK("Transpose", 2*(u64)M.RowCount*M.ColumnCount*sizeof(r32), 0);
+
+	matrix Result = MatrixRawAt(Site, Pool, M.ColumnCount, M.RowCount);
+
+	for(u32 ColumnIndex = 0;
+	    ColumnIndex < M.ColumnCount;
+	    ++ColumnIndex)
+	{
+		r32 *Source = MatrixColumnData(M, ColumnIndex);
+		for(u32 RowIndex = 0;
+		    RowIndex < M.RowCount;
+		    ++RowIndex)
+		{
+			r32 *Dest = MatrixColumnData(Result, RowIndex) + ColumnIndex;
+			*Dest = *Source++;
+		}
+	}
+
+	return Result;
+}
+#define Transpose(...) TransposeAt(POOL_CALL_SITE, __VA_ARGS__)
+
+inline void
+MultInto(matrix Result, matrix A, matrix B)
+{
+	TIMED_BLOCK("Mult(matrix, matrix)",
+	            ((u64)A.RowCount*A.ColumnCount + (u64)B.RowCount*B.ColumnCount + (u64)A.RowCount*B.ColumnCount)*sizeof(r32),
+	            2*(u64)A.RowCount*A.ColumnCount*B.ColumnCount);
+
+	Assert(A.ColumnCount == B.RowCount);
+	Assert((Result.RowCount == A.RowCount) && (Result.ColumnCount == B.ColumnCount));
+
+	GlobalMathKernels.Gemm(Result.Data, Result.Stride, A.Data, A.Stride,
+	                       B.Data, 1, B.Stride, A.RowCount, B.ColumnCount, A.ColumnCount,
+	                       GetGemmConfig(A.RowCount, A.ColumnCount, false));
+}
+
+inline matrix
+MultAt(char *Site, memory_pool *Pool, matrix A, matrix B)
+{
+	matrix Result = MatrixRawAt(Site, Pool, A.RowCount, B.ColumnCount);
+	MultInto(Result, A, B);
+	return Result;
+}
+#define Mult(...) MultAt(POOL_CALL_SITE, __VA_ARGS__)
+
+inline matrix
+VectorTransposeMultAt(char *Site, memory_pool *Pool, vec A, vec B)
+{
+	TIMED_BLOCK("VectorTransposeMult",
+	            (A.Dimension + B.Dimension + (u64)A.Dimension*B.Dimension)*sizeof(r32),
+	            (u64)A.Dimension*B.Dimension);
+
+	matrix Result = MatrixRawAt(Site, Pool, A.Dimension, B.Dimension);
+
+	for(u32 ColumnIndex = 0;
+	    ColumnIndex < Result.ColumnCount;
+	    ++ColumnIndex)
+	{
+		r32 *Dest = MatrixColumnData(Result, ColumnIndex);
+		for(u32 RowIndex = 0;
+		    RowIndex < Result.RowCount;
+		    ++RowIndex)
+		{
+			*Dest++ = A.Data[RowIndex]*B.Data[ColumnIndex]; 
+		}
+	}
+
+	return Result;
+}
+#define VectorTransposeMult(...) VectorTransposeMultAt(POOL_CALL_SITE, __VA_ARGS__)
+
+inline void
+MatrixPlusEquals(matrix A, matrix B)
+{
+	TIMED_BLOCK("MatrixPlusEquals",
+	            3*(u64)A.RowCount*A.ColumnCount*sizeof(r32),
+	            (u64)A.RowCount*A.ColumnCount);
+
+	Assert(A.RowCount == B.RowCount);
+	Assert(A.ColumnCount == B.ColumnCount);
+
+	for(u32 ColumnIndex = 0;
+	    ColumnIndex < A.ColumnCount;
+	    ++ColumnIndex)
+	{
+		GlobalMathKernels.AddEquals(MatrixColumnData(A, ColumnIndex), MatrixColumnData(B, ColumnIndex), A.RowCount);
+	}
+}
+
+inline void
+MatrixScaleEquals(r32 Scale, matrix A)
+{
+	TIMED_BLOCK("MatrixScaleEquals",
+	            2*(u64)A.RowCount*A.ColumnCount*sizeof(r32),
+	            (u64)A.RowCount*A.ColumnCount);
+
+	for(u32 ColumnIndex = 0;
+	    ColumnIndex < A.ColumnCount;
+	    ++ColumnIndex)
+	{
+		GlobalMathKernels.ScaleEquals(MatrixColumnData(A, ColumnIndex), Scale, A.RowCount);
+	}
+}
+
+inline void
+MatrixZero(matrix A)
+{
+	for(u32 ColumnIndex = 0;
+	    ColumnIndex < A.ColumnCount;
+	    ++ColumnIndex)
+	{
+		memset(MatrixColumnData(A, ColumnIndex), 0, A.RowCount*sizeof(r32));
+	}
+}
+
+// NOTE: For checking one path against another: counts the elements that
+//	aren't exactly equal, and raises MaxDifference to the largest gap.
+inline void
+CompareMatrices(matrix Expected, matrix Actual, u32 *DifferentCount, r32 *MaxDifference)
+{
+	for(u32 ColumnIndex = 0;
+	    ColumnIndex < Expected.ColumnCount;
+	    ++ColumnIndex)
+	{
+		r32 *ExpectedValue = MatrixColumnData(Expected, ColumnIndex);
+		r32 *ActualValue = MatrixColumnData(Actual, ColumnIndex);
+		for(u32 RowIndex = 0;
+		    RowIndex < Expected.RowCount;
+		    ++RowIndex)
+		{
+			r32 Difference = AbsoluteValue(ExpectedValue[RowIndex] - ActualValue[RowIndex]);
+			*DifferentCount += (ExpectedValue[RowIndex] != ActualValue[RowIndex]);
+			if(Difference > *MaxDifference)
+			{
+				*MaxDifference = Difference;
+			}
+		}
+	}
+}
+
+inline matrix
+MVPlusAt(char *Site, memory_pool *Pool, matrix A, vec V)
+{
+	TIMED_BLOCK("MVPlus",
+	            (2*(u64)A.RowCount*A.ColumnCount + V.Dimension)*sizeof(r32),
+	            (u64)A.RowCount*A.ColumnCount);
+
+	Assert(V.Dimension == A.RowCount);
+
+	matrix Result = MatrixRawAt(Site, Pool, A.RowCount, A.ColumnCount);
+
+	for(u32 ColumnIndex = 0;
+	    ColumnIndex < Result.ColumnCount;
+	    ++ColumnIndex)
+	{
+		GlobalMathKernels.Add(MatrixColumnData(Result, ColumnIndex), MatrixColumnData(A, ColumnIndex),
+		                      V.Data, Result.RowCount);
+	}
+
+	return Result;
+}
+#define MVPlus(...) MVPlusAt(POOL_CALL_SITE, __VA_ARGS__)
+
+inline void
+SigmoidInto(matrix Result, matrix M)
+{
+	TIMED_BLOCK("Sigmoid(matrix)",
+	            2*(u64)M.RowCount*M.ColumnCount*sizeof(r32),
+	            3*(u64)M.RowCount*M.ColumnCount);
+
+	Assert((Result.RowCount == M.RowCount) && (Result.ColumnCount == M.ColumnCount));
+
+	for(u32 ColumnIndex = 0;
+	    ColumnIndex < Result.ColumnCount;
+	    ++ColumnIndex)
+	{
+		GlobalMathKernels.Sigmoid(MatrixColumnData(Result, ColumnIndex), MatrixColumnData(M, ColumnIndex),
+		                  Result.RowCount);
+	}
+}
+
+inline matrix
+Sigmoid(memory_pool *Pool, matrix M)
+{
+	matrix Result = MatrixRaw_(Pool, M.RowCount, M.ColumnCount);
+	SigmoidInto(Result, M);
+	return Result;
+}
+
+inline matrix
+SigmoidPrime(memory_pool *Pool, matrix M)
+{
+	TIMED_BLOCK("SigmoidPrime(matrix)",
+	            2*(u64)M.RowCount*M.ColumnCount*sizeof(r32),
+	            5*(u64)M.RowCount*M.ColumnCount);
+
+	matrix Result = MatrixRaw_(Pool, M.RowCount, M.ColumnCount);
+
+	for(u32 ColumnIndex = 0;
+	    ColumnIndex < Result.ColumnCount;
+	    ++ColumnIndex)
+	{
+		GlobalMathKernels.SigmoidPrime(MatrixColumnData(Result, ColumnIndex), MatrixColumnData(M, ColumnIndex),
+		                  Result.RowCount);
+	}
+
+	return Result;
+}
+
+inline matrix
+MinusAt(char *Site, memory_pool *Pool, matrix A, matrix B)
+{
+	TIMED_BLOCK("Minus(matrix, matrix)",
+	            3*(u64)A.RowCount*A.ColumnCount*sizeof(r32),
+	            (u64)A.RowCount*A.ColumnCount);
+
+	Assert((A.RowCount == B.RowCount) && (A.ColumnCount == B.ColumnCount));
+
+	matrix Result = MatrixRawAt(Site, Pool, A.RowCount, A.ColumnCount);
+
+	for(u32 ColumnIndex = 0;
+	    ColumnIndex < Result.ColumnCount;
+	    ++ColumnIndex)
+	{
+		GlobalMathKernels.Subtract(MatrixColumnData(Result, ColumnIndex), MatrixColumnData(A, ColumnIndex),
+		                  MatrixColumnData(B, ColumnIndex), Result.RowCount);
+	}
+
+	return Result;
+}
+#define Minus(...) MinusAt(POOL_CALL_SITE, __VA_ARGS__)
+
+inline matrix
+HadamardAt(char *Site, memory_pool *Pool, matrix A, matrix B)
+{
+	TIMED_BLOCK("Hadamard(matrix, matrix)",
+	            3*(u64)A.RowCount*A.ColumnCount*sizeof(r32),
+	            (u64)A.RowCount*A.ColumnCount);
+
+	Assert((A.RowCount == B.RowCount) && (A.ColumnCount == B.ColumnCount));
+
+	matrix Result = MatrixRawAt(Site, Pool, A.RowCount, A.ColumnCount);
+
+	for(u32 ColumnIndex = 0;
+	    ColumnIndex < Result.ColumnCount;
+	    ++ColumnIndex)
+	{
+		GlobalMathKernels.Multiply(MatrixColumnData(Result, ColumnIndex), MatrixColumnData(A, ColumnIndex),
+		                  MatrixColumnData(B, ColumnIndex), Result.RowCount);
+	}
+
+	return Result;
+}
+#define Hadamard(...) HadamardAt(POOL_CALL_SITE, __VA_ARGS__)
+
+inline void
+MatrixHadamardEquals(matrix A, matrix B)
+{
+	TIMED_BLOCK("MatrixHadamardEquals",
+	            3*(u64)A.RowCount*A.ColumnCount*sizeof(r32),
+	            (u64)A.RowCount*A.ColumnCount);
+
+	Assert((A.RowCount == B.RowCount) && (A.ColumnCount == B.ColumnCount));
+
+	for(u32 ColumnIndex = 0;
+	    ColumnIndex < A.ColumnCount;
+	    ++ColumnIndex)
+	{
+		r32 *Dest = MatrixColumnData(A, ColumnIndex);
+		GlobalMathKernels.Multiply(Dest, Dest, MatrixColumnData(B, ColumnIndex), A.RowCount);
+	}
+}
+
+/*
+	NOTE: Lazy elementwise expressions. The Lazy* functions only build an
+		expression tree (see nn_kernels.h), and Evaluate or EvaluateInto runs
+		it in one fused pass, so
+
+			Evaluate(Pool, LazyHadamard(LazyMinus(Lazy(A), Lazy(Y)), LazySigmoidPrime(Lazy(Z))))
+
+		allocates the result and nothing else, where the same Hadamard, Minus
+		and SigmoidPrime calls allocate and run a pass over two intermediates.
+		Lazy(vec) is a column repeated across every column, as in MVPlus.
+
+		EvaluateInto can write over one of the expression's own operands;
+		every element is read before it's written.
+*/
+
+template<typename node>
+struct lazy
+{
+	node Node;
+	u32 RowCount;
+
+	// NOTE: Zero for a vector that repeats across columns.
+	u32 ColumnCount;
+};
+
+inline lazy<expr_operand>
+Lazy(matrix A)
+{
+	lazy<expr_operand> Result = {};
+	Result.Node.Data = A.Data;
+	Result.Node.Stride = A.Stride;
+	Result.RowCount = A.RowCount;
+	Result.ColumnCount = A.ColumnCount;
+	return Result;
+}
+
+inline lazy<expr_operand>
+Lazy(vec V)
+{
+	lazy<expr_operand> Result = {};
+	Result.Node.Data = V.Data;
+	Result.Node.Stride = 0;
+	Result.RowCount = V.Dimension;
+	Result.ColumnCount = 0;
+	return Result;
+}
+
+template<u32 Op, typename a, typename b>
+inline lazy<expr_binary<Op, a, b> >
+LazyBinary(lazy<a> A, lazy<b> B)
+{
+	Assert(A.RowCount == B.RowCount);
+	Assert(!A.ColumnCount || !B.ColumnCount || (A.ColumnCount == B.ColumnCount));
+
+	lazy<expr_binary<Op, a, b> > Result = {};
+	Result.Node.A = A.Node;
+	Result.Node.B = B.Node;
+	Result.RowCount = A.RowCount;
+	Result.ColumnCount = Maximum(A.ColumnCount, B.ColumnCount);
+	return Result;
+}
+
+template<u32 Op, typename a>
+inline lazy<expr_unary<Op, a> >
+LazyUnary(lazy<a> A)
+{
+	lazy<expr_unary<Op, a> > Result = {};
+	Result.Node.A = A.Node;
+	Result.RowCount = A.RowCount;
+	Result.ColumnCount = A.ColumnCount;
+	return Result;
+}
+
+template<typename a, typename b>
+inline lazy<expr_binary<ExprOp_Plus, a, b> >
+LazyPlus(lazy<a> A, lazy<b> B)
+{
+	return LazyBinary<ExprOp_Plus>(A, B);
+}
+
+template<typename a, typename b>
+inline lazy<expr_binary<ExprOp_Minus, a, b> >
+LazyMinus(lazy<a> A, lazy<b> B)
+{
+	return LazyBinary<ExprOp_Minus>(A, B);
+}
+
+template<typename a, typename b>
+inline lazy<expr_binary<ExprOp_Hadamard, a, b> >
+LazyHadamard(lazy<a> A, lazy<b> B)
+{
+	return LazyBinary<ExprOp_Hadamard>(A, B);
+}
+
+template<typename a>
+inline lazy<expr_binary<ExprOp_Plus, a, expr_operand> >
+LazyMVPlus(lazy<a> A, vec V)
+{
+	return LazyBinary<ExprOp_Plus>(A, Lazy(V));
+}
+
+template<typename a>
+inline lazy<expr_binary<ExprOp_Hadamard, a, expr_scalar> >
+LazyScale(r32 Scale, lazy<a> A)
+{
+	lazy<expr_scalar> ScaleNode = {};
+	ScaleNode.Node.Value = Scale;
+	ScaleNode.RowCount = A.RowCount;
+	return LazyBinary<ExprOp_Hadamard>(A, ScaleNode);
+}
+
+template<typename a>
+inline lazy<expr_unary<ExprOp_Sigmoid, a> >
+LazySigmoid(lazy<a> A)
+{
+	return LazyUnary<ExprOp_Sigmoid>(A);
+}
+
+template<typename a>
+inline lazy<expr_unary<ExprOp_SigmoidPrime, a> >
+LazySigmoidPrime(lazy<a> A)
+{
+	return LazyUnary<ExprOp_SigmoidPrime>(A);
+}
+
+template<typename node>
+inline void
+EvaluateInto(matrix Dest, lazy<node> E)
+{
+	TIMED_BLOCK("EvaluateInto",
+	            (u64)(ExprOperandCount(E.Node) + 1)*Dest.RowCount*Dest.ColumnCount*sizeof(r32),
+	            (u64)ExprOperationCount(E.Node)*Dest.RowCount*Dest.ColumnCount);
+
+	Assert(Dest.RowCount == E.RowCount);
+	Assert(!E.ColumnCount || (Dest.ColumnCount == E.ColumnCount));
+
+	EvaluateExpression(Dest.Data, Dest.Stride, E.Node, Dest.RowCount, Dest.ColumnCount);
+}
+
+template<typename node>
+inline void
+EvaluateInto(vec Dest, lazy<node> E)
+{
+	TIMED_BLOCK("EvaluateInto(vec)",
+	            (u64)(ExprOperandCount(E.Node) + 1)*Dest.Dimension*sizeof(r32),
+	            (u64)ExprOperationCount(E.Node)*Dest.Dimension);
+
+	Assert(Dest.Dimension == E.RowCount);
+	Assert(E.ColumnCount <= 1);
+
+	EvaluateExpression(Dest.Data, 0, E.Node, Dest.Dimension, 1);
+}
+
+template<typename node>
+inline matrix
+EvaluateAt(char *Site, memory_pool *Pool, lazy<node> E)
+{
+	// NOTE: An expression of vectors alone comes back as one column.
+	matrix Result = MatrixRawAt(Site, Pool, E.RowCount, E.ColumnCount ? E.ColumnCount : 1);
+	EvaluateInto(Result, E);
+	return Result;
+}
+#define Evaluate(...) EvaluateAt(POOL_CALL_SITE, __VA_ARGS__)
+
+/*
+	NOTE: Activation functions. Sigmoid goes through its kernel and the rest
+		through the expression evaluator, which has a SIMD version of each
+		at every level. Their derivatives are taken at the weighted inputs,
+		the same as SigmoidPrime. Softmax is only for the output layer, with
+		the cross-entropy cost, whose gradient at the weighted inputs is then
+		a - y, so it never needs its own derivative. Sign, +-1, is for binary
+		networks (see nn_binary.cpp); its derivative is the straight-through
+		estimator's. The enum is saved in network files, so new activations
+		go on the end.
+*/
+enum activation_function
+{
+	Activation_Sigmoid,
+	Activation_ReLU,
+	Activation_LeakyReLU,
+	Activation_Tanh,
+	Activation_Softmax,
+	Activation_Sign,
+
+	Activation_Count,
+};
+
+global_variable char *ActivationNames[Activation_Count] =
+{
+	"sigmoid",
+	"relu",
+	"leakyrelu",
+	"tanh",
+	"softmax",
+	"sign",
+};
+
+inline void
+SoftmaxInto(matrix Result, matrix M)
+{
+	TIMED_BLOCK("Softmax(matrix)",
+	            3*(u64)M.RowCount*M.ColumnCount*sizeof(r32),
+	            4*(u64)M.RowCount*M.ColumnCount);
+
+	Assert((Result.RowCount == M.RowCount) && (Result.ColumnCount == M.ColumnCount));
+
+	// NOTE: Shifted by the column's largest value, so exp never overflows.
+	//	The columns are only as long as the output layer, so this is scalar.
+	for(u32 ColumnIndex = 0;
+	    ColumnIndex < M.ColumnCount;
+	    ++ColumnIndex)
+	{
+		r32 *Source = MatrixColumnData(M, ColumnIndex);
+		r32 *Dest = MatrixColumnData(Result, ColumnIndex);
+
+		r32 Largest = Source[0];
+		for(u32 RowIndex = 1;
+		    RowIndex < M.RowCount;
+		    ++RowIndex)
+		{
+			Largest = Maximum(Largest, Source[RowIndex]);
+		}
+
+		r32 Sum = 0.0f;
+		for(u32 RowIndex = 0;
+		    RowIndex < M.RowCount;
+		    ++RowIndex)
+		{
+			Dest[RowIndex] = Exp(Source[RowIndex] - Largest);
+			Sum += Dest[RowIndex];
+		}
+
+		for(u32 RowIndex = 0;
+		    RowIndex < M.RowCount;
+		    ++RowIndex)
+		{
+			Dest[RowIndex] /= Sum;
+		}
+	}
+}
+
+internal void
+ActivateInto(matrix Result, matrix WeightedInputs, activation_function Activation)
+{
+	switch(Activation)
+	{
+		case Activation_Sigmoid: {SigmoidInto(Result, WeightedInputs);} break;
+		case Activation_ReLU: {EvaluateInto(Result, LazyUnary<ExprOp_ReLU>(Lazy(WeightedInputs)));} break;
+		case Activation_LeakyReLU: {EvaluateInto(Result, LazyUnary<ExprOp_LeakyReLU>(Lazy(WeightedInputs)));} break;
+		case Activation_Tanh: {EvaluateInto(Result, LazyUnary<ExprOp_Tanh>(Lazy(WeightedInputs)));} break;
+		case Activation_Softmax: {SoftmaxInto(Result, WeightedInputs);} break;
+		case Activation_Sign: {EvaluateInto(Result, LazyUnary<ExprOp_Sign>(Lazy(WeightedInputs)));} break;
+
+		InvalidDefaultCase;
+	}
+}
+
+inline matrix
+ActivateAt(char *Site, memory_pool *Pool, matrix WeightedInputs, activation_function Activation)
+{
+	matrix Result = MatrixRawAt(Site, Pool, WeightedInputs.RowCount, WeightedInputs.ColumnCount);
+	ActivateInto(Result, WeightedInputs, Activation);
+	return Result;
+}
+#define Activate(...) ActivateAt(POOL_CALL_SITE, __VA_ARGS__)
+
+internal void
+HadamardActivationPrime(matrix Error, matrix WeightedInputs, activation_function Activation)
+{
+	// NOTE: Error *= f'(z), in place.
+	lazy<expr_operand> E = Lazy(Error);
+	lazy<expr_operand> Z = Lazy(WeightedInputs);
+	switch(Activation)
+	{
+		case Activation_Sigmoid: {EvaluateInto(Error, LazyHadamard(E, LazySigmoidPrime(Z)));} break;
+		case Activation_ReLU: {EvaluateInto(Error, LazyHadamard(E, LazyUnary<ExprOp_ReLUPrime>(Z)));} break;
+		case Activation_LeakyReLU: {EvaluateInto(Error, LazyHadamard(E, LazyUnary<ExprOp_LeakyReLUPrime>(Z)));} break;
+		case Activation_Tanh: {EvaluateInto(Error, LazyHadamard(E, LazyUnary<ExprOp_TanhPrime>(Z)));} break;
+		case Activation_Sign: {EvaluateInto(Error, LazyHadamard(E, LazyUnary<ExprOp_SignPrime>(Z)));} break;
+
+		InvalidDefaultCase;
+	}
+}
+
+internal void
+HadamardActivationPrimeFromOutput(matrix Error, matrix Activations, activation_function Activation)
+{
+	// NOTE: Error *= f'(z), from a = f(z) instead of z: a - a*a for the
+	//	sigmoid, 1 - a*a for tanh, and the ReLUs' slopes from a's sign,
+	//	which is z's. Sign's depends on z's size, which a doesn't keep.
+	lazy<expr_operand> E = Lazy(Error);
+	lazy<expr_operand> A = Lazy(Activations);
+	switch(Activation)
+	{
+		case Activation_Sigmoid: {EvaluateInto(Error, LazyHadamard(E, LazyMinus(A, LazyHadamard(A, A))));} break;
+		case Activation_ReLU: {EvaluateInto(Error, LazyHadamard(E, LazyUnary<ExprOp_ReLUPrime>(A)));} break;
+		case Activation_LeakyReLU: {EvaluateInto(Error, LazyHadamard(E, LazyUnary<ExprOp_LeakyReLUPrime>(A)));} break;
+		case Activation_Tanh: {EvaluateInto(Error, LazyMinus(E, LazyHadamard(E, LazyHadamard(A, A))));} break;
+
+		InvalidDefaultCase;
+	}
+}
+
+internal matrix
+MatrixNonZeroPatternAt(char *Site, memory_pool *Pool, matrix A)
+{
+	// NOTE: One where A is non-zero and zero elsewhere.
+	matrix Result = MatrixRawAt(Site, Pool, A.RowCount, A.ColumnCount);
+	for(u32 ColumnIndex = 0;
+	    ColumnIndex < A.ColumnCount;
+	    ++ColumnIndex)
+	{
+		r32 *Source = MatrixColumnData(A, ColumnIndex);
+		r32 *Dest = MatrixColumnData(Result, ColumnIndex);
+		for(u32 RowIndex = 0;
+		    RowIndex < A.RowCount;
+		    ++RowIndex)
+		{
+			*Dest++ = (*Source++ != 0.0f) ? 1.0f : 0.0f;
+		}
+	}
+
+	return Result;
+}
+#define MatrixNonZeroPattern(...) MatrixNonZeroPatternAt(POOL_CALL_SITE, __VA_ARGS__)
+
+inline void
+TransposeMultInto(matrix Result, matrix A, matrix B)
+{
+	TIMED_BLOCK("TransposeMult(matrix, matrix)",
+	            ((u64)A.RowCount*A.ColumnCount + (u64)B.RowCount*B.ColumnCount + (u64)A.ColumnCount*B.ColumnCount)*sizeof(r32),
+	            2*(u64)A.ColumnCount*A.RowCount*B.ColumnCount);
+
+	Assert(A.RowCount == B.RowCount);
+	Assert((Result.RowCount == A.ColumnCount) && (Result.ColumnCount == B.ColumnCount));
+
+	for(u32 ColumnIndex = 0;
+	    ColumnIndex < Result.ColumnCount;
+	    ++ColumnIndex)
+	{
+		r32 *Dest = MatrixColumnData(Result, ColumnIndex);
+		r32 *SourceB = MatrixColumnData(B, ColumnIndex);
+		for(u32 RowIndex = 0;
+		    RowIndex < Result.RowCount;
+		    ++RowIndex)
+		{
+			*Dest++ = GlobalMathKernels.Dot(MatrixColumnData(A, RowIndex), SourceB, A.RowCount);
+		}
+	}
+}
+
+inline matrix
+TransposeMultAt(char *Site, memory_pool *Pool, matrix A, matrix B)
+{
+	matrix Result = MatrixRawAt(Site, Pool, A.ColumnCount, B.ColumnCount);
+	TransposeMultInto(Result, A, B);
+	return Result;
+}
+#define TransposeMult(...) TransposeMultAt(POOL_CALL_SITE, __VA_ARGS__)
+
+inline void
+MultTransposeInto(matrix Result, matrix A, matrix B)
+{
+	TIMED_BLOCK("MultTranspose",
+	            ((u64)A.RowCount*A.ColumnCount + (u64)B.RowCount*B.ColumnCount + (u64)A.RowCount*B.RowCount)*sizeof(r32),
+	            2*(u64)A.RowCount*A.ColumnCount*B.RowCount);
+
+	Assert(A.ColumnCount == B.ColumnCount);
+	Assert((Result.RowCount == A.RowCount) && (Result.ColumnCount == B.RowCount));
+
+	// NOTE: B is read transposed by swapping its steps.
+	GlobalMathKernels.Gemm(Result.Data, Result.Stride, A.Data, A.Stride,
+	                       B.Data, B.Stride, 1, A.RowCount, B.RowCount, A.ColumnCount,
+	                       GetGemmConfig(A.RowCount, B.RowCount, true));
+}
+
+inline matrix
+MultTransposeAt(char *Site, memory_pool *Pool, matrix A, matrix B)
+{
+	matrix Result = MatrixRawAt(Site, Pool, A.RowCount, B.RowCount);
+	MultTransposeInto(Result, A, B);
+	return Result;
+}
+#define MultTranspose(...) MultTransposeAt(POOL_CALL_SITE, __VA_ARGS__)
+
+inline void
+MatrixSumColumnsInto(vec Result, matrix A)
+{
+	TIMED_BLOCK("MatrixSumColumns",
+	            ((u64)A.RowCount*A.ColumnCount + A.RowCount)*sizeof(r32),
+	            (u64)A.RowCount*A.ColumnCount);
+
+	Assert(Result.Dimension == A.RowCount);
+
+	r32 *VData = Result.Data;
+	for(u32 RowIndex = 0;
+	    RowIndex < A.RowCount;
+	    ++RowIndex)
+	{
+		*VData++ = 0.0f;
+	}
+
+	for(u32 ColumnIndex = 0;
+	    ColumnIndex < A.ColumnCount;
+	    ++ColumnIndex)
+	{
+		GlobalMathKernels.AddEquals(Result.Data, MatrixColumnData(A, ColumnIndex), A.RowCount);
+	}
+}
+
+inline vec
+MatrixSumColumnsAt(char *Site, memory_pool *Pool, matrix A)
+{
+	vec Result = VecRawAt(Site, Pool, A.RowCount);
+	MatrixSumColumnsInto(Result, A);
+	return Result;
+}
+#define MatrixSumColumns(...) MatrixSumColumnsAt(POOL_CALL_SITE, __VA_ARGS__)
+
+//
+// NOTE: Sparse matrices
+//
+
+/*
+	NOTE: Compressed sparse columns. Column j's non-zeros are entries
+		[ColumnStarts[j], ColumnStarts[j + 1]) of RowIndices and Values, in row
+		order. A column range is a view that shares the arrays, the same way
+		MatrixColumns is.
+
+	The products skip the zeros but otherwise run the same multiply-adds in
+		the same order as the dense GEMM, so they give the same bits.
+*/
+struct sparse_matrix
+{
+	u32 RowCount;
+	u32 ColumnCount;
+	u32 *ColumnStarts;
+	u32 *RowIndices;
+	r32 *Values;
+};
+
+internal b32
+MakeSparseMatrixAt(char *Site, memory_pool *Pool, matrix A, r32 MaxDensity, sparse_matrix *Result)
+{
+	TIMED_BLOCK("MakeSparseMatrix", (u64)A.RowCount*A.ColumnCount*sizeof(r32), 0);
+
+	// NOTE: One pass builds a bit per value and counts the non-zeros, so a
+	//	matrix that turns out too dense costs no more than that. The second
+	//	pass only visits the set bits.
+	temp_memory Scratch = BeginThreadScratch();
+	Assert(Scratch.Pool != Pool);
+
+	u32 MasksPerColumn = (A.RowCount + 31) / 32;
+	u32 *Masks = PoolPushArrayAt(Site, Scratch.Pool, u32, (umm)MasksPerColumn*A.ColumnCount);
+
+	u32 NonZeroCount = 0;
+	for(u32 ColumnIndex = 0;
+	    ColumnIndex < A.ColumnCount;
+	    ++ColumnIndex)
+	{
+		NonZeroCount += GlobalMathKernels.NonZeroMask(Masks + (umm)ColumnIndex*MasksPerColumn,
+		                                              MatrixColumnData(A, ColumnIndex), A.RowCount);
+	}
+
+	b32 Sparse = (NonZeroCount <= MaxDensity*((r32)A.RowCount*A.ColumnCount));
+	if(Sparse)
+	{
+		Result->RowCount = A.RowCount;
+		Result->ColumnCount = A.ColumnCount;
+		Result->ColumnStarts = PoolPushArrayAt(Site, Pool, u32, A.ColumnCount + 1);
+		Result->RowIndices = PoolPushArrayAt(Site, Pool, u32, NonZeroCount);
+		Result->Values = PoolPushArrayAt(Site, Pool, r32, NonZeroCount);
+
+		u32 EntryIndex = 0;
+		u32 *Mask = Masks;
+		for(u32 ColumnIndex = 0;
+		    ColumnIndex < A.ColumnCount;
+		    ++ColumnIndex)
+		{
+			Result->ColumnStarts[ColumnIndex] = EntryIndex;
+
+			r32 *Source = MatrixColumnData(A, ColumnIndex);
+			for(u32 FirstRow = 0;
+			    FirstRow < A.RowCount;
+			    FirstRow += 32)
+			{
+				u32 Bits = *Mask++;
+				while(Bits)
+				{
+					u32 RowIndex = FirstRow + FindLeastSignificantSetBit(Bits);
+					Result->RowIndices[EntryIndex] = RowIndex;
+					Result->Values[EntryIndex] = Source[RowIndex];
+					++EntryIndex;
+					Bits &= Bits - 1;
+				}
+			}
+		}
+		Result->ColumnStarts[A.ColumnCount] = EntryIndex;
+		Assert(EntryIndex == NonZeroCount);
+	}
+
+	PoolEndTempMemory(Scratch);
+	return Sparse;
+}
+#define MakeSparseMatrix(...) MakeSparseMatrixAt(POOL_CALL_SITE, __VA_ARGS__)
+
+inline sparse_matrix
+SparseColumns(sparse_matrix A, u32 FirstColumn, u32 ColumnCount)
+{
+	Assert((FirstColumn + ColumnCount) <= A.ColumnCount);
+
+	sparse_matrix Result = A;
+	Result.ColumnCount = ColumnCount;
+	Result.ColumnStarts = A.ColumnStarts + FirstColumn;
+	return Result;
+}
+
+inline u32
+SparseNonZeroCount(sparse_matrix A)
+{
+	u32 Result = A.ColumnStarts[A.ColumnCount] - A.ColumnStarts[0];
+	return Result;
+}
+
+internal sparse_matrix
+SparseTransposeAt(char *Site, memory_pool *Pool, sparse_matrix A)
+{
+	TIMED_BLOCK("SparseTranspose", (4*(u64)SparseNonZeroCount(A) + 2*(u64)A.RowCount)*sizeof(u32), 0);
+
+	// NOTE: A counting sort by row. Entries go out in column order, so every
+	//	transposed column lists its rows in order too.
+	u32 FirstEntry = A.ColumnStarts[0];
+	u32 NonZeroCount = SparseNonZeroCount(A);
+
+	sparse_matrix Result = {};
+	Result.RowCount = A.ColumnCount;
+	Result.ColumnCount = A.RowCount;
+	Result.ColumnStarts = PoolPushArrayAt(Site, Pool, u32, Result.ColumnCount + 1);
+	Result.RowIndices = PoolPushArrayAt(Site, Pool, u32, NonZeroCount);
+	Result.Values = PoolPushArrayAt(Site, Pool, r32, NonZeroCount);
+
+	for(u32 ColumnIndex = 0;
+	    ColumnIndex <= Result.ColumnCount;
+	    ++ColumnIndex)
+	{
+		Result.ColumnStarts[ColumnIndex] = 0;
+	}
+
+	for(u32 EntryIndex = FirstEntry;
+	    EntryIndex < (FirstEntry + NonZeroCount);
+	    ++EntryIndex)
+	{
+		++Result.ColumnStarts[A.RowIndices[EntryIndex] + 1];
+	}
+
+	for(u32 ColumnIndex = 0;
+	    ColumnIndex < Result.ColumnCount;
+	    ++ColumnIndex)
+	{
+		Result.ColumnStarts[ColumnIndex + 1] += Result.ColumnStarts[ColumnIndex];
+	}
+
+	u32 *NextEntry = PoolPushArrayAt(Site, Pool, u32, Result.ColumnCount);
+	for(u32 ColumnIndex = 0;
+	    ColumnIndex < Result.ColumnCount;
+	    ++ColumnIndex)
+	{
+		NextEntry[ColumnIndex] = Result.ColumnStarts[ColumnIndex];
+	}
+
+	for(u32 ColumnIndex = 0;
+	    ColumnIndex < A.ColumnCount;
+	    ++ColumnIndex)
+	{
+		for(u32 EntryIndex = A.ColumnStarts[ColumnIndex];
+		    EntryIndex < A.ColumnStarts[ColumnIndex + 1];
+		    ++EntryIndex)
+		{
+			u32 Dest = NextEntry[A.RowIndices[EntryIndex]]++;
+			Result.RowIndices[Dest] = ColumnIndex;
+			Result.Values[Dest] = A.Values[EntryIndex];
+		}
+	}
+
+	return Result;
+}
+#define SparseTranspose(...) SparseTransposeAt(POOL_CALL_SITE, __VA_ARGS__)
+
+inline void
+SparseMultInto(matrix Result, matrix A, sparse_matrix B)
+{
+	TIMED_BLOCK("SparseMult",
+	            ((u64)A.RowCount*(SparseNonZeroCount(B) + B.ColumnCount) + 2*(u64)SparseNonZeroCount(B))*sizeof(r32),
+	            2*(u64)A.RowCount*SparseNonZeroCount(B));
+
+	Assert(A.ColumnCount == B.RowCount);
+	Assert((Result.RowCount == A.RowCount) && (Result.ColumnCount == B.ColumnCount));
+
+	GlobalMathKernels.SparseGemm(Result.Data, Result.Stride, A.Data, A.Stride,
+	                             B.ColumnStarts, B.RowIndices, B.Values,
+	                             Result.RowCount, Result.ColumnCount);
+}
+
+inline void
+SparseMultTransposeInto(matrix Result, matrix A, sparse_matrix B)
+{
+	TIMED_BLOCK("SparseMultTranspose",
+	            ((u64)A.RowCount*(SparseNonZeroCount(B) + B.RowCount) + 2*(u64)SparseNonZeroCount(B))*sizeof(r32),
+	            2*(u64)A.RowCount*SparseNonZeroCount(B));
+
+	Assert(A.ColumnCount == B.ColumnCount);
+	Assert((Result.RowCount == A.RowCount) && (Result.ColumnCount == B.RowCount));
+
+	// NOTE: B transposed lists, for every result column, the columns of A
+	//	to add up. This can run on any thread, so it goes in that thread's
+	//	scratch.
+	temp_memory Scratch = BeginThreadScratch();
+	SparseMultInto(Result, A, SparseTranspose(Scratch.Pool, B));
+	PoolEndTempMemory(Scratch);
+}
+
+//
+// NOTE: Block sparse matrices
+//
+
+/*
+	NOTE: Block sparse rows, for pruned weights. Rows are grouped
+		BLOCK_SPARSE_ROWS at a time and each block row lists the columns it
+		keeps a block for, in column order. Block b covers column
+		BlockColumns[b] of its block row and keeps its values at
+		BlockValues[b*BLOCK_SPARSE_ROWS], zero padded past the last row, so
+		a block that is all zeros costs neither space nor time.
+*/
+struct block_sparse_matrix
+{
+	u32 RowCount;
+	u32 ColumnCount;
+	u32 BlockCount;
+	u32 *BlockRowStarts;
+	u32 *BlockColumns;
+	r32 *BlockValues;
+};
+
+inline u32
+BlockSparseRowCount(u32 RowCount)
+{
+	u32 Result = (RowCount + BLOCK_SPARSE_ROWS - 1) / BLOCK_SPARSE_ROWS;
+	return Result;
+}
+
+inline b32
+BlockHasNonZero(matrix A, u32 BlockRow, u32 ColumnIndex)
+{
+	u32 FirstRow = BlockRow*BLOCK_SPARSE_ROWS;
+	u32 BlockRows = Minimum(BLOCK_SPARSE_ROWS, A.RowCount - FirstRow);
+
+	b32 Result = false;
+	r32 *Source = MatrixColumnData(A, ColumnIndex) + FirstRow;
+	for(u32 RowIndex = 0;
+	    RowIndex < BlockRows;
+	    ++RowIndex)
+	{
+		if(Source[RowIndex] != 0.0f)
+		{
+			Result = true;
+			break;
+		}
+	}
+	return Result;
+}
+
+inline void
+BlockSparseCopyValues(block_sparse_matrix A, matrix Source)
+{
+	TIMED_BLOCK("BlockSparseCopyValues", 2*(u64)A.BlockCount*BLOCK_SPARSE_ROWS*sizeof(r32), 0);
+
+	Assert((A.RowCount == Source.RowCount) && (A.ColumnCount == Source.ColumnCount));
+
+	u32 BlockRowCount = BlockSparseRowCount(A.RowCount);
+	for(u32 BlockRow = 0;
+	    BlockRow < BlockRowCount;
+	    ++BlockRow)
+	{
+		u32 FirstRow = BlockRow*BLOCK_SPARSE_ROWS;
+		u32 BlockRows = Minimum(BLOCK_SPARSE_ROWS, A.RowCount - FirstRow);
+		for(u32 BlockIndex = A.BlockRowStarts[BlockRow];
+		    BlockIndex < A.BlockRowStarts[BlockRow + 1];
+		    ++BlockIndex)
+		{
+			r32 *Dest = A.BlockValues + (umm)BlockIndex*BLOCK_SPARSE_ROWS;
+			r32 *SourceValue = MatrixColumnData(Source, A.BlockColumns[BlockIndex]) + FirstRow;
+			for(u32 RowIndex = 0;
+			    RowIndex < BlockRows;
+			    ++RowIndex)
+			{
+				Dest[RowIndex] = SourceValue[RowIndex];
+			}
+		}
+	}
+}
+
+internal block_sparse_matrix
+PackBlockSparseAt(char *Site, memory_pool *Pool, matrix A, matrix Pattern)
+{
+	TIMED_BLOCK("PackBlockSparse", 0, 0);
+
+	// NOTE: Pattern's non-zeros pick the blocks and A fills them in. Packing
+	//	by a pruning mask keeps a block for every weight training may still
+	//	move, so BlockSparseCopyValues can refresh the values in place.
+	Assert((A.RowCount == Pattern.RowCount) && (A.ColumnCount == Pattern.ColumnCount));
+
+	block_sparse_matrix Result = {};
+	Result.RowCount = A.RowCount;
+	Result.ColumnCount = A.ColumnCount;
+
+	u32 BlockRowCount = BlockSparseRowCount(A.RowCount);
+	Result.BlockRowStarts = PoolPushArrayAt(Site, Pool, u32, BlockRowCount + 1);
+	for(u32 BlockRow = 0;
+	    BlockRow < BlockRowCount;
+	    ++BlockRow)
+	{
+		Result.BlockRowStarts[BlockRow] = Result.BlockCount;
+		for(u32 ColumnIndex = 0;
+		    ColumnIndex < A.ColumnCount;
+		    ++ColumnIndex)
+		{
+			if(BlockHasNonZero(Pattern, BlockRow, ColumnIndex))
+			{
+				++Result.BlockCount;
+			}
+		}
+	}
+	Result.BlockRowStarts[BlockRowCount] = Result.BlockCount;
+
+	Result.BlockColumns = PoolPushArrayAt(Site, Pool, u32, Result.BlockCount);
+	Result.BlockValues = PoolPushArrayAlignedAt(Site, Pool, r32, (umm)Result.BlockCount*BLOCK_SPARSE_ROWS);
+
+	u32 BlockIndex = 0;
+	for(u32 BlockRow = 0;
+	    BlockRow < BlockRowCount;
+	    ++BlockRow)
+	{
+		for(u32 ColumnIndex = 0;
+		    ColumnIndex < A.ColumnCount;
+		    ++ColumnIndex)
+		{
+			if(BlockHasNonZero(Pattern, BlockRow, ColumnIndex))
+			{
+				Result.BlockColumns[BlockIndex++] = ColumnIndex;
+			}
+		}
+	}
+	Assert(BlockIndex == Result.BlockCount);
+
+	r32 *Values = Result.BlockValues;
+	for(umm ValueIndex = 0;
+	    ValueIndex < (umm)Result.BlockCount*BLOCK_SPARSE_ROWS;
+	    ++ValueIndex)
+	{
+		*Values++ = 0.0f;
+	}
+	BlockSparseCopyValues(Result, A);
+
+	return Result;
+}
+#define PackBlockSparse(...) PackBlockSparseAt(POOL_CALL_SITE, __VA_ARGS__)
+
+internal matrix
+UnpackBlockSparseAt(char *Site, memory_pool *Pool, block_sparse_matrix A)
+{
+	matrix Result = MatrixRawAt(Site, Pool, A.RowCount, A.ColumnCount);
+	for(u32 ColumnIndex = 0;
+	    ColumnIndex < Result.ColumnCount;
+	    ++ColumnIndex)
+	{
+		r32 *Dest = MatrixColumnData(Result, ColumnIndex);
+		for(u32 RowIndex = 0;
+		    RowIndex < Result.RowCount;
+		    ++RowIndex)
+		{
+			Dest[RowIndex] = 0.0f;
+		}
+	}
+
+	u32 BlockRowCount = BlockSparseRowCount(A.RowCount);
+	for(u32 BlockRow = 0;
+	    BlockRow < BlockRowCount;
+	    ++BlockRow)
+	{
+		u32 FirstRow = BlockRow*BLOCK_SPARSE_ROWS;
+		u32 BlockRows = Minimum(BLOCK_SPARSE_ROWS, A.RowCount - FirstRow);
+		for(u32 BlockIndex = A.BlockRowStarts[BlockRow];
+		    BlockIndex < A.BlockRowStarts[BlockRow + 1];
+		    ++BlockIndex)
+		{
+			r32 *Source = A.BlockValues + (umm)BlockIndex*BLOCK_SPARSE_ROWS;
+			r32 *Dest = MatrixColumnData(Result, A.BlockColumns[BlockIndex]) + FirstRow;
+			for(u32 RowIndex = 0;
+			    RowIndex < BlockRows;
+			    ++RowIndex)
+			{
+				Dest[RowIndex] = Source[RowIndex];
+			}
+		}
+	}
+
+	return Result;
+}
+#define UnpackBlockSparse(...) UnpackBlockSparseAt(POOL_CALL_SITE, __VA_ARGS__)
+
+// NOTE: Any denser and the dense GEMM is faster, even counting the zeros.
+#define BLOCK_SPARSE_MAX_DENSITY 0.6f
+
+inline r32
+BlockSparseDensity(block_sparse_matrix A)
+{
+	r32 Result = (r32)A.BlockCount / ((r32)BlockSparseRowCount(A.RowCount)*A.ColumnCount);
+	return Result;
+}
+
+inline void
+BlockSparseMultInto(matrix Result, block_sparse_matrix A, matrix B)
+{
+	TIMED_BLOCK("BlockSparseMult",
+	            ((u64)A.BlockCount*(BLOCK_SPARSE_ROWS + 1) + (u64)B.RowCount*B.ColumnCount +
+	             (u64)A.RowCount*B.ColumnCount)*sizeof(r32),
+	            2*(u64)A.BlockCount*BLOCK_SPARSE_ROWS*B.ColumnCount);
+
+	Assert(A.ColumnCount == B.RowCount);
+	Assert((Result.RowCount == A.RowCount) && (Result.ColumnCount == B.ColumnCount));
+
+	GlobalMathKernels.BlockSparseGemm(Result.Data, Result.Stride,
+	                                  A.BlockRowStarts, A.BlockColumns, A.BlockValues,
+	                                  B.Data, B.Stride, Result.RowCount, Result.ColumnCount);
+}
+
+//
+// NOTE: Decompositions
+//
+
+internal void
+OrthonormalizeColumns(matrix A)
+{
+	TIMED_BLOCK("OrthonormalizeColumns", 0, 2*2*(u64)A.RowCount*A.ColumnCount*A.ColumnCount);
+
+	// NOTE: Modified Gram-Schmidt, twice over, since a single pass loses
+	//	orthogonality when the columns are close to dependent. A column with
+	//	nothing left of it is zeroed rather than blown up.
+	for(u32 Pass = 0;
+	    Pass < 2;
+	    ++Pass)
+	{
+		for(u32 ColumnIndex = 0;
+		    ColumnIndex < A.ColumnCount;
+		    ++ColumnIndex)
+		{
+			r32 *Column = MatrixColumnData(A, ColumnIndex);
+			for(u32 PreviousIndex = 0;
+			    PreviousIndex < ColumnIndex;
+			    ++PreviousIndex)
+			{
+				r32 *Previous = MatrixColumnData(A, PreviousIndex);
+				r32 Projection = GlobalMathKernels.Dot(Previous, Column, A.RowCount);
+				for(u32 RowIndex = 0;
+				    RowIndex < A.RowCount;
+				    ++RowIndex)
+				{
+					Column[RowIndex] -= Projection*Previous[RowIndex];
+				}
+			}
+
+			r32 Length = SquareRoot(GlobalMathKernels.Dot(Column, Column, A.RowCount));
+			r32 Scale = (Length > 1e-20f) ? (1.0f / Length) : 0.0f;
+			GlobalMathKernels.ScaleEquals(Column, Scale, A.RowCount);
+		}
+	}
+}
+
+internal void
+SymmetricEigen(r64 *A, r64 *Vectors, r64 *Values, u32 Count)
+{
+	TIMED_BLOCK("SymmetricEigen", 0, 0);
+
+	// NOTE: Cyclic Jacobi on a column-major Count x Count symmetric A, which
+	//	is destroyed. The eigenvectors come back as the columns of Vectors,
+	//	ordered by descending eigenvalue. Meant for the small matrices the
+	//	factorizations reduce to, not for anything large.
+	for(u32 Column = 0;
+	    Column < Count;
+	    ++Column)
+	{
+		for(u32 Row = 0;
+		    Row < Count;
+		    ++Row)
+		{
+			Vectors[Column*Count + Row] = (Row == Column) ? 1.0 : 0.0;
+		}
+	}
+
+	for(u32 Sweep = 0;
+	    Sweep < 64;
+	    ++Sweep)
+	{
+		r64 OffDiagonal = 0.0;
+		r64 Diagonal = 0.0;
+		for(u32 Column = 0;
+		    Column < Count;
+		    ++Column)
+		{
+			for(u32 Row = 0;
+			    Row < Count;
+			    ++Row)
+			{
+				r64 Value = A[Column*Count + Row];
+				if(Row == Column)
+				{
+					Diagonal += Value*Value;
+				}
+				else
+				{
+					OffDiagonal += Value*Value;
+				}
+			}
+		}
+		if(OffDiagonal <= 1e-24*Diagonal)
+		{
+			break;
+		}
+
+		for(u32 P = 0;
+		    P < Count;
+		    ++P)
+		{
+			for(u32 Q = P + 1;
+			    Q < Count;
+			    ++Q)
+			{
+				r64 APQ = A[Q*Count + P];
+				if(APQ == 0.0)
+				{
+					continue;
+				}
+
+				r64 Theta = (A[Q*Count + Q] - A[P*Count + P]) / (2.0*APQ);
+				r64 T = ((Theta >= 0.0) ? 1.0 : -1.0) / (fabs(Theta) + sqrt(Theta*Theta + 1.0));
+				r64 C = 1.0 / sqrt(T*T + 1.0);
+				r64 S = T*C;
+
+				for(u32 K = 0;
+				    K < Count;
+				    ++K)
+				{
+					r64 AKP = A[P*Count + K];
+					r64 AKQ = A[Q*Count + K];
+					A[P*Count + K] = C*AKP - S*AKQ;
+					A[Q*Count + K] = S*AKP + C*AKQ;
+				}
+				for(u32 K = 0;
+				    K < Count;
+				    ++K)
+				{
+					r64 APK = A[K*Count + P];
+					r64 AQK = A[K*Count + Q];
+					A[K*Count + P] = C*APK - S*AQK;
+					A[K*Count + Q] = S*APK + C*AQK;
+				}
+				for(u32 K = 0;
+				    K < Count;
+				    ++K)
+				{
+					r64 VKP = Vectors[P*Count + K];
+					r64 VKQ = Vectors[Q*Count + K];
+					Vectors[P*Count + K] = C*VKP - S*VKQ;
+					Vectors[Q*Count + K] = S*VKP + C*VKQ;
+				}
+			}
+		}
+	}
+
+	for(u32 Index = 0;
+	    Index < Count;
+	    ++Index)
+	{
+		Values[Index] = A[Index*Count + Index];
+	}
+
+	// NOTE: Selection sort; Count is small and each swap moves a whole vector.
+	for(u32 Index = 0;
+	    Index < Count;
+	    ++Index)
+	{
+		u32 Largest = Index;
+		for(u32 Other = Index + 1;
+		    Other < Count;
+		    ++Other)
+		{
+			if(Values[Other] > Values[Largest])
+			{
+				Largest = Other;
+			}
+		}
+
+		if(Largest != Index)
+		{
+			r64 Value = Values[Index];
+			Values[Index] = Values[Largest];
+			Values[Largest] = Value;
+			for(u32 K = 0;
+			    K < Count;
+			    ++K)
+			{
+				r64 Component = Vectors[Index*Count + K];
+				Vectors[Index*Count + K] = Vectors[Largest*Count + K];
+				Vectors[Largest*Count + K] = Component;
+			}
+		}
+	}
+}
@@ -1,68 +1,324 @@
-#pragma once
-
-struct memory_pool
-{
-	u8 *Base;
-	umm TotalSize;
-	umm Size;
-	u32 TempMemCount;
-};
-
-struct temp_memory
-{
-	memory_pool *Pool;
-	umm OldSize;
-	u32 TempMemIndex;
-};
-
-internal void
-PoolInitialize(memory_pool *Pool, u8 *Base, umm TotalSize)
-{
-	Pool->Base = Base;
-	Pool->TotalSize = TotalSize;
-	Pool->Size = 0;
-}
-
-inline umm
-PoolSizeLeft(memory_pool *Pool)
-{
-	umm Result = Pool->TotalSize - Pool->Size;
-	return Result;
-}
-
-inline u8*
-PoolPushSize(memory_pool *Pool, u32 Size)
-{
-	u8 *Result = 0;
-	Assert(PoolSizeLeft(Pool) >= Size);
-	Result = Pool->Base + Pool->Size;
-	Pool->Size += Size;
-	return Result;
-}
-#define PoolPushStruct(Pool, type) (type *)PoolPushSize(Pool, sizeof(type))
-#define PoolPushArray(Pool, type, Count) (type *)PoolPushSize(Pool, (Count) * sizeof(type))
-
-inline temp_memory
-PoolBeginTempMemory(memory_pool *Pool)
-{
-	temp_memory Result;
-	Result.Pool = Pool;
-	Result.OldSize = Pool->Size;
-	Result.TempMemIndex = ++Pool->TempMemCount;
-	return Result;
-}
-
-inline void
-PoolEndTempMemory(temp_memory TempMem)
-{
-	memory_pool *Pool = TempMem.Pool;
-	Assert(Pool->TempMemCount == TempMem.TempMemIndex)
-	Pool->Size = TempMem.OldSize;
-	--Pool->TempMemCount;
-}
-
-inline void
-PoolCheckMemory(memory_pool *Pool)
-{
-	Assert(Pool->TempMemCount == 0);
-}
\ No newline at end of file
+#pragma once
+
+/*
+	NOTE: A pool either wraps memory the caller already owns (PoolInitialize)
+		or reserves its own address space up front and commits it in
+		POOL_COMMIT_GRANULARITY steps as Size grows (PoolReserve). Reserving is
+		free, so pools can be given far more room than they will use, and the
+		process only pays for what is actually pushed.
+*/
+
+#define POOL_COMMIT_GRANULARITY Megabytes(2)
+
+struct memory_pool
+{
+	u8 *Base;
+	umm TotalSize;
+	umm CommittedSize;
+	umm Size;
+	umm HighWaterMark;
+	u32 TempMemCount;
+	u32 Flags;
+};
+
+struct temp_memory
+{
+	memory_pool *Pool;
+	umm OldSize;
+	u32 TempMemIndex;
+};
+
+#if NN_INTERNAL
+/*
+	NOTE: Every PoolPush records its call site (file and line) here, across
+		all pools. Sites are string literals, so the pointer is the key.
+*/
+#define POOL_ALLOCATION_SITE_COUNT 256
+
+struct pool_allocation_site
+{
+	char * volatile Site;
+	u64 volatile PushCount;
+	u64 volatile ByteCount;
+};
+global_variable pool_allocation_site GlobalPoolAllocationSites[POOL_ALLOCATION_SITE_COUNT];
+
+internal void
+PoolRecordAllocationSite(char *Site, umm Size)
+{
+	u32 Hash = (u32)(((umm)Site >> 3) * 2654435761u);
+	for(u32 Probe = 0;
+	    Probe < POOL_ALLOCATION_SITE_COUNT;
+	    ++Probe)
+	{
+		pool_allocation_site *Entry = GlobalPoolAllocationSites + ((Hash + Probe) % POOL_ALLOCATION_SITE_COUNT);
+		char *EntrySite = Entry->Site;
+		if(!EntrySite)
+		{
+#if _WIN32
+			EntrySite = (char *)InterlockedCompareExchangePointer((void * volatile *)&Entry->Site, Site, 0);
+#else
+			EntrySite = __sync_val_compare_and_swap(&Entry->Site, (char *)0, Site);
+#endif
+			if(!EntrySite)
+			{
+				EntrySite = Site;
+			}
+		}
+
+		if(EntrySite == Site)
+		{
+			AtomicAddU64(&Entry->PushCount, 1);
+			AtomicAddU64(&Entry->ByteCount, Size);
+			break;
+		}
+	}
+}
+#endif
+
+internal void
+PoolInitialize(memory_pool *Pool, u8 *Base, umm TotalSize)
+{
+	Pool->Base = Base;
+	Pool->TotalSize = TotalSize;
+	Pool->CommittedSize = TotalSize;
+	Pool->Size = 0;
+	Pool->HighWaterMark = 0;
+	Pool->Flags = 0;
+}
+
+internal b32
+PoolReserve(memory_pool *Pool, umm TotalSize, u32 Flags = 0)
+{
+	// NOTE: Flags are platform_memory_flags; Pool->Flags says which ones the
+	//	OS actually granted.
+	u32 GrantedFlags = 0;
+	u8 *Base = PlatformReserveMemory(TotalSize, Flags, &GrantedFlags);
+
+	PoolInitialize(Pool, Base, Base ? TotalSize : 0);
+	Pool->CommittedSize = 0;
+	Pool->Flags = GrantedFlags;
+
+	b32 Result = (Base != 0);
+	return Result;
+}
+
+inline umm
+PoolSizeLeft(memory_pool *Pool)
+{
+	umm Result = Pool->TotalSize - Pool->Size;
+	return Result;
+}
+
+internal void
+PoolCommit(memory_pool *Pool, umm Size)
+{
+	if(Size > Pool->TotalSize)
+	{
+		fprintf(stderr, "Memory pool exhausted: %llu bytes needed, %llu reserved\n",
+		        (unsigned long long)Size, (unsigned long long)Pool->TotalSize);
+		InvalidCodePath;
+		exit(1);
+	}
+
+	umm NewCommittedSize = (Size + POOL_COMMIT_GRANULARITY - 1) & ~(umm)(POOL_COMMIT_GRANULARITY - 1);
+	if(NewCommittedSize > Pool->TotalSize)
+	{
+		NewCommittedSize = Pool->TotalSize;
+	}
+
+	if(!PlatformCommitMemory(Pool->Base + Pool->CommittedSize, NewCommittedSize - Pool->CommittedSize))
+	{
+		fprintf(stderr, "Memory pool could not commit %llu bytes\n", (unsigned long long)NewCommittedSize);
+		InvalidCodePath;
+		exit(1);
+	}
+	Pool->CommittedSize = NewCommittedSize;
+}
+
+inline u8*
+PoolPushSize_(memory_pool *Pool, umm Size, char *Site)
+{
+	u8 *Result = 0;
+
+	umm NewSize = Pool->Size + Size;
+	if(NewSize > Pool->CommittedSize)
+	{
+		PoolCommit(Pool, NewSize);
+	}
+
+	Result = Pool->Base + Pool->Size;
+	Pool->Size = NewSize;
+	if(Pool->HighWaterMark < NewSize)
+	{
+		Pool->HighWaterMark = NewSize;
+	}
+
+#if NN_INTERNAL
+	PoolRecordAllocationSite(Site, Size);
+#endif
+
+	return Result;
+}
+
+#define POOL_STRINGIZE_(Value) #Value
+#define POOL_STRINGIZE(Value) POOL_STRINGIZE_(Value)
+#define POOL_CALL_SITE __FILE__ "(" POOL_STRINGIZE(__LINE__) ")"
+
+#define PoolPushSize(Pool, Size) PoolPushSize_(Pool, (umm)(Size), POOL_CALL_SITE)
+#define PoolPushStruct(Pool, type) (type *)PoolPushSize(Pool, sizeof(type))
+#define PoolPushArray(Pool, type, Count) (type *)PoolPushSize(Pool, (umm)(Count) * sizeof(type))
+
+// NOTE: A cache line, which also covers every SIMD register width we use.
+#define POOL_DEFAULT_ALIGNMENT 64
+
+inline u8 *
+PoolPushSizeAligned_(char *Site, memory_pool *Pool, umm Size, umm Alignment = POOL_DEFAULT_ALIGNMENT)
+{
+	Assert((Alignment & (Alignment - 1)) == 0);
+
+	umm Address = (umm)(Pool->Base + Pool->Size);
+	umm Padding = ((Address + Alignment - 1) & ~(Alignment - 1)) - Address;
+	u8 *Result = PoolPushSize_(Pool, Padding + Size, Site) + Padding;
+	return Result;
+}
+#define PoolPushSizeAligned(...) PoolPushSizeAligned_(POOL_CALL_SITE, __VA_ARGS__)
+#define PoolPushStructAligned(Pool, type) (type *)PoolPushSizeAligned(Pool, sizeof(type))
+#define PoolPushArrayAligned(Pool, type, Count) (type *)PoolPushSizeAligned(Pool, (umm)(Count) * sizeof(type))
+
+/*
+	NOTE: Helpers that push on their caller's behalf (MatrixRaw_, Mult,
+		MakeSparseMatrix, ...) take the caller's site as their first argument,
+		with a macro of the helper's name passing POOL_CALL_SITE, and push with
+		the At versions below. That way -memstats names the line that asked for
+		the matrix, not the line in nn_math.h that pushed it.
+*/
+#define PoolPushSizeAt(Site, Pool, Size) PoolPushSize_(Pool, (umm)(Size), Site)
+#define PoolPushArrayAt(Site, Pool, type, Count) (type *)PoolPushSizeAt(Site, Pool, (umm)(Count) * sizeof(type))
+#define PoolPushSizeAlignedAt(Site, ...) PoolPushSizeAligned_(Site, __VA_ARGS__)
+#define PoolPushArrayAlignedAt(Site, Pool, type, Count) (type *)PoolPushSizeAlignedAt(Site, Pool, (umm)(Count) * sizeof(type))
+
+inline temp_memory
+PoolBeginTempMemory(memory_pool *Pool)
+{
+	temp_memory Result;
+	Result.Pool = Pool;
+	Result.OldSize = Pool->Size;
+	Result.TempMemIndex = ++Pool->TempMemCount;
+	return Result;
+}
+
+inline void
+PoolEndTempMemory(temp_memory TempMem)
+{
+	memory_pool *Pool = TempMem.Pool;
+	Assert(Pool->TempMemCount == TempMem.TempMemIndex)
+	Pool->Size = TempMem.OldSize;
+	--Pool->TempMemCount;
+}
+
+inline void
+PoolCheckMemory(memory_pool *Pool)
+{
+	Assert(Pool->TempMemCount == 0);
+}
+
+inline void
+PoolReset(memory_pool *Pool)
+{
+	PoolCheckMemory(Pool);
+	Pool->Size = 0;
+}
+
+/*
+	NOTE: Every thread gets its own scratch pool the first time it asks for
+		one. It is reserved and committed by that thread, so the pages land on
+		the thread's own NUMA node the first time it writes them, and no two
+		threads ever push from the same pool or share a cache line of it.
+
+		Use BeginThreadScratch/PoolEndTempMemory around scratch work; scopes
+		nest like any other temp memory, so the pools empty themselves and
+		never need a reset.
+*/
+#define THREAD_SCRATCH_RESERVE_SIZE Gigabytes(4)
+#define THREAD_SCRATCH_MAX_COUNT 64
+
+global_variable memory_pool GlobalThreadScratchPools[THREAD_SCRATCH_MAX_COUNT];
+global_variable u32 volatile GlobalThreadScratchCount;
+global_variable thread_local memory_pool *GlobalThreadScratch;
+
+internal memory_pool *
+GetThreadScratch()
+{
+	memory_pool *Result = GlobalThreadScratch;
+	if(!Result)
+	{
+		u32 ScratchIndex = AtomicAddU32(&GlobalThreadScratchCount, 1);
+		Assert(ScratchIndex < THREAD_SCRATCH_MAX_COUNT);
+		Result = GlobalThreadScratchPools + ScratchIndex;
+		if(!PoolReserve(Result, THREAD_SCRATCH_RESERVE_SIZE))
+		{
+			fprintf(stderr, "Could not reserve thread scratch memory\n");
+			InvalidCodePath;
+			exit(1);
+		}
+		GlobalThreadScratch = Result;
+	}
+	return Result;
+}
+
+inline temp_memory
+BeginThreadScratch()
+{
+	temp_memory Result = PoolBeginTempMemory(GetThreadScratch());
+	return Result;
+}
+
+internal void
+PrintPoolStats(char *Name, memory_pool *Pool)
+{
+	printf("%s: %.1f MB high water, %.1f MB committed, %.1f MB reserved%s%s\n",
+	       Name,
+	       (r64)Pool->HighWaterMark / (1024.0*1024.0),
+	       (r64)Pool->CommittedSize / (1024.0*1024.0),
+	       (r64)Pool->TotalSize / (1024.0*1024.0),
+	       (Pool->Flags & PlatformMemory_HugeTLB) ? ", hugetlb pages" : "",
+	       (Pool->Flags & PlatformMemory_HugePages) ? ", transparent huge pages" : "");
+}
+
+internal void
+PrintPoolAllocationSites()
+{
+#if NN_INTERNAL
+	// NOTE: Biggest sites first.
+	pool_allocation_site *Sorted[POOL_ALLOCATION_SITE_COUNT];
+	u32 SortedCount = 0;
+	for(u32 EntryIndex = 0;
+	    EntryIndex < POOL_ALLOCATION_SITE_COUNT;
+	    ++EntryIndex)
+	{
+		pool_allocation_site *Entry = GlobalPoolAllocationSites + EntryIndex;
+		if(Entry->Site)
+		{
+			u32 InsertIndex = SortedCount++;
+			while((InsertIndex > 0) && (Sorted[InsertIndex - 1]->ByteCount < Entry->ByteCount))
+			{
+				Sorted[InsertIndex] = Sorted[InsertIndex - 1];
+				--InsertIndex;
+			}
+			Sorted[InsertIndex] = Entry;
+		}
+	}
+
+	printf("  %-48s %12s %12s\n", "Allocation site", "Pushes", "MB");
+	for(u32 SortedIndex = 0;
+	    SortedIndex < SortedCount;
+	    ++SortedIndex)
+	{
+		pool_allocation_site *Entry = Sorted[SortedIndex];
+		printf("  %-48s %12llu %12.2f\n", Entry->Site,
+		       (unsigned long long)Entry->PushCount,
+		       (r64)Entry->ByteCount / (1024.0*1024.0));
+	}
+#endif
+}
@@ -0,0 +1,381 @@
+
+/*
+	NOTE: Mixed precision training. -bf16 keeps the batch's activations and
+		errors as bf16 between layers, and multiplies them with a bf16 copy
+		of the weights, while the updates still go into the r32 weights and
+		every product still sums in r32. The weighted inputs aren't kept at
+		all: backprop takes each activation's derivative from its output
+		(HadamardActivationPrimeFromOutput). That is a quarter of the bytes
+		per layer that BackPropagateBatch keeps, and the products read half
+		the bytes.
+
+	Some things stay r32:
+		- The first layer. It reads the data set's inputs with the r32
+			weights, so the sparse and JIT paths still apply, and the inputs
+			are never converted.
+		- The output layer's weighted inputs and activations, for
+			OutputErrorBatch, and every layer's error while it is being
+			computed. Each error is stored as bf16 once its bias gradient is
+			summed.
+		- The weight and bias gradients, and everything ApplyGradients does.
+
+	bf16 has r32's exponent range, so small gradients don't flush to zero
+		the way they would in fp16, and there is no loss scaling. What it
+		loses is mantissa: about 3 significant digits.
+
+	The error going back, the transposed product, uses AVX512-BF16's dot
+		product when the CPU has it (see InitializeMathKernels), and the
+		widening dot everywhere else. -bf16bench compares a batch both
+		ways, in peak memory and time, and trains copies of the network
+		both ways on the same batches.
+*/
+
+#define MIXED_BENCHMARK_BATCHES 200
+#define MIXED_BENCHMARK_REPEATS 5
+
+struct mixed_network
+{
+	// NOTE: bf16 copies of the weights from layer 2 on, refreshed from the
+	//	r32 ones after every update.
+	matrix_bf16 *Weights;
+};
+
+internal b32
+MixedNetworkSupports(neural_network Network)
+{
+	// NOTE: Sign's derivative can't be taken from its output, which is all
+	//	this path keeps.
+	b32 Result = (NetworkIsDense(Network) && !Network.Ranks);
+	for(u32 LayerIndex = 1;
+	    LayerIndex < (Network.LayerCount - 1);
+	    ++LayerIndex)
+	{
+		Result &= (LayerActivation(Network, LayerIndex) != Activation_Sign);
+	}
+	return Result;
+}
+
+internal void
+RefreshMixedWeights(mixed_network *Mixed, neural_network Network)
+{
+	for(u32 LayerIndex = 2;
+	    LayerIndex < Network.LayerCount;
+	    ++LayerIndex)
+	{
+		ToBF16Into(Mixed->Weights[LayerIndex], Network.WeightMatrices[LayerIndex]);
+	}
+}
+
+internal mixed_network *
+PushMixedNetwork(memory_pool *Pool, neural_network Network)
+{
+	Assert(MixedNetworkSupports(Network));
+
+	mixed_network *Result = PoolPushStruct(Pool, mixed_network);
+	Result->Weights = PoolPushArray(Pool, matrix_bf16, Network.LayerCount);
+	for(u32 LayerIndex = 2;
+	    LayerIndex < Network.LayerCount;
+	    ++LayerIndex)
+	{
+		matrix Weights = Network.WeightMatrices[LayerIndex];
+		Result->Weights[LayerIndex] = MatrixBF16Raw_(Pool, Weights.RowCount, Weights.ColumnCount);
+	}
+	RefreshMixedWeights(Result, Network);
+
+	return Result;
+}
+
+internal void
+MixedFeedForwardLayer(memory_pool *Pool, parallel_context *Parallel, mixed_network *Mixed,
+                      neural_network Network, u32 Index, matrix_bf16 Input,
+                      matrix *WeightedInput, matrix *Activation)
+{
+	TRACE_BLOCK_ARG("Layer forward", Index);
+
+	*WeightedInput = MatrixRaw_(Pool, Network.Layers[Index], Input.ColumnCount);
+	ParallelBF16ProductInto(Pool, Parallel, BF16ProductKernel_Mult, *WeightedInput, Mixed->Weights[Index], Input);
+	EvaluateInto(*WeightedInput, LazyMVPlus(Lazy(*WeightedInput), Network.BiasVectors[Index]));
+	*Activation = Activate(Pool, *WeightedInput, LayerActivation(Network, Index));
+}
+
+internal network_gradients
+MixedComputeGradientsBatch(memory_pool *Pool, parallel_context *Parallel, mixed_network *Mixed,
+                           neural_network Network, matrix Inputs, matrix Outputs)
+{
+	TIMED_BLOCK("MixedComputeGradientsBatch", 0, 0);
+
+	Assert(Inputs.RowCount == Network.Layers[0]);
+
+	network_gradients Result = PushNetworkGradients(Pool, Network);
+
+	u32 TrialCount = Inputs.ColumnCount;
+	u32 OutputLayer = Network.LayerCount - 1;
+
+	sparse_matrix SparseInputs = {};
+	b32 HasSparseInputs = false;
+	if(Parallel->SparseInputDensity > 0.0f)
+	{
+		HasSparseInputs = MakeSparseMatrix(Pool, Inputs, Parallel->SparseInputDensity, &SparseInputs);
+	}
+
+	// NOTE: Every layer's r32 results are dropped as soon as its activations
+	//	are stored as bf16, except the output layer's.
+	matrix_bf16 *Activations = PoolPushArray(Pool, matrix_bf16, Network.LayerCount);
+	matrix OutputWeightedInput = {};
+	matrix OutputActivation = {};
+	for(u32 LayerIndex = 1;
+	    LayerIndex <= OutputLayer;
+	    ++LayerIndex)
+	{
+		b32 Hidden = (LayerIndex < OutputLayer);
+		temp_memory LayerMem = {};
+		if(Hidden)
+		{
+			Activations[LayerIndex] = MatrixBF16Raw_(Pool, Network.Layers[LayerIndex], TrialCount);
+			LayerMem = PoolBeginTempMemory(Pool);
+		}
+
+		matrix WeightedInput;
+		matrix Activation;
+		if(LayerIndex == 1)
+		{
+			FeedForwardLayer(Pool, Parallel, Network, 1, Inputs, HasSparseInputs, SparseInputs,
+			                 &WeightedInput, &Activation);
+		}
+		else
+		{
+			MixedFeedForwardLayer(Pool, Parallel, Mixed, Network, LayerIndex, Activations[LayerIndex - 1],
+			                      &WeightedInput, &Activation);
+		}
+
+		if(Hidden)
+		{
+			ToBF16Into(Activations[LayerIndex], Activation);
+			PoolEndTempMemory(LayerMem);
+		}
+		else
+		{
+			OutputWeightedInput = WeightedInput;
+			OutputActivation = Activation;
+		}
+	}
+
+	matrix OutputError = OutputErrorBatch(Pool, Network, OutputWeightedInput, OutputActivation, Outputs);
+	if(OutputLayer == 1)
+	{
+		AccumulateLayerGradients(Pool, Parallel, Network, Result, 1, OutputError, Inputs,
+		                         HasSparseInputs, SparseInputs, false);
+		return Result;
+	}
+
+	ParallelMatrixSumColumnsInto(Pool, Parallel, Result.BiasGradients[OutputLayer], OutputError);
+	matrix_bf16 Error = ToBF16(Pool, OutputError);
+	for(u32 LayerIndex = OutputLayer;
+	    LayerIndex > 1;
+	    --LayerIndex)
+	{
+		TRACE_BLOCK_ARG("Layer backward", LayerIndex - 1);
+
+		ParallelBF16ProductInto(Pool, Parallel, BF16ProductKernel_MultTranspose, Result.WeightGradients[LayerIndex],
+		                        Error, Activations[LayerIndex - 1]);
+
+		// NOTE: The previous layer's error is r32 until its bias gradient, and
+		//	the first layer's weight gradient, are taken from it.
+		b32 FirstLayer = (LayerIndex == 2);
+		matrix_bf16 PreviousError = {};
+		if(!FirstLayer)
+		{
+			PreviousError = MatrixBF16Raw_(Pool, Network.Layers[LayerIndex - 1], TrialCount);
+		}
+		temp_memory LayerMem = PoolBeginTempMemory(Pool);
+
+		matrix PreviousError32 = MatrixRaw_(Pool, Network.Layers[LayerIndex - 1], TrialCount);
+		ParallelBF16ProductInto(Pool, Parallel, BF16ProductKernel_TransposeMult, PreviousError32,
+		                        Mixed->Weights[LayerIndex], Error);
+		HadamardActivationPrimeFromOutput(PreviousError32, FromBF16(Pool, Activations[LayerIndex - 1]),
+		                                  LayerActivation(Network, LayerIndex - 1));
+
+		if(FirstLayer)
+		{
+			AccumulateLayerGradients(Pool, Parallel, Network, Result, 1, PreviousError32, Inputs,
+			                         HasSparseInputs, SparseInputs, false);
+		}
+		else
+		{
+			ParallelMatrixSumColumnsInto(Pool, Parallel, Result.BiasGradients[LayerIndex - 1], PreviousError32);
+			ToBF16Into(PreviousError, PreviousError32);
+		}
+
+		PoolEndTempMemory(LayerMem);
+		Error = PreviousError;
+	}
+
+	return Result;
+}
+
+internal void
+MixedGradientDescentBatch(memory_pool *Pool, parallel_context *Parallel, mixed_network *Mixed,
+                          neural_network Network, matrix Inputs, matrix Outputs,
+                          r32 LearningRate, r32 Regularization, u32 TotalTrials)
+{
+	TIMED_BLOCK("MixedGradientDescentBatch", 0, 0);
+
+	temp_memory TempMem = PoolBeginTempMemory(Pool);
+
+	network_gradients Gradients = MixedComputeGradientsBatch(Pool, Parallel, Mixed, Network, Inputs, Outputs);
+	ApplyGradients(Network, Gradients, Inputs.ColumnCount, LearningRate, Regularization, TotalTrials);
+	RefreshMixedWeights(Mixed, Network);
+
+	PoolEndTempMemory(TempMem);
+}
+
+// NOTE: Like MeasureGradientsBatch, with Mixed set for the bf16 path.
+internal umm
+MeasureMixedBatch(memory_pool *Pool, parallel_context *Parallel, mixed_network *Mixed, neural_network Network,
+                  matrix Inputs, matrix Outputs, r32 *Seconds)
+{
+	umm OldHighWaterMark = Pool->HighWaterMark;
+	umm Result = 0;
+	*Seconds = 1e30f;
+	for(u32 Repeat = 0;
+	    Repeat < MIXED_BENCHMARK_REPEATS;
+	    ++Repeat)
+	{
+		temp_memory TempMem = PoolBeginTempMemory(Pool);
+		umm Start = Pool->Size;
+		Pool->HighWaterMark = Start;
+
+		u64 StartClock = PlatformGetWallClock();
+		if(Mixed)
+		{
+			MixedComputeGradientsBatch(Pool, Parallel, Mixed, Network, Inputs, Outputs);
+		}
+		else
+		{
+			ComputeGradientsBatch(Pool, Parallel, Network, Inputs, Outputs);
+		}
+		r32 BatchSeconds = PlatformGetSecondsElapsed(StartClock, PlatformGetWallClock());
+		if(BatchSeconds < *Seconds)
+		{
+			*Seconds = BatchSeconds;
+		}
+
+		Result = Pool->HighWaterMark - Start;
+		if(Pool->HighWaterMark < OldHighWaterMark)
+		{
+			Pool->HighWaterMark = OldHighWaterMark;
+		}
+		OldHighWaterMark = Pool->HighWaterMark;
+		PoolEndTempMemory(TempMem);
+	}
+
+	return Result;
+}
+
+internal r32
+TimeMixedErrorProduct(memory_pool *Pool, parallel_context *Parallel, matrix Result, matrix_bf16 Weights,
+                      matrix_bf16 Error)
+{
+	r32 Best = 1e30f;
+	for(u32 Repeat = 0;
+	    Repeat < MIXED_BENCHMARK_REPEATS;
+	    ++Repeat)
+	{
+		temp_memory TempMem = PoolBeginTempMemory(Pool);
+		u64 Start = PlatformGetWallClock();
+		ParallelBF16ProductInto(Pool, Parallel, BF16ProductKernel_TransposeMult, Result, Weights, Error);
+		r32 Seconds = PlatformGetSecondsElapsed(Start, PlatformGetWallClock());
+		if(Seconds < Best)
+		{
+			Best = Seconds;
+		}
+		PoolEndTempMemory(TempMem);
+	}
+	return Best;
+}
+
+internal BENCHMARK_TRAIN_BATCH(MixedBenchmarkBatch)
+{
+	MixedGradientDescentBatch(Pool, Parallel, (mixed_network *)Data, Network, Inputs, Outputs,
+	                          LearningRate, Regularization, TotalTrials);
+}
+
+internal void
+BenchmarkMixedPrecision(memory_pool *Pool, parallel_context *Parallel, neural_network Network,
+                        data_set TrainingSet, data_set TestSet, u32 BatchSize, r32 LearningRate, r32 Regularization)
+{
+	TRACE_BLOCK("Mixed precision benchmark");
+
+	if(!MixedNetworkSupports(Network))
+	{
+		printf("-bf16bench only trains dense, unfactored networks without sign activations; skipping it\n");
+		return;
+	}
+
+	temp_memory TempMem = PoolBeginTempMemory(Pool);
+
+	matrix Inputs = MatrixColumns(TrainingSet.Inputs, 0, BatchSize);
+	matrix Outputs = MatrixColumns(TrainingSet.Outputs, 0, BatchSize);
+	mixed_network *Mixed = PushMixedNetwork(Pool, Network);
+
+	r32 FullSeconds;
+	r32 MixedSeconds;
+	umm FullBytes = MeasureMixedBatch(Pool, Parallel, 0, Network, Inputs, Outputs, &FullSeconds);
+	umm MixedBytes = MeasureMixedBatch(Pool, Parallel, Mixed, Network, Inputs, Outputs, &MixedSeconds);
+
+	printf("Mixed precision benchmark, batches of %u, %u thread(s), bf16 error products in %s:\n",
+	       BatchSize, Parallel->Queue->ThreadCount, GlobalMathKernels.HardwareBF16 ? "AVX512-BF16" : "software");
+	// NOTE: The gradients are r32 both ways, so they are left out of the
+	//	comparison.
+	temp_memory GradientMem = PoolBeginTempMemory(Pool);
+	umm GradientStart = Pool->Size;
+	PushNetworkGradients(Pool, Network);
+	umm GradientBytes = Pool->Size - GradientStart;
+	PoolEndTempMemory(GradientMem);
+
+	printf("  a batch peaks at %.2fMB instead of %.2fMB, %.2fMB of it the gradients (%.0f%% saved on the rest)\n",
+	       (r64)MixedBytes/(1024.0*1024.0), (r64)FullBytes/(1024.0*1024.0), (r64)GradientBytes/(1024.0*1024.0),
+	       100.0*(1.0 - (r64)(MixedBytes - GradientBytes)/(r64)(FullBytes - GradientBytes)));
+	printf("  %.2fms a batch instead of %.2fms (%.2fx)\n", 1000.0f*MixedSeconds, 1000.0f*FullSeconds,
+	       FullSeconds/MixedSeconds);
+
+	// NOTE: The error products on their own, with AVX512-BF16's dot and
+	//	without it, when the CPU has it. The activations stand in for the
+	//	errors; only their shape matters.
+	if(GlobalMathKernels.HardwareBF16)
+	{
+		math_dot_bf16_kernel *HardwareDot = GlobalMathKernels.DotBF16;
+		feed_forward_batch_result FeedForward = FeedForwardBatch(Pool, Parallel, Network, Inputs);
+		for(u32 LayerIndex = 2;
+		    LayerIndex < Network.LayerCount;
+		    ++LayerIndex)
+		{
+			matrix_bf16 Weights = Mixed->Weights[LayerIndex];
+			matrix_bf16 Error = ToBF16(Pool, FeedForward.Activations[LayerIndex]);
+			matrix Result = MatrixRaw_(Pool, Network.Layers[LayerIndex - 1], BatchSize);
+
+			r32 HardwareSeconds = TimeMixedErrorProduct(Pool, Parallel, Result, Weights, Error);
+			GlobalMathKernels.DotBF16 = DotBF16_AVX512;
+			r32 SoftwareSeconds = TimeMixedErrorProduct(Pool, Parallel, Result, Weights, Error);
+			GlobalMathKernels.DotBF16 = HardwareDot;
+
+			printf("  layer %u error: %.2fus with AVX512-BF16, %.2fus widening (%.2fx)\n", LayerIndex,
+			       1e6f*HardwareSeconds, 1e6f*SoftwareSeconds, SoftwareSeconds/HardwareSeconds);
+		}
+	}
+
+	// NOTE: Both sides train, then run the test set. The bf16 copies of the
+	//	weights start out from Network's, the same as the copy they go with.
+	training_benchmark Training = BenchmarkTraining(Pool, Parallel, Network, TrainingSet, BatchSize,
+	                                                MIXED_BENCHMARK_BATCHES, LearningRate, Regularization,
+	                                                MixedBenchmarkBatch, 0, PushMixedNetwork(Pool, Network));
+
+	printf("  %u batches: %.2fus a batch instead of %.2fus, %.2f%% success instead of %.2f%%; "
+	       "%u weights and biases differ, by at most %g\n", Training.BatchCount,
+	       1e6f*Training.CandidateSeconds/Training.BatchCount, 1e6f*Training.GenericSeconds/Training.BatchCount,
+	       EvaluateNetwork(Pool, Parallel, Training.Candidate, TestSet),
+	       EvaluateNetwork(Pool, Parallel, Training.Generic, TestSet),
+	       Training.DifferentCount, Training.MaxDifference);
+
+	PoolEndTempMemory(TempMem);
+}
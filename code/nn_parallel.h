@@ -0,0 +1,580 @@
+#pragma once
+
+/*
+	NOTE: Reductions over the batch dimension (the weight and bias gradients),
+		spread across the work queue.
+
+	ReductionMode_Fast gives every thread one column range and adds the
+		partials into the result in whatever order the threads finished them.
+		The adds happen on the main thread once the queue drains, so no
+		worker ever waits on another to take its turn at the result.
+		Each partial lives in the scratch pool of the thread that computed it,
+		so it is written to memory local to that thread.
+		The float summation order changes with the thread count and with
+		scheduling, so the weights are not reproducible.
+
+	ReductionMode_Deterministic cuts the batch into chunks whose boundaries
+		depend only on the batch size, reduces each chunk serially and then
+		combines the chunk partials with a fixed pairwise tree. Which thread
+		does which piece of work never changes the result, so training is
+		bit-identical across runs and across thread counts. A batch that fits
+		in one chunk reduces exactly like the serial kernels.
+
+	The forward and backward products are split by columns instead. Every
+		column is computed on its own, so they give the same bits in either
+		mode however they are split. ColumnSplit is the number of column
+		ranges per thread.
+
+	MicroBatchSize runs the batch through backprop that many trials at a time,
+		so the activations of a micro-batch stay in cache from one layer to the
+		next. The gradients are summed across micro-batches, which changes
+		their summation order, so it is only used in ReductionMode_Fast.
+		Zero means the whole batch at once.
+
+	Input batches with at most SparseInputDensity non-zeros are encoded as
+		sparse columns, and the first layer's forward product and weight
+		gradient only touch the non-zero pixels. Those products give the same
+		bits as the dense ones, so this never changes the result. Zero turns
+		it off.
+	RecomputeSegment keeps the forward activations only every that many
+		layers and recomputes the layers in between during backprop, one
+		segment at a time (see nn_recompute.cpp). The kernels and their
+		inputs are the same, so this never changes the result either. Zero
+		keeps every layer.
+*/
+
+#define DETERMINISTIC_MIN_CHUNK_COLUMNS 32
+#define DETERMINISTIC_MAX_CHUNK_COUNT 64
+#define SPARSE_INPUT_DEFAULT_DENSITY 0.35f
+
+enum reduction_mode
+{
+	ReductionMode_Fast,
+	ReductionMode_Deterministic,
+};
+
+struct parallel_context
+{
+	platform_work_queue *Queue;
+	reduction_mode ReductionMode;
+
+	u32 ColumnSplit;
+	u32 MicroBatchSize;
+	r32 SparseInputDensity;
+	u32 RecomputeSegment;
+};
+
+enum reduction_kernel
+{
+	ReductionKernel_MultTranspose,
+	ReductionKernel_SparseMultTranspose,
+	ReductionKernel_SumColumns,
+};
+
+struct reduction_work;
+struct reduction_completion_order
+{
+	u32 volatile Count;
+	reduction_work **Works;
+};
+
+struct reduction_work
+{
+	reduction_kernel Kernel;
+	matrix A;
+	matrix B;
+	sparse_matrix SparseB;
+	matrix Partial;
+
+	// NOTE: Only used in ReductionMode_Fast, where Partial is pushed from the
+	//	scratch pool of whichever thread picks the work up.
+	reduction_completion_order *CompletionOrder;
+	temp_memory Scratch;
+};
+
+struct reduction_combine_work
+{
+	r32 **Partials;
+	u32 PartialCount;
+	u32 RowCount;
+	u32 ColumnStride;
+
+	// NOTE: Values count RowCount per column, so the padding rows are skipped.
+	u32 FirstValue;
+	u32 ValueCount;
+};
+
+internal void
+ReducePartial(reduction_work *Work)
+{
+	switch(Work->Kernel)
+	{
+		case ReductionKernel_MultTranspose:
+		{
+			MultTransposeInto(Work->Partial, Work->A, Work->B);
+		} break;
+
+		case ReductionKernel_SparseMultTranspose:
+		{
+			SparseMultTransposeInto(Work->Partial, Work->A, Work->SparseB);
+		} break;
+
+		case ReductionKernel_SumColumns:
+		{
+			MatrixSumColumnsInto(Vec(Work->Partial.Data, Work->Partial.RowCount), Work->A);
+		} break;
+
+		InvalidDefaultCase;
+	}
+}
+
+internal PLATFORM_WORK_QUEUE_CALLBACK(DoReductionPartialWork)
+{
+	TRACE_BLOCK("Reduction partial");
+
+	reduction_work *Work = (reduction_work *)Data;
+	reduction_completion_order *CompletionOrder = Work->CompletionOrder;
+	if(CompletionOrder)
+	{
+		Work->Scratch = BeginThreadScratch();
+		Work->Partial = MatrixRaw_(Work->Scratch.Pool, Work->Partial.RowCount, Work->Partial.ColumnCount);
+	}
+
+	ReducePartial(Work);
+
+	if(CompletionOrder)
+	{
+		u32 Slot = AtomicAddU32(&CompletionOrder->Count, 1);
+		CompletionOrder->Works[Slot] = Work;
+	}
+}
+
+internal PLATFORM_WORK_QUEUE_CALLBACK(DoReductionCombineWork)
+{
+	TRACE_BLOCK("Reduction combine");
+
+	reduction_combine_work *Work = (reduction_combine_work *)Data;
+
+	for(u32 Stride = 1;
+	    Stride < Work->PartialCount;
+	    Stride *= 2)
+	{
+		for(u32 PartialIndex = 0;
+		    (PartialIndex + Stride) < Work->PartialCount;
+		    PartialIndex += 2*Stride)
+		{
+			r32 *Dest = Work->Partials[PartialIndex];
+			r32 *Source = Work->Partials[PartialIndex + Stride];
+
+			u32 EndValue = Work->FirstValue + Work->ValueCount;
+			for(u32 ValueIndex = Work->FirstValue;
+			    ValueIndex < EndValue;
+			    )
+			{
+				u32 RowIndex = ValueIndex % Work->RowCount;
+				u32 RunCount = Minimum(Work->RowCount - RowIndex, EndValue - ValueIndex);
+				umm Offset = (umm)(ValueIndex / Work->RowCount)*Work->ColumnStride + RowIndex;
+				GlobalMathKernels.AddEquals(Dest + Offset, Source + Offset, RunCount);
+				ValueIndex += RunCount;
+			}
+		}
+	}
+}
+
+internal reduction_work *
+PushReductionWork(memory_pool *Pool, reduction_kernel Kernel, matrix A, matrix B,
+                  sparse_matrix SparseB, u32 FirstColumn, u32 ColumnCount)
+{
+	reduction_work *Work = PoolPushStruct(Pool, reduction_work);
+	*Work = {};
+	Work->Kernel = Kernel;
+	Work->A = MatrixColumns(A, FirstColumn, ColumnCount);
+	if(Kernel == ReductionKernel_MultTranspose)
+	{
+		Work->B = MatrixColumns(B, FirstColumn, ColumnCount);
+	}
+	else if(Kernel == ReductionKernel_SparseMultTranspose)
+	{
+		Work->SparseB = SparseColumns(SparseB, FirstColumn, ColumnCount);
+	}
+	return Work;
+}
+
+internal void
+ParallelReduceInto(memory_pool *Pool, parallel_context *Parallel, reduction_kernel Kernel,
+                   matrix Result, matrix A, matrix B, sparse_matrix SparseB = {})
+{
+	u32 ResultRows = Result.RowCount;
+	u32 ResultColumns = Result.ColumnCount;
+	Assert((ResultColumns == 1) || (Result.Stride == MatrixStrideFor(ResultRows)));
+
+	platform_work_queue *Queue = Parallel->Queue;
+	u32 ColumnCount = A.ColumnCount;
+	u32 ValueCount = ResultRows*ResultColumns;
+
+	if(Parallel->ReductionMode == ReductionMode_Fast)
+	{
+		u32 WorkCount = Minimum(Queue->ThreadCount, ColumnCount);
+		if(WorkCount <= 1)
+		{
+			reduction_work Work = *PushReductionWork(Pool, Kernel, A, B, SparseB, 0, ColumnCount);
+			Work.Partial = Result;
+			ReducePartial(&Work);
+		}
+		else
+		{
+			reduction_completion_order *CompletionOrder = PoolPushStruct(Pool, reduction_completion_order);
+			CompletionOrder->Count = 0;
+			CompletionOrder->Works = PoolPushArray(Pool, reduction_work *, WorkCount);
+
+			u32 FirstColumn = 0;
+			for(u32 WorkIndex = 0;
+			    WorkIndex < WorkCount;
+			    ++WorkIndex)
+			{
+				u32 WorkColumns = ColumnCount / WorkCount;
+				if(WorkIndex < (ColumnCount % WorkCount))
+				{
+					++WorkColumns;
+				}
+
+				reduction_work *Work = PushReductionWork(Pool, Kernel, A, B, SparseB, FirstColumn, WorkColumns);
+				Work->Partial.RowCount = ResultRows;
+				Work->Partial.ColumnCount = ResultColumns;
+				Work->CompletionOrder = CompletionOrder;
+				PlatformAddEntry(Queue, DoReductionPartialWork, Work);
+
+				FirstColumn += WorkColumns;
+			}
+			PlatformCompleteAllWork(Queue);
+
+			Assert(CompletionOrder->Count == WorkCount);
+			MatrixZero(Result);
+			for(u32 Slot = 0;
+			    Slot < WorkCount;
+			    ++Slot)
+			{
+				MatrixPlusEquals(Result, CompletionOrder->Works[Slot]->Partial);
+			}
+
+			// NOTE: A thread that ran several works nested its scratch scopes in
+			//	the order it finished them, so release them in reverse. The
+			//	workers are idle now, so their pools can be touched from here.
+			for(u32 Slot = WorkCount;
+			    Slot > 0;
+			    --Slot)
+			{
+				PoolEndTempMemory(CompletionOrder->Works[Slot - 1]->Scratch);
+			}
+		}
+	}
+	else
+	{
+		Assert(Parallel->ReductionMode == ReductionMode_Deterministic);
+
+		u32 ChunkColumns = (ColumnCount + DETERMINISTIC_MAX_CHUNK_COUNT - 1) / DETERMINISTIC_MAX_CHUNK_COUNT;
+		if(ChunkColumns < DETERMINISTIC_MIN_CHUNK_COLUMNS)
+		{
+			ChunkColumns = DETERMINISTIC_MIN_CHUNK_COLUMNS;
+		}
+		u32 ChunkCount = (ColumnCount + ChunkColumns - 1) / ChunkColumns;
+		r32 **Partials = PoolPushArray(Pool, r32 *, ChunkCount);
+
+		for(u32 ChunkIndex = 0;
+		    ChunkIndex < ChunkCount;
+		    ++ChunkIndex)
+		{
+			u32 FirstColumn = ChunkIndex*ChunkColumns;
+			u32 ChunkColumnCount = Minimum(ChunkColumns, ColumnCount - FirstColumn);
+
+			reduction_work *Work = PushReductionWork(Pool, Kernel, A, B, SparseB, FirstColumn, ChunkColumnCount);
+			Work->Partial = (ChunkIndex == 0) ? Result : MatrixRaw_(Pool, ResultRows, ResultColumns);
+			Partials[ChunkIndex] = Work->Partial.Data;
+			PlatformAddEntry(Queue, DoReductionPartialWork, Work);
+		}
+		PlatformCompleteAllWork(Queue);
+
+		if(ChunkCount > 1)
+		{
+			// NOTE: The tree is the same for every value, so splitting the values
+			//	between threads doesn't change the order of any sum.
+			u32 WorkCount = Minimum(Queue->ThreadCount, ValueCount);
+			u32 FirstValue = 0;
+			for(u32 WorkIndex = 0;
+			    WorkIndex < WorkCount;
+			    ++WorkIndex)
+			{
+				u32 WorkValues = ValueCount / WorkCount;
+				if(WorkIndex < (ValueCount % WorkCount))
+				{
+					++WorkValues;
+				}
+
+				reduction_combine_work *Work = PoolPushStruct(Pool, reduction_combine_work);
+				Work->Partials = Partials;
+				Work->PartialCount = ChunkCount;
+				Work->RowCount = ResultRows;
+				Work->ColumnStride = Result.Stride;
+				Work->FirstValue = FirstValue;
+				Work->ValueCount = WorkValues;
+				PlatformAddEntry(Queue, DoReductionCombineWork, Work);
+
+				FirstValue += WorkValues;
+			}
+			PlatformCompleteAllWork(Queue);
+		}
+	}
+}
+
+inline void
+ParallelMultTransposeInto(memory_pool *Pool, parallel_context *Parallel, matrix Result, matrix A, matrix B)
+{
+	Assert(A.ColumnCount == B.ColumnCount);
+	Assert((Result.RowCount == A.RowCount) && (Result.ColumnCount == B.RowCount));
+
+	ParallelReduceInto(Pool, Parallel, ReductionKernel_MultTranspose, Result, A, B);
+}
+
+inline matrix
+ParallelMultTransposeAt(char *Site, memory_pool *Pool, parallel_context *Parallel, matrix A, matrix B)
+{
+	matrix Result = MatrixRawAt(Site, Pool, A.RowCount, B.RowCount);
+	ParallelMultTransposeInto(Pool, Parallel, Result, A, B);
+	return Result;
+}
+#define ParallelMultTranspose(...) ParallelMultTransposeAt(POOL_CALL_SITE, __VA_ARGS__)
+
+inline void
+ParallelSparseMultTransposeInto(memory_pool *Pool, parallel_context *Parallel, matrix Result,
+                                matrix A, sparse_matrix B)
+{
+	Assert(A.ColumnCount == B.ColumnCount);
+	Assert((Result.RowCount == A.RowCount) && (Result.ColumnCount == B.RowCount));
+
+	matrix NoB = {};
+	ParallelReduceInto(Pool, Parallel, ReductionKernel_SparseMultTranspose, Result, A, NoB, B);
+}
+
+inline matrix
+ParallelSparseMultTransposeAt(char *Site, memory_pool *Pool, parallel_context *Parallel, matrix A, sparse_matrix B)
+{
+	matrix Result = MatrixRawAt(Site, Pool, A.RowCount, B.RowCount);
+	ParallelSparseMultTransposeInto(Pool, Parallel, Result, A, B);
+	return Result;
+}
+#define ParallelSparseMultTranspose(...) ParallelSparseMultTransposeAt(POOL_CALL_SITE, __VA_ARGS__)
+
+inline void
+ParallelMatrixSumColumnsInto(memory_pool *Pool, parallel_context *Parallel, vec Result, matrix A)
+{
+	Assert(Result.Dimension == A.RowCount);
+
+	ParallelReduceInto(Pool, Parallel, ReductionKernel_SumColumns, Matrix(Result.Data, Result.Dimension, 1), A, A);
+}
+
+inline vec
+ParallelMatrixSumColumnsAt(char *Site, memory_pool *Pool, parallel_context *Parallel, matrix A)
+{
+	vec Result = VecRawAt(Site, Pool, A.RowCount);
+	ParallelMatrixSumColumnsInto(Pool, Parallel, Result, A);
+	return Result;
+}
+#define ParallelMatrixSumColumns(...) ParallelMatrixSumColumnsAt(POOL_CALL_SITE, __VA_ARGS__)
+
+//
+// NOTE: Column-split products
+//
+
+enum product_kernel
+{
+	ProductKernel_Mult,
+	ProductKernel_SparseMult,
+	ProductKernel_BlockSparseMult,
+	ProductKernel_TransposeMult,
+};
+
+struct product_work
+{
+	product_kernel Kernel;
+	matrix Result;
+	matrix A;
+	matrix B;
+	sparse_matrix SparseB;
+	block_sparse_matrix BlockSparseA;
+};
+
+internal void
+DoProduct(product_work *Work)
+{
+	switch(Work->Kernel)
+	{
+		case ProductKernel_Mult:
+		{
+			MultInto(Work->Result, Work->A, Work->B);
+		} break;
+
+		case ProductKernel_SparseMult:
+		{
+			SparseMultInto(Work->Result, Work->A, Work->SparseB);
+		} break;
+
+		case ProductKernel_BlockSparseMult:
+		{
+			BlockSparseMultInto(Work->Result, Work->BlockSparseA, Work->B);
+		} break;
+
+		case ProductKernel_TransposeMult:
+		{
+			TransposeMultInto(Work->Result, Work->A, Work->B);
+		} break;
+
+		InvalidDefaultCase;
+	}
+}
+
+internal PLATFORM_WORK_QUEUE_CALLBACK(DoProductWork)
+{
+	TRACE_BLOCK("Product columns");
+
+	product_work *Work = (product_work *)Data;
+	DoProduct(Work);
+}
+
+internal void
+ParallelProductInto(memory_pool *Pool, parallel_context *Parallel, product_kernel Kernel, matrix Result,
+                    matrix A, matrix B, sparse_matrix SparseB = {}, block_sparse_matrix BlockSparseA = {})
+{
+	u32 ColumnCount = Result.ColumnCount;
+
+	platform_work_queue *Queue = Parallel->Queue;
+	u32 WorkCount = Minimum(Queue->ThreadCount*Parallel->ColumnSplit, ColumnCount);
+	if(WorkCount <= 1)
+	{
+		product_work Work = {Kernel, Result, A, B, SparseB, BlockSparseA};
+		DoProduct(&Work);
+	}
+	else
+	{
+		// NOTE: Ranges are whole GEMM tiles, so only the last one has a ragged
+		//	edge.
+		u32 WorkColumns = (ColumnCount + WorkCount - 1) / WorkCount;
+		WorkColumns = (WorkColumns + 3) & ~3;
+
+		for(u32 FirstColumn = 0;
+		    FirstColumn < ColumnCount;
+		    FirstColumn += WorkColumns)
+		{
+			u32 RangeColumns = Minimum(WorkColumns, ColumnCount - FirstColumn);
+
+			product_work *Work = PoolPushStruct(Pool, product_work);
+			*Work = {};
+			Work->Kernel = Kernel;
+			Work->Result = MatrixColumns(Result, FirstColumn, RangeColumns);
+			Work->A = A;
+			Work->BlockSparseA = BlockSparseA;
+			if(Kernel == ProductKernel_SparseMult)
+			{
+				Work->SparseB = SparseColumns(SparseB, FirstColumn, RangeColumns);
+			}
+			else
+			{
+				Work->B = MatrixColumns(B, FirstColumn, RangeColumns);
+			}
+			PlatformAddEntry(Queue, DoProductWork, Work);
+		}
+		PlatformCompleteAllWork(Queue);
+	}
+}
+
+internal matrix
+ParallelProductAt(char *Site, memory_pool *Pool, parallel_context *Parallel, product_kernel Kernel,
+                matrix A, matrix B, sparse_matrix SparseB = {}, block_sparse_matrix BlockSparseA = {})
+{
+	u32 ResultRows = A.RowCount;
+	if(Kernel == ProductKernel_TransposeMult)
+	{
+		ResultRows = A.ColumnCount;
+	}
+	else if(Kernel == ProductKernel_BlockSparseMult)
+	{
+		ResultRows = BlockSparseA.RowCount;
+	}
+	u32 ColumnCount = (Kernel == ProductKernel_SparseMult) ? SparseB.ColumnCount : B.ColumnCount;
+	matrix Result = MatrixRawAt(Site, Pool, ResultRows, ColumnCount);
+
+	ParallelProductInto(Pool, Parallel, Kernel, Result, A, B, SparseB, BlockSparseA);
+
+	return Result;
+}
+#define ParallelProduct(...) ParallelProductAt(POOL_CALL_SITE, __VA_ARGS__)
+
+inline void
+ParallelMultInto(memory_pool *Pool, parallel_context *Parallel, matrix Result, matrix A, matrix B)
+{
+	Assert(A.ColumnCount == B.RowCount);
+	Assert((Result.RowCount == A.RowCount) && (Result.ColumnCount == B.ColumnCount));
+
+	ParallelProductInto(Pool, Parallel, ProductKernel_Mult, Result, A, B);
+}
+
+inline void
+ParallelSparseMultInto(memory_pool *Pool, parallel_context *Parallel, matrix Result, matrix A, sparse_matrix B)
+{
+	Assert(A.ColumnCount == B.RowCount);
+	Assert((Result.RowCount == A.RowCount) && (Result.ColumnCount == B.ColumnCount));
+
+	matrix NoB = {};
+	ParallelProductInto(Pool, Parallel, ProductKernel_SparseMult, Result, A, NoB, B);
+}
+
+inline void
+ParallelTransposeMultInto(memory_pool *Pool, parallel_context *Parallel, matrix Result, matrix A, matrix B)
+{
+	Assert(A.RowCount == B.RowCount);
+	Assert((Result.RowCount == A.ColumnCount) && (Result.ColumnCount == B.ColumnCount));
+
+	ParallelProductInto(Pool, Parallel, ProductKernel_TransposeMult, Result, A, B);
+}
+
+inline matrix
+ParallelMultAt(char *Site, memory_pool *Pool, parallel_context *Parallel, matrix A, matrix B)
+{
+	Assert(A.ColumnCount == B.RowCount);
+
+	matrix Result = ParallelProductAt(Site, Pool, Parallel, ProductKernel_Mult, A, B);
+	return Result;
+}
+#define ParallelMult(...) ParallelMultAt(POOL_CALL_SITE, __VA_ARGS__)
+
+inline matrix
+ParallelSparseMultAt(char *Site, memory_pool *Pool, parallel_context *Parallel, matrix A, sparse_matrix B)
+{
+	Assert(A.ColumnCount == B.RowCount);
+
+	matrix NoB = {};
+	matrix Result = ParallelProductAt(Site, Pool, Parallel, ProductKernel_SparseMult, A, NoB, B);
+	return Result;
+}
+#define ParallelSparseMult(...) ParallelSparseMultAt(POOL_CALL_SITE, __VA_ARGS__)
+
+inline matrix
+ParallelBlockSparseMultAt(char *Site, memory_pool *Pool, parallel_context *Parallel, block_sparse_matrix A, matrix B)
+{
+	Assert(A.ColumnCount == B.RowCount);
+
+	matrix NoA = {};
+	sparse_matrix NoSparseB = {};
+	matrix Result = ParallelProductAt(Site, Pool, Parallel, ProductKernel_BlockSparseMult, NoA, B, NoSparseB, A);
+	return Result;
+}
+#define ParallelBlockSparseMult(...) ParallelBlockSparseMultAt(POOL_CALL_SITE, __VA_ARGS__)
+
+inline matrix
+ParallelTransposeMultAt(char *Site, memory_pool *Pool, parallel_context *Parallel, matrix A, matrix B)
+{
+	Assert(A.RowCount == B.RowCount);
+
+	matrix Result = ParallelProductAt(Site, Pool, Parallel, ProductKernel_TransposeMult, A, B);
+	return Result;
+}
+#define ParallelTransposeMult(...) ParallelTransposeMultAt(POOL_CALL_SITE, __VA_ARGS__)
@@ -0,0 +1,754 @@
+#pragma once
+
+/*
+	NOTE: Everything the rest of the code needs from the OS lives here, so
+		that nn.cpp stays a single translation unit on both Win32 and POSIX.
+*/
+
+#if _WIN32
+	#include <windows.h>
+	#include <intrin.h>
+#else
+	#include <pthread.h>
+	#include <semaphore.h>
+	#include <time.h>
+	#include <errno.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <limits.h>
+	#include <sys/uio.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <string.h>
+	#if __linux__
+		#include <linux/perf_event.h>
+		#include <sys/syscall.h>
+	#endif
+	#include <x86intrin.h>
+
+	typedef int errno_t;
+
+	inline errno_t
+	fopen_s(FILE **File, char const *Filename, char const *Mode)
+	{
+		*File = fopen(Filename, Mode);
+		errno_t Result = (*File) ? 0 : errno;
+		return Result;
+	}
+#endif
+
+//
+// NOTE: Atomics
+//
+
+#if _WIN32
+	#define CompletePreviousReadsBeforeFutureReads _ReadBarrier()
+	#define CompletePreviousWritesBeforeFutureWrites _WriteBarrier()
+
+	inline u32
+	AtomicCompareExchangeU32(u32 volatile *Value, u32 New, u32 Expected)
+	{
+		u32 Result = (u32)InterlockedCompareExchange((long volatile *)Value, (long)New, (long)Expected);
+		return Result;
+	}
+
+	inline u32
+	AtomicAddU32(u32 volatile *Value, u32 Addend)
+	{
+		// NOTE: Returns the value _before_ the add.
+		u32 Result = (u32)InterlockedExchangeAdd((long volatile *)Value, (long)Addend);
+		return Result;
+	}
+
+	inline u64
+	AtomicAddU64(u64 volatile *Value, u64 Addend)
+	{
+		// NOTE: Returns the value _before_ the add.
+		u64 Result = (u64)InterlockedExchangeAdd64((__int64 volatile *)Value, (__int64)Addend);
+		return Result;
+	}
+#else
+	#define CompletePreviousReadsBeforeFutureReads __asm__ __volatile__("" ::: "memory")
+	#define CompletePreviousWritesBeforeFutureWrites __asm__ __volatile__("" ::: "memory")
+
+	inline u32
+	AtomicCompareExchangeU32(u32 volatile *Value, u32 New, u32 Expected)
+	{
+		u32 Result = __sync_val_compare_and_swap(Value, Expected, New);
+		return Result;
+	}
+
+	inline u32
+	AtomicAddU32(u32 volatile *Value, u32 Addend)
+	{
+		// NOTE: Returns the value _before_ the add.
+		u32 Result = __sync_fetch_and_add(Value, Addend);
+		return Result;
+	}
+
+	inline u64
+	AtomicAddU64(u64 volatile *Value, u64 Addend)
+	{
+		// NOTE: Returns the value _before_ the add.
+		u64 Result = __sync_fetch_and_add(Value, Addend);
+		return Result;
+	}
+#endif
+
+//
+// NOTE: Timing
+//
+
+inline u64
+PlatformGetWallClock()
+{
+#if _WIN32
+	LARGE_INTEGER Counter;
+	QueryPerformanceCounter(&Counter);
+	u64 Result = (u64)Counter.QuadPart;
+#else
+	timespec Time;
+	clock_gettime(CLOCK_MONOTONIC, &Time);
+	u64 Result = (u64)Time.tv_sec*1000000000ULL + (u64)Time.tv_nsec;
+#endif
+	return Result;
+}
+
+inline u64
+PlatformGetWallClockFrequency()
+{
+#if _WIN32
+	LARGE_INTEGER Frequency;
+	QueryPerformanceFrequency(&Frequency);
+	u64 Result = (u64)Frequency.QuadPart;
+#else
+	u64 Result = 1000000000ULL;
+#endif
+	return Result;
+}
+
+inline r32
+PlatformGetSecondsElapsed(u64 Start, u64 End)
+{
+#if _WIN32
+	LARGE_INTEGER Frequency;
+	QueryPerformanceFrequency(&Frequency);
+	r32 Result = (r32)((r64)(End - Start) / (r64)Frequency.QuadPart);
+#else
+	r32 Result = (r32)((r64)(End - Start) / 1000000000.0);
+#endif
+	return Result;
+}
+
+//
+// NOTE: Work queue
+//
+
+struct platform_work_queue;
+#define PLATFORM_WORK_QUEUE_CALLBACK(name) void name(platform_work_queue *Queue, void *Data)
+typedef PLATFORM_WORK_QUEUE_CALLBACK(platform_work_queue_callback);
+
+struct platform_work_queue_entry
+{
+	platform_work_queue_callback *Callback;
+	void *Data;
+};
+
+struct platform_work_queue
+{
+	u32 volatile CompletionGoal;
+	u32 volatile CompletionCount;
+
+	u32 volatile NextEntryToWrite;
+	u32 volatile NextEntryToRead;
+
+#if _WIN32
+	HANDLE SemaphoreHandle;
+#else
+	sem_t SemaphoreHandle;
+#endif
+
+	// NOTE: Includes the main thread, which helps out in PlatformCompleteAllWork.
+	u32 ThreadCount;
+
+	platform_work_queue_entry Entries[256];
+};
+
+internal void
+PlatformAddEntry(platform_work_queue *Queue, platform_work_queue_callback *Callback, void *Data)
+{
+	// NOTE: Only the main thread adds entries.
+	u32 NewNextEntryToWrite = (Queue->NextEntryToWrite + 1) % ArrayCount(Queue->Entries);
+	Assert(NewNextEntryToWrite != Queue->NextEntryToRead);
+	platform_work_queue_entry *Entry = Queue->Entries + Queue->NextEntryToWrite;
+	Entry->Callback = Callback;
+	Entry->Data = Data;
+	++Queue->CompletionGoal;
+	CompletePreviousWritesBeforeFutureWrites;
+	Queue->NextEntryToWrite = NewNextEntryToWrite;
+
+#if _WIN32
+	ReleaseSemaphore(Queue->SemaphoreHandle, 1, 0);
+#else
+	sem_post(&Queue->SemaphoreHandle);
+#endif
+}
+
+internal b32
+DoNextWorkQueueEntry(platform_work_queue *Queue)
+{
+	b32 WeShouldSleep = false;
+
+	u32 OriginalNextEntryToRead = Queue->NextEntryToRead;
+	u32 NewNextEntryToRead = (OriginalNextEntryToRead + 1) % ArrayCount(Queue->Entries);
+	if(OriginalNextEntryToRead != Queue->NextEntryToWrite)
+	{
+		u32 Index = AtomicCompareExchangeU32(&Queue->NextEntryToRead,
+		                                     NewNextEntryToRead,
+		                                     OriginalNextEntryToRead);
+		if(Index == OriginalNextEntryToRead)
+		{
+			CompletePreviousReadsBeforeFutureReads;
+			platform_work_queue_entry Entry = Queue->Entries[Index];
+			Entry.Callback(Queue, Entry.Data);
+			AtomicAddU32(&Queue->CompletionCount, 1);
+		}
+	}
+	else
+	{
+		WeShouldSleep = true;
+	}
+
+	return WeShouldSleep;
+}
+
+internal void
+PlatformCompleteAllWork(platform_work_queue *Queue)
+{
+	while(Queue->CompletionGoal != Queue->CompletionCount)
+	{
+		DoNextWorkQueueEntry(Queue);
+	}
+
+	Queue->CompletionGoal = 0;
+	Queue->CompletionCount = 0;
+}
+
+#if _WIN32
+DWORD WINAPI
+WorkerThreadProc(LPVOID Parameter)
+{
+	platform_work_queue *Queue = (platform_work_queue *)Parameter;
+	for(;;)
+	{
+		if(DoNextWorkQueueEntry(Queue))
+		{
+			WaitForSingleObjectEx(Queue->SemaphoreHandle, INFINITE, FALSE);
+		}
+	}
+}
+#else
+internal void *
+WorkerThreadProc(void *Parameter)
+{
+	platform_work_queue *Queue = (platform_work_queue *)Parameter;
+	for(;;)
+	{
+		if(DoNextWorkQueueEntry(Queue))
+		{
+			sem_wait(&Queue->SemaphoreHandle);
+		}
+	}
+}
+#endif
+
+internal void
+PlatformMakeQueue(platform_work_queue *Queue, u32 ThreadCount)
+{
+	Assert(ThreadCount >= 1);
+
+	Queue->CompletionGoal = 0;
+	Queue->CompletionCount = 0;
+	Queue->NextEntryToWrite = 0;
+	Queue->NextEntryToRead = 0;
+	Queue->ThreadCount = ThreadCount;
+
+	u32 WorkerCount = ThreadCount - 1;
+#if _WIN32
+	Queue->SemaphoreHandle = CreateSemaphoreEx(0, 0, WorkerCount + 1, 0, 0, SEMAPHORE_ALL_ACCESS);
+#else
+	sem_init(&Queue->SemaphoreHandle, 0, 0);
+#endif
+
+	for(u32 WorkerIndex = 0;
+	    WorkerIndex < WorkerCount;
+	    ++WorkerIndex)
+	{
+#if _WIN32
+		HANDLE ThreadHandle = CreateThread(0, 0, WorkerThreadProc, Queue, 0, 0);
+		CloseHandle(ThreadHandle);
+#else
+		pthread_t Thread;
+		pthread_create(&Thread, 0, WorkerThreadProc, Queue);
+		pthread_detach(Thread);
+#endif
+	}
+}
+
+//
+// NOTE: Virtual memory
+//
+
+enum platform_memory_flags
+{
+	// NOTE: Transparent huge pages, best effort.
+	PlatformMemory_HugePages = 0x1,
+
+	// NOTE: Explicit MAP_HUGETLB pages. The whole reservation has to fit in the
+	//	hugetlb pool, otherwise this falls back to PlatformMemory_HugePages.
+	PlatformMemory_HugeTLB = 0x2,
+};
+
+#define PLATFORM_HUGE_PAGE_SIZE Megabytes(2)
+
+internal u8 *
+PlatformReserveMemory(umm Size, u32 Flags, u32 *ResultFlags)
+{
+	// NOTE: Reserves address space only. Nothing is backed until it is
+	//	committed, and committed pages are zero until first written.
+	u8 *Result = 0;
+	*ResultFlags = 0;
+
+#if _WIN32
+	// NOTE: Large pages on Win32 can't be reserved and committed lazily, so
+	//	the huge page flags are ignored here.
+	Result = (u8 *)VirtualAlloc(0, Size, MEM_RESERVE, PAGE_NOACCESS);
+#else
+	if(Flags & PlatformMemory_HugeTLB)
+	{
+		void *Memory = mmap(0, Size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if(Memory != MAP_FAILED)
+		{
+			Result = (u8 *)Memory;
+			*ResultFlags |= PlatformMemory_HugeTLB;
+		}
+		else
+		{
+			Flags |= PlatformMemory_HugePages;
+		}
+	}
+
+	if(!Result)
+	{
+		// NOTE: Over-reserve so the base can sit on a huge page boundary.
+		umm ReserveSize = Size + PLATFORM_HUGE_PAGE_SIZE;
+		void *Memory = mmap(0, ReserveSize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if(Memory != MAP_FAILED)
+		{
+			umm Address = (umm)Memory;
+			umm AlignedAddress = (Address + PLATFORM_HUGE_PAGE_SIZE - 1) & ~(umm)(PLATFORM_HUGE_PAGE_SIZE - 1);
+			if(AlignedAddress > Address)
+			{
+				munmap(Memory, AlignedAddress - Address);
+			}
+			umm Tail = (Address + ReserveSize) - (AlignedAddress + Size);
+			if(Tail)
+			{
+				munmap((void *)(AlignedAddress + Size), Tail);
+			}
+			Result = (u8 *)AlignedAddress;
+
+			if((Flags & PlatformMemory_HugePages) &&
+			   (madvise(Result, Size, MADV_HUGEPAGE) == 0))
+			{
+				*ResultFlags |= PlatformMemory_HugePages;
+			}
+		}
+	}
+#endif
+
+	return Result;
+}
+
+internal b32
+PlatformCommitMemory(void *Base, umm Size)
+{
+#if _WIN32
+	b32 Result = (VirtualAlloc(Base, Size, MEM_COMMIT, PAGE_READWRITE) != 0);
+#else
+	b32 Result = (mprotect(Base, Size, PROT_READ | PROT_WRITE) == 0);
+#endif
+	return Result;
+}
+
+//
+// NOTE: Generated code
+//
+
+// NOTE: Code pages are only ever writable or executable, never both (W^X).
+//	They're allocated writable, filled, then flipped to executable once.
+//	Policies that forbid executable mappings (SELinux execmem, PaX MPROTECT,
+//	Windows ACG) make the flip fail, so callers need a way around it.
+
+internal u8 *
+PlatformAllocateCodePages(umm Size)
+{
+#if _WIN32
+	u8 *Result = (u8 *)VirtualAlloc(0, Size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+	void *Memory = mmap(0, Size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	u8 *Result = (Memory != MAP_FAILED) ? (u8 *)Memory : 0;
+#endif
+	return Result;
+}
+
+internal b32
+PlatformMakeCodeExecutable(void *Base, umm Size)
+{
+#if _WIN32
+	DWORD OldProtect;
+	b32 Result = (VirtualProtect(Base, Size, PAGE_EXECUTE_READ, &OldProtect) &&
+	              FlushInstructionCache(GetCurrentProcess(), Base, Size));
+#else
+	b32 Result = (mprotect(Base, Size, PROT_READ | PROT_EXEC) == 0);
+#endif
+	return Result;
+}
+
+internal void
+PlatformFreeCodePages(void *Base, umm Size)
+{
+#if _WIN32
+	VirtualFree(Base, 0, MEM_RELEASE);
+#else
+	munmap(Base, Size);
+#endif
+}
+
+//
+// NOTE: Files
+//
+
+struct platform_file_buffer
+{
+	void *Data;
+	umm Size;
+};
+
+internal b32
+PlatformWriteBuffersToFile(char *Filename, platform_file_buffer *Buffers, u32 BufferCount)
+{
+	// NOTE: Gathers the buffers straight into the file, and flushes it to disk
+	//	before returning so that a following rename can't expose a torn file.
+	b32 Result = false;
+
+#if _WIN32
+	HANDLE File = CreateFileA(Filename, GENERIC_WRITE, 0, 0, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+	if(File != INVALID_HANDLE_VALUE)
+	{
+		Result = true;
+		for(u32 BufferIndex = 0;
+		    Result && (BufferIndex < BufferCount);
+		    ++BufferIndex)
+		{
+			platform_file_buffer *Buffer = Buffers + BufferIndex;
+			DWORD BytesWritten = 0;
+			Result = (WriteFile(File, Buffer->Data, (DWORD)Buffer->Size, &BytesWritten, 0) &&
+			          (BytesWritten == Buffer->Size));
+		}
+
+		Result = Result && FlushFileBuffers(File);
+		CloseHandle(File);
+	}
+#else
+	int File = open(Filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(File != -1)
+	{
+		Result = true;
+
+		// NOTE: writev may write less than asked for, and takes at most IOV_MAX
+		//	buffers at a time, so walk the buffers until everything is out.
+		iovec Vectors[64];
+		u32 BufferIndex = 0;
+		umm BufferOffset = 0;
+		while(Result && (BufferIndex < BufferCount))
+		{
+			u32 VectorCount = 0;
+			for(u32 Index = BufferIndex;
+			    (Index < BufferCount) && (VectorCount < ArrayCount(Vectors)) && (VectorCount < IOV_MAX);
+			    ++Index)
+			{
+				umm Skip = (Index == BufferIndex) ? BufferOffset : 0;
+				Vectors[VectorCount].iov_base = (u8 *)Buffers[Index].Data + Skip;
+				Vectors[VectorCount].iov_len = Buffers[Index].Size - Skip;
+				++VectorCount;
+			}
+
+			ssize_t Written = writev(File, Vectors, (int)VectorCount);
+			if(Written < 0)
+			{
+				Result = (errno == EINTR);
+			}
+			else
+			{
+				umm Remaining = (umm)Written;
+				while((BufferIndex < BufferCount) &&
+				      (Remaining >= (Buffers[BufferIndex].Size - BufferOffset)))
+				{
+					Remaining -= Buffers[BufferIndex].Size - BufferOffset;
+					BufferOffset = 0;
+					++BufferIndex;
+				}
+				BufferOffset += Remaining;
+			}
+		}
+
+		Result = Result && (fsync(File) == 0);
+		close(File);
+	}
+#endif
+
+	return Result;
+}
+
+internal b32
+PlatformReplaceFile(char *Source, char *Dest)
+{
+	// NOTE: Atomic on both platforms, readers see either the old or the new file.
+#if _WIN32
+	b32 Result = MoveFileExA(Source, Dest, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+#else
+	b32 Result = (rename(Source, Dest) == 0);
+#endif
+	return Result;
+}
+
+struct platform_mapped_file
+{
+	void *Data;
+	umm Size;
+};
+
+internal b32
+PlatformMapFileReadOnly(char *Filename, platform_mapped_file *Result)
+{
+	// NOTE: Shared, so every process that maps the same file reads the same
+	//	page cache pages instead of a copy of its own. The file can be
+	//	closed once it is mapped; the mapping keeps it open.
+	Result->Data = 0;
+	Result->Size = 0;
+
+#if _WIN32
+	HANDLE File = CreateFileA(Filename, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, 0, OPEN_EXISTING,
+	                          FILE_ATTRIBUTE_NORMAL, 0);
+	if(File != INVALID_HANDLE_VALUE)
+	{
+		LARGE_INTEGER FileSize;
+		if(GetFileSizeEx(File, &FileSize) && (FileSize.QuadPart > 0))
+		{
+			HANDLE Mapping = CreateFileMappingA(File, 0, PAGE_READONLY, 0, 0, 0);
+			if(Mapping)
+			{
+				Result->Data = MapViewOfFile(Mapping, FILE_MAP_READ, 0, 0, 0);
+				Result->Size = (umm)FileSize.QuadPart;
+				CloseHandle(Mapping);
+			}
+		}
+		CloseHandle(File);
+	}
+#else
+	int File = open(Filename, O_RDONLY);
+	if(File != -1)
+	{
+		struct stat FileStat;
+		if((fstat(File, &FileStat) == 0) && (FileStat.st_size > 0))
+		{
+			void *Memory = mmap(0, (umm)FileStat.st_size, PROT_READ, MAP_SHARED, File, 0);
+			if(Memory != MAP_FAILED)
+			{
+				Result->Data = Memory;
+				Result->Size = (umm)FileStat.st_size;
+			}
+		}
+		close(File);
+	}
+#endif
+
+	if(!Result->Data)
+	{
+		Result->Size = 0;
+	}
+	b32 Mapped = (Result->Data != 0);
+	return Mapped;
+}
+
+internal void
+PlatformUnmapFile(platform_mapped_file *File)
+{
+#if _WIN32
+	UnmapViewOfFile(File->Data);
+#else
+	munmap(File->Data, File->Size);
+#endif
+	File->Data = 0;
+	File->Size = 0;
+}
+
+struct platform_file_stamp
+{
+	u64 Size;
+	u64 WriteTime;
+};
+
+// NOTE: Zero when the file can't be found. WriteTime is in the platform's
+//	own units, 100ns FILETIME ticks or nanoseconds, and only means anything
+//	next to another stamp taken on the same platform.
+internal platform_file_stamp
+PlatformGetFileStamp(char *Filename)
+{
+	platform_file_stamp Result = {};
+
+#if _WIN32
+	WIN32_FILE_ATTRIBUTE_DATA Data;
+	if(GetFileAttributesExA(Filename, GetFileExInfoStandard, &Data))
+	{
+		Result.Size = ((u64)Data.nFileSizeHigh << 32) | Data.nFileSizeLow;
+		Result.WriteTime = ((u64)Data.ftLastWriteTime.dwHighDateTime << 32) | Data.ftLastWriteTime.dwLowDateTime;
+	}
+#else
+	struct stat FileStat;
+	if(stat(Filename, &FileStat) == 0)
+	{
+		Result.Size = (u64)FileStat.st_size;
+		Result.WriteTime = (u64)FileStat.st_mtim.tv_sec*1000000000ULL + (u64)FileStat.st_mtim.tv_nsec;
+	}
+#endif
+
+	return Result;
+}
+
+//
+// NOTE: Hardware performance counters
+//
+
+enum platform_perf_counter
+{
+	PerfCounter_Cycles,
+	PerfCounter_Instructions,
+	PerfCounter_L1DMisses,
+	PerfCounter_LLCMisses,
+	PerfCounter_DTLBMisses,
+
+	PerfCounter_Count,
+};
+
+struct platform_perf_group
+{
+	b32 Valid;
+	int LeaderFd;
+};
+
+struct platform_perf_counters
+{
+	u64 Values[PerfCounter_Count];
+};
+
+internal b32
+PlatformOpenPerfGroup(platform_perf_group *Group, char **ErrorMessage)
+{
+	// NOTE: Counts the calling thread only, on whatever CPU it runs. All the
+	//	counters go in one group so they are scheduled together.
+	Group->Valid = false;
+	*ErrorMessage = "not supported on this platform";
+
+#if __linux__
+	u32 Types[PerfCounter_Count] =
+	{
+		PERF_TYPE_HARDWARE,
+		PERF_TYPE_HARDWARE,
+		PERF_TYPE_HW_CACHE,
+		PERF_TYPE_HARDWARE,
+		PERF_TYPE_HW_CACHE,
+	};
+	u64 Configs[PerfCounter_Count] =
+	{
+		PERF_COUNT_HW_CPU_CYCLES,
+		PERF_COUNT_HW_INSTRUCTIONS,
+		PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+		PERF_COUNT_HW_CACHE_MISSES,
+		PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+	};
+
+	int Fds[PerfCounter_Count];
+	u32 OpenCount = 0;
+	for(u32 CounterIndex = 0;
+	    CounterIndex < PerfCounter_Count;
+	    ++CounterIndex)
+	{
+		perf_event_attr Attributes;
+		memset(&Attributes, 0, sizeof(Attributes));
+		Attributes.size = sizeof(Attributes);
+		Attributes.type = Types[CounterIndex];
+		Attributes.config = Configs[CounterIndex];
+		Attributes.exclude_kernel = 1;
+		Attributes.exclude_hv = 1;
+		Attributes.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+		int GroupFd = (CounterIndex == 0) ? -1 : Fds[0];
+		int Fd = (int)syscall(SYS_perf_event_open, &Attributes, 0, -1, GroupFd, 0);
+		if(Fd == -1)
+		{
+			*ErrorMessage = strerror(errno);
+			break;
+		}
+		Fds[OpenCount++] = Fd;
+	}
+
+	if(OpenCount == PerfCounter_Count)
+	{
+		Group->Valid = true;
+		Group->LeaderFd = Fds[0];
+	}
+	else
+	{
+		for(u32 FdIndex = 0;
+		    FdIndex < OpenCount;
+		    ++FdIndex)
+		{
+			close(Fds[FdIndex]);
+		}
+	}
+#endif
+
+	return Group->Valid;
+}
+
+internal b32
+PlatformReadPerfGroup(platform_perf_group *Group, platform_perf_counters *Counters)
+{
+	b32 Result = false;
+
+#if __linux__
+	if(Group->Valid)
+	{
+		// NOTE: PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_RUNNING layout.
+		u64 Buffer[2 + PerfCounter_Count];
+		ssize_t Size = read(Group->LeaderFd, Buffer, sizeof(Buffer));
+
+		// NOTE: A group that has never been scheduled onto the PMU (more counters
+		//	than the CPU has, or a hypervisor that hides them) reads as zero time.
+		if((Size == sizeof(Buffer)) && (Buffer[0] == PerfCounter_Count) && (Buffer[1] > 0))
+		{
+			for(u32 CounterIndex = 0;
+			    CounterIndex < PerfCounter_Count;
+			    ++CounterIndex)
+			{
+				Counters->Values[CounterIndex] = Buffer[2 + CounterIndex];
+			}
+			Result = true;
+		}
+	}
+#endif
+
+	return Result;
+}
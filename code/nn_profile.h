@@ -0,0 +1,234 @@
+#pragma once
+
+/*
+	NOTE: Timed blocks for finding out where an epoch goes. Every TIMED_BLOCK
+		gets its own debug_record, indexed by __COUNTER__; the array itself is
+		defined at the very end of nn.cpp once the final count is known.
+
+		Cycles are inclusive (a FeedForwardBatch includes its Mults) and summed
+		over every thread that ran the block. Bytes are the compulsory traffic
+		of the kernel (each operand read once, the result written once) and an
+		exp counts as a single flop.
+
+		With -perf, each timed block also reads the thread's hardware counters
+		(cycles, instructions, L1D/LLC/dTLB misses) on entry and exit. That is a
+		syscall at each end, so it's off by default. Threads that can't open the
+		counters (no PMU in the container, perf_event_paranoid, non-Linux) just
+		don't contribute, and if the main thread can't open them the counters
+		are turned off with a note.
+
+		In non-internal builds all of this compiles away to nothing.
+*/
+
+#if NN_INTERNAL
+
+struct debug_record
+{
+	char *Name;
+
+	u64 volatile HitCount;
+	u64 volatile CycleCount;
+	u64 volatile ByteCount;
+	u64 volatile FlopCount;
+
+	u64 volatile PerfCounts[PerfCounter_Count];
+};
+
+extern debug_record GlobalDebugRecords[];
+extern u32 const GlobalDebugRecordCount;
+
+struct debug_profile_epoch
+{
+	u64 StartCycles;
+	u64 StartClock;
+};
+global_variable debug_profile_epoch GlobalProfileEpoch;
+
+enum debug_perf_thread_state
+{
+	DebugPerfThread_Unopened,
+	DebugPerfThread_Open,
+	DebugPerfThread_Failed,
+};
+
+global_variable b32 GlobalProfilePerf;
+global_variable thread_local debug_perf_thread_state GlobalPerfThreadState;
+global_variable thread_local platform_perf_group GlobalPerfGroup;
+
+internal b32
+DebugReadPerfCounters(platform_perf_counters *Counters)
+{
+	if(GlobalPerfThreadState == DebugPerfThread_Unopened)
+	{
+		char *ErrorMessage = 0;
+		GlobalPerfThreadState = PlatformOpenPerfGroup(&GlobalPerfGroup, &ErrorMessage) ?
+			DebugPerfThread_Open : DebugPerfThread_Failed;
+	}
+
+	b32 Result = ((GlobalPerfThreadState == DebugPerfThread_Open) &&
+	              PlatformReadPerfGroup(&GlobalPerfGroup, Counters));
+	return Result;
+}
+
+internal void
+EnableProfilePerfCounters()
+{
+	// NOTE: Try the main thread up front so an unusable PMU is reported once
+	//	instead of silently giving empty columns.
+	char *ErrorMessage = 0;
+	platform_perf_counters Counters;
+	if(PlatformOpenPerfGroup(&GlobalPerfGroup, &ErrorMessage))
+	{
+		GlobalPerfThreadState = DebugPerfThread_Open;
+		if(PlatformReadPerfGroup(&GlobalPerfGroup, &Counters))
+		{
+			GlobalProfilePerf = true;
+		}
+		else
+		{
+			printf("Hardware counters unavailable (group could not be scheduled), continuing without them\n");
+		}
+	}
+	else
+	{
+		GlobalPerfThreadState = DebugPerfThread_Failed;
+		printf("Hardware counters unavailable (%s), continuing without them\n", ErrorMessage);
+	}
+}
+
+struct timed_block
+{
+	debug_record *Record;
+	u64 StartCycles;
+
+	b32 PerfValid;
+	platform_perf_counters StartPerf;
+
+	timed_block(u32 Counter, char *Name, u64 Bytes, u64 Flops)
+	{
+		Record = GlobalDebugRecords + Counter;
+		Record->Name = Name;
+		AtomicAddU64(&Record->ByteCount, Bytes);
+		AtomicAddU64(&Record->FlopCount, Flops);
+
+		PerfValid = GlobalProfilePerf && DebugReadPerfCounters(&StartPerf);
+		StartCycles = __rdtsc();
+	}
+
+	~timed_block()
+	{
+		u64 Cycles = __rdtsc() - StartCycles;
+		AtomicAddU64(&Record->CycleCount, Cycles);
+		AtomicAddU64(&Record->HitCount, 1);
+
+		platform_perf_counters EndPerf;
+		if(PerfValid && DebugReadPerfCounters(&EndPerf))
+		{
+			for(u32 CounterIndex = 0;
+			    CounterIndex < PerfCounter_Count;
+			    ++CounterIndex)
+			{
+				AtomicAddU64(&Record->PerfCounts[CounterIndex],
+				             EndPerf.Values[CounterIndex] - StartPerf.Values[CounterIndex]);
+			}
+		}
+	}
+};
+
+#define TIMED_BLOCK__(Name, Number, Bytes, Flops) timed_block TimedBlock_##Number(__COUNTER__, Name, (u64)(Bytes), (u64)(Flops))
+#define TIMED_BLOCK_(Name, Number, Bytes, Flops) TIMED_BLOCK__(Name, Number, Bytes, Flops)
+#define TIMED_BLOCK(Name, Bytes, Flops) TIMED_BLOCK_(Name, __LINE__, Bytes, Flops)
+
+internal void
+BeginProfileEpoch()
+{
+	for(u32 RecordIndex = 0;
+	    RecordIndex < GlobalDebugRecordCount;
+	    ++RecordIndex)
+	{
+		debug_record *Record = GlobalDebugRecords + RecordIndex;
+		Record->HitCount = 0;
+		Record->CycleCount = 0;
+		Record->ByteCount = 0;
+		Record->FlopCount = 0;
+		for(u32 CounterIndex = 0;
+		    CounterIndex < PerfCounter_Count;
+		    ++CounterIndex)
+		{
+			Record->PerfCounts[CounterIndex] = 0;
+		}
+	}
+
+	GlobalProfileEpoch.StartCycles = __rdtsc();
+	GlobalProfileEpoch.StartClock = PlatformGetWallClock();
+}
+
+internal void
+EndProfileEpoch(b32 Print)
+{
+	u64 EpochCycles = __rdtsc() - GlobalProfileEpoch.StartCycles;
+	r32 EpochSeconds = PlatformGetSecondsElapsed(GlobalProfileEpoch.StartClock, PlatformGetWallClock());
+
+	if(Print && (EpochCycles > 0) && (EpochSeconds > 0.0f))
+	{
+		// NOTE: The TSC ticks at a fixed rate, so the wall clock over the epoch calibrates it.
+		r64 CyclesPerSecond = (r64)EpochCycles / (r64)EpochSeconds;
+
+		printf("  %-28s %10s %10s %7s %9s %9s\n",
+		       "Block", "Hits", "MCycles", "Epoch%", "GFLOP/s", "GB/s");
+		for(u32 RecordIndex = 0;
+		    RecordIndex < GlobalDebugRecordCount;
+		    ++RecordIndex)
+		{
+			debug_record *Record = GlobalDebugRecords + RecordIndex;
+			if(Record->HitCount)
+			{
+				r64 Seconds = (r64)Record->CycleCount / CyclesPerSecond;
+				r64 GFlops = (Seconds > 0.0) ? ((r64)Record->FlopCount / Seconds) / 1.0e9 : 0.0;
+				r64 GBytes = (Seconds > 0.0) ? ((r64)Record->ByteCount / Seconds) / 1.0e9 : 0.0;
+				printf("  %-28s %10llu %10.2f %6.1f%% %9.2f %9.2f\n",
+				       Record->Name,
+				       (unsigned long long)Record->HitCount,
+				       (r64)Record->CycleCount / 1.0e6,
+				       100.0*(r64)Record->CycleCount / (r64)EpochCycles,
+				       GFlops, GBytes);
+			}
+		}
+
+		if(GlobalProfilePerf)
+		{
+			// NOTE: Misses are per thousand instructions.
+			printf("  %-28s %10s %8s %10s %10s %10s\n",
+			       "Block", "Cycles(M)", "IPC", "L1D MPKI", "LLC MPKI", "dTLB MPKI");
+			for(u32 RecordIndex = 0;
+			    RecordIndex < GlobalDebugRecordCount;
+			    ++RecordIndex)
+			{
+				debug_record *Record = GlobalDebugRecords + RecordIndex;
+				u64 *Counts = (u64 *)Record->PerfCounts;
+				if(Record->HitCount && Counts[PerfCounter_Instructions])
+				{
+					r64 KiloInstructions = (r64)Counts[PerfCounter_Instructions] / 1000.0;
+					r64 IPC = Counts[PerfCounter_Cycles] ?
+						(r64)Counts[PerfCounter_Instructions] / (r64)Counts[PerfCounter_Cycles] : 0.0;
+					printf("  %-28s %10.2f %8.2f %10.2f %10.2f %10.2f\n",
+					       Record->Name,
+					       (r64)Counts[PerfCounter_Cycles] / 1.0e6,
+					       IPC,
+					       (r64)Counts[PerfCounter_L1DMisses] / KiloInstructions,
+					       (r64)Counts[PerfCounter_LLCMisses] / KiloInstructions,
+					       (r64)Counts[PerfCounter_DTLBMisses] / KiloInstructions);
+				}
+			}
+		}
+	}
+}
+
+#else
+
+#define TIMED_BLOCK(...)
+#define BeginProfileEpoch(...)
+#define EndProfileEpoch(...)
+#define EnableProfilePerfCounters(...)
+
+#endif
@@ -0,0 +1,390 @@
+
+/*
+	NOTE: Magnitude pruning. Each layer's weights are scored, one at a time or
+		a BLOCK_SPARSE_ROWS block at a time by the block's summed magnitude,
+		and the lowest scoring fraction of them is zeroed. Only empty blocks
+		save inference any work, and scattered single weights rarely empty a
+		block, so -pruneblocks is the one that buys speed.
+
+	The masks stay on the network and keep the pruned weights at zero while
+		it trains, so epochs run after pruning fine-tune the rest. Pruned
+		networks are saved and loaded block sparse (see nn_io.h).
+*/
+
+#define PRUNE_REPORT_REPEATS 5
+
+global_variable r32 PruneReportSparsities[] = {0.0f, 0.5f, 0.75f, 0.9f, 0.95f};
+
+internal int
+CompareR32(void const *A, void const *B)
+{
+	r32 ValueA = *(r32 *)A;
+	r32 ValueB = *(r32 *)B;
+	int Result = (ValueA < ValueB) ? -1 : ((ValueA > ValueB) ? 1 : 0);
+	return Result;
+}
+
+internal void
+PruneWeights(memory_pool *Pool, matrix Weights, matrix Mask, r32 Sparsity, b32 Blocks)
+{
+	TIMED_BLOCK("PruneWeights", 0, 0);
+
+	temp_memory TempMem = PoolBeginTempMemory(Pool);
+
+	u32 UnitRows = Blocks ? BLOCK_SPARSE_ROWS : 1;
+	u32 UnitRowCount = (Weights.RowCount + UnitRows - 1) / UnitRows;
+	u32 UnitCount = UnitRowCount*Weights.ColumnCount;
+
+	r32 *Scores = PoolPushArray(Pool, r32, UnitCount);
+	r32 *SortedScores = PoolPushArray(Pool, r32, UnitCount);
+	for(u32 ColumnIndex = 0;
+	    ColumnIndex < Weights.ColumnCount;
+	    ++ColumnIndex)
+	{
+		r32 *Source = MatrixColumnData(Weights, ColumnIndex);
+		for(u32 UnitRow = 0;
+		    UnitRow < UnitRowCount;
+		    ++UnitRow)
+		{
+			u32 FirstRow = UnitRow*UnitRows;
+			u32 RowCount = Minimum(UnitRows, Weights.RowCount - FirstRow);
+
+			r32 Score = 0.0f;
+			for(u32 RowIndex = FirstRow;
+			    RowIndex < (FirstRow + RowCount);
+			    ++RowIndex)
+			{
+				Score += AbsoluteValue(Source[RowIndex]);
+			}
+
+			u32 UnitIndex = ColumnIndex*UnitRowCount + UnitRow;
+			Scores[UnitIndex] = Score;
+			SortedScores[UnitIndex] = Score;
+		}
+	}
+
+	qsort(SortedScores, UnitCount, sizeof(r32), CompareR32);
+
+	// NOTE: Everything under the threshold goes, then just enough of the
+	//	units tied with it to prune exactly PruneCount.
+	u32 PruneCount = (u32)(Sparsity*UnitCount + 0.5f);
+	if(PruneCount > UnitCount)
+	{
+		PruneCount = UnitCount;
+	}
+
+	r32 Threshold = -1.0f;
+	u32 TiedToPrune = 0;
+	if(PruneCount)
+	{
+		Threshold = SortedScores[PruneCount - 1];
+		u32 FirstTied = PruneCount - 1;
+		while((FirstTied > 0) && (SortedScores[FirstTied - 1] == Threshold))
+		{
+			--FirstTied;
+		}
+		TiedToPrune = PruneCount - FirstTied;
+	}
+
+	for(u32 ColumnIndex = 0;
+	    ColumnIndex < Weights.ColumnCount;
+	    ++ColumnIndex)
+	{
+		r32 *Dest = MatrixColumnData(Mask, ColumnIndex);
+		for(u32 UnitRow = 0;
+		    UnitRow < UnitRowCount;
+		    ++UnitRow)
+		{
+			r32 Score = Scores[ColumnIndex*UnitRowCount + UnitRow];
+			b32 Pruned = (Score < Threshold);
+			if(!Pruned && (Score == Threshold) && TiedToPrune)
+			{
+				Pruned = true;
+				--TiedToPrune;
+			}
+
+			u32 FirstRow = UnitRow*UnitRows;
+			u32 RowCount = Minimum(UnitRows, Weights.RowCount - FirstRow);
+			for(u32 RowIndex = FirstRow;
+			    RowIndex < (FirstRow + RowCount);
+			    ++RowIndex)
+			{
+				Dest[RowIndex] = Pruned ? 0.0f : 1.0f;
+			}
+		}
+	}
+
+	PoolEndTempMemory(TempMem);
+
+	MatrixHadamardEquals(Weights, Mask);
+}
+
+struct prune_stats
+{
+	u64 TotalWeights;
+	u64 KeptWeights;
+	u64 TotalBlocks;
+	u64 KeptBlocks;
+};
+
+internal prune_stats
+GetPruneStats(neural_network Network)
+{
+	prune_stats Result = {};
+	for(u32 LayerIndex = 1;
+	    LayerIndex < Network.LayerCount;
+	    ++LayerIndex)
+	{
+		matrix Mask = Network.WeightMasks[LayerIndex];
+		for(u32 ColumnIndex = 0;
+		    ColumnIndex < Mask.ColumnCount;
+		    ++ColumnIndex)
+		{
+			r32 *MaskValue = MatrixColumnData(Mask, ColumnIndex);
+			for(u32 RowIndex = 0;
+			    RowIndex < Mask.RowCount;
+			    ++RowIndex)
+			{
+				Result.KeptWeights += (MaskValue[RowIndex] != 0.0f);
+			}
+		}
+		Result.TotalWeights += (u64)Mask.RowCount*Mask.ColumnCount;
+		Result.KeptBlocks += Network.BlockSparseWeights[LayerIndex].BlockCount;
+		Result.TotalBlocks += (u64)BlockSparseRowCount(Mask.RowCount)*Mask.ColumnCount;
+	}
+
+	return Result;
+}
+
+internal void
+PruneNetwork(memory_pool *Pool, neural_network *Network, r32 Sparsity, b32 Blocks, b32 Quiet = false)
+{
+	TRACE_BLOCK("Prune");
+
+	if(!Network->WeightMasks)
+	{
+		Network->WeightMasks = PoolPushArray(Pool, matrix, Network->LayerCount);
+		for(u32 LayerIndex = 1;
+		    LayerIndex < Network->LayerCount;
+		    ++LayerIndex)
+		{
+			Network->WeightMasks[LayerIndex] = MatrixRaw_(Pool, Network->Layers[LayerIndex],
+			                                              Network->Layers[LayerIndex - 1]);
+		}
+	}
+
+	// NOTE: The blocks are always repacked; the old ones may not cover what
+	//	a lower sparsity lets back in. Factors would no longer match the
+	//	pruned weights, so those go.
+	Network->Ranks = 0;
+	Network->BlockSparseWeights = PoolPushArray(Pool, block_sparse_matrix, Network->LayerCount);
+
+	for(u32 LayerIndex = 1;
+	    LayerIndex < Network->LayerCount;
+	    ++LayerIndex)
+	{
+		matrix Weights = Network->WeightMatrices[LayerIndex];
+		matrix Mask = Network->WeightMasks[LayerIndex];
+		PruneWeights(Pool, Weights, Mask, Sparsity, Blocks);
+		Network->BlockSparseWeights[LayerIndex] = PackBlockSparse(Pool, Weights, Mask);
+	}
+
+	if(!Quiet)
+	{
+		prune_stats Stats = GetPruneStats(*Network);
+		printf("Pruned %.1f%% of the weights by %s magnitude, keeping %.1f%% of the blocks\n",
+		       100.0f*(1.0f - (r32)Stats.KeptWeights/(r32)Stats.TotalWeights), Blocks ? "block" : "weight",
+		       100.0f*(r32)Stats.KeptBlocks/(r32)Stats.TotalBlocks);
+	}
+}
+
+internal neural_network
+CopyNetwork(memory_pool *Pool, neural_network Network)
+{
+	// NOTE: The copy starts out dense, with its own weights and biases.
+	//	Weights pruned before are zero, so they score lowest and are pruned
+	//	again first.
+	neural_network Result = Network;
+	Result.WeightMatrices = PoolPushArray(Pool, matrix, Network.LayerCount);
+	Result.BiasVectors = PoolPushArray(Pool, vec, Network.LayerCount);
+	Result.WeightMasks = 0;
+	Result.BlockSparseWeights = 0;
+	Result.Ranks = 0;
+	Result.PackedWeights = 0;
+
+	for(u32 LayerIndex = 1;
+	    LayerIndex < Network.LayerCount;
+	    ++LayerIndex)
+	{
+		matrix Source = Network.WeightMatrices[LayerIndex];
+		matrix Dest = MatrixRaw_(Pool, Source.RowCount, Source.ColumnCount);
+		for(u32 ColumnIndex = 0;
+		    ColumnIndex < Source.ColumnCount;
+		    ++ColumnIndex)
+		{
+			memcpy(MatrixColumnData(Dest, ColumnIndex), MatrixColumnData(Source, ColumnIndex),
+			       Source.RowCount*sizeof(r32));
+		}
+		Result.WeightMatrices[LayerIndex] = Dest;
+		Result.BiasVectors[LayerIndex] = Vec(Pool, Network.BiasVectors[LayerIndex].Data,
+		                                     Network.BiasVectors[LayerIndex].Dimension);
+	}
+
+	return Result;
+}
+
+internal r32
+TimeInference(memory_pool *Pool, parallel_context *Parallel, neural_network Network, data_set TestSet)
+{
+	r32 Best = 1e30f;
+	for(u32 Repeat = 0;
+	    Repeat < PRUNE_REPORT_REPEATS;
+	    ++Repeat)
+	{
+		temp_memory TempMem = PoolBeginTempMemory(Pool);
+
+		u64 Start = PlatformGetWallClock();
+		FeedForwardBatch(Pool, Parallel, Network, TestSet.Inputs);
+		r32 Seconds = PlatformGetSecondsElapsed(Start, PlatformGetWallClock());
+
+		PoolEndTempMemory(TempMem);
+
+		if(Seconds < Best)
+		{
+			Best = Seconds;
+		}
+	}
+
+	return Best;
+}
+
+// NOTE: A training path the benchmarks time against GradientDescentBatch.
+//	It trains Network on one batch, or its own copy of the weights in Data.
+//	Paths with their own copy also give a store, which puts the weights back
+//	into Network once the batches are timed.
+#define BENCHMARK_TRAIN_BATCH(name) void name(memory_pool *Pool, parallel_context *Parallel, void *Data, \
+                                              neural_network Network, matrix Inputs, matrix Outputs, \
+                                              r32 LearningRate, r32 Regularization, u32 TotalTrials)
+typedef BENCHMARK_TRAIN_BATCH(benchmark_train_batch);
+
+#define BENCHMARK_STORE_WEIGHTS(name) void name(void *Data, neural_network Network)
+typedef BENCHMARK_STORE_WEIGHTS(benchmark_store_weights);
+
+struct training_benchmark
+{
+	neural_network Generic;
+	neural_network Candidate;
+
+	u32 BatchCount;
+	r32 GenericSeconds;
+	r32 CandidateSeconds;
+
+	// NOTE: Over the weights and the biases.
+	u32 DifferentCount;
+	r32 MaxDifference;
+};
+
+// NOTE: Both sides train their own copy on the same batches, from the same
+//	weights. Data has to start from Network's weights too.
+internal training_benchmark
+BenchmarkTraining(memory_pool *Pool, parallel_context *Parallel, neural_network Network, data_set TrainingSet,
+                  u32 BatchSize, u32 MaxBatchCount, r32 LearningRate, r32 Regularization,
+                  benchmark_train_batch *TrainBatch, benchmark_store_weights *StoreWeights, void *Data)
+{
+	training_benchmark Result = {};
+	Result.Generic = CopyNetwork(Pool, Network);
+	Result.Candidate = CopyNetwork(Pool, Network);
+
+	Result.BatchCount = Minimum(TrainingSet.DataCount / BatchSize, MaxBatchCount);
+	batch *Batches = CreateBatches(Pool, TrainingSet, BatchSize);
+
+	u64 Start = PlatformGetWallClock();
+	for(u32 BatchIndex = 0;
+	    BatchIndex < Result.BatchCount;
+	    ++BatchIndex)
+	{
+		GradientDescentBatch(Pool, Parallel, Result.Generic, Batches[BatchIndex].Input, Batches[BatchIndex].Output,
+		                     LearningRate, Regularization, TrainingSet.DataCount);
+	}
+	Result.GenericSeconds = PlatformGetSecondsElapsed(Start, PlatformGetWallClock());
+
+	Start = PlatformGetWallClock();
+	for(u32 BatchIndex = 0;
+	    BatchIndex < Result.BatchCount;
+	    ++BatchIndex)
+	{
+		TrainBatch(Pool, Parallel, Data, Result.Candidate, Batches[BatchIndex].Input, Batches[BatchIndex].Output,
+		           LearningRate, Regularization, TrainingSet.DataCount);
+	}
+	Result.CandidateSeconds = PlatformGetSecondsElapsed(Start, PlatformGetWallClock());
+
+	if(StoreWeights)
+	{
+		StoreWeights(Data, Result.Candidate);
+	}
+
+	for(u32 LayerIndex = 1;
+	    LayerIndex < Network.LayerCount;
+	    ++LayerIndex)
+	{
+		CompareMatrices(Result.Generic.WeightMatrices[LayerIndex], Result.Candidate.WeightMatrices[LayerIndex],
+		                &Result.DifferentCount, &Result.MaxDifference);
+
+		vec GenericBiases = Result.Generic.BiasVectors[LayerIndex];
+		vec CandidateBiases = Result.Candidate.BiasVectors[LayerIndex];
+		CompareMatrices(Matrix(GenericBiases.Data, GenericBiases.Dimension, 1),
+		                Matrix(CandidateBiases.Data, CandidateBiases.Dimension, 1),
+		                &Result.DifferentCount, &Result.MaxDifference);
+	}
+
+	return Result;
+}
+
+internal void
+ReportPruning(memory_pool *Pool, parallel_context *Parallel, neural_network Network, data_set TestSet)
+{
+	TRACE_BLOCK("Pruning report");
+
+	// NOTE: Every level prunes a fresh copy of the network as it is now, with
+	//	no fine-tuning. Dense times the same pruned weights without the blocks.
+	//	Size is the saved file's size relative to the unpruned file.
+	printf("Pruning report, %u test images:\n", TestSet.DataCount);
+	printf("  %-7s %8s %7s %7s %6s %8s %9s %10s %8s\n",
+	       "prune", "sparsity", "weights", "blocks", "size", "success", "dense ms", "sparse ms", "speedup");
+
+	for(u32 Granularity = 0;
+	    Granularity < 2;
+	    ++Granularity)
+	{
+		b32 Blocks = (Granularity == 1);
+		for(u32 LevelIndex = 0;
+		    LevelIndex < ArrayCount(PruneReportSparsities);
+		    ++LevelIndex)
+		{
+			r32 Sparsity = PruneReportSparsities[LevelIndex];
+			temp_memory TempMem = PoolBeginTempMemory(Pool);
+
+			neural_network Pruned = CopyNetwork(Pool, Network);
+			PruneNetwork(Pool, &Pruned, Sparsity, Blocks, true);
+
+			prune_stats Stats = GetPruneStats(Pruned);
+			r32 SizeRatio = ((r32)NetworkGetTotalFileSize(Pruned, NetworkFormat_BlockSparse, Pruned.BlockSparseWeights) /
+			                 (r32)NetworkGetTotalFileSize(Pruned));
+			r32 SuccessRatePercent = EvaluateNetwork(Pool, Parallel, Pruned, TestSet);
+			r32 SparseSeconds = TimeInference(Pool, Parallel, Pruned, TestSet);
+			block_sparse_matrix *BlockSparseWeights = Pruned.BlockSparseWeights;
+			Pruned.BlockSparseWeights = 0;
+			r32 DenseSeconds = TimeInference(Pool, Parallel, Pruned, TestSet);
+			Pruned.BlockSparseWeights = BlockSparseWeights;
+
+			printf("  %-7s %7.0f%% %6.1f%% %6.1f%% %5.2fx %7.2f%% %9.2f %10.2f %7.2fx\n",
+			       Blocks ? "blocks" : "weights", 100.0f*Sparsity,
+			       100.0f*(r32)Stats.KeptWeights/(r32)Stats.TotalWeights,
+			       100.0f*(r32)Stats.KeptBlocks/(r32)Stats.TotalBlocks,
+			       SizeRatio, SuccessRatePercent, 1000.0f*DenseSeconds, 1000.0f*SparseSeconds,
+			       DenseSeconds/SparseSeconds);
+
+			PoolEndTempMemory(TempMem);
+		}
+	}
+}
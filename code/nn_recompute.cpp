@@ -0,0 +1,115 @@
+
+/*
+	NOTE: Activation recomputation. BackPropagateBatch keeps every layer's
+		weighted inputs, activations and errors until the gradients are
+		taken, which for deep networks and big batches is most of what a
+		batch allocates. -recompute N keeps the weighted inputs and
+		activations only at every Nth layer (the checkpoints) and the
+		output layer. RecomputeGradientsBatch runs the forward pass one
+		segment at a time, keeping just the checkpoint at its end, then
+		goes back through the segments from the last, recomputing each
+		one's layers from the checkpoint before it, and takes each layer's
+		gradients as soon as its error is known.
+
+	So a batch holds the checkpoints plus one segment at a time, for one
+		extra forward product on every layer that isn't a checkpoint.
+		-recompute auto picks segments of sqrt(layers), which makes both
+		about sqrt(layers) layers. -hiddenlayers builds networks deep
+		enough for this to matter.
+
+	ReportRecompute runs one batch both ways at startup and prints the peak
+		pool bytes each took against the forward products recomputed.
+*/
+
+#define RECOMPUTE_REPORT_REPEATS 3
+
+internal umm
+MeasureGradientsBatch(memory_pool *Pool, parallel_context *Parallel, neural_network Network,
+                      matrix Inputs, matrix Outputs, r32 *Seconds)
+{
+	// NOTE: The high water mark only ever goes up, so it's lowered to
+	//	here for the batch and put back after.
+	umm OldHighWaterMark = Pool->HighWaterMark;
+	umm Result = 0;
+	*Seconds = 1e30f;
+	for(u32 Repeat = 0;
+	    Repeat < RECOMPUTE_REPORT_REPEATS;
+	    ++Repeat)
+	{
+		temp_memory TempMem = PoolBeginTempMemory(Pool);
+		umm Start = Pool->Size;
+		Pool->HighWaterMark = Start;
+
+		u64 StartClock = PlatformGetWallClock();
+		ComputeGradientsBatch(Pool, Parallel, Network, Inputs, Outputs);
+		r32 BatchSeconds = PlatformGetSecondsElapsed(StartClock, PlatformGetWallClock());
+		if(BatchSeconds < *Seconds)
+		{
+			*Seconds = BatchSeconds;
+		}
+
+		Result = Pool->HighWaterMark - Start;
+		if(Pool->HighWaterMark < OldHighWaterMark)
+		{
+			Pool->HighWaterMark = OldHighWaterMark;
+		}
+		OldHighWaterMark = Pool->HighWaterMark;
+		PoolEndTempMemory(TempMem);
+	}
+
+	return Result;
+}
+
+internal void
+ReportRecompute(memory_pool *Pool, parallel_context *Parallel, neural_network Network,
+                data_set TrainingSet, u32 BatchSize)
+{
+	TRACE_BLOCK("Recompute report");
+
+	u32 Segment = Parallel->RecomputeSegment;
+	u32 OutputLayer = Network.LayerCount - 1;
+	if((Segment < 2) || (Segment >= OutputLayer))
+	{
+		printf("-recompute %u leaves no layers between checkpoints in a %u layer network; keeping them all\n",
+		       Segment, OutputLayer);
+		Parallel->RecomputeSegment = 0;
+		return;
+	}
+
+	printf("Recompute: checkpoints at layers 0");
+	u64 ForwardFlops = 0;
+	u64 RecomputedFlops = 0;
+	for(u32 LayerIndex = 1;
+	    LayerIndex < Network.LayerCount;
+	    ++LayerIndex)
+	{
+		u64 LayerFlops = LayerFlopsPerInput(Network, LayerIndex)*BatchSize;
+		ForwardFlops += LayerFlops;
+		if(((LayerIndex % Segment) == 0) || (LayerIndex == OutputLayer))
+		{
+			printf(", %u", LayerIndex);
+		}
+		else
+		{
+			RecomputedFlops += LayerFlops;
+		}
+	}
+	printf("\n");
+
+	matrix Inputs = MatrixColumns(TrainingSet.Inputs, 0, BatchSize);
+	matrix Outputs = MatrixColumns(TrainingSet.Outputs, 0, BatchSize);
+
+	r32 KeptSeconds;
+	r32 RecomputedSeconds;
+	Parallel->RecomputeSegment = 0;
+	umm KeptBytes = MeasureGradientsBatch(Pool, Parallel, Network, Inputs, Outputs, &KeptSeconds);
+	Parallel->RecomputeSegment = Segment;
+	umm RecomputedBytes = MeasureGradientsBatch(Pool, Parallel, Network, Inputs, Outputs, &RecomputedSeconds);
+
+	// NOTE: Backprop does two products the size of each forward one.
+	printf("  a batch of %u peaks at %.2fMB instead of %.2fMB (%.0f%% saved), for %.1f%% more training flops\n",
+	       BatchSize, (r64)RecomputedBytes/(1024.0*1024.0), (r64)KeptBytes/(1024.0*1024.0),
+	       100.0*(1.0 - (r64)RecomputedBytes/(r64)KeptBytes),
+	       100.0*(r64)RecomputedFlops/(3.0*(r64)ForwardFlops));
+	printf("  %.2fms a batch instead of %.2fms\n", 1000.0f*RecomputedSeconds, 1000.0f*KeptSeconds);
+}
@@ -0,0 +1,381 @@
+
+/*
+	NOTE: Networks with their topology fixed at compile time.
+		static_network<Cost, Layers...> carries the cost function and every
+		layer size as template arguments, so each layer runs the static
+		kernels of nn_kernels.h with constant sizes and strides. The loops
+		over rows have constant trip counts, the output layer's tail is a
+		constant mask, the cost switch goes away, and every buffer is a fixed
+		array in the network instead of a pool allocation per batch.
+
+	Batches go through STATIC_TILE_COLUMNS trials at a time, and the
+		gradients sum across the tiles in trial order, so a batch gives the
+		same bits as the generic path at the same level, whatever its size.
+		It all runs on the calling thread.
+
+	The weights are copied in from and back out to a neural_network, which
+		does the loading and saving. Pruned and factored networks don't fit;
+		their masks and factors would be lost.
+*/
+
+#define STATIC_BENCHMARK_BATCHES 1000
+#define STATIC_BENCHMARK_REPEATS 5
+
+static_assert(STATIC_ROW_STRIDE(1) == MATRIX_STRIDE_MULTIPLE, "Static buffers must pad their rows like matrices do");
+
+template<u32... Layers>
+struct static_layers;
+
+// NOTE: Past the output layer; only its size is left.
+template<u32 InputCount>
+struct static_layers<InputCount>
+{
+};
+
+template<u32 InputCount, u32 OutputCount, u32... Rest>
+struct static_layers<InputCount, OutputCount, Rest...>
+{
+	static u32 const Stride = STATIC_ROW_STRIDE(OutputCount);
+
+	r32 Weights[Stride*InputCount];
+	r32 Biases[Stride];
+	r32 WeightGradients[Stride*InputCount];
+	r32 BiasGradients[Stride];
+
+	// NOTE: One tile of trials.
+	r32 WeightedInputs[Stride*STATIC_TILE_COLUMNS];
+	r32 Activations[Stride*STATIC_TILE_COLUMNS];
+	r32 Errors[Stride*STATIC_TILE_COLUMNS];
+
+	static_layers<OutputCount, Rest...> Next;
+
+	// NOTE: The gradient columns this batch has touched, see
+	//	STATIC_TILE_COLUMNS.
+	b32 UsedColumns[InputCount];
+};
+
+template<cost_function Cost, u32... Layers>
+struct static_network
+{
+	static_layers<Layers...> First;
+};
+
+// NOTE: The topology we ship. -static and -staticbench use it.
+typedef static_network<CostFn_CrossEntropy, 784, 100, 10> production_network;
+
+//
+// NOTE: Layer recursion
+//
+
+template<u32 InputCount>
+inline void
+StaticCopyWeights(static_layers<InputCount> *Layer, neural_network Network, u32 LayerIndex, b32 ToNetwork)
+{
+}
+
+template<u32 InputCount, u32 OutputCount, u32... Rest>
+inline void
+StaticCopyWeights(static_layers<InputCount, OutputCount, Rest...> *Layer, neural_network Network, u32 LayerIndex,
+                  b32 ToNetwork)
+{
+	// NOTE: Only the real rows; the padding on our side stays zero.
+	u32 const Stride = STATIC_ROW_STRIDE(OutputCount);
+	matrix Weights = Network.WeightMatrices[LayerIndex];
+	for(u32 ColumnIndex = 0;
+	    ColumnIndex < InputCount;
+	    ++ColumnIndex)
+	{
+		r32 *StaticColumn = Layer->Weights + ColumnIndex*Stride;
+		r32 *NetworkColumn = MatrixColumnData(Weights, ColumnIndex);
+		if(ToNetwork)
+		{
+			memcpy(NetworkColumn, StaticColumn, OutputCount*sizeof(r32));
+		}
+		else
+		{
+			memcpy(StaticColumn, NetworkColumn, OutputCount*sizeof(r32));
+		}
+	}
+
+	r32 *NetworkBiases = Network.BiasVectors[LayerIndex].Data;
+	if(ToNetwork)
+	{
+		memcpy(NetworkBiases, Layer->Biases, OutputCount*sizeof(r32));
+	}
+	else
+	{
+		memcpy(Layer->Biases, NetworkBiases, OutputCount*sizeof(r32));
+	}
+
+	StaticCopyWeights(&Layer->Next, Network, LayerIndex + 1, ToNetwork);
+}
+
+template<b32 InputLayer, u32 InputCount>
+inline r32 *
+StaticForwardLayers(static_layers<InputCount> *Layer, r32 *Inputs, u32 ColumnCount)
+{
+	return Inputs;
+}
+
+template<b32 InputLayer, u32 InputCount, u32 OutputCount, u32... Rest>
+inline r32 *
+StaticForwardLayers(static_layers<InputCount, OutputCount, Rest...> *Layer, r32 *Inputs, u32 ColumnCount)
+{
+	StaticForward<OutputCount, InputCount, InputLayer>(Layer->WeightedInputs, Layer->Activations,
+	                                                   Layer->Weights, Layer->Biases, Inputs, ColumnCount);
+	r32 *Result = StaticForwardLayers<false>(&Layer->Next, Layer->Activations, ColumnCount);
+	return Result;
+}
+
+// NOTE: Fills in the layer's errors for the tile and adds its gradients. Inputs
+//	are the previous layer's activations, or the tile's inputs.
+template<cost_function Cost, b32 InputLayer, u32 InputCount, u32 OutputCount>
+inline void
+StaticBackwardLayers(static_layers<InputCount, OutputCount> *Layer, r32 *Inputs, r32 *DesiredOutputs, u32 ColumnCount)
+{
+	StaticOutputError<OutputCount, (Cost == CostFn_Quadratic)>(Layer->Errors, Layer->Activations,
+	                                                           Layer->WeightedInputs, DesiredOutputs, ColumnCount);
+	StaticAccumulateGradients<OutputCount, InputCount, InputLayer>(Layer->WeightGradients, Layer->BiasGradients,
+	                                                               Layer->Errors, Inputs, ColumnCount,
+	                                                               Layer->UsedColumns);
+}
+
+template<cost_function Cost, b32 InputLayer, u32 InputCount, u32 OutputCount, u32 NextCount, u32... Rest>
+inline void
+StaticBackwardLayers(static_layers<InputCount, OutputCount, NextCount, Rest...> *Layer, r32 *Inputs,
+                     r32 *DesiredOutputs, u32 ColumnCount)
+{
+	StaticBackwardLayers<Cost, false>(&Layer->Next, Layer->Activations, DesiredOutputs, ColumnCount);
+	StaticHiddenError<NextCount, OutputCount>(Layer->Errors, Layer->Next.Weights, Layer->Next.Errors,
+	                                          Layer->WeightedInputs, ColumnCount);
+	StaticAccumulateGradients<OutputCount, InputCount, InputLayer>(Layer->WeightGradients, Layer->BiasGradients,
+	                                                               Layer->Errors, Inputs, ColumnCount,
+	                                                               Layer->UsedColumns);
+}
+
+template<u32 InputCount>
+inline void
+StaticUpdateLayers(static_layers<InputCount> *Layer, r32 GradientScale, r32 WeightScale)
+{
+}
+
+template<u32 InputCount, u32 OutputCount, u32... Rest>
+inline void
+StaticUpdateLayers(static_layers<InputCount, OutputCount, Rest...> *Layer, r32 GradientScale, r32 WeightScale)
+{
+	StaticUpdate<OutputCount, InputCount>(Layer->Weights, Layer->Biases, Layer->WeightGradients,
+	                                      Layer->BiasGradients, GradientScale, WeightScale, Layer->UsedColumns);
+
+	StaticUpdateLayers(&Layer->Next, GradientScale, WeightScale);
+}
+
+//
+// NOTE: Static networks
+//
+
+template<cost_function Cost, u32... Layers>
+internal b32
+StaticNetworkMatches(static_network<Cost, Layers...> *Static, neural_network Network)
+{
+	u32 const LayerSizes[] = {Layers...};
+
+	b32 Result = ((Network.CostFn == Cost) &&
+	              (Network.LayerCount == ArrayCount(LayerSizes)) &&
+	              !Network.WeightMasks &&
+	              !Network.Ranks &&
+	              NetworkIsDense(Network) &&
+	              NetworkIsAllSigmoid(Network));
+	for(u32 LayerIndex = 0;
+	    Result && (LayerIndex < ArrayCount(LayerSizes));
+	    ++LayerIndex)
+	{
+		Result = (Network.Layers[LayerIndex] == LayerSizes[LayerIndex]);
+	}
+
+	return Result;
+}
+
+template<cost_function Cost, u32... Layers>
+internal void
+PrintStaticTopology(static_network<Cost, Layers...> *Static)
+{
+	u32 const LayerSizes[] = {Layers...};
+
+	printf("%s [", (Cost == CostFn_Quadratic) ? "quadratic" : "cross-entropy");
+	for(u32 LayerIndex = 0;
+	    LayerIndex < ArrayCount(LayerSizes);
+	    ++LayerIndex)
+	{
+		printf((LayerIndex > 0) ? ", %u" : "%u", LayerSizes[LayerIndex]);
+	}
+	printf("]");
+}
+
+template<typename static_network_type>
+internal static_network_type *
+PushStaticNetwork(memory_pool *Pool)
+{
+	// NOTE: Zeroed, which keeps every padding row zero from here on.
+	static_network_type *Result = PoolPushStructAligned(Pool, static_network_type);
+	memset(Result, 0, sizeof(*Result));
+	return Result;
+}
+
+template<cost_function Cost, u32... Layers>
+internal void
+LoadStaticNetwork(static_network<Cost, Layers...> *Static, neural_network Network)
+{
+	Assert(StaticNetworkMatches(Static, Network));
+	StaticCopyWeights(&Static->First, Network, 1, false);
+}
+
+template<cost_function Cost, u32... Layers>
+internal void
+StoreStaticNetwork(neural_network Network, static_network<Cost, Layers...> *Static)
+{
+	Assert(StaticNetworkMatches(Static, Network));
+	StaticCopyWeights(&Static->First, Network, 1, true);
+}
+
+template<cost_function Cost, u32... Layers>
+internal void
+StaticGradientDescentBatch(static_network<Cost, Layers...> *Network, matrix Inputs, matrix Outputs,
+                           r32 LearningRate, r32 Regularization, u32 TotalTrials)
+{
+	TIMED_BLOCK("StaticGradientDescentBatch", 0, 0);
+
+	u32 const LayerSizes[] = {Layers...};
+	Assert(Inputs.RowCount == LayerSizes[0]);
+	Assert(Outputs.RowCount == LayerSizes[ArrayCount(LayerSizes) - 1]);
+	Assert(Inputs.Stride == STATIC_ROW_STRIDE(LayerSizes[0]));
+	Assert(Outputs.Stride == STATIC_ROW_STRIDE(LayerSizes[ArrayCount(LayerSizes) - 1]));
+
+	u32 TrialCount = Inputs.ColumnCount;
+	for(u32 FirstTrial = 0;
+	    FirstTrial < TrialCount;
+	    FirstTrial += STATIC_TILE_COLUMNS)
+	{
+		u32 TileTrialCount = Minimum(STATIC_TILE_COLUMNS, TrialCount - FirstTrial);
+		r32 *TileInputs = MatrixColumnData(Inputs, FirstTrial);
+		StaticForwardLayers<true>(&Network->First, TileInputs, TileTrialCount);
+		StaticBackwardLayers<Cost, true>(&Network->First, TileInputs, MatrixColumnData(Outputs, FirstTrial),
+		                                 TileTrialCount);
+	}
+
+	StaticUpdateLayers(&Network->First, -LearningRate/TrialCount,
+	                   (1.0f - (LearningRate*Regularization)/TotalTrials));
+}
+
+template<cost_function Cost, u32... Layers>
+internal void
+StaticFeedForwardBatch(static_network<Cost, Layers...> *Network, matrix Inputs, matrix Outputs)
+{
+	TIMED_BLOCK("StaticFeedForwardBatch", 0, 0);
+
+	u32 const LayerSizes[] = {Layers...};
+	u32 const OutputStride = STATIC_ROW_STRIDE(LayerSizes[ArrayCount(LayerSizes) - 1]);
+	Assert(Inputs.RowCount == LayerSizes[0]);
+	Assert(Inputs.Stride == STATIC_ROW_STRIDE(LayerSizes[0]));
+	Assert(Outputs.Stride == OutputStride);
+	Assert(Outputs.ColumnCount == Inputs.ColumnCount);
+
+	for(u32 FirstTrial = 0;
+	    FirstTrial < Inputs.ColumnCount;
+	    FirstTrial += STATIC_TILE_COLUMNS)
+	{
+		u32 TileTrialCount = Minimum(STATIC_TILE_COLUMNS, Inputs.ColumnCount - FirstTrial);
+		r32 *TileOutputs = StaticForwardLayers<true>(&Network->First, MatrixColumnData(Inputs, FirstTrial),
+		                                             TileTrialCount);
+		memcpy(MatrixColumnData(Outputs, FirstTrial), TileOutputs, (umm)TileTrialCount*OutputStride*sizeof(r32));
+	}
+}
+
+template<cost_function Cost, u32... Layers>
+internal r32
+EvaluateStaticNetwork(memory_pool *Pool, static_network<Cost, Layers...> *Network, data_set TestSet)
+{
+	TIMED_BLOCK("EvaluateStaticNetwork", 0, 0);
+
+	temp_memory TempMem = PoolBeginTempMemory(Pool);
+
+	matrix Outputs = MatrixRaw_(Pool, TestSet.Outputs.RowCount, TestSet.DataCount);
+	StaticFeedForwardBatch(Network, TestSet.Inputs, Outputs);
+	r32 SuccessRatePercent = ComputeSuccessRate(Outputs, TestSet.Outputs);
+
+	PoolEndTempMemory(TempMem);
+	return SuccessRatePercent;
+}
+
+//
+// NOTE: Benchmark
+//
+
+internal BENCHMARK_TRAIN_BATCH(StaticBenchmarkBatch)
+{
+	StaticGradientDescentBatch((production_network *)Data, Inputs, Outputs, LearningRate, Regularization, TotalTrials);
+}
+
+internal BENCHMARK_STORE_WEIGHTS(StaticBenchmarkStore)
+{
+	StoreStaticNetwork(Network, (production_network *)Data);
+}
+
+internal void
+BenchmarkStaticNetwork(memory_pool *Pool, parallel_context *Parallel, neural_network Network,
+                       data_set TrainingSet, data_set TestSet, u32 BatchSize, r32 LearningRate, r32 Regularization)
+{
+	TRACE_BLOCK("Static benchmark");
+
+	temp_memory TempMem = PoolBeginTempMemory(Pool);
+
+	production_network *Static = PushStaticNetwork<production_network>(Pool);
+	if(!StaticNetworkMatches(Static, Network))
+	{
+		printf("The static benchmark is compiled for a ");
+		PrintStaticTopology(Static);
+		printf(" sigmoid network, dense and unfactored; skipping it\n");
+		PoolEndTempMemory(TempMem);
+		return;
+	}
+
+	// NOTE: Both sides train, then run the test set.
+	LoadStaticNetwork(Static, Network);
+	training_benchmark Training = BenchmarkTraining(Pool, Parallel, Network, TrainingSet, BatchSize,
+	                                                STATIC_BENCHMARK_BATCHES, LearningRate, Regularization,
+	                                                StaticBenchmarkBatch, StaticBenchmarkStore, Static);
+	neural_network Generic = Training.Generic;
+
+	r32 GenericInferSeconds = TimeInference(Pool, Parallel, Generic, TestSet);
+	matrix Outputs = MatrixRaw_(Pool, TestSet.Outputs.RowCount, TestSet.DataCount);
+	r32 StaticInferSeconds = 1e30f;
+	for(u32 Repeat = 0;
+	    Repeat < STATIC_BENCHMARK_REPEATS;
+	    ++Repeat)
+	{
+		u64 Start = PlatformGetWallClock();
+		StaticFeedForwardBatch(Static, TestSet.Inputs, Outputs);
+		r32 Seconds = PlatformGetSecondsElapsed(Start, PlatformGetWallClock());
+		if(Seconds < StaticInferSeconds)
+		{
+			StaticInferSeconds = Seconds;
+		}
+	}
+
+	r32 GenericSuccessRate = EvaluateNetwork(Pool, Parallel, Generic, TestSet);
+	r32 StaticSuccessRate = EvaluateStaticNetwork(Pool, Static, TestSet);
+
+	printf("Static network benchmark, ");
+	PrintStaticTopology(Static);
+	printf(", %u batches of %u, %u test images, %u thread(s) generic:\n",
+	       Training.BatchCount, BatchSize, TestSet.DataCount, Parallel->Queue->ThreadCount);
+	printf("  %-8s %14s %12s %8s\n", "", "train us/batch", "infer ms", "success");
+	printf("  %-8s %14.2f %12.2f %7.2f%%\n", "generic",
+	       1e6f*Training.GenericSeconds/Training.BatchCount, 1000.0f*GenericInferSeconds, GenericSuccessRate);
+	printf("  %-8s %14.2f %12.2f %7.2f%%\n", "static",
+	       1e6f*Training.CandidateSeconds/Training.BatchCount, 1000.0f*StaticInferSeconds, StaticSuccessRate);
+	printf("  speedup: %.2fx training, %.2fx inference; %u weights and biases differ, by at most %g\n",
+	       Training.GenericSeconds/Training.CandidateSeconds, GenericInferSeconds/StaticInferSeconds,
+	       Training.DifferentCount, Training.MaxDifference);
+
+	PoolEndTempMemory(TempMem);
+}
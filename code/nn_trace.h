@@ -0,0 +1,315 @@
+#pragma once
+
+/*
+	NOTE: Timeline tracing, written as Chrome trace-event JSON for
+		chrome://tracing or Perfetto.
+
+		Every thread that records an event gets its own ring buffer the first
+		time it does so. The owning thread is the only writer and the main
+		thread is the only reader, so no locks are needed; if a buffer fills up
+		before the main thread gets to flush it, new events are dropped and
+		counted. A block is recorded once, when it ends, as a complete ("X")
+		event holding both its begin and end time, so a dropped event can't
+		leave an unbalanced begin behind.
+
+		When -trace isn't given, every TRACE_ macro is one predictable branch.
+
+		TraceBegin is told how many threads will trace. A thread past that
+		count gets no buffer, and its events are dropped and counted.
+*/
+
+#define TRACE_EVENTS_PER_THREAD (1 << 15)
+
+enum trace_event_type
+{
+	TraceEvent_Block,
+	TraceEvent_Counter,
+};
+
+struct trace_event
+{
+	char *Name;
+	u64 Start;
+	union
+	{
+		u64 End;
+		u64 Value;
+	};
+	trace_event_type Type;
+	u32 Arg;
+};
+
+struct trace_thread_buffer
+{
+	u32 ThreadIndex;
+
+	u32 volatile WriteIndex;
+	u32 volatile ReadIndex;
+	u32 volatile DroppedCount;
+
+	trace_event *Events;
+};
+
+struct trace_state
+{
+	b32 Enabled;
+	FILE *File;
+	b32 WroteEvent;
+
+	u64 StartClock;
+	r64 MicrosecondsPerTick;
+
+	u32 MaxThreadCount;
+	u32 volatile ThreadCount;
+	u32 volatile UnbufferedDroppedCount;
+	trace_thread_buffer *Threads;
+};
+
+global_variable trace_state GlobalTrace;
+global_variable thread_local trace_thread_buffer *GlobalTraceThreadBuffer;
+
+internal trace_thread_buffer *
+TraceGetThreadBuffer()
+{
+	trace_thread_buffer *Result = GlobalTraceThreadBuffer;
+	if(!Result)
+	{
+		u32 ThreadIndex = AtomicAddU32(&GlobalTrace.ThreadCount, 1);
+		if(ThreadIndex < GlobalTrace.MaxThreadCount)
+		{
+			Result = GlobalTrace.Threads + ThreadIndex;
+			GlobalTraceThreadBuffer = Result;
+		}
+	}
+	return Result;
+}
+
+inline u32
+TraceBufferedThreadCount()
+{
+	u32 Result = Minimum(GlobalTrace.ThreadCount, GlobalTrace.MaxThreadCount);
+	return Result;
+}
+
+internal void
+TracePushEvent(trace_event_type Type, char *Name, u64 Start, u64 EndOrValue, u32 Arg)
+{
+	trace_thread_buffer *Buffer = TraceGetThreadBuffer();
+	if(!Buffer)
+	{
+		AtomicAddU32(&GlobalTrace.UnbufferedDroppedCount, 1);
+	}
+	else
+	{
+		u32 WriteIndex = Buffer->WriteIndex;
+		if((WriteIndex - Buffer->ReadIndex) < TRACE_EVENTS_PER_THREAD)
+		{
+			trace_event *Event = Buffer->Events + (WriteIndex % TRACE_EVENTS_PER_THREAD);
+			Event->Name = Name;
+			Event->Start = Start;
+			Event->End = EndOrValue;
+			Event->Type = Type;
+			Event->Arg = Arg;
+
+			CompletePreviousWritesBeforeFutureWrites;
+			Buffer->WriteIndex = WriteIndex + 1;
+		}
+		else
+		{
+			++Buffer->DroppedCount;
+		}
+	}
+}
+
+struct trace_block
+{
+	char *Name;
+	u32 Arg;
+	u64 Start;
+
+	trace_block(char *NameInit, u32 ArgInit)
+	{
+		Name = NameInit;
+		Arg = ArgInit;
+		Start = GlobalTrace.Enabled ? PlatformGetWallClock() : 0;
+	}
+
+	~trace_block()
+	{
+		if(GlobalTrace.Enabled)
+		{
+			TracePushEvent(TraceEvent_Block, Name, Start, PlatformGetWallClock(), Arg);
+		}
+	}
+};
+
+#define TRACE_BLOCK__(Name, Arg, Number) trace_block TraceBlock_##Number(Name, Arg)
+#define TRACE_BLOCK_(Name, Arg, Number) TRACE_BLOCK__(Name, Arg, Number)
+#define TRACE_BLOCK_ARG(Name, Arg) TRACE_BLOCK_(Name, (u32)(Arg), __LINE__)
+#define TRACE_BLOCK(Name) TRACE_BLOCK_(Name, U32MAX, __LINE__)
+#define TRACE_COUNTER(Name, Value) if(GlobalTrace.Enabled) {TracePushEvent(TraceEvent_Counter, Name, PlatformGetWallClock(), (u64)(Value), U32MAX);} else {}
+
+// NOTE: Tracing stays disabled when Filename can't be written, so
+//	TRACE_BLOCK, TraceFlushIfNeeded and TraceEnd never touch a null File.
+internal void
+TraceBegin(memory_pool *Pool, char *Filename, u32 MaxThreadCount)
+{
+	if(fopen_s(&GlobalTrace.File, Filename, "wb") != 0)
+	{
+		fprintf(stderr, "Could not write %s; tracing is off\n", Filename);
+		GlobalTrace.File = 0;
+	}
+	else
+	{
+		fprintf(GlobalTrace.File, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+		GlobalTrace.WroteEvent = false;
+
+		GlobalTrace.MaxThreadCount = MaxThreadCount;
+		GlobalTrace.Threads = PoolPushArray(Pool, trace_thread_buffer, MaxThreadCount);
+		for(u32 ThreadIndex = 0;
+		    ThreadIndex < MaxThreadCount;
+		    ++ThreadIndex)
+		{
+			trace_thread_buffer *Buffer = GlobalTrace.Threads + ThreadIndex;
+			*Buffer = {};
+			Buffer->ThreadIndex = ThreadIndex;
+			Buffer->Events = PoolPushArray(Pool, trace_event, TRACE_EVENTS_PER_THREAD);
+		}
+
+		GlobalTrace.StartClock = PlatformGetWallClock();
+		GlobalTrace.MicrosecondsPerTick = 1000000.0 / (r64)PlatformGetWallClockFrequency();
+
+		// NOTE: Claim the first buffer for the main thread.
+		TraceGetThreadBuffer();
+
+		CompletePreviousWritesBeforeFutureWrites;
+		GlobalTrace.Enabled = true;
+	}
+}
+
+inline r64
+TraceMicroseconds(u64 Clock)
+{
+	r64 Result = (r64)(Clock - GlobalTrace.StartClock)*GlobalTrace.MicrosecondsPerTick;
+	return Result;
+}
+
+internal void
+TraceFlush()
+{
+	// NOTE: Main thread only. Safe to call while other threads are still tracing.
+	TRACE_BLOCK("Trace flush");
+
+	FILE *File = GlobalTrace.File;
+	u32 ThreadCount = TraceBufferedThreadCount();
+	for(u32 ThreadIndex = 0;
+	    ThreadIndex < ThreadCount;
+	    ++ThreadIndex)
+	{
+		trace_thread_buffer *Buffer = GlobalTrace.Threads + ThreadIndex;
+
+		u32 WriteIndex = Buffer->WriteIndex;
+		CompletePreviousReadsBeforeFutureReads;
+		for(u32 ReadIndex = Buffer->ReadIndex;
+		    ReadIndex != WriteIndex;
+		    ++ReadIndex)
+		{
+			trace_event *Event = Buffer->Events + (ReadIndex % TRACE_EVENTS_PER_THREAD);
+
+			fputs(GlobalTrace.WroteEvent ? ",\n" : "", File);
+			GlobalTrace.WroteEvent = true;
+
+			switch(Event->Type)
+			{
+				case TraceEvent_Block:
+				{
+					fprintf(File, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f",
+					        Event->Name, Buffer->ThreadIndex,
+					        TraceMicroseconds(Event->Start),
+					        TraceMicroseconds(Event->End) - TraceMicroseconds(Event->Start));
+					if(Event->Arg != U32MAX)
+					{
+						fprintf(File, ",\"args\":{\"index\":%u}", Event->Arg);
+					}
+					fprintf(File, "}");
+				} break;
+
+				case TraceEvent_Counter:
+				{
+					fprintf(File, "{\"name\":\"%s\",\"ph\":\"C\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"args\":{\"value\":%llu}}",
+					        Event->Name, Buffer->ThreadIndex,
+					        TraceMicroseconds(Event->Start),
+					        (unsigned long long)Event->Value);
+				} break;
+
+				InvalidDefaultCase;
+			}
+		}
+
+		CompletePreviousWritesBeforeFutureWrites;
+		Buffer->ReadIndex = WriteIndex;
+	}
+}
+
+internal void
+TraceFlushIfNeeded()
+{
+	// NOTE: Called between batches, so the buffers are emptied well before they fill.
+	if(GlobalTrace.Enabled)
+	{
+		u32 ThreadCount = TraceBufferedThreadCount();
+		for(u32 ThreadIndex = 0;
+		    ThreadIndex < ThreadCount;
+		    ++ThreadIndex)
+		{
+			trace_thread_buffer *Buffer = GlobalTrace.Threads + ThreadIndex;
+			if((Buffer->WriteIndex - Buffer->ReadIndex) >= (TRACE_EVENTS_PER_THREAD / 2))
+			{
+				TraceFlush();
+				break;
+			}
+		}
+	}
+}
+
+internal void
+TraceEnd()
+{
+	if(GlobalTrace.Enabled && GlobalTrace.File)
+	{
+		TraceFlush();
+		GlobalTrace.Enabled = false;
+
+		FILE *File = GlobalTrace.File;
+		u32 DroppedCount = GlobalTrace.UnbufferedDroppedCount;
+		u32 ThreadCount = TraceBufferedThreadCount();
+		for(u32 ThreadIndex = 0;
+		    ThreadIndex < ThreadCount;
+		    ++ThreadIndex)
+		{
+			trace_thread_buffer *Buffer = GlobalTrace.Threads + ThreadIndex;
+			DroppedCount += Buffer->DroppedCount;
+
+			fputs(GlobalTrace.WroteEvent ? ",\n" : "", File);
+			GlobalTrace.WroteEvent = true;
+			if(ThreadIndex == 0)
+			{
+				fprintf(File, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":0,\"args\":{\"name\":\"Main\"}}");
+			}
+			else
+			{
+				fprintf(File, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":\"Thread %u\"}}",
+				        ThreadIndex, ThreadIndex);
+			}
+		}
+
+		fprintf(File, "\n]}\n");
+		fclose(File);
+		GlobalTrace.File = 0;
+
+		if(DroppedCount)
+		{
+			printf("Trace: %u events dropped\n", DroppedCount);
+		}
+	}
+}
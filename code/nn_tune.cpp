@@ -0,0 +1,434 @@
+
+/*
+	NOTE: Startup autotuner. Instead of guessing at blocking sizes, it times
+		the candidates on the shapes this network and batch size actually run:
+
+		- GEMM cache blocking for every weight shape, forward and gradient.
+		- How many column ranges per thread the products are split into, and
+		  the backprop micro-batch size, timed over one whole batch.
+
+	The winners go in a small text cache keyed by CPU brand string, kernel
+		level and shape, one "key value value" per line. A later run on the same
+		machine reads them back instead of re-tuning; -retune times everything
+		again and overwrites the cached values.
+
+	None of the GEMM blocks nor the column split change a bit of the result. The
+		micro-batch does, so deterministic runs keep the whole batch and key
+		their entries separately.
+*/
+
+#define TUNING_CACHE_DEFAULT_FILENAME "nn_tuning.cache"
+#define TUNING_CACHE_VERSION 1
+#define TUNING_CACHE_MAX_ENTRIES 256
+#define TUNING_KEY_SIZE 256
+
+#define TUNING_MIN_REPEATS 3
+#define TUNING_MIN_SECONDS 0.01f
+
+global_variable u32 GemmInnerBlockCandidates[] = {0, 64, 128, 256, 512};
+global_variable u32 GemmColumnBlockCandidates[] = {0, 16, 64, 256};
+global_variable u32 ColumnSplitCandidates[] = {1, 2, 4};
+global_variable u32 MicroBatchCandidates[] = {0, 32, 64, 128, 256, 512};
+
+struct tuning_cache_entry
+{
+	char Key[TUNING_KEY_SIZE];
+	u32 Values[2];
+};
+
+struct tuning_cache
+{
+	char *Filename;
+	b32 Modified;
+
+	u32 EntryCount;
+	tuning_cache_entry Entries[TUNING_CACHE_MAX_ENTRIES];
+};
+
+internal void
+LoadTuningCache(tuning_cache *Cache, char *Filename)
+{
+	Cache->Filename = Filename;
+	Cache->Modified = false;
+	Cache->EntryCount = 0;
+
+	FILE *File = 0;
+	if(fopen_s(&File, Filename, "rb") != 0)
+	{
+		return;
+	}
+
+	char Line[TUNING_KEY_SIZE + 64];
+	u32 Version = 0;
+	if(fgets(Line, sizeof(Line), File) &&
+	   (sscanf(Line, "nn-tuning-cache %u", &Version) == 1) &&
+	   (Version == TUNING_CACHE_VERSION))
+	{
+		while(fgets(Line, sizeof(Line), File) &&
+		      (Cache->EntryCount < TUNING_CACHE_MAX_ENTRIES))
+		{
+			// NOTE: Lines that don't parse are dropped, they'll be re-tuned.
+			tuning_cache_entry *Entry = Cache->Entries + Cache->EntryCount;
+			if(sscanf(Line, "%255s %u %u", Entry->Key, &Entry->Values[0], &Entry->Values[1]) == 3)
+			{
+				++Cache->EntryCount;
+			}
+		}
+	}
+	else
+	{
+		fprintf(stderr, "Ignoring tuning cache %s: unknown version\n", Filename);
+	}
+
+	fclose(File);
+}
+
+internal void
+SaveTuningCache(tuning_cache *Cache)
+{
+	if(!Cache->Modified)
+	{
+		return;
+	}
+
+	FILE *File = 0;
+	if(fopen_s(&File, Cache->Filename, "wb") != 0)
+	{
+		fprintf(stderr, "Could not write tuning cache %s\n", Cache->Filename);
+		return;
+	}
+
+	fprintf(File, "nn-tuning-cache %u\n", TUNING_CACHE_VERSION);
+	for(u32 EntryIndex = 0;
+	    EntryIndex < Cache->EntryCount;
+	    ++EntryIndex)
+	{
+		tuning_cache_entry *Entry = Cache->Entries + EntryIndex;
+		fprintf(File, "%s %u %u\n", Entry->Key, Entry->Values[0], Entry->Values[1]);
+	}
+
+	fclose(File);
+	Cache->Modified = false;
+}
+
+internal tuning_cache_entry *
+FindTuningEntry(tuning_cache *Cache, char *Key)
+{
+	tuning_cache_entry *Result = 0;
+	for(u32 EntryIndex = 0;
+	    EntryIndex < Cache->EntryCount;
+	    ++EntryIndex)
+	{
+		tuning_cache_entry *Entry = Cache->Entries + EntryIndex;
+		if(StringCompare(Entry->Key, Key))
+		{
+			Result = Entry;
+			break;
+		}
+	}
+	return Result;
+}
+
+internal void
+StoreTuningEntry(tuning_cache *Cache, char *Key, u32 Value0, u32 Value1)
+{
+	tuning_cache_entry *Entry = FindTuningEntry(Cache, Key);
+	if(!Entry && (Cache->EntryCount < TUNING_CACHE_MAX_ENTRIES))
+	{
+		Entry = Cache->Entries + Cache->EntryCount++;
+		strcpy(Entry->Key, Key);
+	}
+
+	if(Entry)
+	{
+		Entry->Values[0] = Value0;
+		Entry->Values[1] = Value1;
+		Cache->Modified = true;
+	}
+}
+
+internal void
+FillForTuning(matrix A)
+{
+	// NOTE: Anything but denormals or NaNs, which would skew the timings.
+	for(u32 ColumnIndex = 0;
+	    ColumnIndex < A.ColumnCount;
+	    ++ColumnIndex)
+	{
+		r32 *Dest = MatrixColumnData(A, ColumnIndex);
+		for(u32 RowIndex = 0;
+		    RowIndex < A.RowCount;
+		    ++RowIndex)
+		{
+			*Dest++ = 0.5f + 0.001f*(r32)((RowIndex + ColumnIndex) & 255);
+		}
+	}
+}
+
+internal r32
+TimeGemm(matrix Result, matrix A, matrix B, b32 TransposeB, gemm_config Config)
+{
+	u32 InnerCount = A.ColumnCount;
+	u32 BInnerStep = TransposeB ? B.Stride : 1;
+	u32 BColumnStep = TransposeB ? 1 : B.Stride;
+	u32 ColumnCount = TransposeB ? B.RowCount : B.ColumnCount;
+
+	r32 Best = 1e30f;
+	r32 Total = 0.0f;
+	for(u32 Repeat = 0;
+	    (Repeat < TUNING_MIN_REPEATS) || (Total < TUNING_MIN_SECONDS);
+	    ++Repeat)
+	{
+		u64 Start = PlatformGetWallClock();
+		GlobalMathKernels.Gemm(Result.Data, Result.Stride, A.Data, A.Stride,
+		                       B.Data, BInnerStep, BColumnStep,
+		                       A.RowCount, ColumnCount, InnerCount, Config);
+		r32 Seconds = PlatformGetSecondsElapsed(Start, PlatformGetWallClock());
+
+		Total += Seconds;
+		if(Seconds < Best)
+		{
+			Best = Seconds;
+		}
+	}
+
+	return Best;
+}
+
+internal r32
+TimeGradientBatch(memory_pool *Pool, parallel_context *Parallel, neural_network Network,
+                  matrix Inputs, matrix Outputs)
+{
+	r32 Best = 1e30f;
+	r32 Total = 0.0f;
+	for(u32 Repeat = 0;
+	    (Repeat < TUNING_MIN_REPEATS) || (Total < TUNING_MIN_SECONDS);
+	    ++Repeat)
+	{
+		temp_memory TempMem = PoolBeginTempMemory(Pool);
+
+		u64 Start = PlatformGetWallClock();
+		ComputeGradientsBatch(Pool, Parallel, Network, Inputs, Outputs);
+		r32 Seconds = PlatformGetSecondsElapsed(Start, PlatformGetWallClock());
+
+		PoolEndTempMemory(TempMem);
+
+		Total += Seconds;
+		if(Seconds < Best)
+		{
+			Best = Seconds;
+		}
+	}
+
+	return Best;
+}
+
+internal void
+TuneGemmShape(memory_pool *Pool, tuning_cache *Cache, char *KeyPrefix, b32 Retune,
+              u32 RowCount, u32 ColumnCount, u32 BatchSize, b32 TransposeB)
+{
+	// NOTE: RowCount x ColumnCount is the weight shape. Forward, it's A and the
+	//	batch is the columns of the result; for the gradient it's the result
+	//	and the batch is the inner dimension.
+	char Key[TUNING_KEY_SIZE];
+	snprintf(Key, sizeof(Key), "%s/gemm/%ux%u/%s", KeyPrefix, RowCount, ColumnCount,
+	         TransposeB ? "t" : "n");
+
+	gemm_config Best = {};
+	tuning_cache_entry *Entry = Retune ? 0 : FindTuningEntry(Cache, Key);
+	if(Entry)
+	{
+		Best.InnerBlock = Entry->Values[0];
+		Best.ColumnBlock = Entry->Values[1];
+	}
+	else
+	{
+		temp_memory TempMem = PoolBeginTempMemory(Pool);
+
+		matrix A;
+		matrix B;
+		matrix Result;
+		if(TransposeB)
+		{
+			A = MatrixRaw_(Pool, RowCount, BatchSize);
+			B = MatrixRaw_(Pool, ColumnCount, BatchSize);
+			Result = MatrixRaw_(Pool, RowCount, ColumnCount);
+		}
+		else
+		{
+			A = MatrixRaw_(Pool, RowCount, ColumnCount);
+			B = MatrixRaw_(Pool, ColumnCount, BatchSize);
+			Result = MatrixRaw_(Pool, RowCount, BatchSize);
+		}
+		FillForTuning(A);
+		FillForTuning(B);
+
+		u32 InnerCount = A.ColumnCount;
+		u32 ResultColumns = Result.ColumnCount;
+
+		r32 BestSeconds = 1e30f;
+		for(u32 InnerIndex = 0;
+		    InnerIndex < ArrayCount(GemmInnerBlockCandidates);
+		    ++InnerIndex)
+		{
+			u32 InnerBlock = GemmInnerBlockCandidates[InnerIndex];
+			if(InnerBlock >= InnerCount)
+			{
+				continue;
+			}
+
+			for(u32 ColumnIndex = 0;
+			    ColumnIndex < ArrayCount(GemmColumnBlockCandidates);
+			    ++ColumnIndex)
+			{
+				u32 ColumnBlock = GemmColumnBlockCandidates[ColumnIndex];
+				if(ColumnBlock >= ResultColumns)
+				{
+					continue;
+				}
+
+				gemm_config Config = {InnerBlock, ColumnBlock};
+				r32 Seconds = TimeGemm(Result, A, B, TransposeB, Config);
+				if(Seconds < BestSeconds)
+				{
+					BestSeconds = Seconds;
+					Best = Config;
+				}
+			}
+		}
+
+		PoolEndTempMemory(TempMem);
+		StoreTuningEntry(Cache, Key, Best.InnerBlock, Best.ColumnBlock);
+	}
+
+	printf("  gemm %ux%u %s: inner block %u, column block %u%s\n",
+	       RowCount, ColumnCount, TransposeB ? "gradient" : "forward",
+	       Best.InnerBlock, Best.ColumnBlock, Entry ? " (cached)" : "");
+	SetGemmConfig(RowCount, ColumnCount, TransposeB, Best);
+}
+
+internal void
+TuneKernels(memory_pool *Pool, parallel_context *Parallel, neural_network Network,
+            data_set TrainingSet, u32 BatchSize, char *CacheFilename, b32 Retune)
+{
+	temp_memory TempMem = PoolBeginTempMemory(Pool);
+
+	tuning_cache *Cache = PoolPushStruct(Pool, tuning_cache);
+	LoadTuningCache(Cache, CacheFilename);
+
+	char Brand[CPU_BRAND_STRING_SIZE];
+	GetCpuBrandString(Brand);
+	printf("Tuning kernels for %s (%s)\n", Brand, CpuLevelNames[GlobalMathKernels.Level]);
+
+	// NOTE: Keys are single tokens.
+	for(char *Scan = Brand;
+	    *Scan;
+	    ++Scan)
+	{
+		if((*Scan == ' ') || (*Scan == '/'))
+		{
+			*Scan = '_';
+		}
+	}
+
+	char KeyPrefix[TUNING_KEY_SIZE / 2];
+	snprintf(KeyPrefix, sizeof(KeyPrefix), "%s/%s", Brand, CpuLevelNames[GlobalMathKernels.Level]);
+
+	// NOTE: The scalar GEMM has no blocking to tune.
+	if(GlobalMathKernels.Level != CpuLevel_Scalar)
+	{
+		for(u32 LayerIndex = 1;
+		    LayerIndex < Network.LayerCount;
+		    ++LayerIndex)
+		{
+			// NOTE: Image layers multiply other shapes, per im2col slice.
+			if(LayerType(Network, LayerIndex) != LayerType_Dense)
+			{
+				continue;
+			}
+
+			u32 RowCount = Network.Layers[LayerIndex];
+			u32 ColumnCount = Network.Layers[LayerIndex - 1];
+			TuneGemmShape(Pool, Cache, KeyPrefix, Retune, RowCount, ColumnCount, BatchSize, false);
+			TuneGemmShape(Pool, Cache, KeyPrefix, Retune, RowCount, ColumnCount, BatchSize, true);
+		}
+	}
+
+	char Shape[TUNING_KEY_SIZE / 4] = {};
+	char *ShapeAt = Shape;
+	for(u32 LayerIndex = 0;
+	    LayerIndex < Network.LayerCount;
+	    ++LayerIndex)
+	{
+		umm Remaining = sizeof(Shape) - (ShapeAt - Shape);
+		ShapeAt += snprintf(ShapeAt, Remaining, LayerIndex ? "-%u" : "%u", Network.Layers[LayerIndex]);
+		if(ShapeAt >= (Shape + sizeof(Shape)))
+		{
+			break;
+		}
+	}
+
+	b32 Deterministic = (Parallel->ReductionMode == ReductionMode_Deterministic);
+	u32 ThreadCount = Parallel->Queue->ThreadCount;
+
+	char Key[TUNING_KEY_SIZE];
+	snprintf(Key, sizeof(Key), "%s/batch/%s/b%u/t%u/%s", KeyPrefix, Shape, BatchSize, ThreadCount,
+	         Deterministic ? "deterministic" : "fast");
+
+	tuning_cache_entry *Entry = Retune ? 0 : FindTuningEntry(Cache, Key);
+	if(Entry)
+	{
+		Parallel->ColumnSplit = Entry->Values[0];
+		Parallel->MicroBatchSize = Entry->Values[1];
+	}
+	else
+	{
+		matrix Inputs = MatrixColumns(TrainingSet.Inputs, 0, BatchSize);
+		matrix Outputs = MatrixColumns(TrainingSet.Outputs, 0, BatchSize);
+
+		u32 BestColumnSplit = 1;
+		u32 BestMicroBatchSize = 0;
+		r32 BestSeconds = 1e30f;
+		for(u32 SplitIndex = 0;
+		    SplitIndex < ArrayCount(ColumnSplitCandidates);
+		    ++SplitIndex)
+		{
+			u32 ColumnSplit = ColumnSplitCandidates[SplitIndex];
+			if((ThreadCount == 1) && (ColumnSplit > 1))
+			{
+				continue;
+			}
+
+			for(u32 MicroIndex = 0;
+			    MicroIndex < ArrayCount(MicroBatchCandidates);
+			    ++MicroIndex)
+			{
+				u32 MicroBatchSize = MicroBatchCandidates[MicroIndex];
+				if(MicroBatchSize && (Deterministic || (MicroBatchSize >= BatchSize)))
+				{
+					continue;
+				}
+
+				Parallel->ColumnSplit = ColumnSplit;
+				Parallel->MicroBatchSize = MicroBatchSize;
+				r32 Seconds = TimeGradientBatch(Pool, Parallel, Network, Inputs, Outputs);
+				if(Seconds < BestSeconds)
+				{
+					BestSeconds = Seconds;
+					BestColumnSplit = ColumnSplit;
+					BestMicroBatchSize = MicroBatchSize;
+				}
+			}
+		}
+
+		Parallel->ColumnSplit = BestColumnSplit;
+		Parallel->MicroBatchSize = BestMicroBatchSize;
+		StoreTuningEntry(Cache, Key, BestColumnSplit, BestMicroBatchSize);
+	}
+
+	printf("  batch %u: column split %u, micro-batch %u%s\n", BatchSize,
+	       Parallel->ColumnSplit, Parallel->MicroBatchSize, Entry ? " (cached)" : "");
+
+	SaveTuningCache(Cache);
+	PoolEndTempMemory(TempMem);
+}